@@ -32,6 +32,8 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
 
 #include <glib.h>
 
@@ -40,6 +42,10 @@
 #include "qmi.h"
 #include "ctl.h"
 
+#define QMI_READ_CHUNK		4096
+#define QMI_READ_BUF_MAX	(128 * 1024)
+#define QMI_WRITE_BATCH		16
+
 typedef void (*qmi_message_func_t)(uint16_t message, uint16_t length,
 					const void *buffer, void *user_data);
 
@@ -65,10 +71,17 @@ struct qmi_device {
 	GQueue *control_queue;
 	GQueue *service_queue;
 	GQueue *discovery_queue;
+	GHashTable *req_table;
+	GHashTable *notify_table;
 	uint8_t next_control_tid;
 	uint16_t next_service_tid;
 	qmi_debug_func_t debug_func;
 	void *debug_data;
+	bool hexdump;
+	bool coalesce_writes;
+	unsigned char *read_buf;
+	size_t read_len;
+	size_t read_size;
 	uint16_t control_major;
 	uint16_t control_minor;
 	char *version_str;
@@ -93,6 +106,8 @@ struct qmi_service {
 	uint8_t client_id;
 	uint16_t next_notify_id;
 	GList *notify_list;
+	unsigned int window;	/* Max requests in flight, 0 for no limit */
+	unsigned int in_flight;
 };
 
 struct qmi_param {
@@ -106,13 +121,19 @@ struct qmi_result {
 	uint16_t error;
 	const void *data;
 	uint16_t length;
+	bool indexed;
+	uint16_t index[256];	/* TLV offset + 1 by type, 0 if missing */
 };
 
 struct qmi_request {
 	uint16_t tid;
+	uint8_t service;
 	uint8_t client;
+	GQueue *queue;		/* The queue the request is on */
+	GList *link;		/* and its link there */
 	void *buf;
 	size_t len;
+	size_t written;
 	qmi_message_func_t callback;
 	void *user_data;
 };
@@ -187,6 +208,7 @@ static struct qmi_request *__request_alloc(uint8_t service,
 
 	req->buf = g_malloc(req->len);
 
+	req->service = service;
 	req->client = client;
 
 	hdr = req->buf;
@@ -220,12 +242,57 @@ static void __request_free(gpointer data, gpointer user_data)
 	g_free(req);
 }
 
-static gint __request_compare(gconstpointer a, gconstpointer b)
+/* Requests are looked up by service type, client and transaction */
+#define REQUEST_KEY(service, client, tid) \
+	GUINT_TO_POINTER((service) | ((client) << 8) | ((guint) (tid) << 16))
+
+/* Notifications by service type, client and message */
+#define NOTIFY_KEY(service, client, message) \
+	GUINT_TO_POINTER((service) | ((client) << 8) | \
+						((guint) (message) << 16))
+
+static void __request_queue(GQueue *queue, struct qmi_request *req)
+{
+	g_queue_push_tail(queue, req);
+
+	req->queue = queue;
+	req->link = g_queue_peek_tail_link(queue);
+}
+
+static struct qmi_request *__request_lookup(struct qmi_device *device,
+				uint8_t service, uint8_t client, uint16_t tid)
+{
+	return g_hash_table_lookup(device->req_table,
+					REQUEST_KEY(service, client, tid));
+}
+
+static void wakeup_writer(struct qmi_device *device);
+
+/* Takes the request off its queue and the index */
+static void __request_unlink(struct qmi_device *device,
+				struct qmi_request *req)
 {
-	const struct qmi_request *req = a;
-	uint16_t tid = GPOINTER_TO_UINT(b);
+	gpointer key = REQUEST_KEY(req->service, req->client, req->tid);
+
+	if (req->queue == device->service_queue) {
+		unsigned int hash_id = req->service | (req->client << 8);
+		struct qmi_service *service;
+
+		service = g_hash_table_lookup(device->service_list,
+						GUINT_TO_POINTER(hash_id));
+
+		/* A slot in the window opens up */
+		if (service && service->in_flight && service->in_flight-- ==
+								service->window)
+			wakeup_writer(device);
+	}
+
+	g_queue_delete_link(req->queue, req->link);
+	req->queue = NULL;
+	req->link = NULL;
 
-	return req->tid - tid;
+	if (g_hash_table_lookup(device->req_table, key) == req)
+		g_hash_table_remove(device->req_table, key);
 }
 
 static void __discovery_free(gpointer data, gpointer user_data)
@@ -246,6 +313,12 @@ static void __notify_free(gpointer data, gpointer user_data)
 	g_free(notify);
 }
 
+static void __notify_list_free(gpointer key, gpointer value,
+							gpointer user_data)
+{
+	g_list_free(value);
+}
+
 static gint __notify_compare(gconstpointer a, gconstpointer b)
 {
 	const struct qmi_notify *notify = a;
@@ -641,42 +714,128 @@ static void __debug_device(struct qmi_device *device,
 	device->debug_func(strbuf, device->debug_data);
 }
 
-static gboolean can_write_data(GIOChannel *channel, GIOCondition cond,
-							gpointer user_data)
+static struct qmi_service *__request_service(struct qmi_device *device,
+						struct qmi_request *req)
 {
-	struct qmi_device *device = user_data;
-	struct qmi_mux_hdr *hdr;
-	struct qmi_request *req;
-	ssize_t bytes_written;
+	unsigned int hash_id;
 
-	req = g_queue_pop_head(device->req_queue);
-	if (!req)
-		return FALSE;
+	if (req->service == QMI_SERVICE_CONTROL)
+		return NULL;
 
-	bytes_written = write(device->fd, req->buf, req->len);
-	if (bytes_written < 0)
-		return FALSE;
+	hash_id = req->service | (req->client << 8);
+
+	return g_hash_table_lookup(device->service_list,
+					GUINT_TO_POINTER(hash_id));
+}
+
+/* Whether the window of the request's service lets it go out now */
+static bool __request_window_open(struct qmi_device *device,
+						struct qmi_request *req)
+{
+	struct qmi_service *service = __request_service(device, req);
+
+	if (!service || !service->window)
+		return true;
 
-	__hexdump('>', req->buf, bytes_written,
+	return service->in_flight < service->window;
+}
+
+static bool __request_pending(struct qmi_device *device)
+{
+	GList *list;
+
+	for (list = g_queue_peek_head_link(device->req_queue); list;
+							list = list->next)
+		if (__request_window_open(device, list->data))
+			return true;
+
+	return false;
+}
+
+static void __request_sent(struct qmi_device *device, struct qmi_request *req)
+{
+	struct qmi_service *service;
+
+	if (device->hexdump)
+		__hexdump('>', req->buf, req->len,
 				device->debug_func, device->debug_data);
 
-	__debug_msg(' ', req->buf, bytes_written,
+	__debug_msg(' ', req->buf, req->len,
 				device->debug_func, device->debug_data);
 
-	hdr = req->buf;
+	g_queue_delete_link(device->req_queue, req->link);
 
-	if (hdr->service == QMI_SERVICE_CONTROL)
-		g_queue_push_tail(device->control_queue, req);
-	else
-		g_queue_push_tail(device->service_queue, req);
+	if (req->service == QMI_SERVICE_CONTROL) {
+		__request_queue(device->control_queue, req);
+	} else {
+		__request_queue(device->service_queue, req);
+
+		service = __request_service(device, req);
+		if (service)
+			service->in_flight++;
+	}
 
 	g_free(req->buf);
 	req->buf = NULL;
+}
 
-	if (g_queue_get_length(device->req_queue) > 0)
-		return TRUE;
+/*
+ * Writes out as many queued requests as the service windows allow.
+ * Requests are coalesced into a single writev() unless the device
+ * needs one write per message.
+ */
+static gboolean can_write_data(GIOChannel *channel, GIOCondition cond,
+							gpointer user_data)
+{
+	struct qmi_device *device = user_data;
+	struct qmi_request *batch[QMI_WRITE_BATCH];
+	struct iovec iov[QMI_WRITE_BATCH];
+	unsigned int max = device->coalesce_writes ? QMI_WRITE_BATCH : 1;
+	unsigned int rounds = QMI_WRITE_BATCH;
+	unsigned int count, i;
+	ssize_t bytes_written;
+	GList *list;
 
-	return FALSE;
+	while (rounds--) {
+		count = 0;
+
+		for (list = g_queue_peek_head_link(device->req_queue);
+				list && count < max; list = list->next) {
+			struct qmi_request *req = list->data;
+
+			if (!__request_window_open(device, req))
+				continue;
+
+			batch[count] = req;
+			iov[count].iov_base = req->buf + req->written;
+			iov[count].iov_len = req->len - req->written;
+			count++;
+		}
+
+		if (count == 0)
+			return FALSE;
+
+		bytes_written = writev(device->fd, iov, count);
+		if (bytes_written < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				return TRUE;
+
+			return FALSE;
+		}
+
+		for (i = 0; i < count && bytes_written > 0; i++) {
+			size_t len = MIN((size_t) bytes_written,
+							iov[i].iov_len);
+
+			batch[i]->written += len;
+			bytes_written -= len;
+
+			if (batch[i]->written == batch[i]->len)
+				__request_sent(device, batch[i]);
+		}
+	}
+
+	return __request_pending(device);
 }
 
 static void write_watch_destroy(gpointer user_data)
@@ -722,7 +881,9 @@ static uint16_t __request_submit(struct qmi_device *device,
 		req->tid = hdr->transaction;
 	}
 
-	g_queue_push_tail(device->req_queue, req);
+	__request_queue(device->req_queue, req);
+	g_hash_table_insert(device->req_table,
+			REQUEST_KEY(req->service, req->client, req->tid), req);
 
 	wakeup_writer(device);
 
@@ -735,12 +896,17 @@ static void service_notify(gpointer key, gpointer value, gpointer user_data)
 	struct qmi_result *result = user_data;
 	GList *list;
 
-	for (list = g_list_first(service->notify_list); list;
-						list = g_list_next(list)) {
+	if (!service->device)
+		return;
+
+	list = g_hash_table_lookup(service->device->notify_table,
+				NOTIFY_KEY(service->type, service->client_id,
+							result->message));
+
+	for (; list; list = g_list_next(list)) {
 		struct qmi_notify *notify = list->data;
 
-		if (notify->message == result->message)
-			notify->callback(result, notify->user_data);
+		notify->callback(result, notify->user_data);
 	}
 }
 
@@ -760,6 +926,7 @@ static void handle_indication(struct qmi_device *device,
 	result.message = message;
 	result.data = data;
 	result.length = length;
+	result.indexed = false;
 
 	if (client_id == 0xff) {
 		g_hash_table_foreach(device->service_list,
@@ -788,7 +955,6 @@ static void handle_packet(struct qmi_device *device,
 		const struct qmi_control_hdr *control = buf;
 		const struct qmi_message_hdr *msg;
 		unsigned int tid;
-		GList *list;
 
 		/* Ignore control messages with client identifier */
 		if (hdr->client != 0x00)
@@ -809,19 +975,15 @@ static void handle_packet(struct qmi_device *device,
 			return;
 		}
 
-		list = g_queue_find_custom(device->control_queue,
-				GUINT_TO_POINTER(tid), __request_compare);
-		if (!list)
+		req = __request_lookup(device, hdr->service, hdr->client, tid);
+		if (!req || req->queue != device->control_queue)
 			return;
 
-		req = list->data;
-
-		g_queue_delete_link(device->control_queue, list);
+		__request_unlink(device, req);
 	} else {
 		const struct qmi_service_hdr *service = buf;
 		const struct qmi_message_hdr *msg;
 		unsigned int tid;
-		GList *list;
 
 		msg = buf + QMI_SERVICE_HDR_SIZE;
 
@@ -838,14 +1000,11 @@ static void handle_packet(struct qmi_device *device,
 			return;
 		}
 
-		list = g_queue_find_custom(device->service_queue,
-				GUINT_TO_POINTER(tid), __request_compare);
-		if (!list)
+		req = __request_lookup(device, hdr->service, hdr->client, tid);
+		if (!req || req->queue != device->service_queue)
 			return;
 
-		req = list->data;
-
-		g_queue_delete_link(device->service_queue, list);
+		__request_unlink(device, req);
 	}
 
 	if (req->callback)
@@ -854,54 +1013,146 @@ static void handle_packet(struct qmi_device *device,
 	__request_free(req, NULL);
 }
 
+static bool read_buf_reserve(struct qmi_device *device, size_t len)
+{
+	size_t size = device->read_size ? device->read_size : QMI_READ_CHUNK;
+	unsigned char *buf;
+
+	while (size - device->read_len < len)
+		size *= 2;
+
+	if (size == device->read_size)
+		return true;
+
+	buf = g_try_realloc(device->read_buf, size);
+	if (!buf)
+		return false;
+
+	device->read_buf = buf;
+	device->read_size = size;
+
+	return true;
+}
+
+/*
+ * Reads whatever is available, up to QMI_READ_BUF_MAX bytes per wakeup.
+ * Anything that doesn't fit the free space of the receive buffer lands
+ * in the overflow chunk, so a single readv gets it all.
+ */
+static void read_all(struct qmi_device *device)
+{
+	unsigned char extra[QMI_READ_CHUNK];
+	struct iovec iov[2];
+	ssize_t bytes_read;
+	size_t start, spill;
+
+	while (device->read_len < QMI_READ_BUF_MAX) {
+		if (!read_buf_reserve(device, QMI_READ_CHUNK))
+			return;
+
+		start = device->read_len;
+
+		iov[0].iov_base = device->read_buf + start;
+		iov[0].iov_len = device->read_size - start;
+		iov[1].iov_base = extra;
+		iov[1].iov_len = sizeof(extra);
+
+		bytes_read = readv(device->fd, iov, 2);
+		if (bytes_read < 0 && errno == EINTR)
+			continue;
+
+		if (bytes_read <= 0)
+			return;
+
+		if ((size_t) bytes_read <= iov[0].iov_len) {
+			device->read_len += bytes_read;
+		} else {
+			spill = bytes_read - iov[0].iov_len;
+			device->read_len = device->read_size;
+
+			if (!read_buf_reserve(device, spill)) {
+				/* The frame is lost, resync on the next one */
+				device->read_len = 0;
+				continue;
+			}
+
+			memcpy(device->read_buf + device->read_len,
+								extra, spill);
+			device->read_len += spill;
+		}
+
+		if (device->hexdump)
+			__hexdump('<', device->read_buf + start,
+					device->read_len - start,
+					device->debug_func, device->debug_data);
+	}
+}
+
 static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 							gpointer user_data)
 {
 	struct qmi_device *device = user_data;
 	struct qmi_mux_hdr *hdr;
-	unsigned char buf[2048];
-	ssize_t bytes_read;
-	uint16_t offset;
+	const unsigned char *frame;
+	size_t offset;
 
 	if (cond & G_IO_NVAL)
 		return FALSE;
 
-	bytes_read = read(device->fd, buf, sizeof(buf));
-	if (bytes_read < 0)
-		return TRUE;
-
-	__hexdump('<', buf, bytes_read,
-				device->debug_func, device->debug_data);
+	read_all(device);
 
 	offset = 0;
 
-	while (offset < bytes_read) {
+	while (offset < device->read_len) {
+		size_t avail = device->read_len - offset;
 		uint16_t len;
 
-		/* Check if QMI mux header fits into packet */
-		if (bytes_read - offset < QMI_MUX_HDR_SIZE)
+		/* Wait for the rest of the QMI mux header */
+		if (avail < QMI_MUX_HDR_SIZE)
 			break;
 
-		hdr = (void *) (buf + offset);
+		frame = device->read_buf + offset;
+		hdr = (void *) frame;
 
 		/* Check for fixed frame and flags value */
-		if (hdr->frame != 0x01 || hdr->flags != 0x80)
-			break;
+		if (hdr->frame != 0x01 || hdr->flags != 0x80) {
+			const unsigned char *next;
+
+			/* Skip garbage up to the next possible frame */
+			next = memchr(frame + 1, 0x01, avail - 1);
+			offset = next ? (size_t) (next - device->read_buf) :
+							device->read_len;
+			continue;
+		}
 
 		len = GUINT16_FROM_LE(hdr->length) + 1;
 
-		/* Check that packet size matches frame size */
-		if (bytes_read - offset < len)
+		/* Wait for the rest of the frame */
+		if (avail < len)
 			break;
 
-		__debug_msg(' ', buf + offset, len,
+		__debug_msg(' ', frame, len,
 				device->debug_func, device->debug_data);
 
-		handle_packet(device, hdr, buf + offset + QMI_MUX_HDR_SIZE);
+		handle_packet(device, hdr, frame + QMI_MUX_HDR_SIZE);
 
 		offset += len;
 	}
 
+	/* Keep the incomplete frame for the next read */
+	if (offset > 0) {
+		device->read_len -= offset;
+		memmove(device->read_buf, device->read_buf + offset,
+							device->read_len);
+	}
+
+	/* Don't hold on to the memory a large response needed */
+	if (device->read_len == 0 && device->read_size > QMI_READ_CHUNK) {
+		g_free(device->read_buf);
+		device->read_buf = NULL;
+		device->read_size = 0;
+	}
+
 	return TRUE;
 }
 
@@ -940,6 +1191,7 @@ static void service_destroy(gpointer data)
 struct qmi_device *qmi_device_new(int fd)
 {
 	struct qmi_device *device;
+	struct stat st;
 	long flags;
 
 	device = g_try_new0(struct qmi_device, 1);
@@ -966,6 +1218,13 @@ struct qmi_device *qmi_device_new(int fd)
 		}
 	}
 
+	/*
+	 * Character devices take one message per write, anything else
+	 * is a stream which requests can be coalesced into
+	 */
+	if (fstat(device->fd, &st) == 0 && !S_ISCHR(st.st_mode))
+		device->coalesce_writes = true;
+
 	device->io = g_io_channel_unix_new(device->fd);
 
 	g_io_channel_set_encoding(device->io, NULL, NULL);
@@ -985,6 +1244,9 @@ struct qmi_device *qmi_device_new(int fd)
 	device->service_list = g_hash_table_new_full(g_direct_hash,
 					g_direct_equal, NULL, service_destroy);
 
+	device->req_table = g_hash_table_new(g_direct_hash, g_direct_equal);
+	device->notify_table = g_hash_table_new(g_direct_hash, g_direct_equal);
+
 	device->next_control_tid = 1;
 	device->next_service_tid = 256;
 
@@ -1036,9 +1298,14 @@ void qmi_device_unref(struct qmi_device *device)
 		g_source_remove(device->shutdown_source);
 
 	g_hash_table_destroy(device->service_list);
+	g_hash_table_destroy(device->req_table);
+
+	g_hash_table_foreach(device->notify_table, __notify_list_free, NULL);
+	g_hash_table_destroy(device->notify_table);
 
 	g_free(device->version_str);
 	g_free(device->version_list);
+	g_free(device->read_buf);
 
 	if (device->shutting_down)
 		device->destroyed = true;
@@ -1056,6 +1323,14 @@ void qmi_device_set_debug(struct qmi_device *device,
 	device->debug_data = user_data;
 }
 
+void qmi_device_set_hexdump(struct qmi_device *device, bool enable)
+{
+	if (device == NULL)
+		return;
+
+	device->hexdump = enable;
+}
+
 void qmi_device_set_close_on_unref(struct qmi_device *device, bool do_close)
 {
 	if (!device)
@@ -1249,29 +1524,15 @@ static gboolean discover_reply(gpointer user_data)
 	struct discover_data *data = user_data;
 	struct qmi_device *device = data->device;
 	unsigned int tid = data->tid;
-	GList *list;
 	struct qmi_request *req = NULL;
 
 	data->timeout = 0;
 
 	/* remove request from queues */
 	if (tid != 0) {
-		list = g_queue_find_custom(device->req_queue,
-				GUINT_TO_POINTER(tid), __request_compare);
-
-		if (list) {
-			req = list->data;
-			g_queue_delete_link(device->req_queue, list);
-		} else {
-			list = g_queue_find_custom(device->control_queue,
-				GUINT_TO_POINTER(tid), __request_compare);
-
-			if (list) {
-				req = list->data;
-				g_queue_delete_link(device->control_queue,
-								list);
-			}
-		}
+		req = __request_lookup(device, QMI_SERVICE_CONTROL, 0x00, tid);
+		if (req)
+			__request_unlink(device, req);
 	}
 
 	if (data->func)
@@ -1772,6 +2033,53 @@ struct qmi_param *qmi_param_new_uint32(uint8_t type, uint32_t value)
 	return param;
 }
 
+/*
+ * Builds the type to offset index of the TLVs on the first lookup, the
+ * getters are then O(1) no matter how many TLVs the message carries.
+ * Only the first TLV of each type is indexed, like tlv_get() finds.
+ */
+static void result_build_index(struct qmi_result *result)
+{
+	const uint8_t *data = result->data;
+	uint16_t offset = 0;
+
+	memset(result->index, 0, sizeof(result->index));
+	result->indexed = true;
+
+	while (result->length - offset > QMI_TLV_HDR_SIZE) {
+		const struct qmi_tlv_hdr *tlv = (const void *) (data + offset);
+		uint16_t tlv_length = GUINT16_FROM_LE(tlv->length);
+
+		/* Truncated TLV */
+		if (tlv_length > result->length - offset - QMI_TLV_HDR_SIZE)
+			break;
+
+		if (!result->index[tlv->type])
+			result->index[tlv->type] = offset + 1;
+
+		offset += QMI_TLV_HDR_SIZE + tlv_length;
+	}
+}
+
+static const void *result_tlv_get(struct qmi_result *result, uint8_t type,
+							uint16_t *length)
+{
+	const struct qmi_tlv_hdr *tlv;
+
+	if (!result->indexed)
+		result_build_index(result);
+
+	if (!result->index[type])
+		return NULL;
+
+	tlv = result->data + result->index[type] - 1;
+
+	if (length)
+		*length = GUINT16_FROM_LE(tlv->length);
+
+	return tlv->value;
+}
+
 bool qmi_result_set_error(struct qmi_result *result, uint16_t *error)
 {
 	if (!result) {
@@ -1806,7 +2114,7 @@ const void *qmi_result_get(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return NULL;
 
-	return tlv_get(result->data, result->length, type, length);
+	return result_tlv_get(result, type, length);
 }
 
 char *qmi_result_get_string(struct qmi_result *result, uint8_t type)
@@ -1817,7 +2125,7 @@ char *qmi_result_get_string(struct qmi_result *result, uint8_t type)
 	if (!result || !type)
 		return NULL;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr)
 		return NULL;
 
@@ -1833,7 +2141,7 @@ bool qmi_result_get_uint8(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr)
 		return false;
 
@@ -1852,7 +2160,7 @@ bool qmi_result_get_int16(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr)
 		return false;
 
@@ -1873,7 +2181,7 @@ bool qmi_result_get_uint16(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr)
 		return false;
 
@@ -1895,7 +2203,7 @@ bool qmi_result_get_uint32(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr)
 		return false;
 
@@ -1917,7 +2225,7 @@ bool qmi_result_get_uint64(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr)
 		return false;
 
@@ -1929,6 +2237,152 @@ bool qmi_result_get_uint64(struct qmi_result *result, uint8_t type,
 	return true;
 }
 
+static void result_iter_set_tlv(struct qmi_result_iter *iter, uint16_t offset)
+{
+	const struct qmi_tlv_hdr *tlv = (const void *) (iter->tlvs + offset);
+
+	iter->length = GUINT16_FROM_LE(tlv->length);
+	iter->data = tlv->value;
+	iter->pos = 0;
+	iter->next_tlv = offset + QMI_TLV_HDR_SIZE + iter->length;
+}
+
+bool qmi_result_iter_init(struct qmi_result_iter *iter,
+				struct qmi_result *result, uint8_t type)
+{
+	if (!iter || !result || !type)
+		return false;
+
+	if (!result->indexed)
+		result_build_index(result);
+
+	if (!result->index[type])
+		return false;
+
+	iter->tlvs = result->data;
+	iter->tlvs_length = result->length;
+	iter->type = type;
+	result_iter_set_tlv(iter, result->index[type] - 1);
+
+	return true;
+}
+
+/* Moves on to the next TLV of the same type, for repeated TLVs */
+bool qmi_result_iter_next_tlv(struct qmi_result_iter *iter)
+{
+	uint16_t offset = iter->next_tlv;
+
+	while (iter->tlvs_length - offset > QMI_TLV_HDR_SIZE) {
+		const struct qmi_tlv_hdr *tlv =
+					(const void *) (iter->tlvs + offset);
+		uint16_t tlv_length = GUINT16_FROM_LE(tlv->length);
+
+		if (tlv_length > iter->tlvs_length - offset -
+							QMI_TLV_HDR_SIZE)
+			break;
+
+		if (tlv->type == iter->type) {
+			result_iter_set_tlv(iter, offset);
+			return true;
+		}
+
+		offset += QMI_TLV_HDR_SIZE + tlv_length;
+	}
+
+	return false;
+}
+
+uint16_t qmi_result_iter_remaining(struct qmi_result_iter *iter)
+{
+	return iter->length - iter->pos;
+}
+
+bool qmi_result_iter_next_data(struct qmi_result_iter *iter, uint16_t len,
+							const void **data)
+{
+	if (iter->length - iter->pos < len)
+		return false;
+
+	if (data)
+		*data = iter->data + iter->pos;
+
+	iter->pos += len;
+
+	return true;
+}
+
+bool qmi_result_iter_next_uint8(struct qmi_result_iter *iter,
+							uint8_t *value)
+{
+	const uint8_t *ptr;
+
+	if (!qmi_result_iter_next_data(iter, 1, (const void **) &ptr))
+		return false;
+
+	if (value)
+		*value = *ptr;
+
+	return true;
+}
+
+bool qmi_result_iter_next_uint16(struct qmi_result_iter *iter,
+							uint16_t *value)
+{
+	const void *ptr;
+	uint16_t tmp;
+
+	if (!qmi_result_iter_next_data(iter, 2, &ptr))
+		return false;
+
+	memcpy(&tmp, ptr, 2);
+
+	if (value)
+		*value = GUINT16_FROM_LE(tmp);
+
+	return true;
+}
+
+bool qmi_result_iter_next_uint32(struct qmi_result_iter *iter,
+							uint32_t *value)
+{
+	const void *ptr;
+	uint32_t tmp;
+
+	if (!qmi_result_iter_next_data(iter, 4, &ptr))
+		return false;
+
+	memcpy(&tmp, ptr, 4);
+
+	if (value)
+		*value = GUINT32_FROM_LE(tmp);
+
+	return true;
+}
+
+/*
+ * Strings with a one byte length prefix.  The string points into the
+ * message and is not NUL terminated.
+ */
+bool qmi_result_iter_next_string(struct qmi_result_iter *iter,
+					const char **str, uint8_t *len)
+{
+	uint16_t pos = iter->pos;
+	uint8_t n;
+
+	if (!qmi_result_iter_next_uint8(iter, &n))
+		return false;
+
+	if (!qmi_result_iter_next_data(iter, n, (const void **) str)) {
+		iter->pos = pos;
+		return false;
+	}
+
+	if (len)
+		*len = n;
+
+	return true;
+}
+
 struct service_create_data {
 	struct discovery super;
 	struct qmi_device *device;
@@ -2206,6 +2660,17 @@ void qmi_service_unref(struct qmi_service *service)
 					service_release_callback, service);
 }
 
+void qmi_service_set_window(struct qmi_service *service, unsigned int window)
+{
+	if (!service)
+		return;
+
+	service->window = window;
+
+	if (service->device)
+		wakeup_writer(service->device);
+}
+
 const char *qmi_service_get_identifier(struct qmi_service *service)
 {
 	if (!service)
@@ -2254,6 +2719,7 @@ static void service_send_callback(uint16_t message, uint16_t length,
 	result.message = message;
 	result.data = buffer;
 	result.length = length;
+	result.indexed = false;
 
 	result_code = tlv_get(buffer, length, 0x02, &len);
 	if (!result_code)
@@ -2318,7 +2784,6 @@ bool qmi_service_cancel(struct qmi_service *service, uint16_t id)
 	unsigned int tid = id;
 	struct qmi_device *device;
 	struct qmi_request *req;
-	GList *list;
 
 	if (!service || !tid)
 		return false;
@@ -2330,22 +2795,11 @@ bool qmi_service_cancel(struct qmi_service *service, uint16_t id)
 	if (!device)
 		return false;
 
-	list = g_queue_find_custom(device->req_queue,
-				GUINT_TO_POINTER(tid), __request_compare);
-	if (list) {
-		req = list->data;
-
-		g_queue_delete_link(device->req_queue, list);
-	} else {
-		list = g_queue_find_custom(device->service_queue,
-				GUINT_TO_POINTER(tid), __request_compare);
-		if (!list)
-			return false;
+	req = __request_lookup(device, service->type, service->client_id, tid);
+	if (!req)
+		return false;
 
-		req = list->data;
-
-		g_queue_delete_link(device->service_queue, list);
-	}
+	__request_unlink(device, req);
 
 	service_send_free(req->user_data);
 
@@ -2354,35 +2808,25 @@ bool qmi_service_cancel(struct qmi_service *service, uint16_t id)
 	return true;
 }
 
-static GQueue *remove_client(GQueue *queue, uint8_t client)
+static void remove_client(struct qmi_device *device, GQueue *queue,
+								uint8_t client)
 {
-	GQueue *new_queue;
-	GList *list;
-
-	new_queue = g_queue_new();
+	GList *list = g_queue_peek_head_link(queue);
 
-	while (1) {
-		struct qmi_request *req;
-
-		list = g_queue_pop_head_link(queue);
-		if (!list)
-			break;
+	while (list) {
+		struct qmi_request *req = list->data;
 
-		req = list->data;
+		list = list->next;
 
-		if (!req->client || req->client != client) {
-			g_queue_push_tail_link(new_queue, list);
+		if (!req->client || req->client != client)
 			continue;
-		}
+
+		__request_unlink(device, req);
 
 		service_send_free(req->user_data);
 
 		__request_free(req, NULL);
 	}
-
-	g_queue_free(queue);
-
-	return new_queue;
 }
 
 bool qmi_service_cancel_all(struct qmi_service *service)
@@ -2399,11 +2843,8 @@ bool qmi_service_cancel_all(struct qmi_service *service)
 	if (!device)
 		return false;
 
-	device->req_queue = remove_client(device->req_queue,
-						service->client_id);
-
-	device->service_queue = remove_client(device->service_queue,
-							service->client_id);
+	remove_client(device, device->req_queue, service->client_id);
+	remove_client(device, device->service_queue, service->client_id);
 
 	return true;
 }
@@ -2413,10 +2854,15 @@ uint16_t qmi_service_register(struct qmi_service *service,
 				void *user_data, qmi_destroy_func_t destroy)
 {
 	struct qmi_notify *notify;
+	gpointer key;
+	GList *list;
 
 	if (!service || !func)
 		return 0;
 
+	if (!service->device)
+		return 0;
+
 	notify = g_try_new0(struct qmi_notify, 1);
 	if (!notify)
 		return 0;
@@ -2432,9 +2878,33 @@ uint16_t qmi_service_register(struct qmi_service *service,
 
 	service->notify_list = g_list_append(service->notify_list, notify);
 
+	key = NOTIFY_KEY(service->type, service->client_id, message);
+	list = g_hash_table_lookup(service->device->notify_table, key);
+	list = g_list_append(list, notify);
+	g_hash_table_insert(service->device->notify_table, key, list);
+
 	return notify->id;
 }
 
+static void notify_table_remove(struct qmi_service *service,
+					struct qmi_notify *notify)
+{
+	gpointer key;
+	GList *list;
+
+	if (!service->device)
+		return;
+
+	key = NOTIFY_KEY(service->type, service->client_id, notify->message);
+	list = g_hash_table_lookup(service->device->notify_table, key);
+	list = g_list_remove(list, notify);
+
+	if (list)
+		g_hash_table_insert(service->device->notify_table, key, list);
+	else
+		g_hash_table_remove(service->device->notify_table, key);
+}
+
 bool qmi_service_unregister(struct qmi_service *service, uint16_t id)
 {
 	unsigned int nid = id;
@@ -2453,16 +2923,23 @@ bool qmi_service_unregister(struct qmi_service *service, uint16_t id)
 
 	service->notify_list = g_list_delete_link(service->notify_list, list);
 
+	notify_table_remove(service, notify);
 	__notify_free(notify, NULL);
 
 	return true;
 }
 
+static void notify_table_remove_all(gpointer data, gpointer user_data)
+{
+	notify_table_remove(user_data, data);
+}
+
 bool qmi_service_unregister_all(struct qmi_service *service)
 {
 	if (!service)
 		return false;
 
+	g_list_foreach(service->notify_list, notify_table_remove_all, service);
 	g_list_foreach(service->notify_list, __notify_free, NULL);
 	g_list_free(service->notify_list);
 
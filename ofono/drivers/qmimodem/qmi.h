@@ -80,6 +80,7 @@ void qmi_device_unref(struct qmi_device *device);
 
 void qmi_device_set_debug(struct qmi_device *device,
 				qmi_debug_func_t func, void *user_data);
+void qmi_device_set_hexdump(struct qmi_device *device, bool enable);
 
 void qmi_device_set_close_on_unref(struct qmi_device *device, bool do_close);
 
@@ -140,6 +141,31 @@ bool qmi_result_get_uint64(struct qmi_result *result, uint8_t type,
 							uint64_t *value);
 void qmi_result_print_tlvs(struct qmi_result *result);
 
+struct qmi_result_iter {
+	const uint8_t *tlvs;
+	uint16_t tlvs_length;
+	uint16_t next_tlv;
+	uint8_t type;
+	const uint8_t *data;
+	uint16_t length;
+	uint16_t pos;
+};
+
+bool qmi_result_iter_init(struct qmi_result_iter *iter,
+				struct qmi_result *result, uint8_t type);
+bool qmi_result_iter_next_tlv(struct qmi_result_iter *iter);
+uint16_t qmi_result_iter_remaining(struct qmi_result_iter *iter);
+bool qmi_result_iter_next_data(struct qmi_result_iter *iter, uint16_t len,
+							const void **data);
+bool qmi_result_iter_next_uint8(struct qmi_result_iter *iter,
+							uint8_t *value);
+bool qmi_result_iter_next_uint16(struct qmi_result_iter *iter,
+							uint16_t *value);
+bool qmi_result_iter_next_uint32(struct qmi_result_iter *iter,
+							uint32_t *value);
+bool qmi_result_iter_next_string(struct qmi_result_iter *iter,
+					const char **str, uint8_t *len);
+
 int qmi_error_to_ofono_cme(int qmi_error);
 
 struct qmi_service;
@@ -159,6 +185,8 @@ struct qmi_service *qmi_service_ref(struct qmi_service *service);
 void qmi_service_unref(struct qmi_service *service);
 
 const char *qmi_service_get_identifier(struct qmi_service *service);
+void qmi_service_set_window(struct qmi_service *service, unsigned int window);
+
 bool qmi_service_get_version(struct qmi_service *service,
 					uint16_t *major, uint16_t *minor);
 
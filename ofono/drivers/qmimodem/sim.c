@@ -317,6 +317,119 @@ error:
 	g_free(cbd);
 }
 
+static void read_records_cb(struct qmi_result *result, void *user_data)
+{
+	struct cb_data *cbd = user_data;
+	ofono_sim_read_cb_t cb = cbd->cb;
+	const unsigned char *content;
+	const unsigned char *extra;
+	uint16_t len;
+	uint16_t extra_len;
+	uint16_t rec_len;
+	uint16_t count;
+	GByteArray *records;
+
+	DBG("");
+
+	if (qmi_result_set_error(result, NULL)) {
+		CALLBACK_WITH_FAILURE(cb, NULL, 0, cbd->data);
+		return;
+	}
+
+	content = qmi_result_get(result, 0x11, &len);
+	if (!content || len < 2) {
+		CALLBACK_WITH_FAILURE(cb, NULL, 0, cbd->data);
+		return;
+	}
+
+	rec_len = len - 2;
+	records = g_byte_array_new();
+	g_byte_array_append(records, content + 2, rec_len);
+
+	/*
+	 * Records after the first one come as a list of length prefixed
+	 * blobs.  Stop at anything that doesn't look like a whole record,
+	 * the core reads the rest one by one.
+	 */
+	extra = qmi_result_get(result, 0x12, &extra_len);
+	if (extra && extra_len >= 2) {
+		count = extra[0] | (extra[1] << 8);
+		extra += 2;
+		extra_len -= 2;
+
+		while (count--) {
+			uint16_t n;
+
+			if (extra_len < 2)
+				break;
+
+			n = extra[0] | (extra[1] << 8);
+			if (n != rec_len || extra_len - 2 < n)
+				break;
+
+			g_byte_array_append(records, extra + 2, n);
+			extra += 2 + n;
+			extra_len -= 2 + n;
+		}
+	}
+
+	CALLBACK_WITH_SUCCESS(cb, records->data, records->len, cbd->data);
+	g_byte_array_free(records, TRUE);
+}
+
+static void qmi_read_records(struct ofono_sim *sim, int fileid,
+				enum ofono_sim_file_structure structure,
+				int record, int count, int length,
+				const unsigned char *path,
+				unsigned int path_len,
+				ofono_sim_read_cb_t cb, void *user_data)
+{
+	struct sim_data *data = ofono_sim_get_data(sim);
+	struct cb_data *cbd = cb_data_new(cb, user_data);
+	unsigned char aid_data[2] = { 0x00, 0x00 };
+	unsigned char read_data[4];
+	unsigned char last_data[2];
+	unsigned char fileid_data[9];
+	int fileid_len;
+	int last = record + count - 1;
+	struct qmi_param *param;
+
+	DBG("file id 0x%04x records %d..%d", fileid, record, last);
+
+	fileid_len = create_fileid_data(data->app_type, fileid,
+						path, path_len, fileid_data);
+	if (fileid_len < 0)
+		goto error;
+
+	read_data[0] = record & 0xff;
+	read_data[1] = (record & 0xff00) >> 8;
+	read_data[2] = length & 0xff;
+	read_data[3] = (length & 0xff00) >> 8;
+
+	last_data[0] = last & 0xff;
+	last_data[1] = (last & 0xff00) >> 8;
+
+	param = qmi_param_new();
+	if (!param)
+		goto error;
+
+	qmi_param_append(param, 0x01, sizeof(aid_data), aid_data);
+	qmi_param_append(param, 0x02, fileid_len, fileid_data);
+	qmi_param_append(param, 0x03, sizeof(read_data), read_data);
+	qmi_param_append(param, 0x10, sizeof(last_data), last_data);
+
+	if (qmi_service_send(data->uim, QMI_UIM_READ_RECORD, param,
+					read_records_cb, cbd, g_free) > 0)
+		return;
+
+	qmi_param_free(param);
+
+error:
+	CALLBACK_WITH_FAILURE(cb, NULL, 0, user_data);
+
+	g_free(cbd);
+}
+
 static void write_generic_cb(struct qmi_result *result, void *user_data)
 {
 	struct cb_data *cbd = user_data;
@@ -956,6 +1069,7 @@ static const struct ofono_sim_driver driver = {
 	.read_file_transparent	= qmi_read_transparent,
 	.read_file_linear	= qmi_read_record,
 	.read_file_cyclic	= qmi_read_record,
+	.read_file_records	= qmi_read_records,
 	.write_file_transparent = qmi_write_transparent,
 	.write_file_linear	= qmi_write_linear,
 	.write_file_cyclic	= qmi_write_cyclic,
@@ -395,6 +395,16 @@ static void set_oper_name(const char *lalpha, const char *salpha,
 		strncpy(op->name, salpha, OFONO_MAX_OPERATOR_NAME_LENGTH);
 }
 
+/* Decodes a string from the parcel into buf, NULL for a null string */
+static const char *parcel_str(const struct parcel_str_view *view, char *buf,
+				size_t size)
+{
+	if (parcel_str_view_to_utf8(view, buf, size) < 0)
+		return NULL;
+
+	return buf;
+}
+
 static void ril_cops_cb(struct ril_msg *message, gpointer user_data)
 {
 	struct cb_data *cbd = user_data;
@@ -532,30 +542,38 @@ static void ril_cops_list_cb(struct ril_msg *message, gpointer user_data)
 	ops = g_new0(struct ofono_network_operator, num_ops);
 
 	for (i = 0; num_ops; num_ops--) {
-		char *lalpha;
-		char *salpha;
-		char *numeric;
-		char *status;
+		struct parcel_str_view view;
+		char lbuf[OFONO_MAX_OPERATOR_NAME_LENGTH + 1];
+		char sbuf[OFONO_MAX_OPERATOR_NAME_LENGTH + 1];
+		char nbuf[OFONO_MAX_MCC_LENGTH + OFONO_MAX_MNC_LENGTH + 1] = "";
+		char stbuf[16];
+		const char *lalpha;
+		const char *salpha;
+		const char *numeric;
+		const char *status;
 		int tech = -1;
 
-		lalpha = parcel_r_string(&rilp);
-		salpha = parcel_r_string(&rilp);
-		numeric = parcel_r_string(&rilp);
-		status = parcel_r_string(&rilp);
+		/* Decode straight into stack buffers, these can be many */
+		parcel_r_string_view(&rilp, &view);
+		lalpha = parcel_str(&view, lbuf, sizeof(lbuf));
+		parcel_r_string_view(&rilp, &view);
+		salpha = parcel_str(&view, sbuf, sizeof(sbuf));
+		parcel_r_string_view(&rilp, &view);
+		numeric = parcel_str(&view, nbuf, sizeof(nbuf));
+		parcel_r_string_view(&rilp, &view);
+		status = parcel_str(&view, stbuf, sizeof(stbuf));
 
 		/*
 		 * MTK: additional string with technology: 2G/3G are the only
 		 * valid values currently.
 		 */
 		if (g_ril_vendor(nd->ril) == OFONO_RIL_VENDOR_MTK) {
-			char *t = parcel_r_string(&rilp);
+			parcel_r_string_view(&rilp, &view);
 
-			if (strcmp(t, "3G") == 0)
+			if (parcel_str_view_cmp(&view, "3G") == 0)
 				tech = ACCESS_TECHNOLOGY_UTRAN;
 			else
 				tech = ACCESS_TECHNOLOGY_GSM;
-
-			g_free(t);
 		}
 
 		if (lalpha == NULL && salpha == NULL)
@@ -587,10 +605,6 @@ next:
 				" numeric=%s status=%s]",
 				print_buf,
 				lalpha, salpha, numeric, status);
-		g_free(lalpha);
-		g_free(salpha);
-		g_free(numeric);
-		g_free(status);
 	}
 
 	g_ril_append_print_buf(nd->ril, "%s}", print_buf);
@@ -58,6 +58,15 @@
 #define CMD_UPDATE_BINARY 214 /* 0xD6   */
 #define CMD_UPDATE_RECORD 220 /* 0xDC   */
 
+/*
+ * Size of a SIM_IO request: command, file id, P1-P3 and the MTK session id,
+ * plus the path, data, pin2 and AID strings.
+ */
+#define SIM_IO_PARCEL_SIZE(path, data, aid)				\
+	(6 * sizeof(int32_t) + parcel_string_size(path) +		\
+		parcel_string_size(data) + parcel_string_size(NULL) +	\
+		parcel_string_size(aid))
+
 /*
  * Based on ../drivers/atmodem/sim.c.
  *
@@ -313,7 +322,8 @@ static void ril_sim_read_info(struct ofono_sim *sim, int fileid,
 		goto error;
 	}
 
-	parcel_init(&rilp);
+	parcel_init_sized(&rilp, SIM_IO_PARCEL_SIZE(hex_path, NULL,
+							sd->aid_str));
 
 	parcel_w_int32(&rilp, CMD_GET_RESPONSE);
 	parcel_w_int32(&rilp, fileid);
@@ -457,7 +467,8 @@ static void ril_sim_read_binary(struct ofono_sim *sim, int fileid,
 		goto error;
 	}
 
-	parcel_init(&rilp);
+	parcel_init_sized(&rilp, SIM_IO_PARCEL_SIZE(hex_path, NULL,
+							sd->aid_str));
 	parcel_w_int32(&rilp, CMD_READ_BINARY);
 	parcel_w_int32(&rilp, fileid);
 	parcel_w_string(&rilp, hex_path);
@@ -508,7 +519,8 @@ static void ril_sim_read_record(struct ofono_sim *sim, int fileid,
 		goto error;
 	}
 
-	parcel_init(&rilp);
+	parcel_init_sized(&rilp, SIM_IO_PARCEL_SIZE(hex_path, NULL,
+							sd->aid_str));
 	parcel_w_int32(&rilp, CMD_READ_RECORD);
 	parcel_w_int32(&rilp, fileid);
 	parcel_w_string(&rilp, hex_path);
@@ -565,7 +577,8 @@ static void ril_sim_update_binary(struct ofono_sim *sim, int fileid,
 	p2 = start & 0xff;
 	hex_data = encode_hex(value, length, 0);
 
-	parcel_init(&rilp);
+	parcel_init_sized(&rilp, SIM_IO_PARCEL_SIZE(hex_path, hex_data,
+							sd->aid_str));
 	parcel_w_int32(&rilp, CMD_UPDATE_BINARY);
 	parcel_w_int32(&rilp, fileid);
 	parcel_w_string(&rilp, hex_path);
@@ -621,7 +634,8 @@ static void update_record(struct ofono_sim *sim, int fileid,
 
 	hex_data = encode_hex(value, length, 0);
 
-	parcel_init(&rilp);
+	parcel_init_sized(&rilp, SIM_IO_PARCEL_SIZE(hex_path, hex_data,
+							sd->aid_str));
 	parcel_w_int32(&rilp, CMD_UPDATE_RECORD);
 	parcel_w_int32(&rilp, fileid);
 	parcel_w_string(&rilp, hex_path);
@@ -59,3 +59,52 @@ const guint16 crc_ccitt_table[256] = {
 	0xf78f, 0xe606, 0xd49d, 0xc514, 0xb1ab, 0xa022, 0x92b9, 0x8330,
 	0x7bc7, 0x6a4e, 0x58d5, 0x495c, 0x3de3, 0x2c6a, 0x1ef1, 0x0f78
 };
+
+/*
+ * Slicing-by-8 tables, crc_ccitt_slice[k][b] is the CRC of byte b followed
+ * by k zero bytes.  crc_ccitt_slice[0] is the same as crc_ccitt_table.
+ */
+static guint16 crc_ccitt_slice[8][256];
+static gboolean crc_ccitt_slice_ready;
+
+static void crc_ccitt_slice_init(void)
+{
+	unsigned int i, k;
+
+	for (i = 0; i < 256; i++) {
+		guint16 crc = crc_ccitt_table[i];
+
+		crc_ccitt_slice[0][i] = crc;
+
+		for (k = 1; k < 8; k++) {
+			crc = crc_ccitt_byte(crc, 0);
+			crc_ccitt_slice[k][i] = crc;
+		}
+	}
+
+	crc_ccitt_slice_ready = TRUE;
+}
+
+guint16 crc_ccitt(guint16 crc, const guint8 *buf, gsize len)
+{
+	if (len >= 8 && !crc_ccitt_slice_ready)
+		crc_ccitt_slice_init();
+
+	while (len >= 8) {
+		guint16 lo = (crc ^ buf[0]) & 0xff;
+		guint16 hi = ((crc >> 8) ^ buf[1]) & 0xff;
+
+		crc = crc_ccitt_slice[7][lo] ^ crc_ccitt_slice[6][hi] ^
+			crc_ccitt_slice[5][buf[2]] ^ crc_ccitt_slice[4][buf[3]] ^
+			crc_ccitt_slice[3][buf[4]] ^ crc_ccitt_slice[2][buf[5]] ^
+			crc_ccitt_slice[1][buf[6]] ^ crc_ccitt_slice[0][buf[7]];
+
+		buf += 8;
+		len -= 8;
+	}
+
+	while (len--)
+		crc = crc_ccitt_byte(crc, *buf++);
+
+	return crc;
+}
@@ -41,6 +41,9 @@
 #define COMMAND_FLAG_EXPECT_PDU			0x1
 #define COMMAND_FLAG_EXPECT_SHORT_PROMPT	0x2
 
+#define LINE_ARENA_MIN_SIZE			256
+#define LINE_ARENA_MAX_KEEP			16384
+
 struct at_chat;
 static void chat_wakeup_writer(struct at_chat *chat);
 
@@ -70,9 +73,40 @@ struct at_notify_node {
 typedef gboolean (*node_remove_func)(struct at_notify_node *node,
 					gpointer user_data);
 
+struct notify_trie;
+
 struct at_notify {
 	GSList *nodes;
 	gboolean pdu;
+	struct notify_trie *trie;
+};
+
+/*
+ * Registered prefixes are indexed by a character trie, so that matching
+ * an unsolicited line costs time proportional to the length of the
+ * matching prefixes rather than to the number of registrations.
+ * The notify_list hash table still owns the at_notify structures.
+ */
+struct notify_trie {
+	char c;
+	struct at_notify *notify;		/* Set if a prefix ends here */
+	struct notify_trie *parent;
+	struct notify_trie *children;
+	struct notify_trie *next;		/* Next sibling */
+};
+
+/*
+ * Storage for the intermediate lines of a response, NUL separated in a
+ * single buffer.  The GSList handed over in GAtResult is built over the
+ * nodes array, so neither the lines nor the list are allocated one by one.
+ */
+struct at_line_arena {
+	char *buf;
+	gsize len;
+	gsize size;
+	GSList *nodes;
+	guint count;
+	guint max_count;
 };
 
 struct at_chat {
@@ -84,6 +118,7 @@ struct at_chat {
 	GQueue *command_queue;			/* Command queue */
 	guint cmd_bytes_written;		/* bytes written from cmd */
 	GHashTable *notify_list;		/* List of notification reg */
+	struct notify_trie *notify_trie;	/* Prefix index of notify_list */
 	GAtDisconnectFunc user_disconnect;	/* user disconnect func */
 	gpointer user_disconnect_data;		/* user disconnect data */
 	guint read_so_far;			/* Number of bytes processed */
@@ -91,7 +126,9 @@ struct at_chat {
 	GAtDebugFunc debugf;			/* debugging output function */
 	gpointer debug_data;			/* Data to pass to debug func */
 	char *pdu_notify;			/* Unsolicited Resp w/ PDU */
-	GSList *response_lines;			/* char * lines of the response */
+	struct at_line_arena response;		/* lines of the response */
+	char *line_buf;				/* Wrapped line storage */
+	gsize line_buf_size;			/* Size of line_buf */
 	char *wakeup;				/* command sent to wakeup modem */
 	gint timeout_source;
 	gdouble inactivity_time;		/* Period of inactivity */
@@ -147,15 +184,149 @@ static void at_notify_node_destroy(gpointer data, gpointer user_data)
 	g_free(node);
 }
 
+static struct notify_trie *notify_trie_child(struct notify_trie *node,
+						char c)
+{
+	for (node = node->children; node; node = node->next)
+		if (node->c == c)
+			return node;
+
+	return NULL;
+}
+
+static struct notify_trie *notify_trie_insert(struct notify_trie *root,
+						const char *prefix)
+{
+	struct notify_trie *node = root;
+	struct notify_trie *child;
+
+	for (; *prefix; prefix++) {
+		child = notify_trie_child(node, *prefix);
+
+		if (child == NULL) {
+			/*
+			 * New nodes are prepended, so that a walk in progress
+			 * (registration from a notify callback) stays valid
+			 */
+			child = g_new0(struct notify_trie, 1);
+			child->c = *prefix;
+			child->parent = node;
+			child->next = node->children;
+			node->children = child;
+		}
+
+		node = child;
+	}
+
+	return node;
+}
+
+static void notify_trie_prune(struct notify_trie *node)
+{
+	while (node->parent && node->notify == NULL &&
+						node->children == NULL) {
+		struct notify_trie *parent = node->parent;
+		struct notify_trie **link = &parent->children;
+
+		while (*link != node)
+			link = &(*link)->next;
+
+		*link = node->next;
+		g_free(node);
+
+		node = parent;
+	}
+}
+
+static void notify_trie_free(struct notify_trie *node)
+{
+	struct notify_trie *child;
+
+	if (node == NULL)
+		return;
+
+	while ((child = node->children)) {
+		node->children = child->next;
+		notify_trie_free(child);
+	}
+
+	g_free(node);
+}
+
 static void at_notify_destroy(gpointer user_data)
 {
 	struct at_notify *notify = user_data;
 
+	if (notify->trie) {
+		notify->trie->notify = NULL;
+		notify_trie_prune(notify->trie);
+	}
+
 	g_slist_foreach(notify->nodes, at_notify_node_destroy, NULL);
 	g_slist_free(notify->nodes);
 	g_free(notify);
 }
 
+static void line_arena_append(struct at_line_arena *arena, const char *line)
+{
+	gsize n = strlen(line) + 1;
+
+	if (arena->len + n > arena->size) {
+		gsize size = arena->size ? arena->size : LINE_ARENA_MIN_SIZE;
+
+		while (size < arena->len + n)
+			size <<= 1;
+
+		arena->buf = g_realloc(arena->buf, size);
+		arena->size = size;
+	}
+
+	memcpy(arena->buf + arena->len, line, n);
+	arena->len += n;
+	arena->count++;
+}
+
+static GSList *line_arena_get_lines(struct at_line_arena *arena)
+{
+	char *line = arena->buf;
+	guint i;
+
+	if (arena->count == 0)
+		return NULL;
+
+	if (arena->count > arena->max_count) {
+		g_free(arena->nodes);
+		arena->nodes = g_new(GSList, arena->count);
+		arena->max_count = arena->count;
+	}
+
+	for (i = 0; i < arena->count; i++) {
+		arena->nodes[i].data = line;
+		arena->nodes[i].next = i + 1 < arena->count ?
+						arena->nodes + i + 1 : NULL;
+		line += strlen(line) + 1;
+	}
+
+	return arena->nodes;
+}
+
+static void line_arena_free(struct at_line_arena *arena)
+{
+	g_free(arena->buf);
+	g_free(arena->nodes);
+	memset(arena, 0, sizeof(*arena));
+}
+
+static void line_arena_reset(struct at_line_arena *arena)
+{
+	/* Don't hold on to the memory used by an exceptionally long listing */
+	if (arena->size > LINE_ARENA_MAX_KEEP)
+		line_arena_free(arena);
+
+	arena->len = 0;
+	arena->count = 0;
+}
+
 static gint at_command_compare_by_id(gconstpointer a, gconstpointer b)
 {
 	const struct at_command *command = a;
@@ -326,13 +497,19 @@ static void chat_cleanup(struct at_chat *chat)
 	chat->command_queue = NULL;
 
 	/* Cleanup any response lines we have pending */
-	g_slist_free_full(chat->response_lines, g_free);
-	chat->response_lines = NULL;
+	line_arena_free(&chat->response);
+
+	g_free(chat->line_buf);
+	chat->line_buf = NULL;
+	chat->line_buf_size = 0;
 
 	/* Cleanup registered notifications */
 	g_hash_table_destroy(chat->notify_list);
 	chat->notify_list = NULL;
 
+	notify_trie_free(chat->notify_trie);
+	chat->notify_trie = NULL;
+
 	if (chat->pdu_notify) {
 		g_free(chat->pdu_notify);
 		chat->pdu_notify = NULL;
@@ -384,26 +561,30 @@ static void at_notify_call_callback(gpointer data, gpointer user_data)
 
 static gboolean at_chat_match_notify(struct at_chat *chat, char *line)
 {
-	GHashTableIter iter;
+	struct notify_trie *node = chat->notify_trie;
 	struct at_notify *notify;
-	gpointer key, value;
+	const char *c;
 	gboolean ret = FALSE;
+	GSList lines = { line, NULL };
 	GAtResult result;
 
-	g_hash_table_iter_init(&iter, chat->notify_list);
-	result.lines = 0;
+	result.lines = &lines;
 	result.final_or_pdu = 0;
 
 	chat->in_notify = TRUE;
 
-	while (g_hash_table_iter_next(&iter, &key, &value)) {
-		notify = value;
+	/* Every node on the path spelled by the line is a matching prefix */
+	for (c = line; *c; c++) {
+		node = notify_trie_child(node, *c);
+		if (node == NULL)
+			break;
 
-		if (!g_str_has_prefix(line, key))
+		notify = node->notify;
+		if (notify == NULL)
 			continue;
 
 		if (notify->pdu) {
-			chat->pdu_notify = line;
+			chat->pdu_notify = g_strdup(line);
 
 			if (chat->syntax->set_hint)
 				chat->syntax->set_hint(chat->syntax,
@@ -411,22 +592,19 @@ static gboolean at_chat_match_notify(struct at_chat *chat, char *line)
 			return TRUE;
 		}
 
-		if (result.lines == NULL)
-			result.lines = g_slist_prepend(NULL, line);
-
 		g_slist_foreach(notify->nodes, at_notify_call_callback,
 					&result);
 		ret = TRUE;
+
+		/* The chat may have been shut down by the callback */
+		if (chat->notify_trie == NULL)
+			break;
 	}
 
 	chat->in_notify = FALSE;
 
-	if (ret) {
-		g_slist_free(result.lines);
-		g_free(line);
-
+	if (ret)
 		at_chat_unregister_all(chat, FALSE, node_is_destroyed, NULL);
-	}
 
 	return ret;
 }
@@ -434,7 +612,7 @@ static gboolean at_chat_match_notify(struct at_chat *chat, char *line)
 static void at_chat_finish_command(struct at_chat *p, gboolean ok, char *final)
 {
 	struct at_command *cmd = g_queue_pop_head(p->command_queue);
-	GSList *response_lines;
+	struct at_line_arena response;
 
 	/* Cannot happen, but lets be paranoid */
 	if (cmd == NULL)
@@ -445,23 +623,27 @@ static void at_chat_finish_command(struct at_chat *p, gboolean ok, char *final)
 	if (g_queue_peek_head(p->command_queue))
 		chat_wakeup_writer(p);
 
-	response_lines = p->response_lines;
-	p->response_lines = NULL;
+	/* The callback may re-enter the chat, detach the lines from it */
+	response = p->response;
+	memset(&p->response, 0, sizeof(p->response));
 
 	if (cmd->callback) {
 		GAtResult result;
 
-		response_lines = g_slist_reverse(response_lines);
-
 		result.final_or_pdu = final;
-		result.lines = response_lines;
+		result.lines = line_arena_get_lines(&response);
 
 		cmd->callback(ok, &result, cmd->user_data);
 	}
 
-	g_slist_free_full(response_lines, g_free);
+	/* Reuse the storage for the next response, unless chat went away */
+	if (p->command_queue && p->response.buf == NULL &&
+						p->response.nodes == NULL) {
+		line_arena_reset(&response);
+		p->response = response;
+	} else
+		line_arena_free(&response);
 
-	g_free(final);
 	at_command_destroy(cmd);
 }
 
@@ -551,29 +733,30 @@ out:
 		p->syntax->set_hint(p->syntax, hint);
 
 	if (cmd->listing && (cmd->flags & COMMAND_FLAG_EXPECT_PDU)) {
-		p->pdu_notify = line;
+		p->pdu_notify = g_strdup(line);
 		return TRUE;
 	}
 
 	if (cmd->listing) {
+		GSList lines = { line, NULL };
 		GAtResult result;
 
-		result.lines = g_slist_prepend(NULL, line);
+		result.lines = &lines;
 		result.final_or_pdu = NULL;
 
 		cmd->listing(&result, cmd->user_data);
-
-		g_slist_free(result.lines);
-		g_free(line);
 	} else
-		p->response_lines = g_slist_prepend(p->response_lines, line);
+		line_arena_append(&p->response, line);
 
 	return TRUE;
 }
 
+/*
+ * The line is borrowed from the read buffer (or from line_buf), anything
+ * that needs to outlive this call has to make a copy of it
+ */
 static void have_line(struct at_chat *p, char *str)
 {
-	/* We're not going to copy terminal <CR><LF> */
 	struct at_command *cmd;
 
 	if (str == NULL)
@@ -581,7 +764,7 @@ static void have_line(struct at_chat *p, char *str)
 
 	/* Check for echo, this should not happen, but lets be paranoid */
 	if (!strncmp(str, "AT", 2))
-		goto done;
+		return;
 
 	cmd = g_queue_peek_head(p->command_queue);
 
@@ -601,38 +784,33 @@ static void have_line(struct at_chat *p, char *str)
 			return;
 	}
 
-	if (at_chat_match_notify(p, str) == TRUE)
-		return;
-
-done:
-	/* No matches & no commands active, ignore line */
-	g_free(str);
+	/* No matches & no commands active, the line is ignored */
+	at_chat_match_notify(p, str);
 }
 
 static void have_notify_pdu(struct at_chat *p, char *pdu, GAtResult *result)
 {
-	GHashTableIter iter;
+	struct notify_trie *node = p->notify_trie;
 	struct at_notify *notify;
-	char *prefix;
-	gpointer key, value;
+	const char *c;
 	gboolean called = FALSE;
 
 	p->in_notify = TRUE;
 
-	g_hash_table_iter_init(&iter, p->notify_list);
-
-	while (g_hash_table_iter_next(&iter, &key, &value)) {
-		prefix = key;
-		notify = value;
-
-		if (!g_str_has_prefix(p->pdu_notify, prefix))
-			continue;
+	for (c = p->pdu_notify; node && *c; c++) {
+		node = notify_trie_child(node, *c);
+		if (node == NULL)
+			break;
 
-		if (!notify->pdu)
+		notify = node->notify;
+		if (notify == NULL || !notify->pdu)
 			continue;
 
 		g_slist_foreach(notify->nodes, at_notify_call_callback, result);
 		called = TRUE;
+
+		if (p->notify_trie == NULL)
+			break;
 	}
 
 	p->in_notify = FALSE;
@@ -644,13 +822,14 @@ static void have_notify_pdu(struct at_chat *p, char *pdu, GAtResult *result)
 static void have_pdu(struct at_chat *p, char *pdu)
 {
 	struct at_command *cmd;
+	GSList lines = { p->pdu_notify, NULL };
 	GAtResult result;
 	gboolean listing_pdu = FALSE;
 
 	if (pdu == NULL)
 		goto error;
 
-	result.lines = g_slist_prepend(NULL, p->pdu_notify);
+	result.lines = &lines;
 	result.final_or_pdu = pdu;
 
 	cmd = g_queue_peek_head(p->command_queue);
@@ -672,14 +851,9 @@ static void have_pdu(struct at_chat *p, char *pdu)
 	} else
 		have_notify_pdu(p, pdu, &result);
 
-	g_slist_free(result.lines);
-
 error:
 	g_free(p->pdu_notify);
 	p->pdu_notify = NULL;
-
-	if (pdu)
-		g_free(pdu);
 }
 
 static char *extract_line(struct at_chat *p, struct ring_buffer *rbuf)
@@ -712,17 +886,43 @@ static char *extract_line(struct at_chat *p, struct ring_buffer *rbuf)
 			buf = ring_buffer_read_ptr(rbuf, pos);
 	}
 
-	line = g_try_new(char, line_length + 1);
-	if (line == NULL) {
-		ring_buffer_drain(rbuf, p->read_so_far);
-		return NULL;
-	}
+	/*
+	 * The line is drained right away but stays in place until the read
+	 * handler returns, since the buffer is only written to before it is
+	 * invoked.  If the line and its terminator do not wrap, terminate it
+	 * in place and hand it out as is, otherwise copy it to line_buf.
+	 */
+	if ((unsigned int) (strip_front + line_length) <
+					MIN(wrap, p->read_so_far)) {
+		line = (char *) ring_buffer_read_ptr(rbuf, strip_front);
+	} else {
+		unsigned int first = 0;
 
-	ring_buffer_drain(rbuf, strip_front);
-	ring_buffer_read(rbuf, line, line_length);
-	ring_buffer_drain(rbuf, p->read_so_far - strip_front - line_length);
+		if ((gsize) line_length + 1 > p->line_buf_size) {
+			line = g_try_realloc(p->line_buf, line_length + 1);
+			if (line == NULL) {
+				ring_buffer_drain(rbuf, p->read_so_far);
+				return NULL;
+			}
+
+			p->line_buf = line;
+			p->line_buf_size = line_length + 1;
+		}
+
+		line = p->line_buf;
+
+		if (wrap > (unsigned int) strip_front)
+			first = MIN((unsigned int) line_length,
+						wrap - strip_front);
+
+		memcpy(line, ring_buffer_read_ptr(rbuf, strip_front), first);
+		memcpy(line + first,
+			ring_buffer_read_ptr(rbuf, strip_front + first),
+			line_length - first);
+	}
 
 	line[line_length] = '\0';
+	ring_buffer_drain(rbuf, p->read_so_far);
 
 	return line;
 }
@@ -1065,6 +1265,8 @@ static struct at_notify *at_notify_create(struct at_chat *chat,
 	}
 
 	notify->pdu = pdu;
+	notify->trie = notify_trie_insert(chat->notify_trie, prefix);
+	notify->trie->notify = notify;
 
 	g_hash_table_insert(chat->notify_list, key, notify);
 
@@ -1287,6 +1489,7 @@ static struct at_chat *create_chat(GIOChannel *channel, GIOFlags flags,
 
 	chat->notify_list = g_hash_table_new_full(g_str_hash, g_str_equal,
 						g_free, at_notify_destroy);
+	chat->notify_trie = g_new0(struct notify_trie, 1);
 
 	g_at_io_set_read_handler(chat->io, new_bytes, chat);
 
@@ -1303,6 +1506,7 @@ error:
 	if (chat->notify_list)
 		g_hash_table_destroy(chat->notify_list);
 
+	g_free(chat->notify_trie);
 	g_free(chat);
 	return NULL;
 }
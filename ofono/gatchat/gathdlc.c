@@ -29,9 +29,16 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <glib.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #include "crc-ccitt.h"
 #include "ringbuffer.h"
 #include "gatio.h"
@@ -78,6 +85,9 @@ struct _GAtHDLC {
 	guint suspend_source;
 	GTimer *timer;
 	guint num_plus;
+	gboolean xmit_congested;
+	GAtHDLCWritableFunc writable_func;
+	gpointer writable_data;
 };
 
 static inline void hdlc_record(GAtHDLC *hdlc, gboolean in,
@@ -242,6 +252,97 @@ static gboolean check_escape(GAtHDLC *hdlc, struct ring_buffer *rbuf)
 	return TRUE;
 }
 
+/*
+ * Returns the length of the run at the start of buf which can be copied
+ * into the frame verbatim, i.e. which contains no flag or escape and, if
+ * ctrl is set, no control characters that may have to be dropped.
+ */
+static unsigned int hdlc_clean_run(const unsigned char *buf,
+					unsigned int len, gboolean ctrl)
+{
+	unsigned int pos = 0;
+
+#if defined(__SSE2__)
+	const __m128i flag = _mm_set1_epi8(HDLC_FLAG);
+	const __m128i esc = _mm_set1_epi8(HDLC_ESCAPE);
+	const __m128i max_ctrl = _mm_set1_epi8(HDLC_TRANS - 1);
+
+	while (pos + 16 <= len) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (buf + pos));
+		__m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, flag),
+						_mm_cmpeq_epi8(v, esc));
+		int mask;
+
+		if (ctrl)
+			m = _mm_or_si128(m, _mm_cmpeq_epi8(
+						_mm_min_epu8(v, max_ctrl), v));
+
+		mask = _mm_movemask_epi8(m);
+		if (mask)
+			return pos + __builtin_ctz(mask);
+
+		pos += 16;
+	}
+#elif defined(__ARM_NEON)
+	const uint8x16_t flag = vdupq_n_u8(HDLC_FLAG);
+	const uint8x16_t esc = vdupq_n_u8(HDLC_ESCAPE);
+	const uint8x16_t trans = vdupq_n_u8(HDLC_TRANS);
+
+	while (pos + 16 <= len) {
+		uint8x16_t v = vld1q_u8(buf + pos);
+		uint8x16_t m = vorrq_u8(vceqq_u8(v, flag), vceqq_u8(v, esc));
+		uint64x2_t m64;
+
+		if (ctrl)
+			m = vorrq_u8(m, vcltq_u8(v, trans));
+
+		m64 = vreinterpretq_u64_u8(m);
+
+		/* The exact position is found by the byte loop below */
+		if (vgetq_lane_u64(m64, 0) | vgetq_lane_u64(m64, 1))
+			break;
+
+		pos += 16;
+	}
+#else
+	const guint64 ones = 0x0101010101010101ULL;
+	const guint64 highs = 0x8080808080808080ULL;
+
+	while (pos + 8 <= len) {
+		guint64 w, f, e, hit;
+
+		memcpy(&w, buf + pos, sizeof(w));
+
+		f = w ^ (ones * HDLC_FLAG);
+		e = w ^ (ones * HDLC_ESCAPE);
+
+		/* Non-zero if any byte of f or e is zero */
+		hit = ((f - ones) & ~f) | ((e - ones) & ~e);
+
+		/* Non-zero if any byte of w is below 0x20 */
+		if (ctrl)
+			hit |= (w - ones * HDLC_TRANS) & ~w;
+
+		if (hit & highs)
+			break;
+
+		pos += 8;
+	}
+#endif
+
+	while (pos < len) {
+		unsigned char c = buf[pos];
+
+		if (c == HDLC_FLAG || c == HDLC_ESCAPE ||
+				(ctrl && c < HDLC_TRANS))
+			break;
+
+		pos++;
+	}
+
+	return pos;
+}
+
 static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 {
 	GAtHDLC *hdlc = user_data;
@@ -282,6 +383,45 @@ static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 				hdlc->decode_offset == 0 && *buf == '\r')
 			break;
 
+		/* Oversized frame, must be garbage.  Drop what we've got */
+		if (hdlc->decode_offset == BUFFER_SIZE) {
+			hdlc->decode_fcs = HDLC_INITFCS;
+			hdlc->decode_offset = 0;
+		}
+
+		/*
+		 * Fast path: copy and checksum the bytes up to the next flag,
+		 * escape or control character in one go.  The byte by byte
+		 * processing below only deals with the special characters.
+		 */
+		if (hdlc->decode_escape == FALSE) {
+			unsigned int end = pos < wrap ? wrap : len;
+			unsigned int run;
+
+			run = hdlc_clean_run(buf, MIN(end - pos,
+					BUFFER_SIZE - hdlc->decode_offset),
+					hdlc->recv_accm != 0);
+
+			if (run > 0) {
+				memcpy(hdlc->decode_buffer + hdlc->decode_offset,
+								buf, run);
+				hdlc->decode_fcs = crc_ccitt(hdlc->decode_fcs,
+								buf, run);
+				hdlc->decode_offset += run;
+
+				buf += run;
+				pos += run;
+
+				if (pos == wrap) {
+					buf = ring_buffer_read_ptr(rbuf, pos);
+					hdlc_record(hdlc, TRUE, buf,
+							len - wrap);
+				}
+
+				continue;
+			}
+		}
+
 		if (hdlc->decode_escape == TRUE) {
 			unsigned char val = *buf ^ HDLC_TRANS;
 
@@ -495,9 +635,19 @@ static gboolean can_write_data(gpointer data)
 			(g_queue_get_length(hdlc->write_queue) > 1)) {
 		write_buffer = g_queue_pop_head(hdlc->write_queue);
 		ring_buffer_free(write_buffer);
-		write_buffer = g_queue_peek_head(hdlc->write_queue);
 	}
 
+	/* Let the sender refill the queue once it has drained enough */
+	if (hdlc->xmit_congested && g_queue_get_length(hdlc->write_queue) <=
+							MAX_BUFFERS / 2) {
+		hdlc->xmit_congested = FALSE;
+
+		if (hdlc->writable_func)
+			hdlc->writable_func(hdlc->writable_data);
+	}
+
+	write_buffer = g_queue_peek_head(hdlc->write_queue);
+
 	if (ring_buffer_len(write_buffer) > 0)
 		return TRUE;
 
@@ -530,116 +680,185 @@ GAtIO *g_at_hdlc_get_io(GAtHDLC *hdlc)
 
 #define NEED_ESCAPE(xmit_accm, c) xmit_accm[c >> 5] & (1 << (c & 0x1f))
 
-gboolean g_at_hdlc_send(GAtHDLC *hdlc, const unsigned char *data, gsize size)
+/*
+ * Copies data into the free space of the write buffer at offset *pos,
+ * taking care of the wrap around.  Fails if there's not enough space.
+ */
+static gboolean hdlc_put(struct ring_buffer *write_buffer, unsigned int *pos,
+				const unsigned char *data, unsigned int len)
 {
-	struct ring_buffer* write_buffer = g_queue_peek_tail(hdlc->write_queue);
-
-	unsigned int avail = ring_buffer_avail(write_buffer);
 	unsigned int wrap = ring_buffer_avail_no_wrap(write_buffer);
-	unsigned char *buf;
-	unsigned char tail[2];
-	unsigned int i = 0;
-	guint16 fcs = HDLC_INITFCS;
-	gboolean escape = FALSE;
-	gsize pos = 0;
-
-	if (avail < size + HDLC_OVERHEAD) {
-		if (g_queue_get_length(hdlc->write_queue) > MAX_BUFFERS)
-			return FALSE;	/* Too many pending buffers */
-
-		write_buffer = ring_buffer_new(BUFFER_SIZE);
-		if (write_buffer == NULL)
-			return FALSE;
+	unsigned int n;
 
-		g_queue_push_tail(hdlc->write_queue, write_buffer);
+	if (*pos + len > (unsigned int) ring_buffer_avail(write_buffer))
+		return FALSE;
 
-		avail = ring_buffer_avail(write_buffer);
-		wrap = ring_buffer_avail_no_wrap(write_buffer);
+	if (*pos < wrap) {
+		n = MIN(len, wrap - *pos);
+		memcpy(ring_buffer_write_ptr(write_buffer, *pos), data, n);
+		*pos += n;
+		data += n;
+		len -= n;
 	}
 
-	i = 0;
-	buf = ring_buffer_write_ptr(write_buffer, 0);
+	if (len > 0) {
+		memcpy(ring_buffer_write_ptr(write_buffer, *pos), data, len);
+		*pos += len;
+	}
 
-	if (hdlc->start_frame_marker == TRUE) {
-		/* Protocol requires 0x7e as start marker */
-		if (pos + 1 > avail)
-			return FALSE;
+	return TRUE;
+}
 
-		*buf++ = HDLC_FLAG;
-		pos++;
+/*
+ * Escapes data into the write buffer, updating the FCS.  Runs of bytes
+ * which need no escaping are copied and checksummed in one go.
+ */
+static gboolean hdlc_escape(GAtHDLC *hdlc, struct ring_buffer *write_buffer,
+				unsigned int *pos, const unsigned char *data,
+				unsigned int size, guint16 *fcs)
+{
+	gboolean ctrl = hdlc->xmit_accm[0] != 0;
+	unsigned char esc[2];
+	unsigned int run;
 
-		if (pos == wrap)
-			buf = ring_buffer_write_ptr(write_buffer, pos);
-	} else if (hdlc->wakeup_sent == FALSE) {
-		/* Write an initial 0x7e as wakeup character */
-		*buf++ = HDLC_FLAG;
-		pos++;
+	while (size > 0) {
+		run = hdlc_clean_run(data, size, ctrl);
 
-		hdlc->wakeup_sent = TRUE;
-	}
+		if (run > 0) {
+			if (!hdlc_put(write_buffer, pos, data, run))
+				return FALSE;
 
-	while (pos < avail && i < size) {
-		if (escape == TRUE) {
-			fcs = HDLC_FCS(fcs, data[i]);
-			*buf = data[i++] ^ HDLC_TRANS;
-			escape = FALSE;
-		} else if (NEED_ESCAPE(hdlc->xmit_accm, data[i])) {
-			*buf = HDLC_ESCAPE;
-			escape = TRUE;
-		} else {
-			fcs = HDLC_FCS(fcs, data[i]);
-			*buf = data[i++];
+			*fcs = crc_ccitt(*fcs, data, run);
+			data += run;
+			size -= run;
+			continue;
 		}
 
-		buf++;
-		pos++;
+		if (NEED_ESCAPE(hdlc->xmit_accm, *data)) {
+			esc[0] = HDLC_ESCAPE;
+			esc[1] = *data ^ HDLC_TRANS;
 
-		if (pos == wrap)
-			buf = ring_buffer_write_ptr(write_buffer, pos);
+			if (!hdlc_put(write_buffer, pos, esc, 2))
+				return FALSE;
+		} else if (!hdlc_put(write_buffer, pos, data, 1))
+			return FALSE;
+
+		*fcs = HDLC_FCS(*fcs, *data);
+		data++;
+		size--;
 	}
 
-	if (i < size)
+	return TRUE;
+}
+
+static gboolean hdlc_encode(GAtHDLC *hdlc, struct ring_buffer *write_buffer,
+				const unsigned char *data, gsize size)
+{
+	static const unsigned char flag = HDLC_FLAG;
+	unsigned int pos = 0;
+	guint16 fcs = HDLC_INITFCS;
+	guint16 unused;
+	unsigned char tail[2];
+
+	/*
+	 * Protocol requires 0x7e as start marker, otherwise write an
+	 * initial 0x7e as wakeup character
+	 */
+	if (hdlc->start_frame_marker == TRUE || hdlc->wakeup_sent == FALSE)
+		if (!hdlc_put(write_buffer, &pos, &flag, 1))
+			return FALSE;
+
+	if (!hdlc_escape(hdlc, write_buffer, &pos, data, size, &fcs))
 		return FALSE;
 
 	fcs ^= HDLC_INITFCS;
 	tail[0] = fcs & 0xff;
 	tail[1] = fcs >> 8;
 
-	i = 0;
-
-	while (pos < avail && i < sizeof(tail)) {
-		if (escape == TRUE) {
-			*buf = tail[i++] ^ HDLC_TRANS;
-			escape = FALSE;
-		} else if (NEED_ESCAPE(hdlc->xmit_accm, tail[i])) {
-			*buf = HDLC_ESCAPE;
-			escape = TRUE;
-		} else {
-			*buf = tail[i++];
-		}
+	if (!hdlc_escape(hdlc, write_buffer, &pos, tail, 2, &unused))
+		return FALSE;
 
-		buf++;
-		pos++;
+	/* Add 0x7e as end marker */
+	if (!hdlc_put(write_buffer, &pos, &flag, 1))
+		return FALSE;
 
-		if (pos == wrap)
-			buf = ring_buffer_write_ptr(write_buffer, pos);
-	}
+	ring_buffer_write_advance(write_buffer, pos);
+	hdlc->wakeup_sent = TRUE;
+
+	return TRUE;
+}
+
+static gboolean hdlc_queue_frame(GAtHDLC *hdlc, const unsigned char *data,
+								gsize size)
+{
+	struct ring_buffer* write_buffer = g_queue_peek_tail(hdlc->write_queue);
 
-	if (i < sizeof(tail))
+	if ((gsize) ring_buffer_avail(write_buffer) >= size + HDLC_OVERHEAD &&
+			hdlc_encode(hdlc, write_buffer, data, size))
+		return TRUE;
+
+	if (g_queue_get_length(hdlc->write_queue) > MAX_BUFFERS) {
+		/* Too many pending buffers, wait for the queue to drain */
+		hdlc->xmit_congested = TRUE;
 		return FALSE;
+	}
 
-	if (pos + 1 > avail)
+	/* Big enough for the frame even if every byte gets escaped */
+	write_buffer = ring_buffer_new(MAX(BUFFER_SIZE,
+						2 * size + HDLC_OVERHEAD));
+	if (write_buffer == NULL)
 		return FALSE;
 
-	/* Add 0x7e as end marker */
-	*buf = HDLC_FLAG;
-	pos++;
+	g_queue_push_tail(hdlc->write_queue, write_buffer);
 
-	ring_buffer_write_advance(write_buffer, pos);
+	return hdlc_encode(hdlc, write_buffer, data, size);
+}
+
+gboolean g_at_hdlc_send(GAtHDLC *hdlc, const unsigned char *data, gsize size)
+{
+	struct iovec frame;
 
-	g_at_io_set_write_handler(hdlc->io, can_write_data, hdlc);
+	frame.iov_base = (void *) data;
+	frame.iov_len = size;
 
-	return TRUE;
+	return g_at_hdlc_send_batch(hdlc, &frame, 1) == 1;
+}
+
+int g_at_hdlc_send_batch(GAtHDLC *hdlc, const struct iovec *frames,
+								int count)
+{
+	int i;
+
+	if (hdlc == NULL)
+		return 0;
+
+	for (i = 0; i < count; i++)
+		if (!hdlc_queue_frame(hdlc, frames[i].iov_base,
+						frames[i].iov_len))
+			break;
+
+	if (i > 0)
+		g_at_io_set_write_handler(hdlc->io, can_write_data, hdlc);
+
+	return i;
+}
+
+gboolean g_at_hdlc_is_congested(GAtHDLC *hdlc)
+{
+	if (hdlc == NULL)
+		return FALSE;
+
+	return hdlc->xmit_congested;
+}
+
+void g_at_hdlc_set_writable_function(GAtHDLC *hdlc, GAtHDLCWritableFunc func,
+							gpointer user_data)
+{
+	if (hdlc == NULL)
+		return;
+
+	hdlc->writable_func = func;
+	hdlc->writable_data = user_data;
 }
 
 void g_at_hdlc_set_start_frame_marker(GAtHDLC *hdlc, gboolean marker)
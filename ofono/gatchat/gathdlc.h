@@ -22,6 +22,8 @@
 #ifndef __G_AT_HDLC_H
 #define __G_AT_HDLC_H
 
+#include <sys/uio.h>
+
 #include "gat.h"
 #include "gatio.h"
 
@@ -33,6 +35,8 @@ struct _GAtHDLC;
 
 typedef struct _GAtHDLC GAtHDLC;
 
+typedef void (*GAtHDLCWritableFunc)(gpointer user_data);
+
 GAtHDLC *g_at_hdlc_new(GIOChannel *channel);
 GAtHDLC *g_at_hdlc_new_from_io(GAtIO *io);
 
@@ -51,6 +55,22 @@ void g_at_hdlc_set_receive(GAtHDLC *hdlc, GAtReceiveFunc func,
 							gpointer user_data);
 gboolean g_at_hdlc_send(GAtHDLC *hdlc, const unsigned char *data, gsize size);
 
+/*!
+ * Queues one frame per iovec, returns the number of frames queued.
+ * Stops at the first frame that doesn't fit, which happens when the
+ * transmit queue is congested (see g_at_hdlc_set_writable_function)
+ */
+int g_at_hdlc_send_batch(GAtHDLC *hdlc, const struct iovec *frames,
+								int count);
+gboolean g_at_hdlc_is_congested(GAtHDLC *hdlc);
+
+/*!
+ * The function is invoked once the transmit queue has drained after a
+ * send has been refused because of congestion
+ */
+void g_at_hdlc_set_writable_function(GAtHDLC *hdlc, GAtHDLCWritableFunc func,
+							gpointer user_data);
+
 void g_at_hdlc_set_recording(GAtHDLC *hdlc, const char *filename);
 
 GAtIO *g_at_hdlc_get_io(GAtHDLC *hdlc);
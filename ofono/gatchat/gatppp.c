@@ -42,9 +42,6 @@
 
 #define DEFAULT_MTU	1500
 
-#define PPP_ADDR_FIELD	0xff
-#define PPP_CTRL	0x03
-
 #define GUARD_TIMEOUTS 1500
 
 enum ppp_phase {
@@ -291,67 +288,91 @@ static void ppp_send_lcp_frame(GAtPPP *ppp, guint8 *packet, guint infolen)
 		g_at_hdlc_set_xmit_accm(ppp->hdlc, xmit_accm);
 }
 
-static void ppp_send_acfc_frame(GAtPPP *ppp, guint8 *packet,
-					guint infolen)
+/*
+ * Returns the offset of the frame within the packet once the address,
+ * control and protocol fields have been compressed as negotiated
+ */
+static guint ppp_frame_offset(GAtPPP *ppp, guint8 *packet)
 {
-	struct ppp_header *header = (struct ppp_header *) packet;
-	guint offset = 0;
+	guint16 proto = ppp_proto(packet);
+
+	/*
+	 * If the upper 8 bits of the protocol are 0, then send
+	 * with PFC if enabled
+	 */
+	if ((proto & 0xff00) != 0 || ppp->xmit_pfc == FALSE) {
+		/* We remove the only address and control field */
+		if (ppp->xmit_acfc)
+			return 2;
+
+		return 0;
+	}
 
 	if (ppp->xmit_acfc)
-		offset = 2;
+		return 3;
 
-	/* We remove the only address and control field */
-	if (g_at_hdlc_send(ppp->hdlc, packet + offset,
-				infolen + sizeof(*header) - offset)
-			== FALSE)
-		DBG(ppp, "Failed to send a frame\n");
+	/* Shuffle AC bytes in place of the first protocol byte */
+	packet[2] = packet[1];
+	packet[1] = packet[0];
+
+	return 1;
 }
 
-static void ppp_send_acfc_pfc_frame(GAtPPP *ppp, guint8 *packet,
-					guint infolen)
+/*
+ * transmit out through the lower layer interface
+ *
+ * infolen - length of the information part of the packet
+ */
+void ppp_transmit(GAtPPP *ppp, guint8 *packet, guint infolen)
 {
-	struct ppp_header *header = (struct ppp_header *) packet;
-	guint offset = 0;
+	guint offset;
 
-	if (ppp->xmit_acfc && ppp->xmit_pfc)
-		offset = 3;
-	else if (ppp->xmit_acfc)
-		offset = 2;
-	else if (ppp->xmit_pfc) {
-		/* Shuffle AC bytes in place of the first protocol byte */
-		packet[2] = packet[1];
-		packet[1] = packet[0];
-		offset = 1;
+	if (ppp_proto(packet) == LCP_PROTOCOL) {
+		ppp_send_lcp_frame(ppp, packet, infolen);
+		return;
 	}
 
+	offset = ppp_frame_offset(ppp, packet);
+
 	if (g_at_hdlc_send(ppp->hdlc, packet + offset,
-				infolen + sizeof(*header) - offset)
+				infolen + sizeof(struct ppp_header) - offset)
 			== FALSE)
 		DBG(ppp, "Failed to send a frame\n");
 }
 
 /*
- * transmit out through the lower layer interface
- *
- * infolen - length of the information part of the packet
+ * Transmits a batch of non-LCP packets, returns the number of packets
+ * accepted by the lower layer.  The headers of the packets which were
+ * not accepted may have been modified and must be reset before they
+ * are passed in again.
  */
-void ppp_transmit(GAtPPP *ppp, guint8 *packet, guint infolen)
+int ppp_transmit_batch(GAtPPP *ppp, guint8 **packets, const gsize *infolen,
+								int count)
 {
-	guint16 proto = ppp_proto(packet);
+	struct iovec frames[PPP_MAX_BATCH];
+	int sent = 0;
+	int n, i;
 
-	if (proto == LCP_PROTOCOL) {
-		ppp_send_lcp_frame(ppp, packet, infolen);
-		return;
+	while (sent < count) {
+		n = MIN(count - sent, PPP_MAX_BATCH);
+
+		for (i = 0; i < n; i++) {
+			guint8 *packet = packets[sent + i];
+			guint offset = ppp_frame_offset(ppp, packet);
+
+			frames[i].iov_base = packet + offset;
+			frames[i].iov_len = infolen[sent + i] +
+					sizeof(struct ppp_header) - offset;
+		}
+
+		i = g_at_hdlc_send_batch(ppp->hdlc, frames, n);
+		sent += i;
+
+		if (i < n)
+			break;
 	}
 
-	/*
-	 * If the upper 8 bits of the protocol are 0, then send
-	 * with PFC if enabled
-	 */
-	if ((proto & 0xff00) == 0)
-		ppp_send_acfc_pfc_frame(ppp, packet, infolen);
-	else
-		ppp_send_acfc_frame(ppp, packet, infolen);
+	return sent;
 }
 
 static inline void ppp_enter_phase(GAtPPP *ppp, enum ppp_phase phase)
@@ -530,6 +551,14 @@ static void io_disconnect(gpointer user_data)
 	pppcp_signal_close(ppp->lcp);
 }
 
+static void ppp_xmit_ready(gpointer user_data)
+{
+	GAtPPP *ppp = user_data;
+
+	if (ppp->net)
+		ppp_net_xmit_ready(ppp->net);
+}
+
 static void ppp_proxy_suspend_net_interface(gpointer user_data)
 {
 	GAtPPP *ppp = user_data;
@@ -551,6 +580,7 @@ gboolean g_at_ppp_listen(GAtPPP *ppp, GAtIO *io)
 	g_at_hdlc_set_receive(ppp->hdlc, ppp_receive, ppp);
 	g_at_hdlc_set_suspend_function(ppp->hdlc,
 					ppp_proxy_suspend_net_interface, ppp);
+	g_at_hdlc_set_writable_function(ppp->hdlc, ppp_xmit_ready, ppp);
 	g_at_io_set_disconnect_function(io, io_disconnect, ppp);
 
 	ppp_enter_phase(ppp, PPP_PHASE_ESTABLISHMENT);
@@ -569,6 +599,7 @@ gboolean g_at_ppp_open(GAtPPP *ppp, GAtIO *io)
 	g_at_hdlc_set_receive(ppp->hdlc, ppp_receive, ppp);
 	g_at_hdlc_set_suspend_function(ppp->hdlc,
 					ppp_proxy_suspend_net_interface, ppp);
+	g_at_hdlc_set_writable_function(ppp->hdlc, ppp_xmit_ready, ppp);
 	g_at_hdlc_set_no_carrier_detect(ppp->hdlc, TRUE);
 	g_at_io_set_disconnect_function(io, io_disconnect, ppp);
 
@@ -197,7 +197,7 @@ static void lcp_rcn_nak(struct pppcp_data *pppcp,
 		{
 			guint16 mru = get_host_short(data);
 
-			if (mru < 2048) {
+			if (mru <= PPP_MAX_MRU) {
 				lcp->mru = get_host_short(data);
 				lcp->req_options |= REQ_OPTION_MRU;
 			}
@@ -24,6 +24,7 @@
 #endif
 
 #include <stdio.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
@@ -38,23 +39,61 @@
 #include "gatppp.h"
 #include "ppp.h"
 
-#define MAX_PACKET 1500
+#define DEFAULT_PACKET 1500
 
 struct ppp_net {
 	GAtPPP *ppp;
 	char *if_name;
 	GIOChannel *channel;
+	int fd;
 	guint watch;
 	gint mtu;
-	struct ppp_header *ppp_packet;
+	gsize packet_size;	/* Room for information in each packet */
+	gboolean suspended;
+	struct ppp_header *ppp_packet[PPP_MAX_BATCH];
+	gsize packet_len[PPP_MAX_BATCH];
+	int pending_start;	/* First packet not yet taken by HDLC */
+	int pending_count;	/* Number of packets read in the batch */
 };
 
+static gboolean ppp_net_alloc_packets(struct ppp_net *net, gsize size)
+{
+	int i;
+
+	for (i = 0; i < PPP_MAX_BATCH; i++) {
+		struct ppp_header *packet;
+
+		if (net->ppp_packet[i] == NULL) {
+			packet = ppp_packet_new(size, PPP_IP_PROTO);
+		} else {
+			/* Pending packets keep their contents */
+			packet = g_try_realloc(net->ppp_packet[i],
+						size + sizeof(*packet));
+		}
+
+		if (packet == NULL)
+			return FALSE;
+
+		net->ppp_packet[i] = packet;
+	}
+
+	net->packet_size = size;
+
+	return TRUE;
+}
+
 gboolean ppp_net_set_mtu(struct ppp_net *net, guint16 mtu)
 {
 	struct ifreq ifr;
 	int sk, err;
 
-	if (net == NULL || mtu > MAX_PACKET)
+	if (net == NULL)
+		return FALSE;
+
+	/* Sending less than the peer's MRU is always fine */
+	mtu = MIN(mtu, PPP_MAX_MRU);
+
+	if (mtu > net->packet_size && !ppp_net_alloc_packets(net, mtu))
 		return FALSE;
 
 	net->mtu = mtu;
@@ -80,50 +119,132 @@ gboolean ppp_net_set_mtu(struct ppp_net *net, guint16 mtu)
 void ppp_net_process_packet(struct ppp_net *net, const guint8 *packet,
 				gsize plen)
 {
-	GIOStatus status;
-	gsize bytes_written;
 	guint16 len;
+	ssize_t err;
 
 	if (plen < 4)
 		return;
 
 	/* find the length of the packet to transmit */
 	len = get_host_short(&packet[2]);
-	status = g_io_channel_write_chars(net->channel, (gchar *) packet,
-						MIN(len, plen),
-						&bytes_written, NULL);
 
-	if (status != G_IO_STATUS_NORMAL)
-		return;
+	/*
+	 * Every write is one packet for tun.  If its queue is full the
+	 * packet gets dropped, same as the kernel would do.
+	 */
+	do {
+		err = write(net->fd, packet, MIN(len, plen));
+	} while (err < 0 && errno == EINTR);
+}
+
+static gboolean ppp_net_callback(GIOChannel *channel, GIOCondition cond,
+				gpointer userdata);
+
+static void ppp_net_add_watch(struct ppp_net *net)
+{
+	net->watch = g_io_add_watch(net->channel,
+			G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+			ppp_net_callback, net);
+}
+
+/*
+ * Hands the pending packets over to the HDLC layer.  Returns FALSE if
+ * the transmit queue is congested and some packets remain pending.
+ */
+static gboolean ppp_net_flush(struct ppp_net *net)
+{
+	int i;
+	int sent;
+
+	for (i = net->pending_start; i < net->pending_count; i++) {
+		/* Headers may have been compressed by a refused attempt */
+		net->ppp_packet[i]->address = PPP_ADDR_FIELD;
+		net->ppp_packet[i]->control = PPP_CTRL;
+		net->ppp_packet[i]->proto = htons(PPP_IP_PROTO);
+	}
+
+	sent = ppp_transmit_batch(net->ppp,
+				(guint8 **) net->ppp_packet + net->pending_start,
+				net->packet_len + net->pending_start,
+				net->pending_count - net->pending_start);
+
+	net->pending_start += sent;
+
+	if (net->pending_start < net->pending_count)
+		return FALSE;
+
+	net->pending_start = 0;
+	net->pending_count = 0;
+
+	return TRUE;
 }
 
 /*
  * packets received by the tun interface need to be written to
- * the modem.  So, just read a packet, write out to the modem
+ * the modem.  So, read as many packets as are available, up to
+ * a batch, and write them out to the modem in one go
  */
 static gboolean ppp_net_callback(GIOChannel *channel, GIOCondition cond,
 				gpointer userdata)
 {
 	struct ppp_net *net = (struct ppp_net *) userdata;
-	GIOStatus status;
-	gsize bytes_read;
-	gchar *buf = (gchar *) net->ppp_packet->info;
+	int fd = g_io_channel_unix_get_fd(channel);
+	gboolean ok = TRUE;
+	ssize_t bytes_read;
 
 	if (cond & (G_IO_NVAL | G_IO_ERR | G_IO_HUP))
-		return FALSE;
+		goto remove;
+
+	if (!(cond & G_IO_IN))
+		return TRUE;
+
+	while (net->pending_count < PPP_MAX_BATCH) {
+		struct ppp_header *packet = net->ppp_packet[net->pending_count];
 
-	if (cond & G_IO_IN) {
 		/* leave space to add PPP protocol field */
-		status = g_io_channel_read_chars(channel, buf, net->mtu,
-							&bytes_read, NULL);
-		if (bytes_read > 0)
-			ppp_transmit(net->ppp, (guint8 *) net->ppp_packet,
-					bytes_read);
+		bytes_read = read(fd, packet->info, net->packet_size);
 
-		if (status != G_IO_STATUS_NORMAL && status != G_IO_STATUS_AGAIN)
-			return FALSE;
+		if (bytes_read > 0) {
+			net->packet_len[net->pending_count++] = bytes_read;
+			continue;
+		}
+
+		if (bytes_read < 0 && errno == EINTR)
+			continue;
+
+		if (bytes_read == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+			ok = FALSE;
+
+		break;
 	}
-	return TRUE;
+
+	if (!ppp_net_flush(net)) {
+		/* Wait for ppp_net_xmit_ready before reading any further */
+		goto remove;
+	}
+
+	if (ok)
+		return TRUE;
+
+remove:
+	net->watch = 0;
+	return FALSE;
+}
+
+/*
+ * Called once the HDLC transmit queue has drained after refusing some
+ * of our packets
+ */
+void ppp_net_xmit_ready(struct ppp_net *net)
+{
+	if (net == NULL || net->channel == NULL)
+		return;
+
+	if (!ppp_net_flush(net))
+		return;
+
+	if (!net->suspended && net->watch == 0)
+		ppp_net_add_watch(net);
 }
 
 const char *ppp_net_get_interface(struct ppp_net *net)
@@ -137,13 +258,13 @@ struct ppp_net *ppp_net_new(GAtPPP *ppp, int fd)
 	GIOChannel *channel = NULL;
 	struct ifreq ifr;
 	int err;
+	int i;
 
 	net = g_try_new0(struct ppp_net, 1);
 	if (net == NULL)
 		goto badalloc;
 
-	net->ppp_packet = ppp_packet_new(MAX_PACKET, PPP_IP_PROTO);
-	if (net->ppp_packet == NULL)
+	if (!ppp_net_alloc_packets(net, DEFAULT_PACKET))
 		goto error;
 
 	/*
@@ -165,7 +286,22 @@ struct ppp_net *ppp_net_new(GAtPPP *ppp, int fd)
 		ifr.ifr_flags = IFF_TUN | IFF_NO_PI;
 		strcpy(ifr.ifr_name, "ppp%d");
 
+#ifdef IFF_MULTI_QUEUE
+		/*
+		 * Multiqueue devices skip the per-device tx lock and let
+		 * the queue be reattached without tearing the link down.
+		 * Older kernels don't know about it.
+		 */
+		ifr.ifr_flags |= IFF_MULTI_QUEUE;
+
+		err = ioctl(fd, TUNSETIFF, (void *) &ifr);
+		if (err < 0 && errno == EINVAL) {
+			ifr.ifr_flags &= ~IFF_MULTI_QUEUE;
+			err = ioctl(fd, TUNSETIFF, (void *) &ifr);
+		}
+#else
 		err = ioctl(fd, TUNSETIFF, (void *) &ifr);
+#endif
 		if (err < 0)
 			goto error;
 	} else {
@@ -181,18 +317,17 @@ struct ppp_net *ppp_net_new(GAtPPP *ppp, int fd)
 	if (channel == NULL)
 		goto error;
 
-	if (!g_at_util_setup_io(channel, 0))
+	if (!g_at_util_setup_io(channel, G_IO_FLAG_NONBLOCK))
 		goto error;
 
 	g_io_channel_set_buffered(channel, FALSE);
 
 	net->channel = channel;
-	net->watch = g_io_add_watch(channel,
-			G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
-			ppp_net_callback, net);
+	net->fd = fd;
 	net->ppp = ppp;
+	ppp_net_add_watch(net);
 
-	net->mtu = MAX_PACKET;
+	net->mtu = DEFAULT_PACKET;
 	return net;
 
 error:
@@ -200,7 +335,10 @@ error:
 		g_io_channel_unref(channel);
 
 	g_free(net->if_name);
-	g_free(net->ppp_packet);
+
+	for (i = 0; i < PPP_MAX_BATCH; i++)
+		g_free(net->ppp_packet[i]);
+
 	g_free(net);
 
 badalloc:
@@ -212,6 +350,8 @@ badalloc:
 
 void ppp_net_free(struct ppp_net *net)
 {
+	int i;
+
 	if (net->watch) {
 		g_source_remove(net->watch);
 		net->watch = 0;
@@ -219,7 +359,9 @@ void ppp_net_free(struct ppp_net *net)
 
 	g_io_channel_unref(net->channel);
 
-	g_free(net->ppp_packet);
+	for (i = 0; i < PPP_MAX_BATCH; i++)
+		g_free(net->ppp_packet[i]);
+
 	g_free(net->if_name);
 	g_free(net);
 }
@@ -229,6 +371,8 @@ void ppp_net_suspend_interface(struct ppp_net *net)
 	if (net == NULL || net->channel == NULL)
 		return;
 
+	net->suspended = TRUE;
+
 	if (net->watch == 0)
 		return;
 
@@ -241,7 +385,9 @@ void ppp_net_resume_interface(struct ppp_net *net)
 	if (net == NULL || net->channel == NULL)
 		return;
 
-	net->watch = g_io_add_watch(net->channel,
-			G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
-			ppp_net_callback, net);
+	net->suspended = FALSE;
+
+	/* Pending packets restart reading once they have been sent */
+	if (net->watch == 0 && net->pending_count == 0)
+		ppp_net_add_watch(net);
 }
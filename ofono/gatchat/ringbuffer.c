@@ -19,11 +19,15 @@
  *
  */
 
+#define _GNU_SOURCE
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
 
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 
 #include <glib.h>
 
@@ -31,12 +35,17 @@
 
 #define MAX_SIZE 262144
 
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
 struct ring_buffer {
 	unsigned char *buffer;
 	unsigned int size;
 	unsigned int mask;
 	unsigned int in;
 	unsigned int out;
+	gboolean mirrored;
 };
 
 struct ring_buffer *ring_buffer_new(unsigned int size)
@@ -65,10 +74,89 @@ struct ring_buffer *ring_buffer_new(unsigned int size)
 	buffer->mask = real_size - 1;
 	buffer->in = 0;
 	buffer->out = 0;
+	buffer->mirrored = FALSE;
+
+	return buffer;
+}
+
+/*
+ * Maps the same memfd pages twice, back to back, so that the region
+ * starting at any offset below size stays contiguous for size bytes.
+ */
+static unsigned char *mirror_alloc(unsigned int size)
+{
+#ifdef __NR_memfd_create
+	long page = sysconf(_SC_PAGESIZE);
+	unsigned char *base;
+	int fd;
+
+	if (page <= 0 || size % page)
+		return NULL;
+
+	fd = syscall(__NR_memfd_create, "ringbuffer", MFD_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	if (ftruncate(fd, size) < 0)
+		goto error;
+
+	base = mmap(NULL, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS,
+			-1, 0);
+	if (base == MAP_FAILED)
+		goto error;
+
+	if (mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+			fd, 0) == MAP_FAILED)
+		goto unmap;
+
+	if (mmap(base + size, size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+		goto unmap;
+
+	close(fd);
+
+	return base;
+
+unmap:
+	munmap(base, 2 * size);
+error:
+	close(fd);
+#endif
+	return NULL;
+}
+
+struct ring_buffer *ring_buffer_new_mirrored(unsigned int size)
+{
+	unsigned int real_size = 1;
+	struct ring_buffer *buffer;
+	unsigned char *mirror;
+
+	while (real_size < size && real_size < MAX_SIZE)
+		real_size = real_size << 1;
+
+	mirror = mirror_alloc(real_size);
+	if (mirror == NULL)
+		return ring_buffer_new(size);
+
+	buffer = g_slice_new(struct ring_buffer);
+	buffer->buffer = mirror;
+	buffer->size = real_size;
+	buffer->mask = real_size - 1;
+	buffer->in = 0;
+	buffer->out = 0;
+	buffer->mirrored = TRUE;
 
 	return buffer;
 }
 
+gboolean ring_buffer_is_mirrored(struct ring_buffer *buf)
+{
+	if (buf == NULL)
+		return FALSE;
+
+	return buf->mirrored;
+}
+
 int ring_buffer_write(struct ring_buffer *buf, const void *data,
 			unsigned int len)
 {
@@ -103,9 +191,35 @@ int ring_buffer_avail_no_wrap(struct ring_buffer *buf)
 	unsigned int offset = buf->in & buf->mask;
 	unsigned int len = buf->size - buf->in + buf->out;
 
+	if (buf->mirrored)
+		return len;
+
 	return MIN(len, buf->size - offset);
 }
 
+int ring_buffer_write_iov(struct ring_buffer *buf, struct iovec iov[2])
+{
+	unsigned int offset = buf->in & buf->mask;
+	unsigned int len = buf->size - buf->in + buf->out;
+	unsigned int end;
+
+	if (len == 0)
+		return 0;
+
+	iov[0].iov_base = buf->buffer + offset;
+
+	end = buf->mirrored ? len : MIN(len, buf->size - offset);
+	iov[0].iov_len = end;
+
+	if (end == len)
+		return 1;
+
+	iov[1].iov_base = buf->buffer;
+	iov[1].iov_len = len - end;
+
+	return 2;
+}
+
 int ring_buffer_write_advance(struct ring_buffer *buf, unsigned int len)
 {
 	len = MIN(len, buf->size - buf->in + buf->out);
@@ -155,9 +269,35 @@ int ring_buffer_len_no_wrap(struct ring_buffer *buf)
 	unsigned int offset = buf->out & buf->mask;
 	unsigned int len = buf->in - buf->out;
 
+	if (buf->mirrored)
+		return len;
+
 	return MIN(len, buf->size - offset);
 }
 
+int ring_buffer_read_iov(struct ring_buffer *buf, struct iovec iov[2])
+{
+	unsigned int offset = buf->out & buf->mask;
+	unsigned int len = buf->in - buf->out;
+	unsigned int end;
+
+	if (len == 0)
+		return 0;
+
+	iov[0].iov_base = buf->buffer + offset;
+
+	end = buf->mirrored ? len : MIN(len, buf->size - offset);
+	iov[0].iov_len = end;
+
+	if (end == len)
+		return 1;
+
+	iov[1].iov_base = buf->buffer;
+	iov[1].iov_len = len - end;
+
+	return 2;
+}
+
 unsigned char *ring_buffer_read_ptr(struct ring_buffer *buf,
 					unsigned int offset)
 {
@@ -202,6 +342,10 @@ void ring_buffer_free(struct ring_buffer *buf)
 	if (buf == NULL)
 		return;
 
-	g_slice_free1(buf->size, buf->buffer);
+	if (buf->mirrored)
+		munmap(buf->buffer, 2 * buf->size);
+	else
+		g_slice_free1(buf->size, buf->buffer);
+
 	g_slice_free1(sizeof(struct ring_buffer), buf);
 }
@@ -19,6 +19,8 @@
  *
  */
 
+#include <sys/uio.h>
+
 struct ring_buffer;
 
 /*!
@@ -26,6 +28,19 @@ struct ring_buffer;
  */
 struct ring_buffer *ring_buffer_new(unsigned int size);
 
+/*!
+ * Creates a new ring buffer with capacity size whose storage is mapped
+ * twice back to back, so that the readable and the writable regions are
+ * always contiguous.  Falls back to ring_buffer_new if the mapping
+ * cannot be set up, e.g. if size is not a multiple of the page size
+ */
+struct ring_buffer *ring_buffer_new_mirrored(unsigned int size);
+
+/*!
+ * Returns TRUE if the ring buffer storage is mirrored
+ */
+gboolean ring_buffer_is_mirrored(struct ring_buffer *buf);
+
 /*!
  * Frees the resources allocated for the ring buffer
  */
@@ -73,6 +88,13 @@ int ring_buffer_avail(struct ring_buffer *buf);
  */
 int ring_buffer_avail_no_wrap(struct ring_buffer *buf);
 
+/*!
+ * Fills iov with the free space of the buffer, in write order, suitable
+ * for readv.  Returns the number of vectors used, 0 if the buffer is full.
+ * Use ring_buffer_write_advance to commit the data written.
+ */
+int ring_buffer_write_iov(struct ring_buffer *buf, struct iovec iov[2]);
+
 /*!
  * Reads data from the ring buffer buf into memory region pointed to by data.
  * A maximum of len bytes will be read.  Returns -1 if the read failed or
@@ -100,6 +122,13 @@ int ring_buffer_len(struct ring_buffer *buf);
  */
 int ring_buffer_len_no_wrap(struct ring_buffer *buf);
 
+/*!
+ * Fills iov with the data currently in the buffer, in read order, suitable
+ * for writev.  Returns the number of vectors used, 0 if the buffer is empty.
+ * Use ring_buffer_drain to consume the data.
+ */
+int ring_buffer_read_iov(struct ring_buffer *buf, struct iovec iov[2]);
+
 /*!
  * Drains the ring buffer of len bytes.  Returns the number of bytes the
  * read counter was actually advanced.
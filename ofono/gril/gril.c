@@ -43,6 +43,15 @@
 #include "gril.h"
 #include "grilutil.h"
 
+/* Largest parcel accepted from rild, unless overridden */
+#define RIL_MAX_PARCEL_SIZE	(256 * 1024)
+
+/* Initial size of the reassembly buffer */
+#define RIL_PARCEL_CHUNK	4096
+
+/* Number of message structures kept around for reuse */
+#define RIL_MSG_POOL_SIZE	4
+
 #define RIL_TRACE(ril, fmt, arg...) do {	\
 	if (ril->trace == TRUE)			\
 		ofono_debug(fmt, ## arg);	\
@@ -57,6 +66,9 @@ struct ril_request {
 	GRilResponseFunc callback;
 	gpointer user_data;
 	GDestroyNotify notify;
+	GList link;			/* Link in command or out queue */
+	GQueue *queue;			/* Queue the request is in */
+	gint64 sent_time;		/* When the last byte went out */
 };
 
 struct ril_notify_node {
@@ -80,13 +92,22 @@ struct ril_s {
 	guint next_notify_id;			/* Next notify id */
 	guint next_gid;				/* Next group id */
 	GRilIO *io;				/* GRil IO */
-	GQueue *command_queue;			/* Command queue */
-	GQueue *out_queue;			/* Commands sent/been sent */
+	GQueue *command_queue;			/* Commands not yet sent */
+	GQueue *out_queue;			/* Commands sent/being sent */
+	GHashTable *req_table;			/* Pending commands by serial */
+	GHashTable *req_stats;			/* Latencies by request id */
 	guint req_bytes_written;		/* bytes written from req */
 	GHashTable *notify_list;		/* List of notification reg */
 	GRilDisconnectFunc user_disconnect;	/* user disconnect func */
 	gpointer user_disconnect_data;		/* user disconnect data */
-	guint read_so_far;			/* Number of bytes processed */
+	guchar *parcel_buf;			/* Reassembly buffer */
+	guint parcel_size;			/* Reassembly buffer size */
+	guint parcel_len;			/* Bytes of parcel collected */
+	guint parcel_need;			/* Parcel length, 0 if none */
+	guint parcel_skip;			/* Bytes of dropped parcel */
+	guint max_parcel_size;			/* Largest parcel accepted */
+	struct ril_msg *msg_pool[RIL_MSG_POOL_SIZE];
+	guint msg_pool_len;			/* Messages in msg_pool */
 	gboolean suspended;			/* Are we suspended? */
 	gboolean debug;
 	gboolean trace;
@@ -286,6 +307,7 @@ static struct ril_request *ril_request_create(struct ril_s *ril,
 	r->req = req;
 	r->gid = gid;
 	r->id = id;
+	r->link.data = r;
 	r->callback = func;
 	r->user_data = user_data;
 	r->notify = notify;
@@ -302,20 +324,154 @@ static void ril_request_destroy(struct ril_request *req)
 	g_free(req);
 }
 
+static struct ril_msg *ril_msg_new(struct ril_s *p)
+{
+	if (p->msg_pool_len > 0)
+		return p->msg_pool[--p->msg_pool_len];
+
+	return g_new(struct ril_msg, 1);
+}
+
+static void ril_msg_free(struct ril_s *p, struct ril_msg *message)
+{
+	if (p->msg_pool_len < RIL_MSG_POOL_SIZE)
+		p->msg_pool[p->msg_pool_len++] = message;
+	else
+		g_free(message);
+}
+
+static void ril_free(struct ril_s *p)
+{
+	while (p->msg_pool_len > 0)
+		g_free(p->msg_pool[--p->msg_pool_len]);
+
+	if (p->req_stats)
+		g_hash_table_destroy(p->req_stats);
+
+	g_free(p->parcel_buf);
+	g_free(p);
+}
+
+static gboolean parcel_reserve(struct ril_s *p, guint size)
+{
+	guint new_size = p->parcel_size ? p->parcel_size : RIL_PARCEL_CHUNK;
+	guchar *buf;
+
+	if (size <= p->parcel_size)
+		return TRUE;
+
+	while (new_size < size)
+		new_size <<= 1;
+
+	/* Nothing in there needs to be preserved */
+	buf = g_try_malloc(new_size);
+	if (buf == NULL)
+		return FALSE;
+
+	g_free(p->parcel_buf);
+	p->parcel_buf = buf;
+	p->parcel_size = new_size;
+
+	return TRUE;
+}
+
+static void parcel_release(struct ril_s *p)
+{
+	p->parcel_len = 0;
+	p->parcel_need = 0;
+
+	/* Don't hold on to the memory used by an unusually large parcel */
+	if (p->parcel_size > GRIL_BUFFER_SIZE) {
+		g_free(p->parcel_buf);
+		p->parcel_buf = NULL;
+		p->parcel_size = 0;
+	}
+}
+
+static void ril_request_queue(struct ril_s *p, GQueue *queue,
+					struct ril_request *req)
+{
+	if (req->queue)
+		g_queue_unlink(req->queue, &req->link);
+
+	g_queue_push_tail_link(queue, &req->link);
+	req->queue = queue;
+}
+
+static void ril_request_unlink(struct ril_s *p, struct ril_request *req)
+{
+	g_queue_unlink(req->queue, &req->link);
+	req->queue = NULL;
+
+	g_hash_table_remove(p->req_table, GINT_TO_POINTER(req->id));
+}
+
+static void ril_request_queue_free(GQueue *queue)
+{
+	GList *link;
+
+	/* The links are embedded in the requests */
+	while ((link = g_queue_pop_head_link(queue)) != NULL)
+		ril_request_destroy(link->data);
+
+	g_queue_free(queue);
+}
+
+static void ril_request_stats_update(struct ril_s *p, struct ril_request *req)
+{
+	struct ril_request_stats *stats;
+	guint64 latency;
+
+	/* Response to a request which never made it out completely */
+	if (req->sent_time == 0)
+		return;
+
+	latency = g_get_monotonic_time() - req->sent_time;
+
+	if (p->req_stats == NULL)
+		p->req_stats = g_hash_table_new_full(g_direct_hash,
+							g_direct_equal,
+							NULL, g_free);
+
+	stats = g_hash_table_lookup(p->req_stats, GINT_TO_POINTER(req->req));
+	if (stats == NULL) {
+		stats = g_new0(struct ril_request_stats, 1);
+		stats->min_us = latency;
+		g_hash_table_insert(p->req_stats, GINT_TO_POINTER(req->req),
+					stats);
+	}
+
+	stats->count++;
+	stats->total_us += latency;
+
+	if (latency < stats->min_us)
+		stats->min_us = latency;
+
+	if (latency > stats->max_us)
+		stats->max_us = latency;
+}
+
 static void ril_cleanup(struct ril_s *p)
 {
 	/* Cleanup pending commands */
 
+	if (p->req_table) {
+		g_hash_table_destroy(p->req_table);
+		p->req_table = NULL;
+	}
+
 	if (p->command_queue) {
-		g_queue_free(p->command_queue);
+		ril_request_queue_free(p->command_queue);
 		p->command_queue = NULL;
 	}
 
 	if (p->out_queue) {
-		g_queue_free(p->out_queue);
+		ril_request_queue_free(p->out_queue);
 		p->out_queue = NULL;
 	}
 
+	p->req_bytes_written = 0;
+
 	/* Cleanup registered notifications */
 	if (p->notify_list) {
 		g_hash_table_destroy(p->notify_list);
@@ -326,6 +482,10 @@ static void ril_cleanup(struct ril_s *p)
 		g_source_remove(p->timeout_source);
 		p->timeout_source = 0;
 	}
+
+	/* Partially received parcel is lost along with the connection */
+	p->parcel_skip = 0;
+	parcel_release(p);
 }
 
 void g_ril_set_disconnect_function(GRil *ril, GRilDisconnectFunc disconnect,
@@ -351,60 +511,42 @@ static void io_disconnect(gpointer user_data)
 
 static void handle_response(struct ril_s *p, struct ril_msg *message)
 {
-	guint count = g_queue_get_length(p->command_queue);
-	struct ril_request *req;
-	gboolean found = FALSE;
-	guint i, len;
-	gint id;
-
-	for (i = 0; i < count; i++) {
-		req = g_queue_peek_nth(p->command_queue, i);
+	struct ril_request *req = NULL;
 
-		if (req->id == message->serial_no) {
-			found = TRUE;
-			message->req = req->req;
+	if (p->req_table)
+		req = g_hash_table_lookup(p->req_table,
+					GINT_TO_POINTER(message->serial_no));
 
-			if (message->error != RIL_E_SUCCESS)
-				RIL_TRACE(p, "[%d,%04d]< %s failed %s",
-					p->slot, message->serial_no,
-					request_id_to_string(p, message->req),
-					ril_error_to_string(message->error));
-
-			req = g_queue_pop_nth(p->command_queue, i);
-			if (req->callback)
-				req->callback(message, req->user_data);
-
-			/* gril may have been destroyed in the request callback */
-			if (p->destroyed) {
-				ril_request_destroy(req);
-				return;
-			}
+	if (req == NULL) {
+		ofono_error("No matching request for reply: serial_no: %d!",
+				message->serial_no);
+		return;
+	}
 
-			len = g_queue_get_length(p->out_queue);
+	message->req = req->req;
 
-			for (i = 0; i < len; i++) {
-				id = GPOINTER_TO_INT(g_queue_peek_nth(
-							p->out_queue, i));
-				if (id == req->id) {
-					g_queue_pop_nth(p->out_queue, i);
-					break;
-				}
-			}
+	if (message->error != RIL_E_SUCCESS)
+		RIL_TRACE(p, "[%d,%04d]< %s failed %s",
+				p->slot, message->serial_no,
+				request_id_to_string(p, message->req),
+				ril_error_to_string(message->error));
 
-			ril_request_destroy(req);
+	ril_request_unlink(p, req);
+	ril_request_stats_update(p, req);
 
-			if (g_queue_peek_head(p->command_queue))
-				ril_wakeup_writer(p);
+	if (req->callback)
+		req->callback(message, req->user_data);
 
-			break;
-		}
+	/* gril may have been destroyed in the request callback */
+	if (p->destroyed) {
+		ril_request_destroy(req);
+		return;
 	}
 
-	if (found == FALSE)
-		ofono_error("No matching request for reply: %s serial_no: %d!",
-			request_id_to_string(p, message->req),
-			message->serial_no);
+	ril_request_destroy(req);
 
+	if (p->command_queue && g_queue_peek_head(p->command_queue))
+		ril_wakeup_writer(p);
 }
 
 static gboolean node_check_destroyed(struct ril_notify_node *node,
@@ -454,72 +596,59 @@ static void handle_unsol_req(struct ril_s *p, struct ril_msg *message)
 					GUINT_TO_POINTER(TRUE));
 }
 
-static void dispatch(struct ril_s *p, struct ril_msg *message)
+/*
+ * Dispatches the parcel of length plen, not including the length field.
+ * The message data points into the parcel, which is only valid for the
+ * duration of the callbacks.
+ */
+static void dispatch(struct ril_s *p, const guchar *parcel, guint plen)
 {
-	int32_t *unsolicited_field, *id_num_field;
-	gchar *bufp = message->buf;
-	gchar *datap;
-	gsize data_len;
-
-	/* This could be done with a struct/union... */
-	unsolicited_field = (int32_t *) (void *) bufp;
-	if (*unsolicited_field)
-		message->unsolicited = TRUE;
-	else
-		message->unsolicited = FALSE;
+	struct ril_msg *message;
+	int32_t header[3];
+	guint header_len;
 
-	bufp += 4;
+	/*
+	 * A RIL Unsolicited Event is two UINT32 fields (unsolicited and
+	 * req/ev), a Solicited Response is three UINT32 fields (unsolicited,
+	 * serial_no and error).  Whatever follows is the Event Data.
+	 */
+	if (plen < 8) {
+		ofono_error("RIL parcel too short (%u), ignoring", plen);
+		return;
+	}
 
-	id_num_field = (int32_t *) (void *) bufp;
-	if (message->unsolicited) {
-		message->req = (int) *id_num_field;
+	memcpy(header, parcel, 8);
 
-		/*
-		 * A RIL Unsolicited Event is two UINT32 fields ( unsolicited,
-		 * and req/ev ), so subtract the length of the header from the
-		 * overall length to calculate the length of the Event Data.
-		 */
-		data_len = message->buf_len - 8;
+	message = ril_msg_new(p);
+	message->req = 0;
+	message->serial_no = 0;
+	message->error = 0;
+
+	if (header[0]) {
+		message->unsolicited = TRUE;
+		message->req = header[1];
+		header_len = 8;
 	} else {
-		message->serial_no = (int) *id_num_field;
+		if (plen < 12) {
+			ofono_error("RIL response too short (%u), ignoring",
+					plen);
+			ril_msg_free(p, message);
+			return;
+		}
 
-		bufp += 4;
-		message->error = *((int32_t *) (void *) bufp);
+		memcpy(header + 2, parcel + 8, 4);
 
-		/*
-		 * A RIL Solicited Response is three UINT32 fields ( unsolicied,
-		 * serial_no and error ), so subtract the length of the header
-		 * from the overall length to calculate the length of the Event
-		 * Data.
-		 */
-		data_len = message->buf_len - 12;
+		message->unsolicited = FALSE;
+		message->serial_no = header[1];
+		message->error = header[2];
+		header_len = 12;
 	}
 
-	/* advance to start of data.. */
-	bufp += 4;
-
-	/*
-	 * Now, use buffer for event data if present
-	 */
-	if (data_len) {
-		datap = g_try_malloc(data_len);
-		if (datap == NULL)
-			goto error;
-
-		/* Copy event bytes from message->buf into new buffer */
-		memcpy(datap, bufp, data_len);
-
-		/* Free buffer that includes header */
-		g_free(message->buf);
-
-		/* ...and replace with new buffer */
-		message->buf = datap;
-		message->buf_len = data_len;
+	/* To know if there was no data when parsing */
+	if (plen > header_len) {
+		message->buf = (gchar *) parcel + header_len;
+		message->buf_len = plen - header_len;
 	} else {
-		/* Free buffer that includes header */
-		g_free(message->buf);
-
-		/* To know if there was no data when parsing */
 		message->buf = NULL;
 		message->buf_len = 0;
 	}
@@ -529,113 +658,113 @@ static void dispatch(struct ril_s *p, struct ril_msg *message)
 	else
 		handle_response(p, message);
 
-error:
-	g_free(message->buf);
-	g_free(message);
+	ril_msg_free(p, message);
 }
 
-static struct ril_msg *read_fixed_record(struct ril_s *p,
-						const guchar *bytes, gsize *len)
+/* The first four bytes of a record are its length in network byte order */
+static guint32 peek_parcel_length(struct ring_buffer *rbuf)
 {
-	struct ril_msg *message;
-	unsigned message_len, plen;
-
-	/* First four bytes are length in TCP byte order (Big Endian) */
-	plen = ntohl(*((uint32_t *) (void *) bytes));
-	bytes += 4;
-
-	/*
-	 * TODO: Verify that 8k is the max message size from rild.
-	 *
-	 * This condition shouldn't happen.  If it does
-	 * there are three options:
-	 *
-	 * 1) Exit; ofono will restart via DBus (this is what we do now)
-	 * 2) Consume the bytes & continue
-	 * 3) force a disconnect
-	 */
-	if (plen > GRIL_BUFFER_SIZE - 4) {
-		ofono_error("ERROR RIL parcel bigger than buffer (%u), exiting",
-				plen);
-		exit(1);
-	}
-
-	/*
-	 * If we don't have the whole fixed record in the ringbuffer
-	 * then return NULL & leave ringbuffer as is.
-	 */
-
-	message_len = *len - 4;
-	if (message_len < plen)
-		return NULL;
+	guint32 plen = 0;
+	int i;
 
-	message = g_malloc(sizeof(struct ril_msg));
+	/* The length field may be split by the end of the buffer */
+	for (i = 0; i < 4; i++)
+		plen = (plen << 8) | *ring_buffer_read_ptr(rbuf, i);
 
-	/* allocate ril_msg->buffer */
-	message->buf_len = plen;
-	message->buf = g_malloc(plen);
-
-	/* Copy bytes into message buffer */
-	memmove(message->buf, (const void *) bytes, plen);
-
-	/* Indicate to caller size of record we extracted */
-	*len = plen + 4;
-	return message;
+	return plen;
 }
 
 static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 {
-	struct ril_msg *message;
 	struct ril_s *p = user_data;
-	unsigned int len = ring_buffer_len(rbuf);
-	unsigned int wrap = ring_buffer_len_no_wrap(rbuf);
-	guchar *buf = ring_buffer_read_ptr(rbuf, p->read_so_far);
+	unsigned int len;
+	guint32 plen;
 
 	p->in_read_handler = TRUE;
 
-	while (p->suspended == FALSE && (p->read_so_far < len)) {
-		gsize rbytes = MIN(len - p->read_so_far, wrap - p->read_so_far);
+	while (p->suspended == FALSE && (len = ring_buffer_len(rbuf)) > 0) {
+		/* Throw away the remains of a parcel we couldn't take */
+		if (p->parcel_skip) {
+			p->parcel_skip -= ring_buffer_drain(rbuf,
+						MIN(len, p->parcel_skip));
+			continue;
+		}
 
-		if (rbytes < 4) {
-			DBG("Not enough bytes for header length: len: %d", len);
-			return;
+		/* Keep collecting a parcel which didn't fit */
+		if (p->parcel_need) {
+			unsigned int n = MIN(len, p->parcel_need -
+							p->parcel_len);
+
+			ring_buffer_read(rbuf, p->parcel_buf + p->parcel_len,
+						n);
+			p->parcel_len += n;
+
+			if (p->parcel_len < p->parcel_need)
+				break;
+
+			dispatch(p, p->parcel_buf, p->parcel_need);
+			parcel_release(p);
+			continue;
 		}
 
+		if (len < 4)
+			break;
+
+		plen = peek_parcel_length(rbuf);
+
 		/*
-		 * This function attempts to read the next full length
-		 * fixed message from the stream.  if not all bytes are
-		 * available, it returns NULL.  otherwise it allocates
-		 * and returns a ril_message with the copied bytes, and
-		 * drains those bytes from the ring_buffer
+		 * Rather than tearing down the connection, skip over parcels
+		 * we can't handle and carry on with the next one.
 		 */
-		message = read_fixed_record(p, buf, &rbytes);
+		if (plen > p->max_parcel_size) {
+			ofono_error("RIL parcel too big (%u), dropping", plen);
+			ring_buffer_drain(rbuf, 4);
+			p->parcel_skip = plen;
+			continue;
+		}
 
-		/* wait for the rest of the record... */
-		if (message == NULL)
+		if (plen + 4 <= len) {
+			const guchar *parcel = ring_buffer_read_ptr(rbuf, 4);
+
+			/*
+			 * The whole record is in the ring buffer. Unless it
+			 * wraps, hand it out directly from there.
+			 */
+			if ((guint) ring_buffer_len_no_wrap(rbuf) >= plen + 4 &&
+					((gsize) parcel & 3) == 0) {
+				dispatch(p, parcel, plen);
+				ring_buffer_drain(rbuf, plen + 4);
+				continue;
+			}
+		} else if (plen + 4 <= (guint) ring_buffer_capacity(rbuf)) {
+			/* Wait for the rest of the record... */
 			break;
-
-		buf += rbytes;
-		p->read_so_far += rbytes;
-
-		/* TODO: need to better understand how wrap works! */
-		if (p->read_so_far == wrap) {
-			buf = ring_buffer_read_ptr(rbuf, p->read_so_far);
-			wrap = len;
 		}
 
-		dispatch(p, message);
+		/* Either wrapped, or bigger than the ring buffer */
+		if (!parcel_reserve(p, plen)) {
+			ofono_error("Can't allocate %u bytes for RIL parcel",
+					plen);
+			ring_buffer_drain(rbuf, 4);
+			p->parcel_skip = plen;
+			continue;
+		}
 
-		ring_buffer_drain(rbuf, p->read_so_far);
+		ring_buffer_drain(rbuf, 4);
+		p->parcel_len = 0;
+		p->parcel_need = plen;
 
-		len -= p->read_so_far;
-		wrap -= p->read_so_far;
-		p->read_so_far = 0;
+		/* A zero length record has nothing to collect */
+		if (plen == 0) {
+			dispatch(p, p->parcel_buf, 0);
+			parcel_release(p);
+		}
 	}
 
 	p->in_read_handler = FALSE;
 
 	if (p->destroyed)
-		g_free(p);
+		ril_free(p);
 }
 
 /*
@@ -647,73 +776,19 @@ static gboolean can_write_data(gpointer data)
 {
 	struct ril_s *ril = data;
 	struct ril_request *req;
-	gsize bytes_written, towrite, len;
-	guint qlen, oqlen;
-	gint id;
-	gboolean written = TRUE;
-	guint i, j;
+	gsize bytes_written, towrite;
 
-	qlen = g_queue_get_length(ril->command_queue);
-	if (qlen < 1)
-		return FALSE;
-
-	/* if the whole request was not written */
 	if (ril->req_bytes_written != 0) {
-
-		for (i = 0; i < qlen; i++) {
-			req = g_queue_peek_nth(ril->command_queue, i);
-			if (req) {
-				id = GPOINTER_TO_INT(g_queue_peek_head(
-							ril->out_queue));
-				if (req->id == id)
-					goto out;
-			} else {
-				return FALSE;
-			}
-		}
-	}
-	/* if no requests already sent */
-	oqlen = g_queue_get_length(ril->out_queue);
-	if (oqlen < 1) {
+		/* The whole request was not written, carry on with it */
+		req = g_queue_peek_tail(ril->out_queue);
+	} else {
 		req = g_queue_peek_head(ril->command_queue);
-		if (req == NULL)
-			return FALSE;
-
-		g_queue_push_head(ril->out_queue, GINT_TO_POINTER(req->id));
-
-		goto out;
-	}
-
-	for (i = 0; i < qlen; i++) {
-		req = g_queue_peek_nth(ril->command_queue, i);
-		if (req == NULL)
-			return FALSE;
-
-		for (j = 0; j < oqlen; j++) {
-			id = GPOINTER_TO_INT(
-					g_queue_peek_nth(ril->out_queue, j));
-			if (req->id == id) {
-				written = TRUE;
-				break;
-			} else {
-				written = FALSE;
-			}
-		}
-
-		if (written == FALSE)
-			break;
 	}
 
-	/* watcher fired though requests already written */
-	if (written == TRUE)
+	if (req == NULL)
 		return FALSE;
 
-	g_queue_push_head(ril->out_queue, GINT_TO_POINTER(req->id));
-
-out:
-	len = req->data_len;
-
-	towrite = len - ril->req_bytes_written;
+	towrite = req->data_len - ril->req_bytes_written;
 
 #ifdef WRITE_SCHEDULER_DEBUG
 	if (towrite > 5)
@@ -727,11 +802,15 @@ out:
 	if (bytes_written == 0)
 		return FALSE;
 
+	if (req->queue != ril->out_queue)
+		ril_request_queue(ril, ril->out_queue, req);
+
 	ril->req_bytes_written += bytes_written;
 	if (bytes_written < towrite)
 		return TRUE;
-	else
-		ril->req_bytes_written = 0;
+
+	ril->req_bytes_written = 0;
+	req->sent_time = g_get_monotonic_time();
 
 	return FALSE;
 }
@@ -780,7 +859,7 @@ static void ril_unref(struct ril_s *ril)
 	if (ril->in_read_handler)
 		ril->destroyed = TRUE;
 	else
-		g_free(ril);
+		ril_free(ril);
 }
 
 static gboolean node_compare_by_group(struct ril_notify_node *node,
@@ -814,6 +893,7 @@ static struct ril_s *create_ril(const char *sock_path, unsigned int uid,
 	ril->next_gid = 0;
 	ril->req_bytes_written = 0;
 	ril->trace = FALSE;
+	ril->max_parcel_size = RIL_MAX_PARCEL_SIZE;
 
 	/* sock_path is allowed to be NULL for unit tests */
 	if (sock_path == NULL)
@@ -888,6 +968,8 @@ static struct ril_s *create_ril(const char *sock_path, unsigned int uid,
 		goto error;
 	}
 
+	ril->req_table = g_hash_table_new(g_direct_hash, g_direct_equal);
+
 	ril->notify_list = g_hash_table_new_full(g_int_hash, g_int_equal,
 							g_free,
 							ril_notify_destroy);
@@ -925,39 +1007,31 @@ static struct ril_notify *ril_notify_create(struct ril_s *ril,
 
 static void ril_cancel_group(struct ril_s *ril, guint group)
 {
-	int n = 0;
-	guint len, i;
+	GList *l, *next;
 	struct ril_request *req;
-	gboolean sent;
 
 	if (ril->command_queue == NULL)
 		return;
 
-	while ((req = g_queue_peek_nth(ril->command_queue, n)) != NULL) {
-		if (req->id == 0 || req->gid != group) {
-			n += 1;
+	/* Requests not sent yet can simply go away */
+	for (l = ril->command_queue->head; l; l = next) {
+		next = l->next;
+		req = l->data;
+
+		if (req->id == 0 || req->gid != group)
 			continue;
-		}
 
 		req->callback = NULL;
-		sent = FALSE;
-
-		len = g_queue_get_length(ril->out_queue);
-		for (i = 0; i < len; i++) {
-			if (GPOINTER_TO_INT(
-					g_queue_peek_nth(ril->out_queue, i))
-					== req->id) {
-				n += 1;
-				sent = TRUE;
-				break;
-			}
-		 }
+		ril_request_unlink(ril, req);
+		ril_request_destroy(req);
+	}
 
-		if (sent)
-			continue;
+	/* Those already sent still have their response to come */
+	for (l = ril->out_queue->head; l; l = l->next) {
+		req = l->data;
 
-		g_queue_remove(ril->command_queue, req);
-		ril_request_destroy(req);
+		if (req->id != 0 && req->gid == group)
+			req->callback = NULL;
 	}
 }
 
@@ -1150,7 +1224,8 @@ gint g_ril_send(GRil *ril, const gint reqid, struct parcel *rilp,
 
 	p->next_cmd_id++;
 
-	g_queue_push_tail(p->command_queue, r);
+	ril_request_queue(p, p->command_queue, r);
+	g_hash_table_insert(p->req_table, GINT_TO_POINTER(r->id), r);
 
 	ril_wakeup_writer(p);
 
@@ -1216,6 +1291,44 @@ int g_ril_get_slot(GRil *ril)
 	return ril->parent->slot;
 }
 
+gboolean g_ril_set_max_parcel_size(GRil *ril, guint size)
+{
+	if (ril == NULL || ril->parent == NULL || size < 12)
+		return FALSE;
+
+	ril->parent->max_parcel_size = size;
+	return TRUE;
+}
+
+gboolean g_ril_get_request_stats(GRil *ril, int req,
+					struct ril_request_stats *stats)
+{
+	struct ril_request_stats *found;
+
+	if (ril == NULL || ril->parent == NULL ||
+					ril->parent->req_stats == NULL)
+		return FALSE;
+
+	found = g_hash_table_lookup(ril->parent->req_stats,
+					GINT_TO_POINTER(req));
+	if (found == NULL)
+		return FALSE;
+
+	if (stats)
+		*stats = *found;
+
+	return TRUE;
+}
+
+void g_ril_reset_request_stats(GRil *ril)
+{
+	if (ril == NULL || ril->parent == NULL ||
+					ril->parent->req_stats == NULL)
+		return;
+
+	g_hash_table_remove_all(ril->parent->req_stats);
+}
+
 gboolean g_ril_set_debugf(GRil *ril,
 			GRilDebugFunc func, gpointer user_data)
 {
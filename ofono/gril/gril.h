@@ -51,6 +51,14 @@ struct ril_msg {
 	int error;
 };
 
+/* Time between sending requests and receiving their responses */
+struct ril_request_stats {
+	unsigned int count;
+	guint64 total_us;
+	guint64 min_us;
+	guint64 max_us;
+};
+
 typedef void (*GRilResponseFunc)(struct ril_msg *message, gpointer user_data);
 
 typedef void (*GRilNotifyFunc)(struct ril_msg *message, gpointer user_data);
@@ -138,6 +146,16 @@ gboolean g_ril_set_slot(GRil *ril, int slot);
  */
 gboolean g_ril_set_debugf(GRil *ril, GRilDebugFunc func, gpointer user_data);
 
+/*
+ * Parcels longer than size are dropped.  Parcels which don't fit into the
+ * read buffer are reassembled in memory allocated on demand.
+ */
+gboolean g_ril_set_max_parcel_size(GRil *ril, guint size);
+
+gboolean g_ril_get_request_stats(GRil *ril, int req,
+					struct ril_request_stats *stats);
+void g_ril_reset_request_stats(GRil *ril);
+
 gboolean g_ril_set_vendor_print_msg_id_funcs(GRil *ril,
 					GRilMsgIdToStrFunc req_to_string,
 					GRilMsgIdToStrFunc unsol_to_string);
@@ -29,6 +29,7 @@
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <sys/uio.h>
 
 #include <glib.h>
 
@@ -44,7 +45,6 @@ struct _GRilIO {
 	GRilDisconnectFunc user_disconnect;	/* user disconnect func */
 	gpointer user_disconnect_data;		/* user disconnect data */
 	struct ring_buffer *buf;		/* Current read buffer */
-	guint max_read_attempts;		/* max reads / select */
 	GRilIOReadFunc read_handler;		/* Read callback */
 	gpointer read_data;			/* Read callback userdata */
 	gboolean use_write_watch;		/* Use write select */
@@ -82,50 +82,57 @@ static void read_watcher_destroy_notify(gpointer user_data)
 static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 				gpointer data)
 {
-	unsigned char *buf;
 	GRilIO *io = data;
-	GIOStatus status;
-	gsize rbytes;
-	gsize toread;
-	gsize total_read = 0;
-	guint read_count = 0;
+	struct iovec iov[2];
+	ssize_t rbytes = 0;
+	int iovcnt;
+	int err = 0;
+	int i;
 
 	if (cond & G_IO_NVAL)
 		return FALSE;
 
-	/* Regardless of condition, try to read all the data available */
-	do {
-		toread = ring_buffer_avail_no_wrap(io->buf);
+	/*
+	 * Regardless of condition, try to read all the data available.
+	 * The free space of the ring buffer may wrap, so fill both parts
+	 * of it with a single readv.
+	 */
+	iovcnt = ring_buffer_write_iov(io->buf, iov);
 
-		if (toread == 0)
-			break;
+	if (iovcnt > 0) {
+		int fd = g_io_channel_unix_get_fd(channel);
 
-		rbytes = 0;
-		buf = ring_buffer_write_ptr(io->buf, 0);
+		do {
+			rbytes = readv(fd, iov, iovcnt);
+		} while (rbytes < 0 && errno == EINTR);
 
-		status = g_io_channel_read_chars(channel, (char *) buf,
-							toread, &rbytes, NULL);
+		if (rbytes < 0)
+			err = errno;
+	}
 
-		g_ril_util_debug_hexdump(TRUE, (guchar *) buf, rbytes,
-						io->debugf, io->debug_data);
+	if (rbytes > 0) {
+		gsize left = rbytes;
 
-		read_count++;
+		for (i = 0; i < iovcnt && left > 0; i++) {
+			gsize n = MIN(left, iov[i].iov_len);
 
-		total_read += rbytes;
+			g_ril_util_debug_hexdump(TRUE, iov[i].iov_base, n,
+						io->debugf, io->debug_data);
 
-		if (rbytes > 0)
-			ring_buffer_write_advance(io->buf, rbytes);
+			left -= n;
+		}
 
-	} while (status == G_IO_STATUS_NORMAL && rbytes > 0 &&
-					read_count < io->max_read_attempts);
+		ring_buffer_write_advance(io->buf, rbytes);
 
-	if (total_read > 0 && io->read_handler)
-		io->read_handler(io->buf, io->read_data);
+		if (io->read_handler)
+			io->read_handler(io->buf, io->read_data);
+	}
 
 	if (cond & (G_IO_HUP | G_IO_ERR))
 		return FALSE;
 
-	if (read_count > 0 && rbytes == 0 && status != G_IO_STATUS_AGAIN)
+	/* End of file, or a read error other than running out of data */
+	if (iovcnt > 0 && (rbytes == 0 || (rbytes < 0 && err != EAGAIN)))
 		return FALSE;
 
 	/* We're overflowing the buffer, shutdown the socket */
@@ -197,15 +204,12 @@ static GRilIO *create_io(GIOChannel *channel, GIOFlags flags)
 	io->ref_count = 1;
 	io->debugf = NULL;
 
-	if (flags & G_IO_FLAG_NONBLOCK) {
-		io->max_read_attempts = 3;
+	if (flags & G_IO_FLAG_NONBLOCK)
 		io->use_write_watch = TRUE;
-	} else {
-		io->max_read_attempts = 1;
+	else
 		io->use_write_watch = FALSE;
-	}
 
-	io->buf = ring_buffer_new(GRIL_BUFFER_SIZE);
+	io->buf = ring_buffer_new_mirrored(GRIL_BUFFER_SIZE);
 
 	if (!io->buf)
 		goto error;
@@ -48,9 +48,17 @@ typedef uint16_t char16_t;
 
 void parcel_init(struct parcel *p)
 {
-	p->data = g_malloc0(sizeof(int32_t));
+	parcel_init_sized(p, sizeof(int32_t));
+}
+
+void parcel_init_sized(struct parcel *p, size_t capacity)
+{
+	if (capacity < sizeof(int32_t))
+		capacity = sizeof(int32_t);
+
+	p->data = g_malloc0(capacity);
 	p->size = 0;
-	p->capacity = sizeof(int32_t);
+	p->capacity = capacity;
 	p->offset = 0;
 	p->malformed = 0;
 }
@@ -62,6 +70,18 @@ void parcel_grow(struct parcel *p, size_t size)
 	p->capacity += size;
 }
 
+/* Makes room for size more bytes at the current offset */
+static void parcel_reserve(struct parcel *p, size_t size)
+{
+	size_t needed = p->offset + size;
+
+	if (needed <= p->capacity)
+		return;
+
+	/* Grow geometrically so that a series of writes stays linear */
+	parcel_grow(p, MAX(needed, p->capacity * 2) - p->capacity);
+}
+
 void parcel_free(struct parcel *p)
 {
 	g_free(p->data);
@@ -70,6 +90,16 @@ void parcel_free(struct parcel *p)
 	p->offset = 0;
 }
 
+size_t parcel_string_size(const char *str)
+{
+	if (str == NULL)
+		return sizeof(int32_t);
+
+	/* There are never more UTF-16 code units than UTF-8 bytes */
+	return sizeof(int32_t) + PAD_SIZE((strlen(str) + 1) *
+						sizeof(char16_t));
+}
+
 int32_t parcel_r_int32(struct parcel *p)
 {
 	int32_t ret;
@@ -90,112 +120,346 @@ int32_t parcel_r_int32(struct parcel *p)
 
 int parcel_w_int32(struct parcel *p, int32_t val)
 {
-	for (;;) {
+	parcel_reserve(p, sizeof(int32_t));
+
+	*((int32_t *) (void *) (p->data + p->offset)) = val;
+	p->offset += sizeof(int32_t);
+	p->size += sizeof(int32_t);
 
-		if (p->offset + sizeof(int32_t) < p->capacity) {
-			/* There's enough space */
-			*((int32_t *) (void *) (p->data + p->offset)) = val;
-			p->offset += sizeof(int32_t);
-			p->size += sizeof(int32_t);
-			break;
+	return 0;
+}
+
+/*
+ * Converts len bytes of UTF-8 into out, which must have room for len
+ * code units.  Returns the number of code units written or -1 if the
+ * input is not valid UTF-8.
+ */
+static int utf8_to_utf16(const char *str, size_t len, char16_t *out)
+{
+	const unsigned char *s = (const unsigned char *) str;
+	const unsigned char *end = s + len;
+	char16_t *d = out;
+
+	while (s < end) {
+		uint32_t c = *s;
+		uint32_t min;
+		int n;
+
+		/* ASCII fast path, four characters at a time */
+		if (c < 0x80) {
+			uint32_t word;
+
+			while (end - s >= 4) {
+				memcpy(&word, s, 4);
+
+				if (word & 0x80808080)
+					break;
+
+				d[0] = s[0];
+				d[1] = s[1];
+				d[2] = s[2];
+				d[3] = s[3];
+				d += 4;
+				s += 4;
+			}
+
+			while (s < end && *s < 0x80)
+				*d++ = *s++;
+
+			continue;
+		}
+
+		if (c >= 0xc2 && c <= 0xdf) {
+			c &= 0x1f;
+			n = 1;
+			min = 0x80;
+		} else if ((c & 0xf0) == 0xe0) {
+			c &= 0x0f;
+			n = 2;
+			min = 0x800;
+		} else if (c >= 0xf0 && c <= 0xf4) {
+			c &= 0x07;
+			n = 3;
+			min = 0x10000;
+		} else
+			return -1;
+
+		if (end - s <= n)
+			return -1;
+
+		for (s++; n > 0; n--, s++) {
+			if ((*s & 0xc0) != 0x80)
+				return -1;
+
+			c = (c << 6) | (*s & 0x3f);
+		}
+
+		/* Overlong forms, surrogates and beyond Unicode */
+		if (c < min || (c >= 0xd800 && c <= 0xdfff) || c > 0x10ffff)
+			return -1;
+
+		if (c < 0x10000) {
+			*d++ = c;
 		} else {
-			/* Grow data and retry */
-			parcel_grow(p, sizeof(int32_t));
+			c -= 0x10000;
+			*d++ = 0xd800 | (c >> 10);
+			*d++ = 0xdc00 | (c & 0x3ff);
 		}
 	}
-	return 0;
+
+	return d - out;
+}
+
+/*
+ * Returns the code point at *i and advances *i past it, -1 at the end
+ * of the string or on a broken surrogate pair.
+ */
+static int32_t utf16_next(const char16_t *s16, int len16, int *i)
+{
+	uint32_t c;
+	uint32_t lo;
+
+	if (*i >= len16 || s16[*i] == 0)
+		return -1;
+
+	c = s16[(*i)++];
+
+	if (c < 0xd800 || c > 0xdfff)
+		return c;
+
+	if (c > 0xdbff || *i >= len16)
+		return -1;
+
+	lo = s16[*i];
+	if (lo < 0xdc00 || lo > 0xdfff)
+		return -1;
+
+	(*i)++;
+
+	return 0x10000 + ((c - 0xd800) << 10) + (lo - 0xdc00);
+}
+
+/*
+ * Converts up to len16 code units, stopping early at a NUL, into out.
+ * At most size bytes including the terminating NUL are written, and only
+ * whole characters.  Returns the length of the complete conversion, or -1
+ * if the input is not valid UTF-16.
+ */
+static int utf16_to_utf8(const char16_t *s16, int len16, char *out,
+				size_t size)
+{
+	size_t n = 0;
+	size_t written = 0;
+	int i = 0;
+
+	while (i < len16 && s16[i] != 0) {
+		char buf[4];
+		int32_t c;
+		int clen;
+
+		/* ASCII fast path */
+		if (s16[i] < 0x80) {
+			if (n + 1 < size && written == n) {
+				out[n] = s16[i];
+				written++;
+			}
+
+			n++;
+			i++;
+			continue;
+		}
+
+		c = utf16_next(s16, len16, &i);
+		if (c < 0)
+			return -1;
+
+		if (c < 0x800) {
+			buf[0] = 0xc0 | (c >> 6);
+			buf[1] = 0x80 | (c & 0x3f);
+			clen = 2;
+		} else if (c < 0x10000) {
+			buf[0] = 0xe0 | (c >> 12);
+			buf[1] = 0x80 | ((c >> 6) & 0x3f);
+			buf[2] = 0x80 | (c & 0x3f);
+			clen = 3;
+		} else {
+			buf[0] = 0xf0 | (c >> 18);
+			buf[1] = 0x80 | ((c >> 12) & 0x3f);
+			buf[2] = 0x80 | ((c >> 6) & 0x3f);
+			buf[3] = 0x80 | (c & 0x3f);
+			clen = 4;
+		}
+
+		if (n + clen < size && written == n) {
+			memcpy(out + n, buf, clen);
+			written += clen;
+		}
+
+		n += clen;
+	}
+
+	if (size > 0)
+		out[written] = '\0';
+
+	return n;
 }
 
 int parcel_w_string(struct parcel *p, const char *str)
 {
-	gunichar2 *gs16;
-	glong gs16_len;
 	size_t len;
-	size_t gs16_size;
+	size_t bytes;
+	size_t padded;
+	char16_t *s16;
+	int len16;
 
 	if (str == NULL) {
 		parcel_w_int32(p, -1);
 		return 0;
 	}
 
-	gs16 = g_utf8_to_utf16(str, -1, NULL, &gs16_len, NULL);
+	/* Reserve for the worst case and convert right into the parcel */
+	len = strlen(str);
+	parcel_reserve(p, parcel_string_size(str));
 
-	if (parcel_w_int32(p, gs16_len) == -1)
+	s16 = (char16_t *) (void *) (p->data + p->offset + sizeof(int32_t));
+	len16 = utf8_to_utf16(str, len, s16);
+	if (len16 < 0) {
+		ofono_error("%s: wrong UTF8 coding", __func__);
+		parcel_w_int32(p, -1);
 		return -1;
+	}
 
-	gs16_size = gs16_len * sizeof(char16_t);
-	len = gs16_size + sizeof(char16_t);
-	for (;;) {
-		size_t padded = PAD_SIZE(len);
-
-		if (p->offset + len < p->capacity) {
-			/* There's enough space */
-			memcpy(p->data + p->offset, gs16, gs16_size);
-			*((char16_t *) (void *)
-				(p->data + p->offset + gs16_size)) = 0;
-			p->offset += padded;
-			p->size += padded;
-			if (padded != len) {
-
-#if BYTE_ORDER == BIG_ENDIAN
-				static const uint32_t mask[4] = {
-					0x00000000, 0xffffff00,
-					0xffff0000, 0xff000000
-				};
-#endif
-#if BYTE_ORDER == LITTLE_ENDIAN
-				static const uint32_t mask[4] = {
-					0x00000000, 0x00ffffff,
-					0x0000ffff, 0x000000ff
-				};
-#endif
+	*((int32_t *) (void *) (p->data + p->offset)) = len16;
+	s16[len16] = 0;
 
-				*((uint32_t *) (void *)
-					(p->data + p->offset - 4)) &=
-							mask[padded - len];
-			}
-			break;
+	bytes = (len16 + 1) * sizeof(char16_t);
+	padded = PAD_SIZE(bytes);
+	memset((char *) s16 + bytes, 0, padded - bytes);
 
-		} else {
-			/* Grow data and retry */
-			parcel_grow(p, padded);
-		}
-	}
+	p->offset += sizeof(int32_t) + padded;
+	p->size += sizeof(int32_t) + padded;
 
-	g_free(gs16);
 	return 0;
 }
 
-char *parcel_r_string(struct parcel *p)
+int parcel_r_string_view(struct parcel *p, struct parcel_str_view *view)
 {
-	char *ret;
 	int len16 = parcel_r_int32(p);
 	int strbytes;
 
+	view->data = NULL;
+	view->len = 0;
+
 	if (p->malformed)
-		return NULL;
+		return -1;
 
 	/* This is how a null string is sent */
 	if (len16 < 0)
-		return NULL;
+		return 0;
 
 	strbytes = PAD_SIZE((len16 + 1) * sizeof(char16_t));
 	if (p->offset + strbytes > p->size) {
 		ofono_error("%s: parcel is too small", __func__);
 		p->malformed = 1;
-		return NULL;
+		return -1;
 	}
 
-	ret = g_utf16_to_utf8((gunichar2 *) (void *) (p->data + p->offset),
-				len16, NULL, NULL, NULL);
+	view->data = (const char16_t *) (void *) (p->data + p->offset);
+	view->len = len16;
+	p->offset += strbytes;
+
+	return 0;
+}
+
+int parcel_str_view_cmp(const struct parcel_str_view *view, const char *str)
+{
+	const unsigned char *s = (const unsigned char *) str;
+	int i = 0;
+
+	if (view->data == NULL || str == NULL)
+		return (view->data != NULL) - (str != NULL);
+
+	for (;;) {
+		int32_t c16;
+		int32_t c8;
+
+		/* ASCII fast path */
+		if (i < view->len && view->data[i] < 0x80 && *s < 0x80) {
+			if (view->data[i] != *s || *s == 0)
+				return (int) view->data[i] - (int) *s;
+
+			i++;
+			s++;
+			continue;
+		}
+
+		c16 = utf16_next(view->data, view->len, &i);
+
+		if (*s < 0x80) {
+			c8 = *s ? *s++ : -1;
+		} else {
+			const gchar *next = g_utf8_next_char((const gchar *) s);
+
+			c8 = g_utf8_get_char_validated((const gchar *) s,
+							-1);
+			s = (const unsigned char *) next;
+
+			/* Invalid UTF-8 never matches */
+			if (c8 < 0)
+				return -1;
+		}
+
+		if (c16 != c8 || c16 < 0)
+			return c16 < c8 ? -1 : (c16 > c8 ? 1 : 0);
+	}
+}
+
+int parcel_str_view_to_utf8(const struct parcel_str_view *view, char *buf,
+				size_t size)
+{
+	if (view->data == NULL) {
+		if (size > 0)
+			buf[0] = '\0';
+
+		return -1;
+	}
+
+	return utf16_to_utf8(view->data, view->len, buf, size);
+}
+
+char *parcel_str_view_dup(const struct parcel_str_view *view)
+{
+	char *ret;
+	int len;
+
+	if (view->data == NULL)
+		return NULL;
+
+	len = utf16_to_utf8(view->data, view->len, NULL, 0);
+	if (len < 0)
+		return NULL;
+
+	ret = g_malloc(len + 1);
+	utf16_to_utf8(view->data, view->len, ret, len + 1);
+
+	return ret;
+}
+
+char *parcel_r_string(struct parcel *p)
+{
+	struct parcel_str_view view;
+	char *ret;
+
+	if (parcel_r_string_view(p, &view) < 0 || view.data == NULL)
+		return NULL;
+
+	ret = parcel_str_view_dup(&view);
 	if (ret == NULL) {
 		ofono_error("%s: wrong UTF16 coding", __func__);
 		p->malformed = 1;
 		return NULL;
 	}
 
-	p->offset += strbytes;
-
 	return ret;
 }
 
@@ -228,20 +492,12 @@ int parcel_w_raw(struct parcel *p, const void *data, size_t len)
 	}
 
 	parcel_w_int32(p, len);
+	parcel_reserve(p, len);
 
-	for (;;) {
+	memcpy(p->data + p->offset, data, len);
+	p->offset += len;
+	p->size += len;
 
-		if (p->offset + len < p->capacity) {
-			/* There's enough space */
-			memcpy(p->data + p->offset, data, len);
-			p->offset += len;
-			p->size += len;
-			break;
-		} else {
-			/* Grow data and retry */
-			parcel_grow(p, len);
-		}
-	}
 	return 0;
 }
 
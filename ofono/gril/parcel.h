@@ -33,13 +33,26 @@ struct parcel {
 	int malformed;
 };
 
+/* A string inside of a parcel, in UTF-16 */
+struct parcel_str_view {
+	const uint16_t *data;	/* NULL for a null string */
+	int len;		/* Number of code units */
+};
+
 void parcel_init(struct parcel *p);
+void parcel_init_sized(struct parcel *p, size_t capacity);
 void parcel_grow(struct parcel *p, size_t size);
 void parcel_free(struct parcel *p);
 int32_t parcel_r_int32(struct parcel *p);
 int parcel_w_int32(struct parcel *p, int32_t val);
 int parcel_w_string(struct parcel *p, const char *str);
 char *parcel_r_string(struct parcel *p);
+int parcel_r_string_view(struct parcel *p, struct parcel_str_view *view);
+int parcel_str_view_cmp(const struct parcel_str_view *view, const char *str);
+int parcel_str_view_to_utf8(const struct parcel_str_view *view, char *buf,
+				size_t size);
+char *parcel_str_view_dup(const struct parcel_str_view *view);
+size_t parcel_string_size(const char *str);
 void parcel_skip_string(struct parcel *p);
 int parcel_w_raw(struct parcel *p, const void *data, size_t len);
 void *parcel_r_raw(struct parcel *p,  int *len);
@@ -222,12 +222,18 @@ struct ofono_sim_driver {
 	/* API version 2 (since 1.29+git1) */
 	void (*set_active_card_slot)(struct ofono_sim *sim, unsigned int index,
 			ofono_sim_set_active_card_slot_cb_t cb, void *data);
+	/* API version 3 (since 1.29+git9) */
+	void (*read_file_records)(struct ofono_sim *sim, int fileid,
+			enum ofono_sim_file_structure structure,
+			int record, int count, int length,
+			const unsigned char *path, unsigned int path_len,
+			ofono_sim_read_cb_t cb, void *data);
 };
 
 int ofono_sim_driver_register(const struct ofono_sim_driver *d);
 void ofono_sim_driver_unregister(const struct ofono_sim_driver *d);
 
-#define OFONO_SIM_DRIVER_API_VERSION 2
+#define OFONO_SIM_DRIVER_API_VERSION 3
 #define ofono_sim_driver_register(d) /* Since 1.28+git4 */ \
 	ofono_sim_driver_register_version(d, OFONO_SIM_DRIVER_API_VERSION)
 int ofono_sim_driver_register_version(const struct ofono_sim_driver *d, int v);
@@ -335,9 +335,14 @@ static int gobi_enable(struct ofono_modem *modem)
 		return -ENOMEM;
 	}
 
-	if (getenv("OFONO_QMI_DEBUG"))
+	if (getenv("OFONO_QMI_DEBUG")) {
 		qmi_device_set_debug(data->device, gobi_debug, "QMI: ");
 
+		/* Raw dumps of the traffic are rarely needed */
+		if (getenv("OFONO_QMI_HEXDUMP"))
+			qmi_device_set_hexdump(data->device, true);
+	}
+
 	qmi_device_set_close_on_unref(data->device, true);
 
 	qmi_device_discover(data->device, discover_cb, modem, NULL);
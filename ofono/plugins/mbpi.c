@@ -50,9 +50,20 @@
 #  endif
 #endif
 
+#ifndef MBPI_INDEX
+#  if defined(STORAGEDIR)
+#    define MBPI_INDEX STORAGEDIR "/mbpi.index"
+#  elif defined(DEFAULT_STORAGEDIR)
+#    define MBPI_INDEX DEFAULT_STORAGEDIR "/mbpi.index"
+#  else
+#    define MBPI_INDEX NULL
+#  endif
+#endif
+
 #include "mbpi.h"
 
 const char *mbpi_database = MBPI_DATABASE;
+const char *mbpi_index = MBPI_INDEX;
 
 /*
  * Use IPv4 for MMS contexts because gprs.c assumes that MMS proxy
@@ -66,12 +77,111 @@ enum ofono_gprs_auth_method mbpi_default_auth_method = OFONO_GPRS_AUTH_METHOD_AN
 
 #define OFONO_GPRS_AUTH_METHOD_UNSPECIFIED ((enum ofono_gprs_auth_method)(-1))
 
+/*
+ * The default protocols are resolved when the lookup returns, so that
+ * the compiled index doesn't depend on them.
+ */
+#define MBPI_PROTO_DEFAULT ((enum ofono_gprs_proto)(-1))
+#define MBPI_PROTO_DEFAULT_INTERNET ((enum ofono_gprs_proto)(-2))
+#define MBPI_PROTO_DEFAULT_MMS ((enum ofono_gprs_proto)(-3))
+#define MBPI_PROTO_DEFAULT_IMS ((enum ofono_gprs_proto)(-4))
+
 #define _(x) case x: return (#x)
 
 enum MBPI_ERROR {
 	MBPI_ERROR_DUPLICATE,
 };
 
+/*
+ * The compiled index.  The file consists of the header followed by the
+ * arrays of access points, networks (sorted by MCC and MNC), access point
+ * references of the networks, SIDs (sorted) and the string pool.  Strings
+ * are referenced by their offset in the pool.  The index is only used on
+ * the machine that produced it, everything is in host byte order.
+ */
+#define MBPI_INDEX_MAGIC "MBPIidx"
+#define MBPI_INDEX_VERSION 1
+#define MBPI_INDEX_NONE 0xffffffff
+
+struct mbpi_index_header {
+	char magic[8];
+	guint32 version;
+	guint32 header_size;
+	guint64 db_dev;
+	guint64 db_ino;
+	guint64 db_size;
+	gint64 db_mtime;
+	gint64 db_mtime_nsec;
+	guint32 database;
+	guint32 unmatched_name;
+	guint32 n_apns;
+	guint32 n_networks;
+	guint32 n_refs;
+	guint32 n_sids;
+	guint32 strings_size;
+};
+
+struct mbpi_index_apn {
+	guint32 provider_name;
+	guint32 name;
+	guint32 apn;
+	guint32 username;
+	guint32 password;
+	guint32 message_proxy;
+	guint32 message_center;
+	guint32 line;
+	gint32 type;
+	gint32 proto;
+	gint32 auth_method;
+	guint32 provider_primary;
+};
+
+struct mbpi_index_network {
+	guint32 mcc;
+	guint32 mnc;
+	guint32 first;
+	guint32 count;
+};
+
+struct mbpi_index_sid {
+	guint32 sid;
+	guint32 provider_name;
+};
+
+/* What the index is compiled from */
+struct index_data {
+	GPtrArray *apns;
+	GArray *lines;
+	GHashTable *networks;
+	GSList *gsm_networks;	/* Seen so far in the current <gsm> */
+	GHashTable *sids;
+	GSList *provider_sids;	/* Seen in the current <provider> */
+	char *unmatched_name;
+};
+
+struct index_network {
+	char *mcc;
+	char *mnc;
+	GArray *apns;
+};
+
+struct index_map {
+	char *database;
+	struct stat st;
+	void *data;
+	gsize size;
+	gboolean mapped;
+	const struct mbpi_index_header *hdr;
+	const struct mbpi_index_apn *apns;
+	const struct mbpi_index_network *networks;
+	const guint32 *refs;
+	const struct mbpi_index_sid *sids;
+	const char *strings;
+};
+
+static struct index_map *index_map;
+
+/* In index mode (non-NULL index) all networks and SIDs are matched */
 struct gsm_data {
 	const char *match_mcc;
 	const char *match_mnc;
@@ -80,12 +190,14 @@ struct gsm_data {
 	GSList *apns;
 	gboolean match_found;
 	gboolean allow_duplicates;
+	struct index_data *index;
 };
 
 struct cdma_data {
 	const char *match_sid;
 	char *provider_name;
 	gboolean match_found;
+	struct index_data *index;
 };
 
 const char *mbpi_ap_type(enum ofono_gprs_context_type type)
@@ -119,6 +231,29 @@ void mbpi_ap_free(struct ofono_gprs_provision_data *ap)
 	g_free(ap);
 }
 
+static void mbpi_ap_apply_defaults(struct ofono_gprs_provision_data *ap)
+{
+	if (ap->proto == MBPI_PROTO_DEFAULT)
+		ap->proto = mbpi_default_proto;
+	else if (ap->proto == MBPI_PROTO_DEFAULT_INTERNET)
+		ap->proto = mbpi_default_internet_proto;
+	else if (ap->proto == MBPI_PROTO_DEFAULT_MMS)
+		ap->proto = mbpi_default_mms_proto;
+	else if (ap->proto == MBPI_PROTO_DEFAULT_IMS)
+		ap->proto = mbpi_default_ims_proto;
+
+	/* Fix the authentication method if none was specified */
+	if (ap->auth_method == OFONO_GPRS_AUTH_METHOD_UNSPECIFIED) {
+		if ((!ap->username || !ap->username[0]) &&
+				(!ap->password || !ap->password[0])) {
+			/* No username or password => no authentication */
+			ap->auth_method = OFONO_GPRS_AUTH_METHOD_NONE;
+		} else {
+			ap->auth_method = mbpi_default_auth_method;
+		}
+	}
+}
+
 static void mbpi_g_set_error(GMarkupParseContext *context, GError **error,
 				GQuark domain, gint code, const gchar *fmt, ...)
 {
@@ -243,13 +378,13 @@ static void usage_start(GMarkupParseContext *context,
 
 	if (strcmp(text, "internet") == 0) {
 		apn->type = OFONO_GPRS_CONTEXT_TYPE_INTERNET;
-		apn->proto = mbpi_default_internet_proto;
+		apn->proto = MBPI_PROTO_DEFAULT_INTERNET;
 	} else if (strcmp(text, "mms") == 0) {
 		apn->type = OFONO_GPRS_CONTEXT_TYPE_MMS;
-		apn->proto = mbpi_default_mms_proto;
+		apn->proto = MBPI_PROTO_DEFAULT_MMS;
 	} else if (strcmp(text, "ims") == 0) {
 		apn->type = OFONO_GPRS_CONTEXT_TYPE_IMS;
-		apn->proto = mbpi_default_ims_proto;
+		apn->proto = MBPI_PROTO_DEFAULT_IMS;
 	} else if (strcmp(text, "wap") == 0)
 		apn->type = OFONO_GPRS_CONTEXT_TYPE_WAP;
 	else
@@ -328,6 +463,122 @@ static const GMarkupParser skip_parser = {
 	NULL,
 };
 
+static guint index_network_hash(gconstpointer key)
+{
+	const struct index_network *net = key;
+
+	return g_str_hash(net->mcc) * 31 + g_str_hash(net->mnc);
+}
+
+static gboolean index_network_equal(gconstpointer a, gconstpointer b)
+{
+	const struct index_network *net_a = a;
+	const struct index_network *net_b = b;
+
+	return g_str_equal(net_a->mcc, net_b->mcc) &&
+				g_str_equal(net_a->mnc, net_b->mnc);
+}
+
+static void index_network_free(gpointer data)
+{
+	struct index_network *net = data;
+
+	g_free(net->mcc);
+	g_free(net->mnc);
+	g_array_free(net->apns, TRUE);
+	g_free(net);
+}
+
+static struct index_data *index_data_new(void)
+{
+	struct index_data *index = g_new0(struct index_data, 1);
+
+	index->apns = g_ptr_array_new_with_free_func((GDestroyNotify)
+								mbpi_ap_free);
+	index->lines = g_array_new(FALSE, FALSE, sizeof(guint32));
+	index->networks = g_hash_table_new_full(index_network_hash,
+						index_network_equal,
+						index_network_free, NULL);
+	index->sids = g_hash_table_new_full(g_str_hash, g_str_equal,
+						g_free, g_free);
+	return index;
+}
+
+static void index_data_free(struct index_data *index)
+{
+	g_ptr_array_free(index->apns, TRUE);
+	g_array_free(index->lines, TRUE);
+	g_hash_table_destroy(index->networks);
+	g_slist_free(index->gsm_networks);
+	g_hash_table_destroy(index->sids);
+	g_slist_free_full(index->provider_sids, g_free);
+	g_free(index->unmatched_name);
+	g_free(index);
+}
+
+static void index_add_network(struct index_data *index, const char *mcc,
+							const char *mnc)
+{
+	struct index_network key, *net;
+
+	key.mcc = (char *) mcc;
+	key.mnc = (char *) mnc;
+	net = g_hash_table_lookup(index->networks, &key);
+
+	if (net == NULL) {
+		net = g_new0(struct index_network, 1);
+		net->mcc = g_strdup(mcc);
+		net->mnc = g_strdup(mnc);
+		net->apns = g_array_new(FALSE, FALSE, sizeof(guint32));
+		g_hash_table_add(index->networks, net);
+	}
+
+	if (g_slist_find(index->gsm_networks, net) == NULL)
+		index->gsm_networks = g_slist_prepend(index->gsm_networks,
+									net);
+}
+
+/* The access point belongs to the networks listed before it */
+static void index_add_apn(struct index_data *index,
+				struct ofono_gprs_provision_data *ap,
+				guint32 line)
+{
+	guint32 i = index->apns->len;
+	GSList *l;
+
+	g_ptr_array_add(index->apns, ap);
+	g_array_append_val(index->lines, line);
+
+	for (l = index->gsm_networks; l; l = l->next) {
+		struct index_network *net = l->data;
+
+		g_array_append_val(net->apns, i);
+	}
+}
+
+/* Like the lookup does, the first provider with the SID wins */
+static void index_add_sid(struct index_data *index, const char *sid)
+{
+	if (g_hash_table_contains(index->sids, sid) ||
+			g_slist_find_custom(index->provider_sids, sid,
+						(GCompareFunc) strcmp))
+		return;
+
+	index->provider_sids = g_slist_prepend(index->provider_sids,
+							g_strdup(sid));
+}
+
+static void index_end_provider(struct index_data *index, const char *name)
+{
+	GSList *l;
+
+	for (l = index->provider_sids; l; l = l->next)
+		g_hash_table_insert(index->sids, l->data, g_strdup(name));
+
+	g_slist_free(index->provider_sids);
+	index->provider_sids = NULL;
+}
+
 static void network_id_handler(GMarkupParseContext *context,
 				struct gsm_data *gsm,
 				const gchar **attribute_names,
@@ -358,7 +609,10 @@ static void network_id_handler(GMarkupParseContext *context,
 		return;
 	}
 
-	if (g_str_equal(mcc, gsm->match_mcc) &&
+	if (gsm->index) {
+		index_add_network(gsm->index, mcc, mnc);
+		gsm->match_found = TRUE;
+	} else if (g_str_equal(mcc, gsm->match_mcc) &&
 			g_str_equal(mnc, gsm->match_mnc))
 		gsm->match_found = TRUE;
 }
@@ -398,7 +652,7 @@ static void apn_handler(GMarkupParseContext *context, struct gsm_data *gsm,
 
 	ap->apn = g_strdup(apn);
 	ap->type = OFONO_GPRS_CONTEXT_TYPE_INTERNET;
-	ap->proto = mbpi_default_proto;
+	ap->proto = MBPI_PROTO_DEFAULT;
 	ap->auth_method = OFONO_GPRS_AUTH_METHOD_UNSPECIFIED;
 
 	g_markup_parse_context_push(context, &apn_parser, ap);
@@ -428,7 +682,9 @@ static void sid_handler(GMarkupParseContext *context,
 		return;
 	}
 
-	if (g_str_equal(sid, cdma->match_sid))
+	if (cdma->index)
+		index_add_sid(cdma->index, sid);
+	else if (g_str_equal(sid, cdma->match_sid))
 		cdma->match_found = TRUE;
 }
 
@@ -444,7 +700,7 @@ static void gsm_start(GMarkupParseContext *context, const gchar *element_name,
 		 * For entries with multiple network-id elements, don't bother
 		 * searching if we already have a match
 		 */
-		if (gsm->match_found == TRUE)
+		if (gsm->match_found == TRUE && !gsm->index)
 			return;
 
 		network_id_handler(context, userdata, attribute_names,
@@ -469,17 +725,17 @@ static void gsm_end(GMarkupParseContext *context, const gchar *element_name,
 	if (ap == NULL)
 		return;
 
-	/* Fix the authentication method if none was specified */
-	if (ap->auth_method == OFONO_GPRS_AUTH_METHOD_UNSPECIFIED) {
-		if ((!ap->username || !ap->username[0]) &&
-				(!ap->password || !ap->password[0])) {
-			/* No username or password => no authentication */
-			ap->auth_method = OFONO_GPRS_AUTH_METHOD_NONE;
-		} else {
-			ap->auth_method = mbpi_default_auth_method;
-		}
+	if (gsm->index) {
+		gint line_number, char_number;
+
+		g_markup_parse_context_get_position(context, &line_number,
+							&char_number);
+		index_add_apn(gsm->index, ap, line_number);
+		return;
 	}
 
+	mbpi_ap_apply_defaults(ap);
+
 	if (gsm->allow_duplicates == FALSE) {
 		GSList *l;
 
@@ -589,6 +845,12 @@ static void gsm_provider_start(GMarkupParseContext *context,
 						&gsm->provider_name);
 	} else if (g_str_equal(element_name, "gsm")) {
 		gsm->match_found = FALSE;
+
+		if (gsm->index) {
+			g_slist_free(gsm->index->gsm_networks);
+			gsm->index->gsm_networks = NULL;
+		}
+
 		g_markup_parse_context_push(context, &gsm_parser, gsm);
 	} else if (g_str_equal(element_name, "cdma"))
 		g_markup_parse_context_push(context, &skip_parser, NULL);
@@ -668,8 +930,15 @@ static void toplevel_cdma_end(GMarkupParseContext *context,
 					const gchar *element_name,
 					gpointer userdata, GError **error)
 {
-	if (g_str_equal(element_name, "provider"))
-		g_markup_parse_context_pop(context);
+	struct cdma_data *cdma = userdata;
+
+	if (g_str_equal(element_name, "provider") == FALSE)
+		return;
+
+	g_markup_parse_context_pop(context);
+
+	if (cdma->index)
+		index_end_provider(cdma->index, cdma->provider_name);
 }
 
 static const GMarkupParser toplevel_cdma_parser = {
@@ -681,7 +950,7 @@ static const GMarkupParser toplevel_cdma_parser = {
 };
 
 static gboolean mbpi_parse(const GMarkupParser *parser, gpointer userdata,
-				GError **error)
+				struct stat *out_st, GError **error)
 {
 	struct stat st;
 	char *db;
@@ -717,6 +986,9 @@ static gboolean mbpi_parse(const GMarkupParser *parser, gpointer userdata,
 		return FALSE;
 	}
 
+	if (out_st)
+		*out_st = st;
+
 	context = g_markup_parse_context_new(parser,
 						G_MARKUP_TREAT_CDATA_AS_TEXT,
 						userdata, NULL);
@@ -733,18 +1005,548 @@ static gboolean mbpi_parse(const GMarkupParser *parser, gpointer userdata,
 	return ret;
 }
 
+static gboolean index_same_file(const struct stat *a, const struct stat *b)
+{
+	return a->st_dev == b->st_dev && a->st_ino == b->st_ino &&
+		a->st_size == b->st_size && a->st_mtime == b->st_mtime &&
+		a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+/*
+ * Parses the whole database in index mode.  Any error, even one that
+ * wouldn't affect some lookups, leaves the lookups to the XML parser
+ * which reports it exactly as before.
+ */
+static gboolean index_compile(struct index_data *index, struct stat *st)
+{
+	struct gsm_data gsm;
+	struct cdma_data cdma;
+	struct stat cdma_st;
+	GError *error = NULL;
+	gboolean ret;
+
+	memset(&gsm, 0, sizeof(gsm));
+	gsm.index = index;
+
+	/* mbpi_parse() may succeed and still report an error at the end */
+	ret = mbpi_parse(&toplevel_gsm_parser, &gsm, st, &error);
+	g_free(gsm.provider_name);
+
+	if (ret == FALSE || error) {
+		g_clear_error(&error);
+		return FALSE;
+	}
+
+	memset(&cdma, 0, sizeof(cdma));
+	cdma.index = index;
+
+	ret = mbpi_parse(&toplevel_cdma_parser, &cdma, &cdma_st, &error);
+
+	/* This is what a lookup of an unknown SID returns */
+	index->unmatched_name = cdma.provider_name;
+
+	if (ret == FALSE || error) {
+		g_clear_error(&error);
+		return FALSE;
+	}
+
+	return index_same_file(st, &cdma_st);
+}
+
+static guint32 index_string(GByteArray *pool, GHashTable *offsets,
+							const char *str)
+{
+	gpointer value;
+	guint32 offset;
+
+	if (str == NULL)
+		return MBPI_INDEX_NONE;
+
+	if (g_hash_table_lookup_extended(offsets, str, NULL, &value))
+		return GPOINTER_TO_UINT(value);
+
+	offset = pool->len;
+	g_byte_array_append(pool, (const guint8 *) str, strlen(str) + 1);
+	g_hash_table_insert(offsets, (gpointer) str, GUINT_TO_POINTER(offset));
+
+	return offset;
+}
+
+static int index_network_compare(gconstpointer a, gconstpointer b)
+{
+	const struct index_network *net_a = *(const struct index_network **) a;
+	const struct index_network *net_b = *(const struct index_network **) b;
+	int r = strcmp(net_a->mcc, net_b->mcc);
+
+	return r ? r : strcmp(net_a->mnc, net_b->mnc);
+}
+
+static void *index_serialize(struct index_data *index, const struct stat *st,
+								gsize *out_size)
+{
+	struct mbpi_index_header hdr;
+	GByteArray *out = g_byte_array_new();
+	GByteArray *pool = g_byte_array_new();
+	GHashTable *offsets = g_hash_table_new(g_str_hash, g_str_equal);
+	GPtrArray *networks = g_ptr_array_new();
+	GHashTableIter iter;
+	gpointer key, value;
+	GList *sids, *l;
+	guint32 first = 0;
+	guint i;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, MBPI_INDEX_MAGIC, sizeof(hdr.magic));
+	hdr.version = MBPI_INDEX_VERSION;
+	hdr.header_size = sizeof(hdr);
+	hdr.db_dev = st->st_dev;
+	hdr.db_ino = st->st_ino;
+	hdr.db_size = st->st_size;
+	hdr.db_mtime = st->st_mtime;
+	hdr.db_mtime_nsec = st->st_mtim.tv_nsec;
+	hdr.database = index_string(pool, offsets, mbpi_database);
+	hdr.unmatched_name = index_string(pool, offsets,
+						index->unmatched_name);
+
+	/* The header is rewritten once everything has been counted */
+	g_byte_array_append(out, (const guint8 *) &hdr, sizeof(hdr));
+
+	for (i = 0; i < index->apns->len; i++) {
+		const struct ofono_gprs_provision_data *ap =
+					g_ptr_array_index(index->apns, i);
+		struct mbpi_index_apn rec;
+
+		rec.provider_name = index_string(pool, offsets,
+							ap->provider_name);
+		rec.name = index_string(pool, offsets, ap->name);
+		rec.apn = index_string(pool, offsets, ap->apn);
+		rec.username = index_string(pool, offsets, ap->username);
+		rec.password = index_string(pool, offsets, ap->password);
+		rec.message_proxy = index_string(pool, offsets,
+							ap->message_proxy);
+		rec.message_center = index_string(pool, offsets,
+							ap->message_center);
+		rec.line = g_array_index(index->lines, guint32, i);
+		rec.type = ap->type;
+		rec.proto = ap->proto;
+		rec.auth_method = ap->auth_method;
+		rec.provider_primary = ap->provider_primary;
+		g_byte_array_append(out, (const guint8 *) &rec, sizeof(rec));
+	}
+
+	g_hash_table_iter_init(&iter, index->networks);
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+		g_ptr_array_add(networks, key);
+
+	g_ptr_array_sort(networks, index_network_compare);
+
+	for (i = 0; i < networks->len; i++) {
+		const struct index_network *net =
+					g_ptr_array_index(networks, i);
+		struct mbpi_index_network rec;
+
+		rec.mcc = index_string(pool, offsets, net->mcc);
+		rec.mnc = index_string(pool, offsets, net->mnc);
+		rec.first = first;
+		rec.count = net->apns->len;
+		first += rec.count;
+		g_byte_array_append(out, (const guint8 *) &rec, sizeof(rec));
+	}
+
+	for (i = 0; i < networks->len; i++) {
+		const struct index_network *net =
+					g_ptr_array_index(networks, i);
+
+		g_byte_array_append(out, (const guint8 *) net->apns->data,
+					net->apns->len * sizeof(guint32));
+	}
+
+	sids = g_list_sort(g_hash_table_get_keys(index->sids),
+							(GCompareFunc) strcmp);
+
+	for (l = sids; l; l = l->next) {
+		struct mbpi_index_sid rec;
+
+		value = g_hash_table_lookup(index->sids, l->data);
+		rec.sid = index_string(pool, offsets, l->data);
+		rec.provider_name = index_string(pool, offsets, value);
+		g_byte_array_append(out, (const guint8 *) &rec, sizeof(rec));
+	}
+
+	hdr.n_apns = index->apns->len;
+	hdr.n_networks = networks->len;
+	hdr.n_refs = first;
+	hdr.n_sids = g_list_length(sids);
+	hdr.strings_size = pool->len;
+	memcpy(out->data, &hdr, sizeof(hdr));
+	g_byte_array_append(out, pool->data, pool->len);
+
+	g_list_free(sids);
+	g_ptr_array_free(networks, TRUE);
+	g_hash_table_destroy(offsets);
+	g_byte_array_free(pool, TRUE);
+
+	*out_size = out->len;
+	return g_byte_array_free(out, FALSE);
+}
+
+static gboolean index_check_string(const struct index_map *map,
+					guint32 offset, gboolean optional)
+{
+	if (offset == MBPI_INDEX_NONE)
+		return optional;
+
+	return offset < map->hdr->strings_size;
+}
+
+/* Validates whatever is found in the file before anything uses it */
+static gboolean index_map_check(struct index_map *map)
+{
+	const struct mbpi_index_header *hdr = map->data;
+	const char *ptr = map->data;
+	guint64 size;
+	guint32 i;
+
+	if (map->size < sizeof(*hdr) ||
+			memcmp(hdr->magic, MBPI_INDEX_MAGIC,
+						sizeof(hdr->magic)) ||
+			hdr->version != MBPI_INDEX_VERSION ||
+			hdr->header_size != sizeof(*hdr))
+		return FALSE;
+
+	size = sizeof(*hdr) +
+		(guint64) hdr->n_apns * sizeof(struct mbpi_index_apn) +
+		(guint64) hdr->n_networks * sizeof(struct mbpi_index_network) +
+		(guint64) hdr->n_refs * sizeof(guint32) +
+		(guint64) hdr->n_sids * sizeof(struct mbpi_index_sid) +
+		hdr->strings_size;
+
+	if (size != map->size || hdr->strings_size == 0)
+		return FALSE;
+
+	map->hdr = hdr;
+	ptr += sizeof(*hdr);
+	map->apns = (const void *) ptr;
+	ptr += hdr->n_apns * sizeof(struct mbpi_index_apn);
+	map->networks = (const void *) ptr;
+	ptr += hdr->n_networks * sizeof(struct mbpi_index_network);
+	map->refs = (const void *) ptr;
+	ptr += hdr->n_refs * sizeof(guint32);
+	map->sids = (const void *) ptr;
+	ptr += hdr->n_sids * sizeof(struct mbpi_index_sid);
+	map->strings = ptr;
+
+	if (map->strings[hdr->strings_size - 1] != '\0' ||
+			!index_check_string(map, hdr->database, FALSE) ||
+			!index_check_string(map, hdr->unmatched_name, TRUE))
+		return FALSE;
+
+	for (i = 0; i < hdr->n_apns; i++) {
+		const struct mbpi_index_apn *rec = map->apns + i;
+
+		if (!index_check_string(map, rec->provider_name, TRUE) ||
+				!index_check_string(map, rec->name, TRUE) ||
+				!index_check_string(map, rec->apn, TRUE) ||
+				!index_check_string(map, rec->username, TRUE) ||
+				!index_check_string(map, rec->password, TRUE) ||
+				!index_check_string(map, rec->message_proxy,
+									TRUE) ||
+				!index_check_string(map, rec->message_center,
+									TRUE))
+			return FALSE;
+	}
+
+	for (i = 0; i < hdr->n_networks; i++) {
+		const struct mbpi_index_network *rec = map->networks + i;
+
+		if (!index_check_string(map, rec->mcc, FALSE) ||
+				!index_check_string(map, rec->mnc, FALSE) ||
+				(guint64) rec->first + rec->count > hdr->n_refs)
+			return FALSE;
+	}
+
+	for (i = 0; i < hdr->n_refs; i++)
+		if (map->refs[i] >= hdr->n_apns)
+			return FALSE;
+
+	for (i = 0; i < hdr->n_sids; i++) {
+		const struct mbpi_index_sid *rec = map->sids + i;
+
+		if (!index_check_string(map, rec->sid, FALSE) ||
+				!index_check_string(map, rec->provider_name,
+									TRUE))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean index_map_load(struct index_map *map)
+{
+	const struct mbpi_index_header *hdr;
+	struct stat st;
+	void *data;
+	int fd;
+
+	fd = open(mbpi_index, O_RDONLY);
+	if (fd < 0)
+		return FALSE;
+
+	if (fstat(fd, &st) < 0 || st.st_size == 0) {
+		close(fd);
+		return FALSE;
+	}
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED)
+		return FALSE;
+
+	map->data = data;
+	map->size = st.st_size;
+	map->mapped = TRUE;
+
+	if (index_map_check(map)) {
+		hdr = map->hdr;
+
+		if (hdr->db_dev == (guint64) map->st.st_dev &&
+				hdr->db_ino == (guint64) map->st.st_ino &&
+				hdr->db_size == (guint64) map->st.st_size &&
+				hdr->db_mtime == map->st.st_mtime &&
+				hdr->db_mtime_nsec == map->st.st_mtim.tv_nsec &&
+				g_str_equal(map->strings + hdr->database,
+							mbpi_database))
+			return TRUE;
+	}
+
+	munmap(data, st.st_size);
+	map->data = NULL;
+	map->size = 0;
+	map->mapped = FALSE;
+	return FALSE;
+}
+
+static void index_save(const void *data, gsize size)
+{
+	char *dir = g_path_get_dirname(mbpi_index);
+
+	/* The index is only a cache, failing to save it is not fatal */
+	if (g_mkdir_with_parents(dir, S_IRUSR | S_IWUSR | S_IXUSR) == 0)
+		g_file_set_contents(mbpi_index, data, size, NULL);
+
+	g_free(dir);
+}
+
+static gboolean index_map_build(struct index_map *map)
+{
+	struct index_data *index = index_data_new();
+	struct stat st;
+	gboolean ok;
+
+	ok = index_compile(index, &st) && index_same_file(&st, &map->st);
+
+	if (ok) {
+		map->data = index_serialize(index, &st, &map->size);
+		map->mapped = FALSE;
+
+		if (!index_map_check(map)) {
+			g_free(map->data);
+			map->data = NULL;
+			ok = FALSE;
+		}
+	}
+
+	index_data_free(index);
+
+	if (!ok)
+		return FALSE;
+
+	if (mbpi_index)
+		index_save(map->data, map->size);
+
+	return TRUE;
+}
+
+static void index_map_free(struct index_map *map)
+{
+	if (map->mapped)
+		munmap(map->data, map->size);
+	else
+		g_free(map->data);
+
+	g_free(map->database);
+	g_free(map);
+}
+
+/*
+ * Returns the index of the current database, loading or compiling it if
+ * necessary, or NULL if the database can't be compiled.  The outcome is
+ * remembered until the database file changes.
+ */
+static const struct index_map *index_get(void)
+{
+	struct index_map *map = index_map;
+	struct stat st;
+
+	if (stat(mbpi_database, &st) < 0)
+		return NULL;
+
+	if (map && (!g_str_equal(map->database, mbpi_database) ||
+					!index_same_file(&map->st, &st))) {
+		index_map_free(map);
+		map = index_map = NULL;
+	}
+
+	if (map == NULL) {
+		map = g_new0(struct index_map, 1);
+		map->database = g_strdup(mbpi_database);
+		map->st = st;
+
+		if (!mbpi_index || !index_map_load(map))
+			index_map_build(map);
+
+		index_map = map;
+	}
+
+	return map->data ? map : NULL;
+}
+
+static char *index_strdup(const struct index_map *map, guint32 offset)
+{
+	if (offset == MBPI_INDEX_NONE)
+		return NULL;
+
+	return g_strdup(map->strings + offset);
+}
+
+static const struct mbpi_index_network *index_find_network(
+					const struct index_map *map,
+					const char *mcc, const char *mnc)
+{
+	guint32 low = 0, high = map->hdr->n_networks;
+
+	while (low < high) {
+		guint32 mid = low + (high - low) / 2;
+		const struct mbpi_index_network *net = map->networks + mid;
+		int r = strcmp(mcc, map->strings + net->mcc);
+
+		if (r == 0)
+			r = strcmp(mnc, map->strings + net->mnc);
+
+		if (r == 0)
+			return net;
+
+		if (r < 0)
+			high = mid;
+		else
+			low = mid + 1;
+	}
+
+	return NULL;
+}
+
+static const struct mbpi_index_sid *index_find_sid(
+					const struct index_map *map,
+					const char *sid)
+{
+	guint32 low = 0, high = map->hdr->n_sids;
+
+	while (low < high) {
+		guint32 mid = low + (high - low) / 2;
+		const struct mbpi_index_sid *rec = map->sids + mid;
+		int r = strcmp(sid, map->strings + rec->sid);
+
+		if (r == 0)
+			return rec;
+
+		if (r < 0)
+			high = mid;
+		else
+			low = mid + 1;
+	}
+
+	return NULL;
+}
+
+static GSList *index_lookup_apn(const struct index_map *map,
+				const char *mcc, const char *mnc,
+				gboolean allow_duplicates, GError **error)
+{
+	const struct mbpi_index_network *net;
+	GSList *apns = NULL;
+	guint32 i;
+
+	net = index_find_network(map, mcc, mnc);
+	if (net == NULL)
+		return NULL;
+
+	for (i = 0; i < net->count; i++) {
+		const struct mbpi_index_apn *rec =
+				map->apns + map->refs[net->first + i];
+		struct ofono_gprs_provision_data *ap;
+
+		ap = g_new0(struct ofono_gprs_provision_data, 1);
+		ap->provider_name = index_strdup(map, rec->provider_name);
+		ap->provider_primary = rec->provider_primary;
+		ap->name = index_strdup(map, rec->name);
+		ap->apn = index_strdup(map, rec->apn);
+		ap->username = index_strdup(map, rec->username);
+		ap->password = index_strdup(map, rec->password);
+		ap->message_proxy = index_strdup(map, rec->message_proxy);
+		ap->message_center = index_strdup(map, rec->message_center);
+		ap->type = rec->type;
+		ap->proto = rec->proto;
+		ap->auth_method = rec->auth_method;
+		mbpi_ap_apply_defaults(ap);
+
+		if (allow_duplicates == FALSE) {
+			GSList *l;
+
+			for (l = apns; l; l = l->next) {
+				struct ofono_gprs_provision_data *pd = l->data;
+
+				if (pd->type == ap->type)
+					break;
+			}
+
+			if (l) {
+				g_set_error(error, mbpi_error_quark(),
+						MBPI_ERROR_DUPLICATE,
+						"Duplicate context detected");
+				g_prefix_error(error, "%s:%d ", mbpi_database,
+							(int) rec->line);
+				mbpi_ap_free(ap);
+				g_slist_free_full(apns, (GDestroyNotify)
+								mbpi_ap_free);
+				return NULL;
+			}
+		}
+
+		apns = g_slist_prepend(apns, ap);
+	}
+
+	return g_slist_reverse(apns);
+}
+
 GSList *mbpi_lookup_apn(const char *mcc, const char *mnc,
 			gboolean allow_duplicates, GError **error)
 {
+	const struct index_map *map;
 	struct gsm_data gsm;
 	GSList *l;
 
+	map = index_get();
+	if (map)
+		return index_lookup_apn(map, mcc, mnc, allow_duplicates,
+									error);
+
 	memset(&gsm, 0, sizeof(gsm));
 	gsm.match_mcc = mcc;
 	gsm.match_mnc = mnc;
 	gsm.allow_duplicates = allow_duplicates;
 
-	if (mbpi_parse(&toplevel_gsm_parser, &gsm, error) == FALSE) {
+	if (mbpi_parse(&toplevel_gsm_parser, &gsm, NULL, error) == FALSE) {
 		for (l = gsm.apns; l; l = l->next)
 			mbpi_ap_free(l->data);
 
@@ -758,12 +1560,21 @@ GSList *mbpi_lookup_apn(const char *mcc, const char *mnc,
 
 char *mbpi_lookup_cdma_provider_name(const char *sid, GError **error)
 {
+	const struct index_map *map;
 	struct cdma_data cdma;
 
+	map = index_get();
+	if (map) {
+		const struct mbpi_index_sid *rec = index_find_sid(map, sid);
+
+		return index_strdup(map, rec ? rec->provider_name :
+						map->hdr->unmatched_name);
+	}
+
 	memset(&cdma, 0, sizeof(cdma));
 	cdma.match_sid = sid;
 
-	if (mbpi_parse(&toplevel_cdma_parser, &cdma, error) == FALSE) {
+	if (mbpi_parse(&toplevel_cdma_parser, &cdma, NULL, error) == FALSE) {
 		g_free(cdma.provider_name);
 		cdma.provider_name = NULL;
 	}
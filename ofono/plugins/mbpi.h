@@ -21,6 +21,7 @@
  */
 
 extern const char *mbpi_database;
+extern const char *mbpi_index;	/* NULL keeps the index in memory only */
 extern enum ofono_gprs_proto mbpi_default_internet_proto;
 extern enum ofono_gprs_proto mbpi_default_mms_proto;
 extern enum ofono_gprs_proto mbpi_default_ims_proto;
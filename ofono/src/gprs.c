@@ -29,10 +29,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
-#include <sys/ioctl.h>
 #include <sys/socket.h>
-#include <net/if.h>
-#include <net/route.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <ctype.h>
@@ -46,6 +43,7 @@
 #include "common.h"
 #include "storage.h"
 #include "idmap.h"
+#include "rtnl.h"
 #include "simutil.h"
 #include "util.h"
 #include "watch_p.h"
@@ -662,126 +660,35 @@ static gboolean pri_parse_proxy(struct pri_context *ctx, const char *proxy)
 	return TRUE;
 }
 
-static void pri_ifupdown(const char *interface, ofono_bool_t active)
+static unsigned int pri_ipv6_prefix_len(const struct ipv6_settings *ipv6)
 {
-	struct ifreq ifr;
-	int sk;
-
-	if (interface == NULL)
-		return;
-
-	sk = socket(PF_INET, SOCK_DGRAM, 0);
-	if (sk < 0)
-		return;
-
-	memset(&ifr, 0, sizeof(ifr));
-	strncpy(ifr.ifr_name, interface, IFNAMSIZ);
-
-	if (ioctl(sk, SIOCGIFFLAGS, &ifr) < 0)
-		goto done;
-
-	if (active == TRUE) {
-		if (ifr.ifr_flags & IFF_UP)
-			goto done;
-		ifr.ifr_flags |= IFF_UP;
-	} else {
-		if (!(ifr.ifr_flags & IFF_UP))
-			goto done;
-		ifr.ifr_flags &= ~IFF_UP;
-	}
-
-	if (ioctl(sk, SIOCSIFFLAGS, &ifr) < 0)
-		ofono_error("Failed to change interface flags");
-
-done:
-	close(sk);
+	return ipv6->prefix_len ? ipv6->prefix_len : 64;
 }
 
-static void pri_set_ipv4_addr(const char *interface, const char *address)
+static void pri_ifup(const char *interface)
 {
-	struct ifreq ifr;
-	struct sockaddr_in addr;
-	int sk;
-
-	if (interface == NULL)
-		return;
-
-	sk = socket(PF_INET, SOCK_DGRAM, 0);
-	if (sk < 0)
-		return;
-
-	memset(&ifr, 0, sizeof(ifr));
-	strncpy(ifr.ifr_name, interface, IFNAMSIZ);
-
-	if (ioctl(sk, SIOCGIFFLAGS, &ifr) < 0)
-		goto done;
-
-	memset(&addr, 0, sizeof(addr));
-	addr.sin_family = AF_INET;
-	addr.sin_addr.s_addr = address ? inet_addr(address) : INADDR_ANY;
-	memcpy(&ifr.ifr_addr, &addr, sizeof(ifr.ifr_addr));
-
-	if (ioctl(sk, SIOCSIFADDR, &ifr) < 0) {
-		ofono_error("Failed to set interface address");
-		goto done;
-	}
-
-	if (address == NULL)
-		goto done;
+	struct rtnl_request *req = rtnl_request_new(interface);
 
-	memset(&addr, 0, sizeof(addr));
-	addr.sin_family = AF_INET;
-	addr.sin_addr.s_addr = inet_addr("255.255.255.255");
-	memcpy(&ifr.ifr_netmask, &addr, sizeof(ifr.ifr_netmask));
-
-	if (ioctl(sk, SIOCSIFNETMASK, &ifr) < 0)
-		ofono_error("Failed to set interface netmask");
-
-done:
-	close(sk);
+	rtnl_request_set_link_up(req, TRUE);
+	rtnl_request_submit(req, NULL, NULL);
 }
 
-static void pri_setproxy(const char *interface, const char *proxy)
+static void pri_ifdown(struct pri_context *ctx, const char *interface,
+				const struct context_settings *settings)
 {
-	struct rtentry rt;
-	struct sockaddr_in addr;
-	in_addr_t proxy_addr;
-	int sk;
-
-	if (interface == NULL)
-		return;
-
-	proxy_addr = inet_addr(proxy);
-	if (proxy_addr == INADDR_NONE)
-		return;
+	struct rtnl_request *req = rtnl_request_new(interface);
 
-	sk = socket(PF_INET, SOCK_DGRAM, 0);
-	if (sk < 0)
-		return;
-
-	memset(&rt, 0, sizeof(rt));
-	rt.rt_flags = RTF_UP | RTF_HOST;
-	rt.rt_dev = (char *) interface;
-
-	memset(&addr, 0, sizeof(addr));
-	addr.sin_family = AF_INET;
-	addr.sin_addr.s_addr = proxy_addr;
-	memcpy(&rt.rt_dst, &addr, sizeof(rt.rt_dst));
-
-	memset(&addr, 0, sizeof(addr));
-	addr.sin_family = AF_INET;
-	addr.sin_addr.s_addr = INADDR_ANY;
-	memcpy(&rt.rt_gateway, &addr, sizeof(rt.rt_gateway));
-
-	memset(&addr, 0, sizeof(addr));
-	addr.sin_family = AF_INET;
-	addr.sin_addr.s_addr = INADDR_ANY;
-	memcpy(&rt.rt_genmask, &addr, sizeof(rt.rt_genmask));
+	if (ctx->type == OFONO_GPRS_CONTEXT_TYPE_MMS) {
+		/* Drop the primary IPv4 address, whatever it is */
+		rtnl_request_del_address(req, NULL, 0);
 
-	if (ioctl(sk, SIOCADDRT, &rt) < 0)
-		ofono_error("Failed to add proxy host route");
+		if (settings && settings->ipv6 && settings->ipv6->ip)
+			rtnl_request_del_address(req, settings->ipv6->ip,
+					pri_ipv6_prefix_len(settings->ipv6));
+	}
 
-	close(sk);
+	rtnl_request_set_link_up(req, FALSE);
+	rtnl_request_submit(req, NULL, NULL);
 }
 
 static void pri_reset_context_settings(struct pri_context *ctx)
@@ -800,27 +707,25 @@ static void pri_reset_context_settings(struct pri_context *ctx)
 	signal_ipv4 = settings->ipv4 != NULL;
 	signal_ipv6 = settings->ipv6 != NULL;
 
+	pri_ifdown(ctx, interface, settings);
 	context_settings_free(settings);
 
 	pri_context_signal_settings(ctx, signal_ipv4, signal_ipv6);
 
 	if (ctx->type == OFONO_GPRS_CONTEXT_TYPE_MMS) {
-		pri_set_ipv4_addr(interface, NULL);
-
 		g_free(ctx->proxy_host);
 		ctx->proxy_host = NULL;
 		ctx->proxy_port = 0;
 	}
-
-	pri_ifupdown(interface, FALSE);
 }
 
-static void pri_update_mms_context_settings(struct pri_context *ctx)
+static void pri_update_mms_context_settings(struct pri_context *ctx,
+						struct rtnl_request *req)
 {
 	struct ofono_gprs_context *gc = ctx->context_driver;
 	struct context_settings *settings = gc->settings;
 
-	if (ctx->message_proxy)
+	if (ctx->message_proxy && settings->ipv4)
 		settings->ipv4->proxy = g_strdup(ctx->message_proxy);
 
 	if (!pri_parse_proxy(ctx, ctx->message_proxy))
@@ -828,10 +733,19 @@ static void pri_update_mms_context_settings(struct pri_context *ctx)
 
 	DBG("proxy %s port %u", ctx->proxy_host, ctx->proxy_port);
 
-	pri_set_ipv4_addr(gc->interface, settings->ipv4->ip);
+	if (settings->ipv4) {
+		/* Replaces the primary address, like SIOCSIFADDR did */
+		rtnl_request_del_address(req, NULL, 0);
+		rtnl_request_add_address(req, settings->ipv4->ip, 32);
+	}
+
+	if (settings->ipv6 && settings->ipv6->ip)
+		rtnl_request_add_address(req, settings->ipv6->ip,
+					pri_ipv6_prefix_len(settings->ipv6));
 
+	/* Host names are left to the MMS engine */
 	if (ctx->proxy_host)
-		pri_setproxy(gc->interface, ctx->proxy_host);
+		rtnl_request_add_host_route(req, ctx->proxy_host);
 }
 
 static gboolean pri_str_changed(const char *val, const char *newval)
@@ -1154,11 +1068,16 @@ static void pri_activate_callback(const struct ofono_error *error, void *data)
 				dbus_message_new_method_return(ctx->pending));
 
 	if (gc->interface != NULL) {
-		pri_ifupdown(gc->interface, TRUE);
+		struct rtnl_request *req = rtnl_request_new(gc->interface);
+
+		/* Link, addresses and the proxy route go in one batch */
+		rtnl_request_set_link_up(req, TRUE);
 
 		if (ctx->type == OFONO_GPRS_CONTEXT_TYPE_MMS &&
-				gc->settings->ipv4)
-			pri_update_mms_context_settings(ctx);
+				(gc->settings->ipv4 || gc->settings->ipv6))
+			pri_update_mms_context_settings(ctx, req);
+
+		rtnl_request_submit(req, NULL, NULL);
 
 		pri_context_signal_settings(ctx, gc->settings->ipv4 != NULL,
 						gc->settings->ipv6 != NULL);
@@ -1248,7 +1167,7 @@ static void pri_read_settings_callback(const struct ofono_error *error,
 	pri_ctx->active = TRUE;
 
 	if (gc->interface != NULL) {
-		pri_ifupdown(gc->interface, TRUE);
+		pri_ifup(gc->interface);
 
 		pri_context_signal_settings(pri_ctx, gc->settings->ipv4 != NULL,
 						gc->settings->ipv6 != NULL);
@@ -1814,15 +1733,9 @@ static gboolean context_dbus_unregister(struct pri_context *ctx)
 	DBusConnection *conn = ofono_dbus_get_connection();
 	char path[256];
 
-	if (ctx->active == TRUE) {
-		const char *interface =
-			ctx->context_driver->interface;
-
-		if (ctx->type == OFONO_GPRS_CONTEXT_TYPE_MMS)
-			pri_set_ipv4_addr(interface, NULL);
-
-		pri_ifupdown(interface, FALSE);
-	}
+	if (ctx->active == TRUE)
+		pri_ifdown(ctx, ctx->context_driver->interface,
+					ctx->context_driver->settings);
 
 	strcpy(path, ctx->path);
 	idmap_put(ctx->gprs->pid_map, ctx->id);
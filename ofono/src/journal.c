@@ -0,0 +1,864 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "storage.h"
+#include "journal.h"
+
+#define JOURNAL_MODE 0600
+#define JOURNAL_VERSION 1
+
+/* Magic (4), version (1), reserved (3) */
+#define JOURNAL_HEADER_SIZE 8
+
+/*
+ * CRC-32 (4), flags (1), reserved (1), key length (2), value length (4),
+ * timestamp (8), all big endian, followed by the key and the value.  The
+ * CRC covers everything in the record after itself.
+ */
+#define JOURNAL_RECORD_SIZE 20
+
+/* More records of the same change follow */
+#define JOURNAL_FLAG_MORE 0x01
+
+#define JOURNAL_MAX_KEY 1024
+#define JOURNAL_MAX_VALUE (64 * 1024)
+
+/* Compact once superseded records exceed both this and the live data */
+#define JOURNAL_COMPACT_MIN (16 * 1024)
+
+static const unsigned char journal_magic[4] = { 'O', 'J', 'N', 'L' };
+
+struct journal_entry {
+	time_t ts;
+	unsigned int len;
+	unsigned char data[];
+};
+
+struct journal {
+	int refcount;
+	char *path;
+	int fd;
+	size_t size;
+	size_t live;			/* bytes of records still in use */
+	GHashTable *index;		/* key -> struct journal_entry */
+};
+
+/* One change, len 0 removes the key */
+struct journal_op {
+	const char *key;
+	const unsigned char *data;
+	unsigned int len;
+	time_t ts;
+};
+
+static GHashTable *journals;
+
+static guint32 journal_crc_table[256];
+
+static guint32 journal_crc32(const unsigned char *data, size_t len)
+{
+	guint32 crc = 0xffffffff;
+
+	if (journal_crc_table[1] == 0) {
+		guint32 i, j;
+
+		for (i = 0; i < 256; i++) {
+			guint32 c = i;
+
+			for (j = 0; j < 8; j++)
+				c = (c & 1) ? (c >> 1) ^ 0xedb88320 : c >> 1;
+
+			journal_crc_table[i] = c;
+		}
+	}
+
+	while (len--)
+		crc = journal_crc_table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+
+	return crc ^ 0xffffffff;
+}
+
+static void journal_put_be(unsigned char *p, guint64 value, int bytes)
+{
+	while (bytes--) {
+		p[bytes] = value & 0xff;
+		value >>= 8;
+	}
+}
+
+static guint64 journal_get_be(const unsigned char *p, int bytes)
+{
+	guint64 value = 0;
+
+	while (bytes--)
+		value = (value << 8) | *p++;
+
+	return value;
+}
+
+static void journal_encode(GByteArray *buf, const struct journal_op *op,
+				gboolean more)
+{
+	unsigned char hdr[JOURNAL_RECORD_SIZE];
+	size_t key_len = strlen(op->key);
+	guint start = buf->len;
+
+	memset(hdr, 0, sizeof(hdr));
+	hdr[4] = more ? JOURNAL_FLAG_MORE : 0;
+	journal_put_be(hdr + 6, key_len, 2);
+	journal_put_be(hdr + 8, op->len, 4);
+	journal_put_be(hdr + 12, op->ts, 8);
+
+	g_byte_array_append(buf, hdr, sizeof(hdr));
+	g_byte_array_append(buf, (const guint8 *) op->key, key_len);
+
+	if (op->len)
+		g_byte_array_append(buf, op->data, op->len);
+
+	journal_put_be(buf->data + start,
+			journal_crc32(buf->data + start + 4,
+					buf->len - start - 4), 4);
+}
+
+static gboolean journal_op_valid(const struct journal_op *op)
+{
+	size_t key_len = strlen(op->key);
+
+	return key_len > 0 && key_len <= JOURNAL_MAX_KEY &&
+						op->len <= JOURNAL_MAX_VALUE;
+}
+
+static void journal_apply(struct journal *journal, const struct journal_op *op)
+{
+	size_t key_len = strlen(op->key);
+	struct journal_entry *entry;
+
+	entry = g_hash_table_lookup(journal->index, op->key);
+	if (entry)
+		journal->live -= JOURNAL_RECORD_SIZE + key_len + entry->len;
+
+	if (op->len == 0) {
+		if (entry)
+			g_hash_table_remove(journal->index, op->key);
+
+		return;
+	}
+
+	/* The data may point to the entry being replaced, copy it first */
+	entry = g_malloc(sizeof(struct journal_entry) + op->len);
+	entry->ts = op->ts;
+	entry->len = op->len;
+	memcpy(entry->data, op->data, op->len);
+
+	g_hash_table_insert(journal->index, g_strdup(op->key), entry);
+	journal->live += JOURNAL_RECORD_SIZE + key_len + op->len;
+}
+
+static void journal_close(struct journal *journal)
+{
+	if (journal->fd != -1) {
+		TFR(close(journal->fd));
+		journal->fd = -1;
+	}
+
+	g_hash_table_remove_all(journal->index);
+	journal->size = 0;
+	journal->live = 0;
+}
+
+static gboolean journal_reset(struct journal *journal)
+{
+	unsigned char hdr[JOURNAL_HEADER_SIZE];
+
+	g_hash_table_remove_all(journal->index);
+	journal->size = 0;
+	journal->live = 0;
+
+	memset(hdr, 0, sizeof(hdr));
+	memcpy(hdr, journal_magic, sizeof(journal_magic));
+	hdr[4] = JOURNAL_VERSION;
+
+	if (ftruncate(journal->fd, 0) < 0)
+		return FALSE;
+
+	if (TFR(write(journal->fd, hdr, sizeof(hdr))) != sizeof(hdr))
+		return FALSE;
+
+	journal->size = sizeof(hdr);
+
+	return TRUE;
+}
+
+static gboolean journal_read_all(int fd, unsigned char *buf, size_t len)
+{
+	size_t off = 0;
+
+	while (off < len) {
+		ssize_t r = TFR(pread(fd, buf + off, len - off, off));
+
+		if (r <= 0)
+			return FALSE;
+
+		off += r;
+	}
+
+	return TRUE;
+}
+
+/* Replays the records, a change only counts once all its records did */
+static size_t journal_replay(struct journal *journal,
+				const unsigned char *buf, size_t size)
+{
+	GArray *pending = g_array_new(FALSE, FALSE,
+					sizeof(struct journal_op));
+	size_t off = JOURNAL_HEADER_SIZE;
+	size_t end = off;
+	unsigned int i;
+
+	while (off + JOURNAL_RECORD_SIZE <= size) {
+		const unsigned char *rec = buf + off;
+		const unsigned char *key = rec + JOURNAL_RECORD_SIZE;
+		guint32 crc = journal_get_be(rec, 4);
+		unsigned int key_len = journal_get_be(rec + 6, 2);
+		unsigned int len = journal_get_be(rec + 8, 4);
+		size_t rec_size = JOURNAL_RECORD_SIZE + key_len + len;
+		struct journal_op op;
+
+		if (key_len == 0 || key_len > JOURNAL_MAX_KEY ||
+				len > JOURNAL_MAX_VALUE ||
+				rec_size > size - off)
+			break;
+
+		if (journal_crc32(rec + 4, rec_size - 4) != crc)
+			break;
+
+		if (memchr(key, '\0', key_len))
+			break;
+
+		op.key = g_strndup((const char *) key, key_len);
+		op.data = key + key_len;
+		op.len = len;
+		op.ts = journal_get_be(rec + 12, 8);
+		g_array_append_val(pending, op);
+
+		off += rec_size;
+
+		if (rec[4] & JOURNAL_FLAG_MORE)
+			continue;
+
+		for (i = 0; i < pending->len; i++) {
+			struct journal_op *p = &g_array_index(pending,
+						struct journal_op, i);
+
+			journal_apply(journal, p);
+			g_free((char *) p->key);
+		}
+
+		g_array_set_size(pending, 0);
+		end = off;
+	}
+
+	/* An incomplete change at the end is dropped as a whole */
+	for (i = 0; i < pending->len; i++)
+		g_free((char *) g_array_index(pending,
+						struct journal_op, i).key);
+
+	g_array_free(pending, TRUE);
+
+	return end;
+}
+
+static gboolean journal_load(struct journal *journal)
+{
+	unsigned char *buf;
+	struct stat st;
+	size_t end;
+
+	journal_close(journal);
+
+	if (create_dirs(journal->path, JOURNAL_MODE | S_IXUSR) != 0)
+		return FALSE;
+
+	journal->fd = TFR(open(journal->path, O_RDWR | O_CREAT | O_APPEND |
+					O_CLOEXEC, JOURNAL_MODE));
+	if (journal->fd == -1)
+		return FALSE;
+
+	if (fstat(journal->fd, &st) < 0)
+		goto error;
+
+	if ((size_t) st.st_size < JOURNAL_HEADER_SIZE) {
+		if (!journal_reset(journal))
+			goto error;
+
+		return TRUE;
+	}
+
+	buf = g_try_malloc(st.st_size);
+	if (buf == NULL)
+		goto error;
+
+	if (!journal_read_all(journal->fd, buf, st.st_size)) {
+		g_free(buf);
+		goto error;
+	}
+
+	/* Start over if the file is damaged or from an unknown version */
+	if (memcmp(buf, journal_magic, sizeof(journal_magic)) ||
+			buf[4] != JOURNAL_VERSION) {
+		g_free(buf);
+
+		if (!journal_reset(journal))
+			goto error;
+
+		return TRUE;
+	}
+
+	end = journal_replay(journal, buf, st.st_size);
+	g_free(buf);
+
+	/* Drop whatever an interrupted append has left behind */
+	if (end < (size_t) st.st_size && ftruncate(journal->fd, end) < 0)
+		goto error;
+
+	journal->size = end;
+
+	return TRUE;
+
+error:
+	journal_close(journal);
+	return FALSE;
+}
+
+static void journal_maintain(struct journal *journal)
+{
+	size_t garbage = journal->size - JOURNAL_HEADER_SIZE - journal->live;
+
+	if (garbage == 0)
+		return;
+
+	/* Nothing is in use, no need for a new file to get rid of it all */
+	if (journal->live == 0) {
+		if (ftruncate(journal->fd, JOURNAL_HEADER_SIZE) == 0)
+			journal->size = JOURNAL_HEADER_SIZE;
+
+		return;
+	}
+
+	if (garbage > JOURNAL_COMPACT_MIN && garbage > journal->live)
+		journal_compact(journal);
+}
+
+static gboolean journal_append(struct journal *journal,
+				const struct journal_op *ops, unsigned int n)
+{
+	GByteArray *buf;
+	unsigned int i;
+	ssize_t r;
+
+	if (n == 0)
+		return TRUE;
+
+	for (i = 0; i < n; i++)
+		if (!journal_op_valid(&ops[i]))
+			return FALSE;
+
+	/* Retry if the journal couldn't be opened or recovered earlier */
+	if (journal->fd == -1 && !journal_load(journal))
+		return FALSE;
+
+	buf = g_byte_array_new();
+
+	for (i = 0; i < n; i++)
+		journal_encode(buf, &ops[i], i + 1 < n);
+
+	/* O_APPEND, so the records always land at the end of the file */
+	r = TFR(write(journal->fd, buf->data, buf->len));
+	if (r != (ssize_t) buf->len) {
+		/* Never leave a partial record behind */
+		if (r > 0 && ftruncate(journal->fd, journal->size) < 0)
+			journal_close(journal);
+
+		g_byte_array_free(buf, TRUE);
+		return FALSE;
+	}
+
+	journal->size += r;
+	g_byte_array_free(buf, TRUE);
+
+	for (i = 0; i < n; i++)
+		journal_apply(journal, &ops[i]);
+
+	journal_maintain(journal);
+
+	return TRUE;
+}
+
+static void journal_free(struct journal *journal)
+{
+	journal_close(journal);
+	g_hash_table_destroy(journal->index);
+	g_free(journal->path);
+	g_free(journal);
+}
+
+struct journal *journal_open(const char *path)
+{
+	struct journal *journal;
+
+	if (path == NULL)
+		return NULL;
+
+	if (journals == NULL)
+		journals = g_hash_table_new(g_str_hash, g_str_equal);
+
+	journal = g_hash_table_lookup(journals, path);
+	if (journal) {
+		journal->refcount++;
+		return journal;
+	}
+
+	journal = g_new0(struct journal, 1);
+	journal->refcount = 1;
+	journal->fd = -1;
+	journal->path = g_strdup(path);
+	journal->index = g_hash_table_new_full(g_str_hash, g_str_equal,
+						g_free, g_free);
+
+	if (!journal_load(journal)) {
+		journal_free(journal);
+		return NULL;
+	}
+
+	g_hash_table_insert(journals, journal->path, journal);
+
+	return journal;
+}
+
+void journal_unref(struct journal *journal)
+{
+	if (journal == NULL)
+		return;
+
+	if (--journal->refcount > 0)
+		return;
+
+	g_hash_table_remove(journals, journal->path);
+
+	if (g_hash_table_size(journals) == 0) {
+		g_hash_table_destroy(journals);
+		journals = NULL;
+	}
+
+	journal_free(journal);
+}
+
+const unsigned char *journal_lookup(struct journal *journal,
+					const char *key, unsigned int *out_len,
+					time_t *out_ts)
+{
+	struct journal_entry *entry;
+
+	if (journal == NULL || key == NULL)
+		return NULL;
+
+	entry = g_hash_table_lookup(journal->index, key);
+	if (entry == NULL)
+		return NULL;
+
+	if (out_len)
+		*out_len = entry->len;
+
+	if (out_ts)
+		*out_ts = entry->ts;
+
+	return entry->data;
+}
+
+gboolean journal_store(struct journal *journal, const char *key,
+			const unsigned char *data, unsigned int len)
+{
+	struct journal_op op;
+
+	if (journal == NULL || key == NULL || data == NULL || len == 0)
+		return FALSE;
+
+	op.key = key;
+	op.data = data;
+	op.len = len;
+	op.ts = time(NULL);
+
+	return journal_append(journal, &op, 1);
+}
+
+gboolean journal_remove(struct journal *journal, const char *key)
+{
+	struct journal_op op;
+
+	if (journal == NULL || key == NULL)
+		return FALSE;
+
+	if (!g_hash_table_lookup(journal->index, key))
+		return TRUE;
+
+	memset(&op, 0, sizeof(op));
+	op.key = key;
+
+	return journal_append(journal, &op, 1);
+}
+
+static GArray *journal_prefix_ops(struct journal *journal,
+					const char *prefix)
+{
+	GArray *ops = g_array_new(FALSE, TRUE, sizeof(struct journal_op));
+	GHashTableIter iter;
+	gpointer key, value;
+
+	g_hash_table_iter_init(&iter, journal->index);
+
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		struct journal_entry *entry = value;
+		struct journal_op op;
+
+		if (!g_str_has_prefix(key, prefix))
+			continue;
+
+		op.key = key;
+		op.data = entry->data;
+		op.len = entry->len;
+		op.ts = entry->ts;
+		g_array_append_val(ops, op);
+	}
+
+	return ops;
+}
+
+gboolean journal_remove_prefix(struct journal *journal, const char *prefix)
+{
+	GArray *ops;
+	gboolean ok;
+	unsigned int i;
+
+	if (journal == NULL || prefix == NULL)
+		return FALSE;
+
+	ops = journal_prefix_ops(journal, prefix);
+
+	/* The keys point into the index, copy them before it changes */
+	for (i = 0; i < ops->len; i++) {
+		struct journal_op *op = &g_array_index(ops,
+						struct journal_op, i);
+
+		op->key = g_strdup(op->key);
+		op->len = 0;
+	}
+
+	ok = journal_append(journal, (struct journal_op *) ops->data,
+				ops->len);
+
+	for (i = 0; i < ops->len; i++)
+		g_free((char *) g_array_index(ops, struct journal_op, i).key);
+
+	g_array_free(ops, TRUE);
+
+	return ok;
+}
+
+gboolean journal_rename_prefix(struct journal *journal, const char *from,
+				const char *to)
+{
+	GArray *ops;
+	unsigned int n;
+	unsigned int i;
+	gboolean ok;
+
+	if (journal == NULL || from == NULL || to == NULL)
+		return FALSE;
+
+	if (!strcmp(from, to))
+		return TRUE;
+
+	ops = journal_prefix_ops(journal, from);
+	n = ops->len;
+
+	/*
+	 * New keys first, their data is copied before the old entries are
+	 * removed by the second half of the change.
+	 */
+	for (i = 0; i < n; i++) {
+		struct journal_op *op = &g_array_index(ops,
+						struct journal_op, i);
+		struct journal_op removal;
+
+		memset(&removal, 0, sizeof(removal));
+		removal.key = g_strdup(op->key);
+		op->key = g_strconcat(to, op->key + strlen(from), NULL);
+		g_array_append_val(ops, removal);
+	}
+
+	ok = journal_append(journal, (struct journal_op *) ops->data,
+				ops->len);
+
+	for (i = 0; i < ops->len; i++)
+		g_free((char *) g_array_index(ops, struct journal_op, i).key);
+
+	g_array_free(ops, TRUE);
+
+	return ok;
+}
+
+static int journal_key_compare(const void *a, const void *b)
+{
+	return strverscmp(*(const char **) a, *(const char **) b);
+}
+
+void journal_foreach(struct journal *journal, const char *prefix,
+			journal_foreach_func func, void *user_data)
+{
+	GPtrArray *keys;
+	GHashTableIter iter;
+	gpointer key;
+	unsigned int i;
+
+	if (journal == NULL || func == NULL)
+		return;
+
+	/* Copies, the callback may change the journal */
+	keys = g_ptr_array_new_with_free_func(g_free);
+	g_hash_table_iter_init(&iter, journal->index);
+
+	while (g_hash_table_iter_next(&iter, &key, NULL))
+		if (prefix == NULL || g_str_has_prefix(key, prefix))
+			g_ptr_array_add(keys, g_strdup(key));
+
+	if (keys->len > 1)
+		qsort(keys->pdata, keys->len, sizeof(gpointer),
+						journal_key_compare);
+
+	for (i = 0; i < keys->len; i++) {
+		const char *k = keys->pdata[i];
+		struct journal_entry *entry;
+
+		entry = g_hash_table_lookup(journal->index, k);
+		if (entry == NULL)
+			continue;
+
+		func(k, entry->data, entry->len, entry->ts, user_data);
+	}
+
+	g_ptr_array_free(keys, TRUE);
+}
+
+/*
+ * Writes the live records into a temporary file and renames it over the
+ * journal, so that either the old or the new file survives a crash.
+ */
+gboolean journal_compact(struct journal *journal)
+{
+	unsigned char hdr[JOURNAL_HEADER_SIZE];
+	GHashTableIter iter;
+	gpointer key, value;
+	GByteArray *buf;
+	char *tmp_path;
+	gboolean ok = FALSE;
+	int fd;
+
+	if (journal == NULL || journal->fd == -1)
+		return FALSE;
+
+	memset(hdr, 0, sizeof(hdr));
+	memcpy(hdr, journal_magic, sizeof(journal_magic));
+	hdr[4] = JOURNAL_VERSION;
+
+	buf = g_byte_array_sized_new(JOURNAL_HEADER_SIZE + journal->live);
+	g_byte_array_append(buf, hdr, sizeof(hdr));
+
+	g_hash_table_iter_init(&iter, journal->index);
+
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		struct journal_entry *entry = value;
+		struct journal_op op;
+
+		op.key = key;
+		op.data = entry->data;
+		op.len = entry->len;
+		op.ts = entry->ts;
+		journal_encode(buf, &op, FALSE);
+	}
+
+	tmp_path = g_strdup_printf("%s.XXXXXX.tmp", journal->path);
+	fd = TFR(g_mkstemp_full(tmp_path, O_WRONLY | O_CREAT | O_TRUNC,
+							JOURNAL_MODE));
+
+	if (fd != -1) {
+		ok = TFR(write(fd, buf->data, buf->len)) ==
+							(ssize_t) buf->len &&
+			fdatasync(fd) == 0;
+		TFR(close(fd));
+
+		if (ok)
+			ok = rename(tmp_path, journal->path) == 0;
+
+		if (!ok)
+			unlink(tmp_path);
+	}
+
+	g_free(tmp_path);
+	g_byte_array_free(buf, TRUE);
+
+	/* Pick up the compacted file, or the old one if that failed */
+	return journal_load(journal) && ok;
+}
+
+struct journal_import {
+	struct journal *journal;
+	GArray *ops;
+	GPtrArray *owned;
+	GPtrArray *files;
+	GPtrArray *dirs;
+};
+
+static void journal_import_file(struct journal_import *import,
+				const char *path, const char *key)
+{
+	struct journal_op op;
+	struct stat st;
+	gchar *data;
+	gsize len;
+
+	g_ptr_array_add(import->files, g_strdup(path));
+
+	/* Leftovers of interrupted writes */
+	if (g_str_has_suffix(path, ".tmp"))
+		return;
+
+	if (journal_lookup(import->journal, key, NULL, NULL))
+		return;
+
+	if (stat(path, &st) < 0)
+		return;
+
+	if (!g_file_get_contents(path, &data, &len, NULL))
+		return;
+
+	g_ptr_array_add(import->owned, data);
+
+	if (len == 0 || len > JOURNAL_MAX_VALUE)
+		return;
+
+	op.key = g_strdup(key);
+	op.data = (const unsigned char *) data;
+	op.len = len;
+	op.ts = st.st_mtime;
+	g_ptr_array_add(import->owned, (char *) op.key);
+	g_array_append_val(import->ops, op);
+}
+
+static void journal_import_scan(struct journal_import *import,
+				const char *dir, const char *prefix)
+{
+	struct dirent *ent;
+	DIR *d = opendir(dir);
+
+	if (d == NULL)
+		return;
+
+	while ((ent = readdir(d))) {
+		char *path;
+		char *key;
+
+		if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+			continue;
+
+		path = g_build_filename(dir, ent->d_name, NULL);
+		key = g_strconcat(prefix, ent->d_name, NULL);
+
+		if (ent->d_type == DT_DIR) {
+			char *sub = g_strconcat(key, "/", NULL);
+
+			journal_import_scan(import, path, sub);
+			g_free(sub);
+		} else if (ent->d_type == DT_REG) {
+			journal_import_file(import, path, key);
+		}
+
+		g_free(key);
+		g_free(path);
+	}
+
+	closedir(d);
+
+	/* Children come first, so the directories can be removed in order */
+	g_ptr_array_add(import->dirs, g_strdup(dir));
+}
+
+unsigned int journal_import_dir(struct journal *journal, const char *dir,
+				const char *prefix)
+{
+	struct journal_import import;
+	unsigned int count = 0;
+	unsigned int i;
+
+	if (journal == NULL || dir == NULL)
+		return 0;
+
+	import.journal = journal;
+	import.ops = g_array_new(FALSE, FALSE, sizeof(struct journal_op));
+	import.owned = g_ptr_array_new_with_free_func(g_free);
+	import.files = g_ptr_array_new_with_free_func(g_free);
+	import.dirs = g_ptr_array_new_with_free_func(g_free);
+
+	journal_import_scan(&import, dir, prefix ? prefix : "");
+
+	/* The files may only go once the journal has them for sure */
+	if (journal_append(journal, (struct journal_op *) import.ops->data,
+				import.ops->len) &&
+			(import.ops->len == 0 || fdatasync(journal->fd) == 0)) {
+		count = import.ops->len;
+
+		for (i = 0; i < import.files->len; i++)
+			unlink(import.files->pdata[i]);
+
+		for (i = 0; i < import.dirs->len; i++)
+			rmdir(import.dirs->pdata[i]);
+	}
+
+	g_ptr_array_free(import.dirs, TRUE);
+	g_ptr_array_free(import.files, TRUE);
+	g_ptr_array_free(import.owned, TRUE);
+	g_array_free(import.ops, TRUE);
+
+	return count;
+}
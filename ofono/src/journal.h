@@ -0,0 +1,69 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Append-only, CRC protected key/value store.  Every change is a record
+ * appended to the file with a single write; changes made by one call are
+ * applied as a whole or not at all when the journal is replayed.  The
+ * contents are kept in memory and the file is compacted once superseded
+ * records dominate it.  Journals are shared between all users of the
+ * same path.
+ */
+
+struct journal;
+
+typedef void (*journal_foreach_func)(const char *key,
+					const unsigned char *data,
+					unsigned int len, time_t ts,
+					void *user_data);
+
+struct journal *journal_open(const char *path);
+void journal_unref(struct journal *journal);
+
+/* The returned pointer is only valid until the key is modified */
+const unsigned char *journal_lookup(struct journal *journal,
+					const char *key, unsigned int *out_len,
+					time_t *out_ts);
+
+gboolean journal_store(struct journal *journal, const char *key,
+			const unsigned char *data, unsigned int len);
+gboolean journal_remove(struct journal *journal, const char *key);
+gboolean journal_remove_prefix(struct journal *journal, const char *prefix);
+gboolean journal_rename_prefix(struct journal *journal, const char *from,
+				const char *to);
+
+/*
+ * Calls func for each key starting with prefix, in strverscmp() order.
+ * The callback may modify the journal, keys removed by it are skipped.
+ */
+void journal_foreach(struct journal *journal, const char *prefix,
+			journal_foreach_func func, void *user_data);
+
+gboolean journal_compact(struct journal *journal);
+
+/*
+ * Moves the files found under dir into the journal, keyed by prefix
+ * followed by the path relative to dir, and removes them.  Keys already
+ * in the journal are newer and are kept.  Returns the number of files
+ * imported.
+ */
+unsigned int journal_import_dir(struct journal *journal, const char *dir,
+				const char *prefix);
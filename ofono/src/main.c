@@ -315,6 +315,10 @@ int main(int argc, char **argv)
 
 	__ofono_modemwatch_cleanup();
 
+	__ofono_storage_cleanup();
+
+	__ofono_rtnl_cleanup();
+
 	__ofono_dbus_cleanup();
 	dbus_connection_unref(conn);
 
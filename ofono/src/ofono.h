@@ -678,3 +678,5 @@ void __ofono_slot_manager_cleanup(void);
 #include <ofono/storage.h>
 
 void __ofono_set_config_dir(const char *dir);
+void __ofono_storage_cleanup(void);
+void __ofono_rtnl_cleanup(void);
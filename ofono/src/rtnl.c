@@ -0,0 +1,560 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include <glib.h>
+
+#include "ofono.h"
+#include "rtnl.h"
+
+#define RTNL_BUFSIZE 8192
+
+struct rtnl_msg {
+	const char *what;
+	int ignore;		/* errno which isn't really an error */
+};
+
+struct rtnl_request {
+	char *ifname;
+	int ifindex;
+	GByteArray *buf;
+	unsigned int last;	/* offset of the last message in buf */
+	GArray *msgs;
+	guint id;
+	guint32 seq;		/* sequence number of the first message */
+	unsigned int pending;
+	int error;
+	rtnl_request_cb cb;
+	void *user_data;
+};
+
+static int rtnl_fd = -1;
+static GIOChannel *rtnl_channel;
+static guint rtnl_watch;
+static guint32 rtnl_seq;
+static guint rtnl_last_id;
+static GSList *rtnl_pending;
+
+static void rtnl_request_done(struct rtnl_request *req)
+{
+	rtnl_pending = g_slist_remove(rtnl_pending, req);
+
+	if (req->cb)
+		req->cb(req->error, req->user_data);
+
+	rtnl_request_free(req);
+}
+
+static void rtnl_fail_pending(int error)
+{
+	/* Requests submitted by the callbacks are left alone */
+	GSList *list = rtnl_pending;
+	GSList *l;
+
+	rtnl_pending = NULL;
+
+	for (l = list; l; l = l->next) {
+		struct rtnl_request *req = l->data;
+
+		if (!req->error)
+			req->error = error;
+
+		rtnl_request_done(req);
+	}
+
+	g_slist_free(list);
+}
+
+static void rtnl_ack(guint32 seq, int error)
+{
+	GSList *l;
+
+	for (l = rtnl_pending; l; l = l->next) {
+		struct rtnl_request *req = l->data;
+		guint32 index = seq - req->seq;
+		const struct rtnl_msg *msg;
+
+		if (index >= req->msgs->len)
+			continue;
+
+		msg = &g_array_index(req->msgs, struct rtnl_msg, index);
+
+		if (error < 0 && -error != msg->ignore) {
+			ofono_error("%s %s: %s", msg->what, req->ifname,
+							strerror(-error));
+			if (!req->error)
+				req->error = error;
+		}
+
+		if (!--req->pending)
+			rtnl_request_done(req);
+
+		return;
+	}
+
+	DBG("unexpected ack %u", seq);
+}
+
+static void rtnl_handle_nlmsg(const struct nlmsghdr *hdr, unsigned int len)
+{
+	while (len > 0 && NLMSG_OK(hdr, len)) {
+		if (hdr->nlmsg_type == NLMSG_ERROR &&
+				hdr->nlmsg_len >= NLMSG_LENGTH(sizeof(int))) {
+			const struct nlmsgerr *err = NLMSG_DATA(hdr);
+
+			rtnl_ack(hdr->nlmsg_seq, err->error);
+		}
+		hdr = NLMSG_NEXT(hdr, len);
+	}
+}
+
+static void rtnl_close(void)
+{
+	if (rtnl_watch) {
+		g_source_remove(rtnl_watch);
+		rtnl_watch = 0;
+	}
+	if (rtnl_channel) {
+		g_io_channel_shutdown(rtnl_channel, FALSE, NULL);
+		g_io_channel_unref(rtnl_channel);
+		rtnl_channel = NULL;
+	}
+	if (rtnl_fd >= 0) {
+		close(rtnl_fd);
+		rtnl_fd = -1;
+	}
+}
+
+static gboolean rtnl_event(GIOChannel *ch, GIOCondition cond, gpointer data)
+{
+	union {
+		struct nlmsghdr hdr;
+		char buf[RTNL_BUFSIZE];
+	} msg;
+	struct sockaddr_nl addr;
+	socklen_t addrlen = sizeof(addr);
+	ssize_t result;
+
+	if (cond & (G_IO_NVAL | G_IO_HUP | G_IO_ERR)) {
+		ofono_error("rtnetlink socket error");
+		goto fail;
+	}
+
+	result = recvfrom(rtnl_fd, &msg, sizeof(msg), 0,
+				(struct sockaddr *)&addr, &addrlen);
+
+	if (result > 0) {
+		if (!addr.nl_pid)
+			rtnl_handle_nlmsg(&msg.hdr, result);
+		return G_SOURCE_CONTINUE;
+	} else if (result == 0 || errno == EINTR || errno == EAGAIN) {
+		return G_SOURCE_CONTINUE;
+	} else if (errno == ENOBUFS) {
+		/* Some acks have been dropped, we won't see them */
+		ofono_error("rtnetlink socket overrun");
+		rtnl_fail_pending(-ENOBUFS);
+		return G_SOURCE_CONTINUE;
+	}
+
+	ofono_error("rtnetlink receive error: %s", strerror(errno));
+
+fail:
+	/* The socket gets reopened by the next request */
+	rtnl_watch = 0;
+	rtnl_close();
+	rtnl_fail_pending(-EIO);
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean rtnl_open(void)
+{
+	struct sockaddr_nl nl;
+
+	if (rtnl_fd >= 0)
+		return TRUE;
+
+	rtnl_fd = socket(PF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK,
+							NETLINK_ROUTE);
+	if (rtnl_fd < 0) {
+		ofono_error("Failed to open rtnetlink socket: %s",
+							strerror(errno));
+		return FALSE;
+	}
+
+#ifdef NETLINK_CAP_ACK
+	{
+		/* We only need the sequence numbers echoed back */
+		int one = 1;
+
+		setsockopt(rtnl_fd, SOL_NETLINK, NETLINK_CAP_ACK,
+							&one, sizeof(one));
+	}
+#endif
+
+	/* Let the kernel pick the port id, mtu-limit binds to our pid */
+	memset(&nl, 0, sizeof(nl));
+	nl.nl_family = AF_NETLINK;
+
+	if (bind(rtnl_fd, (struct sockaddr *)&nl, sizeof(nl)) < 0) {
+		ofono_error("Failed to bind rtnetlink socket: %s",
+							strerror(errno));
+		close(rtnl_fd);
+		rtnl_fd = -1;
+		return FALSE;
+	}
+
+	rtnl_channel = g_io_channel_unix_new(rtnl_fd);
+	g_io_channel_set_encoding(rtnl_channel, NULL, NULL);
+	g_io_channel_set_buffered(rtnl_channel, FALSE);
+	rtnl_watch = g_io_add_watch(rtnl_channel,
+				G_IO_IN | G_IO_NVAL | G_IO_HUP | G_IO_ERR,
+				rtnl_event, NULL);
+	return TRUE;
+}
+
+static void rtnl_append(GByteArray *buf, const void *data, unsigned int len)
+{
+	static const guint8 zeros[NLMSG_ALIGNTO];
+	unsigned int pad = NLMSG_ALIGN(len) - len;
+
+	g_byte_array_append(buf, data, len);
+	if (pad)
+		g_byte_array_append(buf, zeros, pad);
+}
+
+static void rtnl_request_put_msg(struct rtnl_request *req, guint16 type,
+				guint16 flags, const void *body,
+				unsigned int len, const char *what, int ignore)
+{
+	struct nlmsghdr hdr;
+	struct rtnl_msg msg;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.nlmsg_len = NLMSG_LENGTH(NLMSG_ALIGN(len));
+	hdr.nlmsg_type = type;
+	hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+
+	req->last = req->buf->len;
+	rtnl_append(req->buf, &hdr, sizeof(hdr));
+	rtnl_append(req->buf, body, len);
+
+	msg.what = what;
+	msg.ignore = ignore;
+	g_array_append_val(req->msgs, msg);
+}
+
+static void rtnl_request_put_attr(struct rtnl_request *req, guint16 type,
+					const void *data, unsigned int len)
+{
+	struct rtattr rta;
+	struct nlmsghdr *hdr;
+
+	rta.rta_len = RTA_LENGTH(len);
+	rta.rta_type = type;
+	rtnl_append(req->buf, &rta, sizeof(rta));
+	rtnl_append(req->buf, data, len);
+
+	hdr = (struct nlmsghdr *)(void *)(req->buf->data + req->last);
+	hdr->nlmsg_len = req->buf->len - req->last;
+}
+
+/* Returns the family and the address length, or zero */
+static int rtnl_parse_address(const char *str, struct in6_addr *addr,
+						unsigned int *len)
+{
+	if (!str)
+		return 0;
+
+	if (inet_pton(AF_INET, str, addr) == 1) {
+		*len = sizeof(struct in_addr);
+		return AF_INET;
+	}
+
+	if (inet_pton(AF_INET6, str, addr) == 1) {
+		*len = sizeof(struct in6_addr);
+		return AF_INET6;
+	}
+
+	return 0;
+}
+
+struct rtnl_request *rtnl_request_new(const char *ifname)
+{
+	struct rtnl_request *req;
+	unsigned int ifindex;
+
+	if (!ifname)
+		return NULL;
+
+	ifindex = if_nametoindex(ifname);
+	if (!ifindex) {
+		DBG("%s not found", ifname);
+		return NULL;
+	}
+
+	req = g_new0(struct rtnl_request, 1);
+	req->ifname = g_strdup(ifname);
+	req->ifindex = ifindex;
+	req->buf = g_byte_array_new();
+	req->msgs = g_array_new(FALSE, FALSE, sizeof(struct rtnl_msg));
+	return req;
+}
+
+void rtnl_request_free(struct rtnl_request *req)
+{
+	if (!req)
+		return;
+
+	if (req->buf)
+		g_byte_array_free(req->buf, TRUE);
+
+	g_array_free(req->msgs, TRUE);
+	g_free(req->ifname);
+	g_free(req);
+}
+
+void rtnl_request_set_link_up(struct rtnl_request *req, gboolean up)
+{
+	struct ifinfomsg ifi;
+
+	if (!req)
+		return;
+
+	memset(&ifi, 0, sizeof(ifi));
+	ifi.ifi_family = AF_UNSPEC;
+	ifi.ifi_index = req->ifindex;
+	ifi.ifi_change = IFF_UP;
+	ifi.ifi_flags = up ? IFF_UP : 0;
+
+	rtnl_request_put_msg(req, RTM_NEWLINK, 0, &ifi, sizeof(ifi),
+				"Failed to change interface flags", 0);
+}
+
+void rtnl_request_set_mtu(struct rtnl_request *req, unsigned int mtu)
+{
+	struct ifinfomsg ifi;
+	guint32 value = mtu;
+
+	if (!req)
+		return;
+
+	memset(&ifi, 0, sizeof(ifi));
+	ifi.ifi_family = AF_UNSPEC;
+	ifi.ifi_index = req->ifindex;
+
+	rtnl_request_put_msg(req, RTM_NEWLINK, 0, &ifi, sizeof(ifi),
+				"Failed to set MTU", 0);
+	rtnl_request_put_attr(req, IFLA_MTU, &value, sizeof(value));
+}
+
+static gboolean rtnl_request_put_address(struct rtnl_request *req,
+				guint16 type, guint16 flags,
+				const char *address, unsigned int prefix_len,
+				const char *what, int ignore)
+{
+	struct ifaddrmsg ifa;
+	struct in6_addr addr;
+	unsigned int len = 0;
+	int family;
+
+	if (!req)
+		return FALSE;
+
+	memset(&ifa, 0, sizeof(ifa));
+	ifa.ifa_index = req->ifindex;
+	ifa.ifa_scope = RT_SCOPE_UNIVERSE;
+
+	if (!address && type == RTM_DELADDR) {
+		/* The kernel picks the first (primary) one */
+		ifa.ifa_family = AF_INET;
+		rtnl_request_put_msg(req, type, flags, &ifa, sizeof(ifa),
+								what, ignore);
+		return TRUE;
+	}
+
+	family = rtnl_parse_address(address, &addr, &len);
+	if (!family || prefix_len > len * 8)
+		return FALSE;
+
+	ifa.ifa_family = family;
+	ifa.ifa_prefixlen = prefix_len;
+
+	rtnl_request_put_msg(req, type, flags, &ifa, sizeof(ifa), what, ignore);
+	rtnl_request_put_attr(req, IFA_LOCAL, &addr, len);
+	rtnl_request_put_attr(req, IFA_ADDRESS, &addr, len);
+	return TRUE;
+}
+
+gboolean rtnl_request_add_address(struct rtnl_request *req,
+				const char *address, unsigned int prefix_len)
+{
+	return rtnl_request_put_address(req, RTM_NEWADDR,
+				NLM_F_CREATE | NLM_F_REPLACE,
+				address, prefix_len,
+				"Failed to set interface address", 0);
+}
+
+gboolean rtnl_request_del_address(struct rtnl_request *req,
+				const char *address, unsigned int prefix_len)
+{
+	return rtnl_request_put_address(req, RTM_DELADDR, 0,
+				address, prefix_len,
+				"Failed to remove interface address",
+				EADDRNOTAVAIL);
+}
+
+gboolean rtnl_request_add_route(struct rtnl_request *req, const char *dst,
+					unsigned int prefix_len)
+{
+	struct rtmsg rtm;
+	struct in6_addr addr;
+	unsigned int len = 0;
+	guint32 oif;
+	int family;
+
+	if (!req)
+		return FALSE;
+
+	family = rtnl_parse_address(dst, &addr, &len);
+	if (!family || prefix_len > len * 8)
+		return FALSE;
+
+	memset(&rtm, 0, sizeof(rtm));
+	rtm.rtm_family = family;
+	rtm.rtm_dst_len = prefix_len;
+	rtm.rtm_table = RT_TABLE_MAIN;
+	rtm.rtm_protocol = RTPROT_BOOT;
+	rtm.rtm_scope = family == AF_INET ? RT_SCOPE_LINK : RT_SCOPE_UNIVERSE;
+	rtm.rtm_type = RTN_UNICAST;
+
+	/* The route being there already is fine */
+	rtnl_request_put_msg(req, RTM_NEWROUTE, NLM_F_CREATE | NLM_F_EXCL,
+				&rtm, sizeof(rtm), "Failed to add route",
+				EEXIST);
+	if (prefix_len)
+		rtnl_request_put_attr(req, RTA_DST, &addr, len);
+
+	oif = req->ifindex;
+	rtnl_request_put_attr(req, RTA_OIF, &oif, sizeof(oif));
+	return TRUE;
+}
+
+gboolean rtnl_request_add_host_route(struct rtnl_request *req,
+							const char *dst)
+{
+	struct in6_addr addr;
+	unsigned int len = 0;
+
+	if (!rtnl_parse_address(dst, &addr, &len))
+		return FALSE;
+
+	return rtnl_request_add_route(req, dst, len * 8);
+}
+
+guint rtnl_request_submit(struct rtnl_request *req, rtnl_request_cb cb,
+							void *user_data)
+{
+	struct sockaddr_nl nl;
+	unsigned int off;
+	ssize_t result;
+
+	if (!req)
+		return 0;
+
+	if (!req->msgs->len || !rtnl_open()) {
+		rtnl_request_free(req);
+		return 0;
+	}
+
+	req->seq = rtnl_seq + 1;
+	for (off = 0; off < req->buf->len; ) {
+		struct nlmsghdr *hdr = (void *)(req->buf->data + off);
+
+		hdr->nlmsg_seq = ++rtnl_seq;
+		off += hdr->nlmsg_len;
+	}
+
+	memset(&nl, 0, sizeof(nl));
+	nl.nl_family = AF_NETLINK;
+
+	do {
+		result = sendto(rtnl_fd, req->buf->data, req->buf->len, 0,
+					(struct sockaddr *)&nl, sizeof(nl));
+	} while (result < 0 && errno == EINTR);
+
+	if (result < 0) {
+		ofono_error("Failed to configure %s: %s", req->ifname,
+							strerror(errno));
+		rtnl_request_free(req);
+		return 0;
+	}
+
+	DBG("%s %u message(s)", req->ifname, req->msgs->len);
+
+	g_byte_array_free(req->buf, TRUE);
+	req->buf = NULL;
+
+	req->id = ++rtnl_last_id;
+	if (!req->id)
+		req->id = ++rtnl_last_id;
+
+	req->pending = req->msgs->len;
+	req->cb = cb;
+	req->user_data = user_data;
+	rtnl_pending = g_slist_append(rtnl_pending, req);
+	return req->id;
+}
+
+void rtnl_cancel(guint id)
+{
+	GSList *l;
+
+	for (l = rtnl_pending; l; l = l->next) {
+		struct rtnl_request *req = l->data;
+
+		if (req->id == id) {
+			req->cb = NULL;
+			req->user_data = NULL;
+			return;
+		}
+	}
+}
+
+void __ofono_rtnl_cleanup(void)
+{
+	g_slist_free_full(rtnl_pending, (GDestroyNotify) rtnl_request_free);
+	rtnl_pending = NULL;
+	rtnl_close();
+}
@@ -0,0 +1,66 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Network interface configuration over a shared rtnetlink socket.  A
+ * request collects the changes for one interface, which are sent to the
+ * kernel with a single system call when the request is submitted and
+ * applied in the order they were added.  Acknowledgements are collected
+ * from the main loop, failures are logged.
+ */
+
+struct rtnl_request;
+
+/* error is zero or the first negative errno reported by the kernel */
+typedef void (*rtnl_request_cb)(int error, void *user_data);
+
+/* Returns NULL if there's no such interface, the setters accept NULL */
+struct rtnl_request *rtnl_request_new(const char *ifname);
+void rtnl_request_free(struct rtnl_request *req);
+
+void rtnl_request_set_link_up(struct rtnl_request *req, gboolean up);
+void rtnl_request_set_mtu(struct rtnl_request *req, unsigned int mtu);
+
+/*
+ * The family is deduced from the address.  Passing NULL to
+ * rtnl_request_del_address() removes the primary IPv4 address, like
+ * SIOCSIFADDR with INADDR_ANY does.  Removing an address which isn't
+ * there is not an error.
+ */
+gboolean rtnl_request_add_address(struct rtnl_request *req,
+				const char *address, unsigned int prefix_len);
+gboolean rtnl_request_del_address(struct rtnl_request *req,
+				const char *address, unsigned int prefix_len);
+
+/* Adds a route to dst/prefix_len via the interface, no gateway */
+gboolean rtnl_request_add_route(struct rtnl_request *req, const char *dst,
+					unsigned int prefix_len);
+gboolean rtnl_request_add_host_route(struct rtnl_request *req,
+							const char *dst);
+
+/*
+ * Sends the request and frees it.  Returns zero (and doesn't invoke the
+ * callback) if nothing could be sent, otherwise an id which can be
+ * passed to rtnl_cancel() to stop the callback from being invoked.
+ */
+guint rtnl_request_submit(struct rtnl_request *req, rtnl_request_cb cb,
+							void *user_data);
+void rtnl_cancel(guint id);
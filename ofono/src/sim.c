@@ -1756,6 +1756,74 @@ static void sim_ready(enum ofono_sim_state new_state, void *user)
 					sim_efimg_changed, sim, NULL);
 }
 
+/* EFs read by the core atoms once the SIM is ready, most urgent first */
+static const struct sim_prefetch_entry {
+	struct sim_fs_prefetch file;
+	int ust_service;
+	int sst_service;
+} sim_prefetch_plan[] = {
+	{ { SIM_EFSPN_FILEID, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT },
+		SIM_UST_SERVICE_PROVIDER_NAME,
+		SIM_SST_SERVICE_PROVIDER_NAME },
+	{ { SIM_EFPNN_FILEID, OFONO_SIM_FILE_STRUCTURE_FIXED },
+		SIM_UST_SERVICE_PLMN_NETWORK_NAME,
+		SIM_SST_SERVICE_PLMN_NETWORK_NAME },
+	{ { SIM_EFOPL_FILEID, OFONO_SIM_FILE_STRUCTURE_FIXED },
+		SIM_UST_SERVICE_OPERATOR_PLMN_LIST,
+		SIM_SST_SERVICE_OPERATOR_PLMN_LIST },
+	{ { SIM_EFSPDI_FILEID, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT },
+		SIM_UST_SERVICE_PROVIDER_DISPLAY_INFO,
+		SIM_SST_SERVICE_PROVIDER_DISPLAY_INFO },
+	{ { SIM_EFMSISDN_FILEID, OFONO_SIM_FILE_STRUCTURE_FIXED },
+		SIM_UST_SERVICE_MSISDN,
+		SIM_SST_SERVICE_MSISDN },
+	{ { SIM_EFSDN_FILEID, OFONO_SIM_FILE_STRUCTURE_FIXED },
+		SIM_UST_SERVICE_SDN,
+		SIM_SST_SERVICE_SDN },
+	{ { SIM_EFMWIS_FILEID, OFONO_SIM_FILE_STRUCTURE_FIXED },
+		SIM_UST_SERVICE_MWIS,
+		SIM_SST_SERVICE_MWIS },
+	{ { SIM_EFMBI_FILEID, OFONO_SIM_FILE_STRUCTURE_FIXED },
+		SIM_UST_SERVICE_MAILBOX_DIALLING_NUMBERS,
+		SIM_SST_SERVICE_MAILBOX_DIALLING_NUMBERS },
+	{ { SIM_EFMBDN_FILEID, OFONO_SIM_FILE_STRUCTURE_FIXED },
+		SIM_UST_SERVICE_MAILBOX_DIALLING_NUMBERS,
+		SIM_SST_SERVICE_MAILBOX_DIALLING_NUMBERS },
+	{ { SIM_EFCBMI_FILEID, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT },
+		SIM_UST_SERVICE_CBS_ID,
+		SIM_SST_SERVICE_CBS_ID },
+	{ { SIM_EFCBMIR_FILEID, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT },
+		SIM_UST_SERVICE_CBS_ID_RANGE,
+		SIM_SST_SERVICE_CBS_ID_RANGE },
+	{ { SIM_EFCBMID_FILEID, OFONO_SIM_FILE_STRUCTURE_TRANSPARENT },
+		SIM_UST_SERVICE_DATA_DOWNLOAD_SMS_CB,
+		SIM_SST_SERVICE_DATA_DOWNLOAD_SMS_CB },
+};
+
+/*
+ * Queue everything the atoms are about to ask for in one go, ahead of
+ * their own reads, which are then served from the cache.
+ */
+static void sim_prefetch(struct ofono_sim *sim)
+{
+	struct sim_fs_prefetch files[G_N_ELEMENTS(sim_prefetch_plan)];
+	unsigned int n = 0;
+	unsigned int i;
+
+	for (i = 0; i < G_N_ELEMENTS(sim_prefetch_plan); i++) {
+		const struct sim_prefetch_entry *e = sim_prefetch_plan + i;
+
+		if (__ofono_sim_service_available(sim, e->ust_service,
+							e->sst_service))
+			files[n++] = e->file;
+	}
+
+	DBG("%u of %u files", n, i);
+
+	if (n)
+		sim_fs_prefetch(sim->simfs, files, n);
+}
+
 static void sim_set_ready(struct ofono_sim *sim)
 {
 	if (sim == NULL)
@@ -1768,6 +1836,7 @@ static void sim_set_ready(struct ofono_sim *sim)
 	sim->state = OFONO_SIM_STATE_READY;
 
 	sim_fs_check_version(sim->simfs);
+	sim_prefetch(sim);
 
 	call_state_watches(sim);
 }
@@ -3488,6 +3557,10 @@ int ofono_sim_driver_register_version(const struct ofono_sim_driver *d, int v)
 		memcpy(dd, d, G_STRUCT_OFFSET(struct ofono_sim_driver,
 							set_active_card_slot));
 		break;
+	case 2:
+		memcpy(dd, d, G_STRUCT_OFFSET(struct ofono_sim_driver,
+							read_file_records));
+		break;
 	default:
 		memcpy(dd, d, sizeof(*d));
 		break;
@@ -39,19 +39,26 @@
 
 #include "simfs.h"
 #include "simutil.h"
+#include "simpack.h"
 #include "storage.h"
 
 #define SIM_CACHE_MODE 0600
 #define SIM_CACHE_BASEPATH STORAGEDIR "/%s-%i"
 #define SIM_CACHE_VERSION SIM_CACHE_BASEPATH "/version"
-#define SIM_CACHE_PATH SIM_CACHE_BASEPATH "/%04x"
 #define SIM_CACHE_HEADER_SIZE 39
 #define SIM_FILE_INFO_SIZE 7
+#define SIM_CACHE_BITMAP(cache) ((cache) + SIM_FILE_INFO_SIZE)
 #define SIM_IMAGE_CACHE_BASEPATH STORAGEDIR "/%s-%i/images"
 #define SIM_IMAGE_CACHE_PATH SIM_IMAGE_CACHE_BASEPATH "/%d.xpm"
 
 #define SIM_FS_VERSION 2
 
+/* Records requested at once from drivers that can read several */
+#define SIM_FS_MAX_RECORDS 16
+
+/* Prefetched files nobody asked for are dropped after this long */
+#define SIM_FS_PREFETCH_TIMEOUT 60
+
 static gboolean sim_fs_op_next(gpointer user_data);
 static gboolean sim_fs_op_read_record(gpointer user);
 static gboolean sim_fs_op_read_block(gpointer user_data);
@@ -70,6 +77,8 @@ struct sim_fs_op {
 	unsigned char path_len;
 	gconstpointer cb;
 	gboolean is_read;
+	gboolean prefetch;
+	gboolean single_records;
 	void *userdata;
 	struct ofono_sim_context *context;
 };
@@ -82,8 +91,15 @@ struct ofono_sim_context {
 struct sim_fs {
 	GQueue *op_q;
 	gint op_source;
-	unsigned char bitmap[32];
-	int fd;
+	unsigned char *cache;
+	unsigned int cache_len;
+	gboolean cache_dirty;
+	gboolean cache_persist;
+	GHashTable *prefetched;
+	guint prefetch_timeout;
+	struct sim_pack *pack;
+	char *pack_imsi;
+	enum ofono_sim_phase pack_phase;
 	struct ofono_sim *sim;
 	const struct ofono_sim_driver *driver;
 	GSList *contexts;
@@ -125,6 +141,15 @@ void sim_fs_free(struct sim_fs *fs)
 	if (fs->watch_id)
 		__ofono_sim_remove_session_watch(fs->session, fs->watch_id);
 
+	if (fs->prefetch_timeout)
+		g_source_remove(fs->prefetch_timeout);
+
+	if (fs->prefetched)
+		g_hash_table_destroy(fs->prefetched);
+
+	g_free(fs->cache);
+	sim_pack_unref(fs->pack);
+	g_free(fs->pack_imsi);
 	g_free(fs);
 }
 
@@ -144,7 +169,6 @@ struct sim_fs *sim_fs_new(struct ofono_sim *sim,
 
 	fs->sim = sim;
 	fs->driver = driver;
-	fs->fd = -1;
 
 	return fs;
 }
@@ -265,6 +289,94 @@ void sim_fs_notify_file_watches(struct sim_fs *fs, int id)
 
 }
 
+/*
+ * Returns the EF cache of the current IMSI and phase, mapping it in on
+ * first use.  The old one-file-per-EF cache is folded into the pack at
+ * that point, provided it was written in the current format.
+ */
+static struct sim_pack *sim_fs_get_pack(struct sim_fs *fs)
+{
+	const char *imsi = ofono_sim_get_imsi(fs->sim);
+	enum ofono_sim_phase phase = ofono_sim_get_phase(fs->sim);
+	unsigned char version;
+	char *dir;
+	gboolean import;
+	unsigned int n;
+
+	if (imsi == NULL || phase == OFONO_SIM_PHASE_UNKNOWN)
+		return NULL;
+
+	if (fs->pack && fs->pack_phase == phase &&
+			!g_strcmp0(fs->pack_imsi, imsi))
+		return fs->pack;
+
+	sim_pack_unref(fs->pack);
+	g_free(fs->pack_imsi);
+
+	dir = g_strdup_printf(SIM_CACHE_BASEPATH, imsi, phase);
+	fs->pack = sim_pack_open(dir);
+	fs->pack_imsi = g_strdup(imsi);
+	fs->pack_phase = phase;
+	g_free(dir);
+
+	if (fs->pack == NULL) {
+		ofono_error("Unable to open SIM cache for IMSI %s", imsi);
+		return NULL;
+	}
+
+	import = read_file(&version, 1, SIM_CACHE_VERSION, imsi, phase) == 1 &&
+			version == SIM_FS_VERSION;
+	n = sim_pack_migrate(fs->pack, import);
+
+	if (n)
+		DBG("Imported %u cached files for IMSI %s", n, imsi);
+
+	return fs->pack;
+}
+
+static gboolean sim_fs_prefetch_timeout(gpointer user_data)
+{
+	struct sim_fs *fs = user_data;
+
+	fs->prefetch_timeout = 0;
+
+	if (fs->prefetched) {
+		DBG("Dropping %u unused prefetched files",
+				g_hash_table_size(fs->prefetched));
+		g_hash_table_remove_all(fs->prefetched);
+	}
+
+	return FALSE;
+}
+
+/*
+ * Files which may not be cached persistently are kept in memory once
+ * prefetched, until the first read of the file claims them.
+ */
+static void sim_fs_prefetched_add(struct sim_fs *fs, int id,
+					unsigned char *data, unsigned int len)
+{
+	if (fs->prefetched == NULL)
+		fs->prefetched = g_hash_table_new_full(g_direct_hash,
+					g_direct_equal, NULL,
+					(GDestroyNotify) g_byte_array_unref);
+
+	g_hash_table_replace(fs->prefetched, GINT_TO_POINTER(id),
+					g_byte_array_new_take(data, len));
+
+	if (fs->prefetch_timeout)
+		g_source_remove(fs->prefetch_timeout);
+
+	fs->prefetch_timeout = g_timeout_add_seconds(SIM_FS_PREFETCH_TIMEOUT,
+					sim_fs_prefetch_timeout, fs);
+}
+
+static void sim_fs_prefetched_remove(struct sim_fs *fs, int id)
+{
+	if (fs->prefetched)
+		g_hash_table_remove(fs->prefetched, GINT_TO_POINTER(id));
+}
+
 static void sim_fs_end_current(struct sim_fs *fs)
 {
 	struct sim_fs_op *op = g_queue_pop_head(fs->op_q);
@@ -274,12 +386,20 @@ static void sim_fs_end_current(struct sim_fs *fs)
 	else if (fs->watch_id) /* release the session if no pending reads */
 		__ofono_sim_remove_session_watch(fs->session, fs->watch_id);
 
-	if (fs->fd != -1) {
-		TFR(close(fs->fd));
-		fs->fd = -1;
+	/* Whatever was fetched from the card goes out in a single append */
+	if (fs->cache && fs->cache_dirty && fs->cache_persist) {
+		if (!sim_pack_store(sim_fs_get_pack(fs), op->id, fs->cache,
+							fs->cache_len))
+			DBG("Unable to cache fileid %04x", op->id);
+	} else if (fs->cache && fs->cache_dirty && op->prefetch) {
+		sim_fs_prefetched_add(fs, op->id, fs->cache, fs->cache_len);
+		fs->cache = NULL;
 	}
 
-	memset(fs->bitmap, 0, sizeof(fs->bitmap));
+	g_free(fs->cache);
+	fs->cache = NULL;
+	fs->cache_len = 0;
+	fs->cache_dirty = FALSE;
 
 	sim_fs_op_free(op);
 }
@@ -309,41 +429,31 @@ static void sim_fs_op_error(struct sim_fs *fs)
 static gboolean cache_block(struct sim_fs *fs, int block, int block_len,
 				const unsigned char *data, int num_bytes)
 {
-	int offset;
-	int bit;
-	ssize_t r;
-	unsigned char b;
+	unsigned int offset = SIM_CACHE_HEADER_SIZE + block * block_len;
 
-	if (fs->fd == -1)
+	if (fs->cache == NULL)
 		return FALSE;
 
-	if (lseek(fs->fd, block * block_len +
-				SIM_CACHE_HEADER_SIZE, SEEK_SET) == (off_t) -1)
+	if (block < 0 || block >= 256 || num_bytes < 0 ||
+			offset + num_bytes > fs->cache_len)
 		return FALSE;
 
-	r = TFR(write(fs->fd, data, num_bytes));
-
-	if (r != num_bytes)
-		return FALSE;
+	memcpy(fs->cache + offset, data, num_bytes);
 
 	/* update present bit for this block */
-	offset = block / 8;
-	bit = block % 8;
-
-	/* lseek to correct byte (skip file info) */
-	lseek(fs->fd, offset + SIM_FILE_INFO_SIZE, SEEK_SET);
+	SIM_CACHE_BITMAP(fs->cache)[block / 8] |= 1 << (block % 8);
+	fs->cache_dirty = TRUE;
 
-	b = fs->bitmap[offset];
-	b |= 1 << bit;
-
-	r = TFR(write(fs->fd, &b, sizeof(b)));
+	return TRUE;
+}
 
-	if (r != sizeof(b))
+static gboolean cache_has_block(struct sim_fs *fs, int block)
+{
+	if (fs->cache == NULL || block < 0 || block >= 256)
 		return FALSE;
 
-	fs->bitmap[offset] = b;
-
-	return TRUE;
+	return (SIM_CACHE_BITMAP(fs->cache)[block / 8] &
+						(1 << (block % 8))) != 0;
 }
 
 static void sim_fs_op_write_cb(const struct ofono_error *error, void *data)
@@ -470,16 +580,11 @@ static gboolean sim_fs_op_read_block(gpointer user_data)
 		}
 	}
 
-	while (fs->fd != -1 && op->current <= end_block) {
-		int offset = op->current / 8;
-		int bit = 1 << op->current % 8;
+	while (op->current <= end_block && cache_has_block(fs, op->current)) {
 		int bufoff;
 		int seekoff;
 		int toread;
 
-		if ((fs->bitmap[offset] & bit) == 0)
-			break;
-
 		if (op->current == start_block) {
 			bufoff = 0;
 			seekoff = SIM_CACHE_HEADER_SIZE + op->current * 256 +
@@ -495,12 +600,10 @@ static gboolean sim_fs_op_read_block(gpointer user_data)
 		DBG("bufoff: %d, seekoff: %d, toread: %d",
 				bufoff, seekoff, toread);
 
-		if (lseek(fs->fd, seekoff, SEEK_SET) == (off_t) -1)
-			break;
-
-		if (TFR(read(fs->fd, op->buffer + bufoff, toread)) != toread)
+		if ((unsigned int) (seekoff + toread) > fs->cache_len)
 			break;
 
+		memcpy(op->buffer + bufoff, fs->cache + seekoff, toread);
 		op->current += 1;
 	}
 
@@ -563,6 +666,47 @@ static void sim_fs_op_retrieve_cb(const struct ofono_error *error,
 	}
 }
 
+static void sim_fs_op_retrieve_records_cb(const struct ofono_error *error,
+					const unsigned char *data, int len,
+					void *user)
+{
+	struct sim_fs *fs = user;
+	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
+	int total = op->length / op->record_length;
+
+	if (error->type != OFONO_ERROR_TYPE_NO_ERROR ||
+			len < op->record_length) {
+		/* Let the single record read decide if the file is there */
+		op->single_records = TRUE;
+		fs->op_source = g_idle_add(sim_fs_op_read_record, fs);
+		return;
+	}
+
+	while (len >= op->record_length && op->current <= total) {
+		ofono_sim_file_read_cb_t cb = op->cb;
+
+		cache_block(fs, op->current - 1, op->record_length,
+				data, op->record_length);
+
+		if (cb == NULL) {
+			sim_fs_end_current(fs);
+			return;
+		}
+
+		cb(1, op->length, op->current, data, op->record_length,
+							op->userdata);
+
+		data += op->record_length;
+		len -= op->record_length;
+		op->current += 1;
+	}
+
+	if (op->current > total)
+		sim_fs_end_current(fs);
+	else
+		fs->op_source = g_idle_add(sim_fs_op_read_record, fs);
+}
+
 static gboolean sim_fs_op_read_record(gpointer user)
 {
 	struct sim_fs *fs = user;
@@ -578,21 +722,17 @@ static gboolean sim_fs_op_read_record(gpointer user)
 		return FALSE;
 	}
 
-	while (fs->fd != -1 && op->current <= total) {
-		int offset = (op->current - 1) / 8;
-		int bit = 1 << ((op->current - 1) % 8);
+	while (op->current <= total && cache_has_block(fs, op->current - 1)) {
 		ofono_sim_file_read_cb_t cb = op->cb;
+		unsigned int seekoff = (op->current - 1) * op->record_length +
+						SIM_CACHE_HEADER_SIZE;
 
-		if ((fs->bitmap[offset] & bit) == 0)
+		if (op->record_length > (int) sizeof(buf) ||
+				seekoff + op->record_length > fs->cache_len)
 			break;
 
-		if (lseek(fs->fd, (op->current - 1) * op->record_length +
-				SIM_CACHE_HEADER_SIZE, SEEK_SET) == (off_t) -1)
-			break;
-
-		if (TFR(read(fs->fd, buf, op->record_length)) !=
-				op->record_length)
-			break;
+		/* The callback may queue more reads, don't hand it the cache */
+		memcpy(buf, fs->cache + seekoff, op->record_length);
 
 		cb(1, op->length, op->current,
 				buf, op->record_length, op->userdata);
@@ -606,6 +746,20 @@ static gboolean sim_fs_op_read_record(gpointer user)
 		return FALSE;
 	}
 
+	/* Fetch the rest of the file in as few round trips as possible */
+	if (driver->read_file_records && !op->single_records &&
+			op->current < total) {
+		int count = MIN(total - op->current + 1, SIM_FS_MAX_RECORDS);
+
+		driver->read_file_records(fs->sim, op->id, op->structure,
+					op->current, count,
+					op->record_length,
+					op->path_len ? op->path : NULL,
+					op->path_len,
+					sim_fs_op_retrieve_records_cb, fs);
+		return FALSE;
+	}
+
 	switch (op->structure) {
 	case OFONO_SIM_FILE_STRUCTURE_FIXED:
 		if (driver->read_file_linear == NULL) {
@@ -652,9 +806,8 @@ static void sim_fs_op_cache_fileinfo(struct sim_fs *fs,
 	enum sim_file_access update;
 	enum sim_file_access invalidate;
 	enum sim_file_access rehabilitate;
-	unsigned char fileinfo[SIM_CACHE_HEADER_SIZE];
+	unsigned char *fileinfo;
 	gboolean cache;
-	char *path;
 
 	/* TS 11.11, Section 9.3 */
 	update = file_access_condition_decode(access[0] & 0xf);
@@ -669,11 +822,26 @@ static void sim_fs_op_cache_fileinfo(struct sim_fs *fs,
 			(rehabilitate == SIM_FILE_ACCESS_ADM ||
 				rehabilitate == SIM_FILE_ACCESS_NEVER);
 
-	if (imsi == NULL || phase == OFONO_SIM_PHASE_UNKNOWN || cache == FALSE)
+	/* Prefetched files are kept, in memory if nowhere else */
+	if (imsi == NULL || phase == OFONO_SIM_PHASE_UNKNOWN)
+		cache = FALSE;
+
+	if (cache == FALSE && !op->prefetch)
 		return;
 
-	memset(fileinfo, 0, SIM_CACHE_HEADER_SIZE);
+	/* Blocks are filled in as they arrive and stored once the op ends */
+	g_free(fs->cache);
+	fs->cache_len = SIM_CACHE_HEADER_SIZE + length;
+	fs->cache = g_try_malloc0(fs->cache_len);
+	fs->cache_dirty = TRUE;
+	fs->cache_persist = cache;
 
+	if (fs->cache == NULL) {
+		fs->cache_len = 0;
+		return;
+	}
+
+	fileinfo = fs->cache;
 	fileinfo[0] = error->type;
 	fileinfo[1] = length >> 8;
 	fileinfo[2] = length & 0xff;
@@ -681,20 +849,6 @@ static void sim_fs_op_cache_fileinfo(struct sim_fs *fs,
 	fileinfo[4] = record_length >> 8;
 	fileinfo[5] = record_length & 0xff;
 	fileinfo[6] = file_status;
-
-	path = g_strdup_printf(SIM_CACHE_PATH, imsi, phase, op->id);
-	fs->fd = TFR(open(path, O_WRONLY | O_CREAT | O_TRUNC, SIM_CACHE_MODE));
-	g_free(path);
-
-	if (fs->fd == -1)
-		return;
-
-	if (TFR(write(fs->fd, fileinfo, SIM_CACHE_HEADER_SIZE)) ==
-			SIM_CACHE_HEADER_SIZE)
-		return;
-
-	TFR(close(fs->fd));
-	fs->fd = -1;
 }
 
 static void sim_fs_op_info_cb(const struct ofono_error *error, int length,
@@ -763,42 +917,45 @@ static void sim_fs_op_info_cb(const struct ofono_error *error, int length,
 
 static gboolean sim_fs_op_check_cached(struct sim_fs *fs)
 {
-	const char *imsi = ofono_sim_get_imsi(fs->sim);
-	enum ofono_sim_phase phase = ofono_sim_get_phase(fs->sim);
+	struct sim_pack *pack = sim_fs_get_pack(fs);
 	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
-	char *path;
-	int fd;
-	ssize_t len;
-	unsigned char fileinfo[SIM_CACHE_HEADER_SIZE];
+	gpointer key = GINT_TO_POINTER(op->id);
+	GByteArray *prefetched = NULL;
+	const unsigned char *fileinfo = NULL;
+	unsigned int len = 0;
 	int error_type;
 	int file_length;
 	enum ofono_sim_file_structure structure;
 	int record_length;
 	unsigned char file_status;
 
-	if (imsi == NULL || phase == OFONO_SIM_PHASE_UNKNOWN)
-		return FALSE;
-
-	path = g_strdup_printf(SIM_CACHE_PATH, imsi, phase, op->id);
+	if (op->prefetch) {
+		/* Nothing to do if the file is at hand already */
+		if ((fs->prefetched && g_hash_table_contains(fs->prefetched,
+								key)) ||
+				sim_pack_lookup(pack, op->id, NULL)) {
+			sim_fs_end_current(fs);
+			return TRUE;
+		}
 
-	if (path == NULL)
 		return FALSE;
+	}
 
-	fd = TFR(open(path, O_RDWR));
-	g_free(path);
-
-	if (fd == -1) {
-		if (errno != ENOENT)
-			DBG("Error %i opening cache file for "
-					"fileid %04x, IMSI %s",
-					errno, op->id, imsi);
+	/* The first read claims the prefetched copy */
+	if (fs->prefetched) {
+		prefetched = g_hash_table_lookup(fs->prefetched, key);
 
-		return FALSE;
+		if (prefetched) {
+			g_hash_table_steal(fs->prefetched, key);
+			fileinfo = prefetched->data;
+			len = prefetched->len;
+		}
 	}
 
-	len = TFR(read(fd, fileinfo, SIM_CACHE_HEADER_SIZE));
+	if (fileinfo == NULL)
+		fileinfo = sim_pack_lookup(pack, op->id, &len);
 
-	if (len != SIM_CACHE_HEADER_SIZE)
+	if (fileinfo == NULL || len < SIM_CACHE_HEADER_SIZE)
 		goto error;
 
 	error_type = fileinfo[0];
@@ -813,11 +970,28 @@ static gboolean sim_fs_op_check_cached(struct sim_fs *fs)
 	if (record_length == 0 || file_length < record_length)
 		goto error;
 
+	/*
+	 * Work on a copy, the mapping moves as soon as the pack is
+	 * appended to.  Files imported from the old layout may be short,
+	 * the bitmap tells which blocks are actually there.
+	 */
+	fs->cache_len = SIM_CACHE_HEADER_SIZE + file_length;
+	fs->cache = g_try_malloc0(fs->cache_len);
+	fs->cache_dirty = FALSE;
+	fs->cache_persist = (prefetched == NULL);
+
+	if (fs->cache == NULL) {
+		fs->cache_len = 0;
+		goto error;
+	}
+
+	memcpy(fs->cache, fileinfo, MIN(len, fs->cache_len));
+
+	if (prefetched)
+		g_byte_array_unref(prefetched);
+
 	op->length = file_length;
 	op->record_length = record_length;
-	memcpy(fs->bitmap, fileinfo + SIM_FILE_INFO_SIZE,
-			SIM_CACHE_HEADER_SIZE - SIM_FILE_INFO_SIZE);
-	fs->fd = fd;
 
 	if (error_type != OFONO_ERROR_TYPE_NO_ERROR ||
 			structure != op->structure) {
@@ -850,7 +1024,9 @@ static gboolean sim_fs_op_check_cached(struct sim_fs *fs)
 	return TRUE;
 
 error:
-	TFR(close(fd));
+	if (prefetched)
+		g_byte_array_unref(prefetched);
+
 	return FALSE;
 }
 
@@ -1185,6 +1361,48 @@ int sim_fs_read_record(struct ofono_sim_context *context, int id,
 	return 0;
 }
 
+static void sim_fs_prefetch_cb(int ok, int total_length, int record,
+				const unsigned char *data, int record_length,
+				void *userdata)
+{
+}
+
+int sim_fs_prefetch(struct sim_fs *fs, const struct sim_fs_prefetch *files,
+			unsigned int n_files)
+{
+	unsigned int i;
+
+	if (fs->driver == NULL || fs->driver->read_file_info == NULL)
+		return -ENOSYS;
+
+	/* Only the main application is covered */
+	if (fs->session)
+		return -ENOSYS;
+
+	if (fs->op_q == NULL)
+		fs->op_q = g_queue_new();
+
+	for (i = 0; i < n_files; i++) {
+		struct sim_fs_op *op = g_try_new0(struct sim_fs_op, 1);
+
+		if (op == NULL)
+			return -ENOMEM;
+
+		op->id = files[i].id;
+		op->structure = files[i].structure;
+		op->cb = sim_fs_prefetch_cb;
+		op->is_read = TRUE;
+		op->prefetch = TRUE;
+
+		g_queue_push_tail(fs->op_q, op);
+
+		if (g_queue_get_length(fs->op_q) == 1)
+			fs->op_source = g_idle_add(sim_fs_op_next, fs);
+	}
+
+	return 0;
+}
+
 int sim_fs_write(struct ofono_sim_context *context, int id,
 			ofono_sim_file_write_cb_t cb,
 			enum ofono_sim_file_structure structure, int record,
@@ -1217,6 +1435,9 @@ int sim_fs_write(struct ofono_sim_context *context, int id,
 	if (fn == NULL)
 		return -ENOSYS;
 
+	/* Whatever was prefetched is about to become stale */
+	sim_fs_prefetched_remove(fs, id);
+
 	if (fs->op_q == NULL)
 		fs->op_q = g_queue_new();
 
@@ -1313,23 +1534,6 @@ char *sim_fs_get_cached_image(struct sim_fs *fs, int id)
 	return buffer;
 }
 
-static void remove_cachefile(const char *imsi, enum ofono_sim_phase phase,
-				const struct dirent *file)
-{
-	int id;
-	char *path;
-
-	if (file->d_type != DT_REG)
-		return;
-
-	if (sscanf(file->d_name, "%4x", &id) != 1)
-		return;
-
-	path = g_strdup_printf(SIM_CACHE_PATH, imsi, phase, id);
-	remove(path);
-	g_free(path);
-}
-
 static void remove_imagefile(const char *imsi, enum ofono_sim_phase phase,
 				const struct dirent *file)
 {
@@ -1368,35 +1572,18 @@ void sim_fs_check_version(struct sim_fs *fs)
 
 void sim_fs_cache_flush(struct sim_fs *fs)
 {
-	const char *imsi = ofono_sim_get_imsi(fs->sim);
-	enum ofono_sim_phase phase = ofono_sim_get_phase(fs->sim);
-	char *path = g_strdup_printf(SIM_CACHE_BASEPATH, imsi, phase);
-	struct dirent **entries;
-	int len = scandir(path, &entries, NULL, alphasort);
-
-	g_free(path);
-
-	if (len > 0) {
-		/* Remove all file ids */
-		while (len--) {
-			remove_cachefile(imsi, phase, entries[len]);
-			g_free(entries[len]);
-		}
-
-		g_free(entries);
-	}
+	if (fs->prefetched)
+		g_hash_table_remove_all(fs->prefetched);
 
+	/* Opening the pack also gets rid of any old style cache files */
+	sim_pack_clear(sim_fs_get_pack(fs));
 	sim_fs_image_cache_flush(fs);
 }
 
 void sim_fs_cache_flush_file(struct sim_fs *fs, int id)
 {
-	const char *imsi = ofono_sim_get_imsi(fs->sim);
-	enum ofono_sim_phase phase = ofono_sim_get_phase(fs->sim);
-	char *path = g_strdup_printf(SIM_CACHE_PATH, imsi, phase, id);
-
-	remove(path);
-	g_free(path);
+	sim_fs_prefetched_remove(fs, id);
+	sim_pack_remove(sim_fs_get_pack(fs), id);
 }
 
 void sim_fs_image_cache_flush(struct sim_fs *fs)
@@ -63,6 +63,19 @@ int sim_fs_read_info(struct ofono_sim_context *context, int id,
 
 void sim_fs_check_version(struct sim_fs *fs);
 
+struct sim_fs_prefetch {
+	int id;
+	enum ofono_sim_file_structure structure;
+};
+
+/*
+ * Queues reads of the given EFs as a single batch.  The contents end up
+ * in the EF cache, or in memory until the first read for files which may
+ * not be cached, so that later reads are served without a round trip.
+ */
+int sim_fs_prefetch(struct sim_fs *fs, const struct sim_fs_prefetch *files,
+			unsigned int n_files);
+
 int sim_fs_write(struct ofono_sim_context *context, int id,
 			ofono_sim_file_write_cb_t cb,
 			enum ofono_sim_file_structure structure, int record,
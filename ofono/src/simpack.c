@@ -0,0 +1,581 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+#include <glib.h>
+
+#include "storage.h"
+#include "simpack.h"
+
+#define SIM_PACK_NAME "simfs.pack"
+#define SIM_PACK_MODE 0600
+#define SIM_PACK_VERSION 1
+
+/* Magic (4), version (1), reserved (3) */
+#define SIM_PACK_HEADER_SIZE 8
+
+/* File id (2), body length (4), checksum (2), all big endian */
+#define SIM_PACK_RECORD_SIZE 8
+
+/* Larger than any EF: 39 bytes of file info plus up to 64k of data */
+#define SIM_PACK_MAX_BODY (128 * 1024)
+
+/* Mapping granularity, appends within the slack need no remap */
+#define SIM_PACK_MAP_CHUNK (64 * 1024)
+
+/* Compact once superseded records exceed both this and the live data */
+#define SIM_PACK_COMPACT_MIN (16 * 1024)
+
+static const unsigned char sim_pack_magic[4] = { 'S', 'F', 'P', 'K' };
+
+struct sim_pack_entry {
+	size_t offset;
+	unsigned int len;
+};
+
+struct sim_pack {
+	int refcount;
+	char *dir;
+	char *path;
+	int fd;
+	unsigned char *map;
+	size_t map_len;
+	size_t size;
+	size_t garbage;
+	GHashTable *index;
+};
+
+static GHashTable *sim_packs;
+
+/* Fletcher-16 over the record header fields and the body */
+static guint16 sim_pack_checksum(const unsigned char *hdr,
+				const unsigned char *data, unsigned int len)
+{
+	guint32 sum1 = 0;
+	guint32 sum2 = 0;
+	unsigned int i;
+
+	for (i = 0; i < SIM_PACK_RECORD_SIZE - 2; i++) {
+		sum1 += hdr[i];
+		sum2 += sum1;
+	}
+
+	while (len) {
+		/* Small enough for the 32-bit sums not to overflow */
+		unsigned int n = MIN(len, 4096);
+
+		len -= n;
+
+		while (n--) {
+			sum1 += *data++;
+			sum2 += sum1;
+		}
+
+		sum1 %= 255;
+		sum2 %= 255;
+	}
+
+	sum1 %= 255;
+	sum2 %= 255;
+
+	return (sum2 << 8) | sum1;
+}
+
+static void sim_pack_encode_record(unsigned char *hdr, int id,
+				const unsigned char *data, unsigned int len)
+{
+	guint16 sum;
+
+	hdr[0] = id >> 8;
+	hdr[1] = id & 0xff;
+	hdr[2] = len >> 24;
+	hdr[3] = (len >> 16) & 0xff;
+	hdr[4] = (len >> 8) & 0xff;
+	hdr[5] = len & 0xff;
+
+	sum = sim_pack_checksum(hdr, data, len);
+	hdr[6] = sum >> 8;
+	hdr[7] = sum & 0xff;
+}
+
+static void sim_pack_unmap(struct sim_pack *pack)
+{
+	if (pack->map) {
+		munmap(pack->map, pack->map_len);
+		pack->map = NULL;
+		pack->map_len = 0;
+	}
+}
+
+static void sim_pack_close(struct sim_pack *pack)
+{
+	sim_pack_unmap(pack);
+
+	if (pack->fd != -1) {
+		TFR(close(pack->fd));
+		pack->fd = -1;
+	}
+
+	g_hash_table_remove_all(pack->index);
+	pack->size = 0;
+	pack->garbage = 0;
+}
+
+/* Makes sure that the first pack->size bytes of the file are mapped */
+static gboolean sim_pack_map(struct sim_pack *pack)
+{
+	size_t len;
+	void *map;
+
+	if (pack->map_len >= pack->size)
+		return TRUE;
+
+	sim_pack_unmap(pack);
+
+	/*
+	 * Pages past the end of file are never touched, they only become
+	 * valid as appends grow the file underneath the shared mapping.
+	 */
+	len = (pack->size + SIM_PACK_MAP_CHUNK - 1) &
+					~((size_t) SIM_PACK_MAP_CHUNK - 1);
+	map = mmap(NULL, len, PROT_READ, MAP_SHARED, pack->fd, 0);
+	if (map == MAP_FAILED)
+		return FALSE;
+
+	pack->map = map;
+	pack->map_len = len;
+
+	return TRUE;
+}
+
+static void sim_pack_index(struct sim_pack *pack, int id, size_t offset,
+				unsigned int len)
+{
+	gpointer key = GINT_TO_POINTER(id);
+	struct sim_pack_entry *entry = g_hash_table_lookup(pack->index, key);
+
+	if (entry)
+		pack->garbage += SIM_PACK_RECORD_SIZE + entry->len;
+
+	if (len == 0) {
+		/* The removal record itself is garbage as well */
+		pack->garbage += SIM_PACK_RECORD_SIZE;
+		g_hash_table_remove(pack->index, key);
+		return;
+	}
+
+	if (entry == NULL) {
+		entry = g_new(struct sim_pack_entry, 1);
+		g_hash_table_insert(pack->index, key, entry);
+	}
+
+	entry->offset = offset;
+	entry->len = len;
+}
+
+static gboolean sim_pack_reset(struct sim_pack *pack)
+{
+	unsigned char hdr[SIM_PACK_HEADER_SIZE];
+
+	g_hash_table_remove_all(pack->index);
+	pack->size = 0;
+	pack->garbage = 0;
+
+	memset(hdr, 0, sizeof(hdr));
+	memcpy(hdr, sim_pack_magic, sizeof(sim_pack_magic));
+	hdr[4] = SIM_PACK_VERSION;
+
+	if (ftruncate(pack->fd, 0) < 0)
+		return FALSE;
+
+	if (TFR(write(pack->fd, hdr, sizeof(hdr))) != sizeof(hdr))
+		return FALSE;
+
+	pack->size = sizeof(hdr);
+
+	return TRUE;
+}
+
+static gboolean sim_pack_load(struct sim_pack *pack)
+{
+	struct stat st;
+	size_t off;
+
+	sim_pack_close(pack);
+
+	if (create_dirs(pack->path, SIM_PACK_MODE | S_IXUSR) != 0)
+		return FALSE;
+
+	pack->fd = TFR(open(pack->path, O_RDWR | O_CREAT | O_APPEND |
+					O_CLOEXEC, SIM_PACK_MODE));
+	if (pack->fd == -1)
+		return FALSE;
+
+	if (fstat(pack->fd, &st) < 0)
+		goto error;
+
+	pack->size = st.st_size;
+
+	if (pack->size < SIM_PACK_HEADER_SIZE) {
+		if (!sim_pack_reset(pack))
+			goto error;
+
+		return TRUE;
+	}
+
+	if (!sim_pack_map(pack))
+		goto error;
+
+	/* Start over if the file is damaged or from an unknown version */
+	if (memcmp(pack->map, sim_pack_magic, sizeof(sim_pack_magic)) ||
+			pack->map[4] != SIM_PACK_VERSION) {
+		sim_pack_unmap(pack);
+
+		if (!sim_pack_reset(pack))
+			goto error;
+
+		return TRUE;
+	}
+
+	off = SIM_PACK_HEADER_SIZE;
+
+	while (off + SIM_PACK_RECORD_SIZE <= pack->size) {
+		const unsigned char *rec = pack->map + off;
+		const unsigned char *body = rec + SIM_PACK_RECORD_SIZE;
+		int id = (rec[0] << 8) | rec[1];
+		unsigned int len = ((unsigned int) rec[2] << 24) |
+					(rec[3] << 16) | (rec[4] << 8) | rec[5];
+		guint16 sum = (rec[6] << 8) | rec[7];
+
+		if (len > SIM_PACK_MAX_BODY ||
+				len > pack->size - off - SIM_PACK_RECORD_SIZE)
+			break;
+
+		if (sim_pack_checksum(rec, body, len) != sum)
+			break;
+
+		sim_pack_index(pack, id, off, len);
+		off += SIM_PACK_RECORD_SIZE + len;
+	}
+
+	if (off < pack->size) {
+		/* Drop whatever an interrupted append has left behind */
+		if (ftruncate(pack->fd, off) < 0)
+			goto error;
+
+		pack->size = off;
+	}
+
+	return TRUE;
+
+error:
+	sim_pack_close(pack);
+	return FALSE;
+}
+
+static void sim_pack_free(struct sim_pack *pack)
+{
+	sim_pack_close(pack);
+	g_hash_table_destroy(pack->index);
+	g_free(pack->path);
+	g_free(pack->dir);
+	g_free(pack);
+}
+
+struct sim_pack *sim_pack_open(const char *dir)
+{
+	struct sim_pack *pack;
+
+	if (dir == NULL)
+		return NULL;
+
+	if (sim_packs == NULL)
+		sim_packs = g_hash_table_new(g_str_hash, g_str_equal);
+
+	pack = g_hash_table_lookup(sim_packs, dir);
+	if (pack) {
+		pack->refcount++;
+		return pack;
+	}
+
+	pack = g_new0(struct sim_pack, 1);
+	pack->refcount = 1;
+	pack->fd = -1;
+	pack->dir = g_strdup(dir);
+	pack->path = g_build_filename(dir, SIM_PACK_NAME, NULL);
+	pack->index = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+						NULL, g_free);
+
+	if (!sim_pack_load(pack)) {
+		sim_pack_free(pack);
+		return NULL;
+	}
+
+	g_hash_table_insert(sim_packs, pack->dir, pack);
+
+	return pack;
+}
+
+void sim_pack_unref(struct sim_pack *pack)
+{
+	if (pack == NULL)
+		return;
+
+	if (--pack->refcount > 0)
+		return;
+
+	g_hash_table_remove(sim_packs, pack->dir);
+
+	if (g_hash_table_size(sim_packs) == 0) {
+		g_hash_table_destroy(sim_packs);
+		sim_packs = NULL;
+	}
+
+	sim_pack_free(pack);
+}
+
+const char *sim_pack_get_dir(struct sim_pack *pack)
+{
+	return pack ? pack->dir : NULL;
+}
+
+const unsigned char *sim_pack_lookup(struct sim_pack *pack, int id,
+					unsigned int *out_len)
+{
+	struct sim_pack_entry *entry;
+
+	if (pack == NULL)
+		return NULL;
+
+	entry = g_hash_table_lookup(pack->index, GINT_TO_POINTER(id));
+	if (entry == NULL || !sim_pack_map(pack))
+		return NULL;
+
+	if (out_len)
+		*out_len = entry->len;
+
+	return pack->map + entry->offset + SIM_PACK_RECORD_SIZE;
+}
+
+static gboolean sim_pack_append(struct sim_pack *pack, int id,
+				const unsigned char *data, unsigned int len)
+{
+	unsigned char hdr[SIM_PACK_RECORD_SIZE];
+	struct iovec iov[2];
+	ssize_t r;
+
+	if (len > SIM_PACK_MAX_BODY)
+		return FALSE;
+
+	/* Retry if the pack couldn't be opened or recovered earlier */
+	if (pack->fd == -1 && !sim_pack_load(pack))
+		return FALSE;
+
+	sim_pack_encode_record(hdr, id, data, len);
+
+	iov[0].iov_base = hdr;
+	iov[0].iov_len = sizeof(hdr);
+	iov[1].iov_base = (void *) data;
+	iov[1].iov_len = len;
+
+	/* O_APPEND, so the record always lands at the end of the file */
+	r = TFR(writev(pack->fd, iov, len ? 2 : 1));
+	if (r != (ssize_t) (sizeof(hdr) + len)) {
+		/* Never leave a partial record behind */
+		if (r > 0 && ftruncate(pack->fd, pack->size) < 0)
+			sim_pack_close(pack);
+
+		return FALSE;
+	}
+
+	sim_pack_index(pack, id, pack->size, len);
+	pack->size += r;
+
+	if (pack->garbage > SIM_PACK_COMPACT_MIN && pack->garbage >
+			pack->size - SIM_PACK_HEADER_SIZE - pack->garbage)
+		sim_pack_compact(pack);
+
+	return TRUE;
+}
+
+gboolean sim_pack_store(struct sim_pack *pack, int id,
+			const unsigned char *data, unsigned int len)
+{
+	if (pack == NULL || data == NULL || len == 0)
+		return FALSE;
+
+	return sim_pack_append(pack, id, data, len);
+}
+
+gboolean sim_pack_remove(struct sim_pack *pack, int id)
+{
+	if (pack == NULL)
+		return FALSE;
+
+	if (!g_hash_table_lookup(pack->index, GINT_TO_POINTER(id)))
+		return TRUE;
+
+	return sim_pack_append(pack, id, NULL, 0);
+}
+
+gboolean sim_pack_clear(struct sim_pack *pack)
+{
+	if (pack == NULL)
+		return FALSE;
+
+	if (pack->fd == -1)
+		return sim_pack_load(pack) && sim_pack_clear(pack);
+
+	if (sim_pack_reset(pack))
+		return TRUE;
+
+	sim_pack_close(pack);
+	return FALSE;
+}
+
+/*
+ * Writes the live records into a temporary file and renames it over the
+ * pack, so that either the old or the new file survives a crash.
+ */
+gboolean sim_pack_compact(struct sim_pack *pack)
+{
+	GHashTableIter iter;
+	gpointer value;
+	GByteArray *buf;
+	char *tmp_path;
+	gboolean ok = FALSE;
+	int fd;
+
+	if (pack == NULL || pack->fd == -1 || !sim_pack_map(pack))
+		return FALSE;
+
+	buf = g_byte_array_sized_new(pack->size - pack->garbage);
+	g_byte_array_append(buf, pack->map, SIM_PACK_HEADER_SIZE);
+
+	g_hash_table_iter_init(&iter, pack->index);
+
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		struct sim_pack_entry *entry = value;
+
+		g_byte_array_append(buf, pack->map + entry->offset,
+					SIM_PACK_RECORD_SIZE + entry->len);
+	}
+
+	tmp_path = g_strdup_printf("%s.XXXXXX.tmp", pack->path);
+	fd = TFR(g_mkstemp_full(tmp_path, O_WRONLY | O_CREAT | O_TRUNC,
+							SIM_PACK_MODE));
+
+	if (fd != -1) {
+		ok = TFR(write(fd, buf->data, buf->len)) ==
+							(ssize_t) buf->len &&
+			fdatasync(fd) == 0;
+		TFR(close(fd));
+
+		if (ok)
+			ok = rename(tmp_path, pack->path) == 0;
+
+		if (!ok)
+			unlink(tmp_path);
+	}
+
+	g_free(tmp_path);
+	g_byte_array_free(buf, TRUE);
+
+	/* Pick up the compacted file, or the old one if that failed */
+	return sim_pack_load(pack) && ok;
+}
+
+static gboolean sim_pack_legacy_name(const char *name, int *id)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		if (!g_ascii_isxdigit(name[i]))
+			return FALSE;
+
+	if (name[4] != '\0')
+		return FALSE;
+
+	*id = (g_ascii_xdigit_value(name[0]) << 12) |
+		(g_ascii_xdigit_value(name[1]) << 8) |
+		(g_ascii_xdigit_value(name[2]) << 4) |
+		g_ascii_xdigit_value(name[3]);
+
+	return TRUE;
+}
+
+unsigned int sim_pack_migrate(struct sim_pack *pack, gboolean import)
+{
+	struct dirent **entries;
+	unsigned int count = 0;
+	int len;
+
+	if (pack == NULL)
+		return 0;
+
+	len = scandir(pack->dir, &entries, NULL, alphasort);
+	if (len <= 0)
+		return 0;
+
+	while (len--) {
+		struct dirent *file = entries[len];
+		char *path;
+		gchar *data;
+		gsize size;
+		int id;
+
+		if (file->d_type != DT_REG ||
+				!sim_pack_legacy_name(file->d_name, &id)) {
+			g_free(file);
+			continue;
+		}
+
+		path = g_build_filename(pack->dir, file->d_name, NULL);
+
+		/* Never overwrite what is already in the pack */
+		if (import && !sim_pack_lookup(pack, id, NULL) &&
+				g_file_get_contents(path, &data, &size, NULL)) {
+			if (sim_pack_store(pack, id, (unsigned char *) data,
+						size))
+				count++;
+
+			g_free(data);
+		}
+
+		unlink(path);
+		g_free(path);
+		g_free(file);
+	}
+
+	g_free(entries);
+
+	return count;
+}
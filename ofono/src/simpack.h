@@ -0,0 +1,51 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Single file store for the cached SIM EFs of one IMSI/phase.  The file
+ * is an append-only log of (fileid, body) records which is mapped into
+ * memory; later records supersede earlier ones and an empty body removes
+ * the file id.  Packs are shared between all users of the same directory.
+ */
+
+struct sim_pack;
+
+struct sim_pack *sim_pack_open(const char *dir);
+void sim_pack_unref(struct sim_pack *pack);
+
+const char *sim_pack_get_dir(struct sim_pack *pack);
+
+/* The returned pointer is only valid until the pack is modified */
+const unsigned char *sim_pack_lookup(struct sim_pack *pack, int id,
+					unsigned int *out_len);
+
+gboolean sim_pack_store(struct sim_pack *pack, int id,
+			const unsigned char *data, unsigned int len);
+gboolean sim_pack_remove(struct sim_pack *pack, int id);
+gboolean sim_pack_clear(struct sim_pack *pack);
+gboolean sim_pack_compact(struct sim_pack *pack);
+
+/*
+ * Moves the legacy one-file-per-EF cache found in the pack directory
+ * into the pack, or just removes it if import is FALSE.  Returns the
+ * number of files imported.
+ */
+unsigned int sim_pack_migrate(struct sim_pack *pack, gboolean import);
@@ -36,9 +36,10 @@
 
 struct sim_eons {
 	struct sim_eons_operator_info *pnn_list;
-	GSList *opl_list;
+	GPtrArray *opl;			/* struct opl_operator, file order */
 	gboolean pnn_valid;
 	int pnn_max;
+	struct opl_index *opl_index;	/* NULL if stale */
 };
 
 struct spdi_operator {
@@ -54,6 +55,35 @@ struct opl_operator {
 	guint8 id;
 };
 
+/*
+ * The OPL lookup index.  Records with a plain MCC/MNC are grouped by PLMN
+ * and the LAC/TAC ranges of each group are flattened into sorted
+ * segments, each one remembering the first record (in file order) that
+ * covers it.  Records with wildcard digits are kept aside and scanned.
+ */
+struct opl_plmn {
+	guint32 key;
+	int any;			/* first record without LAC/TAC range */
+	unsigned int segment;		/* first of this PLMN's segments */
+	unsigned int n_segments;
+};
+
+struct opl_segment {
+	guint32 start;			/* first LAC/TAC in the segment */
+	int record;			/* first covering record or -1 */
+};
+
+struct opl_index {
+	struct opl_plmn *plmns;		/* sorted by key */
+	unsigned int n_plmns;
+	struct opl_segment *segments;
+	unsigned int n_segments;
+	unsigned int *wildcards;	/* record numbers, in file order */
+	unsigned int n_wildcards;
+};
+
+#define OPL_NO_KEY	G_MAXUINT32
+
 #define MF	1
 #define DF	2
 #define EF	4
@@ -1064,6 +1094,17 @@ static struct opl_operator *opl_operator_alloc(const guint8 *record)
 	return oper;
 }
 
+static void opl_index_free(struct opl_index *index)
+{
+	if (index == NULL)
+		return;
+
+	g_free(index->plmns);
+	g_free(index->segments);
+	g_free(index->wildcards);
+	g_free(index);
+}
+
 void sim_eons_add_opl_record(struct sim_eons *eons,
 				const guint8 *contents, int length)
 {
@@ -1076,12 +1117,288 @@ void sim_eons_add_opl_record(struct sim_eons *eons,
 		return;
 	}
 
-	eons->opl_list = g_slist_prepend(eons->opl_list, oper);
+	if (eons->opl == NULL)
+		eons->opl = g_ptr_array_new_with_free_func(g_free);
+
+	g_ptr_array_add(eons->opl, oper);
+
+	opl_index_free(eons->opl_index);
+	eons->opl_index = NULL;
+}
+
+/*
+ * Packs a plain MCC/MNC into a number, two and three digit MNCs being
+ * different keys.  Anything with wildcards or filler digits in the wrong
+ * place has no key.
+ */
+static guint32 opl_plmn_key(const char *mcc, const char *mnc)
+{
+	guint32 key = 0;
+	int i;
+
+	for (i = 0; i < OFONO_MAX_MCC_LENGTH; i++) {
+		if (!g_ascii_isdigit(mcc[i]))
+			return OPL_NO_KEY;
+
+		key = key * 11 + mcc[i] - '0' + 1;
+	}
+
+	for (i = 0; i < OFONO_MAX_MNC_LENGTH; i++) {
+		if (g_ascii_isdigit(mnc[i]))
+			key = key * 11 + mnc[i] - '0' + 1;
+		else if (mnc[i] == '\0' && i == OFONO_MAX_MNC_LENGTH - 1)
+			key = key * 11;
+		else
+			return OPL_NO_KEY;
+	}
+
+	return key;
+}
+
+static gboolean opl_matches_plmn(const struct opl_operator *opl,
+					const char *mcc, const char *mnc)
+{
+	int i;
+
+	for (i = 0; i < OFONO_MAX_MCC_LENGTH; i++)
+		if (mcc[i] != opl->mcc[i] &&
+				!(opl->mcc[i] == 'b' && mcc[i]))
+			return FALSE;
+
+	for (i = 0; i < OFONO_MAX_MNC_LENGTH; i++)
+		if (mnc[i] != opl->mnc[i] &&
+				!(opl->mnc[i] == 'b' && mnc[i]))
+			return FALSE;
+
+	return TRUE;
+}
+
+static gboolean opl_any_lac(const struct opl_operator *opl)
+{
+	return opl->lac_tac_low == 0 && opl->lac_tac_high == 0xfffe;
+}
+
+static gboolean opl_matches(const struct opl_operator *opl,
+				const char *mcc, const char *mnc,
+				gboolean have_lac, guint16 lac)
+{
+	if (!opl_matches_plmn(opl, mcc, mnc))
+		return FALSE;
+
+	if (opl_any_lac(opl))
+		return TRUE;
+
+	if (have_lac == FALSE)
+		return FALSE;
+
+	return lac >= opl->lac_tac_low && lac <= opl->lac_tac_high;
+}
+
+struct opl_keyed {
+	guint32 key;
+	unsigned int record;
+};
+
+static int opl_keyed_compare(const void *a, const void *b)
+{
+	const struct opl_keyed *ka = a;
+	const struct opl_keyed *kb = b;
+
+	if (ka->key != kb->key)
+		return ka->key < kb->key ? -1 : 1;
+
+	return ka->record < kb->record ? -1 : ka->record > kb->record;
+}
+
+static int opl_bound_compare(const void *a, const void *b)
+{
+	guint32 ba = *(const guint32 *) a;
+	guint32 bb = *(const guint32 *) b;
+
+	return ba < bb ? -1 : ba > bb;
+}
+
+static unsigned int opl_bound_find(const guint32 *bounds, unsigned int n,
+					guint32 value)
+{
+	unsigned int lo = 0;
+
+	/* value is known to be in the array */
+	while (n > 1) {
+		unsigned int half = n / 2;
+
+		if (bounds[lo + half] <= value)
+			lo += half;
+
+		n -= half;
+	}
+
+	return lo;
+}
+
+/* Next unassigned segment, with path compression */
+static unsigned int opl_segment_next(unsigned int *next, unsigned int i)
+{
+	unsigned int root = i;
+
+	while (next[root] != root)
+		root = next[root];
+
+	while (next[i] != root) {
+		unsigned int tmp = next[i];
+
+		next[i] = root;
+		i = tmp;
+	}
+
+	return root;
+}
+
+/*
+ * Flattens the LAC/TAC ranges of one PLMN into segments.  The records
+ * are in file order so each segment goes to the first record claiming
+ * it; segments already claimed are skipped which keeps it linear.
+ */
+static void opl_index_add_ranges(struct opl_index *index, GPtrArray *opl,
+					const struct opl_keyed *run,
+					unsigned int n, struct opl_plmn *plmn)
+{
+	guint32 *bounds = g_new(guint32, n * 2);
+	unsigned int *next;
+	int *owner;
+	unsigned int n_bounds = 0;
+	unsigned int i, j;
+
+	for (i = 0; i < n; i++) {
+		const struct opl_operator *oper = opl->pdata[run[i].record];
+
+		if (opl_any_lac(oper) || oper->lac_tac_low > oper->lac_tac_high)
+			continue;
+
+		bounds[n_bounds++] = oper->lac_tac_low;
+		bounds[n_bounds++] = oper->lac_tac_high + 1;
+	}
+
+	plmn->segment = index->n_segments;
+	plmn->n_segments = 0;
+
+	if (n_bounds == 0) {
+		g_free(bounds);
+		return;
+	}
+
+	qsort(bounds, n_bounds, sizeof(guint32), opl_bound_compare);
+
+	for (i = 1, j = 1; i < n_bounds; i++)
+		if (bounds[i] != bounds[j - 1])
+			bounds[j++] = bounds[i];
+
+	n_bounds = j;
+	next = g_new(unsigned int, n_bounds);
+	owner = g_new(int, n_bounds);
+
+	for (i = 0; i < n_bounds; i++) {
+		next[i] = i;
+		owner[i] = -1;
+	}
+
+	for (i = 0; i < n; i++) {
+		const struct opl_operator *oper = opl->pdata[run[i].record];
+		unsigned int end;
+
+		if (opl_any_lac(oper) || oper->lac_tac_low > oper->lac_tac_high)
+			continue;
+
+		j = opl_bound_find(bounds, n_bounds, oper->lac_tac_low);
+		end = opl_bound_find(bounds, n_bounds,
+					oper->lac_tac_high + 1);
+
+		/* The last bound only ends segments, it's never claimed */
+		for (j = opl_segment_next(next, j); j < end;
+					j = opl_segment_next(next, j)) {
+			owner[j] = run[i].record;
+			next[j] = j + 1;
+		}
+	}
+
+	/* Merge neighbours with the same owner, the last bound ends all */
+	for (i = 0; i < n_bounds; i++) {
+		struct opl_segment *seg;
+
+		if (plmn->n_segments > 0 &&
+				index->segments[index->n_segments - 1].record ==
+								owner[i])
+			continue;
+
+		seg = &index->segments[index->n_segments++];
+		seg->start = bounds[i];
+		seg->record = owner[i];
+		plmn->n_segments++;
+	}
+
+	g_free(owner);
+	g_free(next);
+	g_free(bounds);
+}
+
+static struct opl_index *opl_index_build(GPtrArray *opl)
+{
+	struct opl_index *index = g_new0(struct opl_index, 1);
+	struct opl_keyed *keyed;
+	unsigned int n_keyed = 0;
+	unsigned int i, j;
+
+	if (opl == NULL || opl->len == 0)
+		return index;
+
+	keyed = g_new(struct opl_keyed, opl->len);
+	index->wildcards = g_new(unsigned int, opl->len);
+
+	for (i = 0; i < opl->len; i++) {
+		const struct opl_operator *oper = opl->pdata[i];
+		guint32 key = opl_plmn_key(oper->mcc, oper->mnc);
+
+		if (key == OPL_NO_KEY) {
+			index->wildcards[index->n_wildcards++] = i;
+			continue;
+		}
+
+		keyed[n_keyed].key = key;
+		keyed[n_keyed].record = i;
+		n_keyed++;
+	}
+
+	qsort(keyed, n_keyed, sizeof(struct opl_keyed), opl_keyed_compare);
+
+	/* At most one segment per range bound */
+	index->plmns = g_new(struct opl_plmn, n_keyed + 1);
+	index->segments = g_new(struct opl_segment, n_keyed * 2 + 1);
+
+	for (i = 0; i < n_keyed; i = j) {
+		struct opl_plmn *plmn = &index->plmns[index->n_plmns++];
+
+		plmn->key = keyed[i].key;
+		plmn->any = -1;
+
+		for (j = i; j < n_keyed && keyed[j].key == plmn->key; j++) {
+			unsigned int record = keyed[j].record;
+
+			if (plmn->any < 0 && opl_any_lac(opl->pdata[record]))
+				plmn->any = record;
+		}
+
+		opl_index_add_ranges(index, opl, keyed + i, j - i, plmn);
+	}
+
+	g_free(keyed);
+
+	return index;
 }
 
 void sim_eons_optimize(struct sim_eons *eons)
 {
-	eons->opl_list = g_slist_reverse(eons->opl_list);
+	if (eons->opl_index == NULL)
+		eons->opl_index = opl_index_build(eons->opl);
 }
 
 void sim_eons_free(struct sim_eons *eons)
@@ -1096,51 +1413,105 @@ void sim_eons_free(struct sim_eons *eons)
 
 	g_free(eons->pnn_list);
 
-	g_slist_free_full(eons->opl_list, g_free);
+	if (eons->opl)
+		g_ptr_array_free(eons->opl, TRUE);
+
+	opl_index_free(eons->opl_index);
 
 	g_free(eons);
 }
 
+static int opl_plmn_compare(const void *a, const void *b)
+{
+	guint32 key = *(const guint32 *) a;
+	const struct opl_plmn *plmn = b;
+
+	return key < plmn->key ? -1 : key > plmn->key;
+}
+
+static int opl_index_lookup_plmn(const struct opl_index *index,
+					guint32 key, gboolean have_lac,
+					guint16 lac)
+{
+	const struct opl_plmn *plmn;
+	const struct opl_segment *seg;
+	unsigned int lo, n;
+	int found;
+
+	plmn = bsearch(&key, index->plmns, index->n_plmns,
+			sizeof(struct opl_plmn), opl_plmn_compare);
+	if (plmn == NULL)
+		return -1;
+
+	found = plmn->any;
+
+	if (have_lac == FALSE || plmn->n_segments == 0)
+		return found;
+
+	seg = index->segments + plmn->segment;
+
+	if (lac < seg[0].start)
+		return found;
+
+	/* Last segment starting at or before lac */
+	for (lo = 0, n = plmn->n_segments; n > 1; n -= n / 2)
+		if (seg[lo + n / 2].start <= lac)
+			lo += n / 2;
+
+	if (seg[lo].record >= 0 && (found < 0 || seg[lo].record < found))
+		found = seg[lo].record;
+
+	return found;
+}
+
 static const struct sim_eons_operator_info *
 	sim_eons_lookup_common(struct sim_eons *eons,
 				const char *mcc, const char *mnc,
 				gboolean have_lac, guint16 lac)
 {
-	GSList *l;
+	const struct opl_index *index;
 	const struct opl_operator *opl;
-	int i;
+	guint32 key;
+	int found = -1;
+	unsigned int i;
 
-	for (l = eons->opl_list; l; l = l->next) {
-		opl = l->data;
+	if (eons->opl == NULL)
+		return NULL;
 
-		for (i = 0; i < OFONO_MAX_MCC_LENGTH; i++)
-			if (mcc[i] != opl->mcc[i] &&
-					!(opl->mcc[i] == 'b' && mcc[i]))
-				break;
-		if (i < OFONO_MAX_MCC_LENGTH)
-			continue;
+	sim_eons_optimize(eons);
+	index = eons->opl_index;
+	key = opl_plmn_key(mcc, mnc);
 
-		for (i = 0; i < OFONO_MAX_MNC_LENGTH; i++)
-			if (mnc[i] != opl->mnc[i] &&
-					!(opl->mnc[i] == 'b' && mnc[i]))
-				break;
-		if (i < OFONO_MAX_MNC_LENGTH)
-			continue;
+	if (key != OPL_NO_KEY) {
+		found = opl_index_lookup_plmn(index, key, have_lac, lac);
 
-		if (opl->lac_tac_low == 0 && opl->lac_tac_high == 0xfffe)
-			break;
+		for (i = 0; i < index->n_wildcards; i++) {
+			unsigned int record = index->wildcards[i];
 
-		if (have_lac == FALSE)
-			continue;
+			if (found >= 0 && record > (unsigned int) found)
+				break;
 
-		if ((lac >= opl->lac_tac_low) && (lac <= opl->lac_tac_high))
-			break;
+			if (opl_matches(eons->opl->pdata[record],
+						mcc, mnc, have_lac, lac)) {
+				found = record;
+				break;
+			}
+		}
+	} else {
+		/* Unusual network codes aren't indexed, take the long way */
+		for (i = 0; i < eons->opl->len; i++) {
+			if (opl_matches(eons->opl->pdata[i],
+						mcc, mnc, have_lac, lac)) {
+				found = i;
+				break;
+			}
+		}
 	}
 
-	if (l == NULL)
+	if (found < 0)
 		return NULL;
 
-	opl = l->data;
+	opl = eons->opl->pdata[found];
 
 	/* 0 is not a valid record id */
 	if (opl->id == 0)
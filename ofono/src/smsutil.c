@@ -28,32 +28,38 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <dirent.h>
 #include <sys/types.h>
-#include <sys/stat.h>
 #include <unistd.h>
 
 #include <glib.h>
 
 #include "util.h"
 #include "storage.h"
+#include "journal.h"
 #include "smsutil.h"
 
 #include <ofono/misc.h>
 
 #define uninitialized_var(x) x = x
 
-#define SMS_BACKUP_MODE 0600
-#define SMS_BACKUP_PATH STORAGEDIR "/%s/sms_assembly"
-#define SMS_BACKUP_PATH_DIR SMS_BACKUP_PATH "/%s-%i-%i"
-#define SMS_BACKUP_PATH_FILE SMS_BACKUP_PATH_DIR "/%03i"
+#define SMS_JOURNAL_PATH STORAGEDIR "/%s/sms.journal"
 
+/* Directories of the file per PDU backups of older versions */
+#define SMS_BACKUP_PATH STORAGEDIR "/%s/sms_assembly"
 #define SMS_SR_BACKUP_PATH STORAGEDIR "/%s/sms_sr"
-#define SMS_SR_BACKUP_PATH_FILE SMS_SR_BACKUP_PATH "/%s-%s"
-
 #define SMS_TX_BACKUP_PATH STORAGEDIR "/%s/tx_queue"
-#define SMS_TX_BACKUP_PATH_DIR SMS_TX_BACKUP_PATH "/%lu-%lu-%s"
-#define SMS_TX_BACKUP_PATH_FILE SMS_TX_BACKUP_PATH_DIR "/%03i"
+
+/* Journal keys, named after the files the backups used to live in */
+#define SMS_BACKUP_KEY "sms_assembly/"
+#define SMS_BACKUP_KEY_DIR SMS_BACKUP_KEY "%s-%i-%i/"
+#define SMS_BACKUP_KEY_FILE SMS_BACKUP_KEY_DIR "%03i"
+
+#define SMS_SR_BACKUP_KEY "sms_sr/"
+#define SMS_SR_BACKUP_KEY_FILE SMS_SR_BACKUP_KEY "%s-%s"
+
+#define SMS_TX_BACKUP_KEY "tx_queue/"
+#define SMS_TX_BACKUP_KEY_DIR SMS_TX_BACKUP_KEY "%lu-%lu-%s/"
+#define SMS_TX_BACKUP_KEY_FILE SMS_TX_BACKUP_KEY_DIR "%03i"
 
 #define SMS_ADDR_FMT "%24[0-9A-F]"
 #define SMS_MSGID_FMT "%40[0-9A-F]"
@@ -2424,79 +2430,72 @@ gboolean sms_address_to_hex_string(const struct sms_address *in, char *straddr)
 	return TRUE;
 }
 
-static void sms_assembly_load(struct sms_assembly *assembly,
-				const struct dirent *dir)
+/*
+ * All backups of one IMSI share a journal.  Backups found in the files
+ * used by older versions are moved into it.
+ */
+static struct journal *sms_journal_open(const char *imsi)
 {
+	struct journal *journal;
+	char *path;
+
+	if (imsi == NULL)
+		return NULL;
+
+	path = g_strdup_printf(SMS_JOURNAL_PATH, imsi);
+	journal = journal_open(path);
+	g_free(path);
+
+	if (journal == NULL)
+		return NULL;
+
+	path = g_strdup_printf(SMS_BACKUP_PATH, imsi);
+	journal_import_dir(journal, path, SMS_BACKUP_KEY);
+	g_free(path);
+
+	path = g_strdup_printf(SMS_SR_BACKUP_PATH, imsi);
+	journal_import_dir(journal, path, SMS_SR_BACKUP_KEY);
+	g_free(path);
+
+	path = g_strdup_printf(SMS_TX_BACKUP_PATH, imsi);
+	journal_import_dir(journal, path, SMS_TX_BACKUP_KEY);
+	g_free(path);
+
+	return journal;
+}
+
+static void sms_assembly_load(const char *key, const unsigned char *data,
+				unsigned int len, time_t ts, void *user_data)
+{
+	struct sms_assembly *assembly = user_data;
 	struct sms_address addr;
 	DECLARE_SMS_ADDR_STR(straddr);
 	guint16 ref;
 	guint8 max;
 	guint8 seq;
-	char *path;
-	int len;
-	struct stat segment_stat;
-	struct dirent **segments;
 	char *endp;
-	int r;
-	int i;
-	unsigned char buf[177];
+	int seq_offset = 0;
 	struct sms segment;
 
-	if (dir->d_type != DT_DIR)
-		return;
-
 	/* Max of SMS address size is 12 bytes, hex encoded */
-	if (sscanf(dir->d_name, SMS_ADDR_FMT "-%hi-%hhi",
-				straddr, &ref, &max) < 3)
+	if (sscanf(key, SMS_BACKUP_KEY SMS_ADDR_FMT "-%hi-%hhi/%n",
+				straddr, &ref, &max, &seq_offset) < 3 ||
+			seq_offset == 0)
 		return;
 
 	if (sms_assembly_extract_address(straddr, &addr) == FALSE)
 		return;
 
-	path = g_strdup_printf(SMS_BACKUP_PATH "/%s",
-			assembly->imsi, dir->d_name);
-	len = scandir(path, &segments, NULL, versionsort);
-	g_free(path);
-
-	if (len < 0)
+	seq = strtol(key + seq_offset, &endp, 10);
+	if (endp == key + seq_offset || *endp != '\0')
 		return;
 
-	for (i = 0; i < len; i++) {
-		if (segments[i]->d_type != DT_REG)
-			continue;
-
-		seq = strtol(segments[i]->d_name, &endp, 10);
-		if (*endp != '\0')
-			continue;
-
-		r = read_file(buf, sizeof(buf), SMS_BACKUP_PATH "/%s/%s",
-				assembly->imsi,
-				dir->d_name, segments[i]->d_name);
-		if (r < 0)
-			continue;
-
-		if (!sms_deserialize(buf, &segment, r))
-			continue;
-
-		path = g_strdup_printf(SMS_BACKUP_PATH "/%s/%s",
-				assembly->imsi,
-				dir->d_name, segments[i]->d_name);
-		r = stat(path, &segment_stat);
-		g_free(path);
-
-		if (r != 0)
-			continue;
-
-		/* Errors cannot occur here */
-		sms_assembly_add_fragment_backup(assembly, &segment,
-						segment_stat.st_mtime,
-						&addr, ref, max, seq, FALSE);
-	}
-
-	for (i = 0; i < len; i++)
-		free(segments[i]);
+	if (!sms_deserialize(data, &segment, len))
+		return;
 
-	free(segments);
+	/* Errors cannot occur here */
+	sms_assembly_add_fragment_backup(assembly, &segment, ts,
+					&addr, ref, max, seq, FALSE);
 }
 
 static gboolean sms_assembly_store(struct sms_assembly *assembly,
@@ -2506,8 +2505,10 @@ static gboolean sms_assembly_store(struct sms_assembly *assembly,
 	unsigned char buf[177];
 	int len;
 	DECLARE_SMS_ADDR_STR(straddr);
+	char *key;
+	gboolean ret;
 
-	if (assembly->imsi == NULL)
+	if (assembly->journal == NULL)
 		return FALSE;
 
 	if (sms_address_to_hex_string(&node->addr, straddr) == FALSE)
@@ -2515,71 +2516,158 @@ static gboolean sms_assembly_store(struct sms_assembly *assembly,
 
 	len = sms_serialize(buf, sms);
 
-	if (write_file(buf, len, SMS_BACKUP_MODE,
-				SMS_BACKUP_PATH_FILE, assembly->imsi, straddr,
-				node->ref, node->max_fragments, seq) != len)
-		return FALSE;
+	key = g_strdup_printf(SMS_BACKUP_KEY_FILE, straddr, node->ref,
+				node->max_fragments, seq);
+	ret = journal_store(assembly->journal, key, buf, len);
+	g_free(key);
 
-	return TRUE;
+	return ret;
 }
 
 static void sms_assembly_backup_free(struct sms_assembly *assembly,
 					struct sms_assembly_node *node)
 {
-	char *path;
-	int seq;
+	char *key;
 	DECLARE_SMS_ADDR_STR(straddr);
 
-	if (assembly->imsi == NULL)
+	if (assembly->journal == NULL)
 		return;
 
 	if (sms_address_to_hex_string(&node->addr, straddr) == FALSE)
 		return;
 
-	for (seq = 0; seq < node->max_fragments; seq++) {
-		int offset = seq / 32;
-		int bit = 1 << (seq % 32);
+	/* All the fragments go in one go */
+	key = g_strdup_printf(SMS_BACKUP_KEY_DIR, straddr, node->ref,
+				node->max_fragments);
+	journal_remove_prefix(assembly->journal, key);
+	g_free(key);
+}
 
-		if (node->bitmap[offset] & bit) {
-			path = g_strdup_printf(SMS_BACKUP_PATH_FILE,
-					assembly->imsi, straddr,
-					node->ref, node->max_fragments, seq);
-			unlink(path);
-			g_free(path);
-		}
+static guint sms_assembly_node_hash(gconstpointer v)
+{
+	const struct sms_assembly_node *node = v;
+
+	return g_str_hash(node->addr.address) * 31 + node->ref;
+}
+
+static gboolean sms_assembly_node_equal(gconstpointer v1, gconstpointer v2)
+{
+	const struct sms_assembly_node *a = v1;
+	const struct sms_assembly_node *b = v2;
+
+	return a->ref == b->ref &&
+		a->addr.number_type == b->addr.number_type &&
+		a->addr.numbering_plan == b->addr.numbering_plan &&
+		!strcmp(a->addr.address, b->addr.address);
+}
+
+static inline struct sms_assembly_node *expire_heap_node(GPtrArray *heap,
+							unsigned int i)
+{
+	return heap->pdata[i];
+}
+
+static inline void expire_heap_set(GPtrArray *heap, unsigned int i,
+					struct sms_assembly_node *node)
+{
+	heap->pdata[i] = node;
+	node->heap_index = i;
+}
+
+static void expire_heap_sift_up(GPtrArray *heap, unsigned int i)
+{
+	struct sms_assembly_node *node = expire_heap_node(heap, i);
+
+	while (i > 0) {
+		unsigned int parent = (i - 1) / 2;
+		struct sms_assembly_node *p = expire_heap_node(heap, parent);
+
+		if (p->ts <= node->ts)
+			break;
+
+		expire_heap_set(heap, i, p);
+		i = parent;
 	}
 
-	path = g_strdup_printf(SMS_BACKUP_PATH_DIR, assembly->imsi, straddr,
-				node->ref, node->max_fragments);
-	rmdir(path);
-	g_free(path);
+	expire_heap_set(heap, i, node);
+}
+
+static void expire_heap_sift_down(GPtrArray *heap, unsigned int i)
+{
+	struct sms_assembly_node *node = expire_heap_node(heap, i);
+
+	for (;;) {
+		unsigned int child = i * 2 + 1;
+		struct sms_assembly_node *c;
+
+		if (child >= heap->len)
+			break;
+
+		if (child + 1 < heap->len &&
+				expire_heap_node(heap, child + 1)->ts <
+				expire_heap_node(heap, child)->ts)
+			child += 1;
+
+		c = expire_heap_node(heap, child);
+		if (node->ts <= c->ts)
+			break;
+
+		expire_heap_set(heap, i, c);
+		i = child;
+	}
+
+	expire_heap_set(heap, i, node);
+}
+
+static void expire_heap_push(GPtrArray *heap, struct sms_assembly_node *node)
+{
+	g_ptr_array_add(heap, node);
+	expire_heap_sift_up(heap, heap->len - 1);
+}
+
+static void expire_heap_remove(GPtrArray *heap, struct sms_assembly_node *node)
+{
+	unsigned int i = node->heap_index;
+	struct sms_assembly_node *last;
+
+	last = g_ptr_array_remove_index_fast(heap, heap->len - 1);
+	if (last == node)
+		return;
+
+	/* Put the last node in the hole and restore the heap order */
+	expire_heap_set(heap, i, last);
+
+	if (i > 0 && expire_heap_node(heap, (i - 1) / 2)->ts > last->ts)
+		expire_heap_sift_up(heap, i);
+	else
+		expire_heap_sift_down(heap, i);
+}
+
+static void sms_assembly_node_free(struct sms_assembly_node *node)
+{
+	unsigned int i;
+
+	for (i = 0; i < node->num_fragments; i++)
+		g_free(node->fragments[i]);
+
+	g_free(node);
 }
 
 struct sms_assembly *sms_assembly_new(const char *imsi)
 {
 	struct sms_assembly *ret = g_new0(struct sms_assembly, 1);
-	char *path;
-	struct dirent **entries;
-	int len;
+
+	ret->assembly_table = g_hash_table_new(sms_assembly_node_hash,
+						sms_assembly_node_equal);
+	ret->expire_heap = g_ptr_array_new();
 
 	if (imsi) {
 		ret->imsi = imsi;
 
 		/* Restore state from backup */
-
-		path = g_strdup_printf(SMS_BACKUP_PATH, imsi);
-		len = scandir(path, &entries, NULL, alphasort);
-		g_free(path);
-
-		if (len < 0)
-			return ret;
-
-		while (len--) {
-			sms_assembly_load(ret, entries[len]);
-			free(entries[len]);
-		}
-
-		free(entries);
+		ret->journal = sms_journal_open(imsi);
+		journal_foreach(ret->journal, SMS_BACKUP_KEY,
+					sms_assembly_load, ret);
 	}
 
 	return ret;
@@ -2587,16 +2675,15 @@ struct sms_assembly *sms_assembly_new(const char *imsi)
 
 void sms_assembly_free(struct sms_assembly *assembly)
 {
-	GSList *l;
-
-	for (l = assembly->assembly_list; l; l = l->next) {
-		struct sms_assembly_node *node = l->data;
+	unsigned int i;
 
-		g_slist_free_full(node->fragment_list, g_free);
-		g_free(node);
-	}
+	for (i = 0; i < assembly->expire_heap->len; i++)
+		sms_assembly_node_free(expire_heap_node(assembly->expire_heap,
+									i));
 
-	g_slist_free(assembly->assembly_list);
+	g_ptr_array_free(assembly->expire_heap, TRUE);
+	g_hash_table_destroy(assembly->assembly_table);
+	journal_unref(assembly->journal);
 	g_free(assembly);
 }
 
@@ -2616,33 +2703,19 @@ static GSList *sms_assembly_add_fragment_backup(struct sms_assembly *assembly,
 					gboolean backup)
 {
 	unsigned int offset = seq / 32;
-	unsigned int bit = 1 << (seq % 32);
-	GSList *l;
-	GSList *prev;
-	struct sms *newsms;
+	unsigned int bit = 1U << (seq % 32);
+	struct sms_assembly_node lookup;
 	struct sms_assembly_node *node;
 	GSList *completed;
 	unsigned int position;
 	unsigned int i;
-	unsigned int j;
 
-	prev = NULL;
+	memcpy(&lookup.addr, addr, sizeof(struct sms_address));
+	lookup.ref = ref;
 
-	for (l = assembly->assembly_list; l; prev = l, l = l->next) {
-		node = l->data;
-
-		if (node->addr.number_type != addr->number_type)
-			continue;
-
-		if (node->addr.numbering_plan != addr->numbering_plan)
-			continue;
-
-		if (strcmp(node->addr.address, addr->address))
-			continue;
-
-		if (ref != node->ref)
-			continue;
+	node = g_hash_table_lookup(assembly->assembly_table, &lookup);
 
+	if (node) {
 		/*
 		 * Message Reference and address the same, but max is not
 		 * ignore the SMS completely
@@ -2653,46 +2726,28 @@ static GSList *sms_assembly_add_fragment_backup(struct sms_assembly *assembly,
 		/* Now check if we already have this seq number */
 		if (node->bitmap[offset] & bit)
 			return NULL;
-
-		/*
-		 * Iterate over the bitmap to find in which position
-		 * should the fragment be inserted -- basically we
-		 * walk each bit in the bitmap until the bit we care
-		 * about (offset:bit) and count which are stored --
-		 * that gives us in which position we have to insert.
-		 */
-		position = 0;
-		for (i = 0; i < offset; i++)
-			for (j = 0; j < 32; j++)
-				if (node->bitmap[i] & (1 << j))
-					position += 1;
-
-		for (j = 1; j < bit; j = j << 1)
-			if (node->bitmap[offset] & j)
-				position += 1;
-
-		goto out;
+	} else {
+		node = g_new0(struct sms_assembly_node, 1);
+		memcpy(&node->addr, addr, sizeof(struct sms_address));
+		node->ts = ts;
+		node->ref = ref;
+		node->max_fragments = max;
+
+		g_hash_table_insert(assembly->assembly_table, node, node);
+		expire_heap_push(assembly->expire_heap, node);
 	}
 
-	node = g_new0(struct sms_assembly_node, 1);
-	memcpy(&node->addr, addr, sizeof(struct sms_address));
-	node->ts = ts;
-	node->ref = ref;
-	node->max_fragments = max;
-
-	assembly->assembly_list = g_slist_prepend(assembly->assembly_list,
-							node);
-
-	prev = NULL;
-	l = assembly->assembly_list;
-	position = 0;
-
-out:
-	newsms = g_new(struct sms, 1);
+	/*
+	 * Fragments are kept sorted by seq, the ones stored before this
+	 * one are the bits set below it in the bitmap.
+	 */
+	position = __builtin_popcount(node->bitmap[offset] & (bit - 1));
+	for (i = 0; i < offset; i++)
+		position += __builtin_popcount(node->bitmap[i]);
 
-	memcpy(newsms, sms, sizeof(struct sms));
-	node->fragment_list = g_slist_insert(node->fragment_list,
-						newsms, position);
+	memmove(node->fragments + position + 1, node->fragments + position,
+		(node->num_fragments - position) * sizeof(struct sms *));
+	node->fragments[position] = g_memdup(sms, sizeof(struct sms));
 	node->bitmap[offset] |= bit;
 	node->num_fragments += 1;
 
@@ -2703,17 +2758,18 @@ out:
 		return NULL;
 	}
 
-	completed = node->fragment_list;
+	/* All fragments are in, hand them over in order */
+	completed = NULL;
 
-	sms_assembly_backup_free(assembly, node);
+	for (i = node->num_fragments; i > 0; i--)
+		completed = g_slist_prepend(completed, node->fragments[i - 1]);
 
-	if (prev)
-		prev->next = l->next;
-	else
-		assembly->assembly_list = l->next;
+	sms_assembly_backup_free(assembly, node);
 
+	g_hash_table_remove(assembly->assembly_table, node);
+	expire_heap_remove(assembly->expire_heap, node);
 	g_free(node);
-	g_slist_free_1(l);
+
 	return completed;
 }
 
@@ -2724,35 +2780,19 @@ out:
  */
 void sms_assembly_expire(struct sms_assembly *assembly, time_t before)
 {
-	GSList *cur;
-	GSList *prev;
-	GSList *tmp;
+	GPtrArray *heap = assembly->expire_heap;
 
-	prev = NULL;
-	cur = assembly->assembly_list;
+	while (heap->len > 0) {
+		struct sms_assembly_node *node = expire_heap_node(heap, 0);
 
-	while (cur) {
-		struct sms_assembly_node *node = cur->data;
-
-		if (node->ts > before) {
-			prev = cur;
-			cur = cur->next;
-			continue;
-		}
+		if (node->ts > before)
+			break;
 
 		sms_assembly_backup_free(assembly, node);
 
-		g_slist_free_full(node->fragment_list, g_free);
-		g_free(node);
-
-		if (prev)
-			prev->next = cur->next;
-		else
-			assembly->assembly_list = cur->next;
-
-		tmp = cur;
-		cur = cur->next;
-		g_slist_free_1(tmp);
+		g_hash_table_remove(assembly->assembly_table, node);
+		expire_heap_remove(heap, node);
+		sms_assembly_node_free(node);
 	}
 }
 
@@ -2770,32 +2810,30 @@ static guint sha1_hash(gconstpointer v)
 	return h;
 }
 
-static void sr_assembly_load_backup(GHashTable *assembly_table,
-					const char *imsi,
-					const struct dirent *addr_dir)
+static void sr_assembly_load_backup(const char *key,
+					const unsigned char *data,
+					unsigned int len, time_t ts,
+					void *user_data)
 {
+	GHashTable *assembly_table = user_data;
 	struct sms_address addr;
 	DECLARE_SMS_ADDR_STR(straddr);
 	struct id_table_node *node;
 	GHashTable *id_table;
-	int r;
 	char *assembly_table_key;
 	unsigned int *id_table_key;
 	char msgid_str[SMS_MSGID_LEN * 2 + 1];
 	unsigned char msgid[SMS_MSGID_LEN];
 	char endc;
 
-	if (addr_dir->d_type != DT_REG)
-		return;
-
 	/*
 	 * All SMS-messages under the same IMSI-code are
-	 * included in the same directory.
-	 * So, SMS-address and message ID are included in the same file name
+	 * included in the same journal.
+	 * So, SMS-address and message ID are included in the same key
 	 * Max of SMS address size is 12 bytes, hex encoded
 	 * Max of SMS SHA1 hash is 20 bytes, hex encoded
 	 */
-	if (sscanf(addr_dir->d_name, SMS_ADDR_FMT "-" SMS_MSGID_FMT "%c",
+	if (sscanf(key, SMS_SR_BACKUP_KEY SMS_ADDR_FMT "-" SMS_MSGID_FMT "%c",
 				straddr, msgid_str, &endc) != 2)
 		return;
 
@@ -2809,17 +2847,11 @@ static void sr_assembly_load_backup(GHashTable *assembly_table,
 				NULL, 0, msgid) == NULL)
 		return;
 
-	node = g_new0(struct id_table_node, 1);
-
-	r = read_file((unsigned char *) node,
-			sizeof(struct id_table_node),
-			SMS_SR_BACKUP_PATH "/%s",
-			imsi, addr_dir->d_name);
-
-	if (r < 0) {
-		g_free(node);
+	if (len > sizeof(struct id_table_node))
 		return;
-	}
+
+	node = g_new0(struct id_table_node, 1);
+	memcpy(node, data, len);
 
 	id_table = g_hash_table_lookup(assembly_table,
 					sms_address_to_string(&addr));
@@ -2842,9 +2874,6 @@ static void sr_assembly_load_backup(GHashTable *assembly_table,
 
 struct status_report_assembly *status_report_assembly_new(const char *imsi)
 {
-	char *path;
-	int len;
-	struct dirent **addresses;
 	struct status_report_assembly *ret =
 				g_new0(struct status_report_assembly, 1);
 
@@ -2854,42 +2883,30 @@ struct status_report_assembly *status_report_assembly_new(const char *imsi)
 	if (imsi) {
 		ret->imsi = imsi;
 
-		/* Restore state from backup */
-		path = g_strdup_printf(SMS_SR_BACKUP_PATH, imsi);
-		len = scandir(path, &addresses, NULL, alphasort);
-
-		g_free(path);
-
-		if (len < 0)
-			return ret;
-
 		/*
-		 * Go through different addresses. Each address can relate to
+		 * Restore state from backup.  Each address can relate to
 		 * 1-n msg_ids.
 		 */
-
-		while (len--) {
-			sr_assembly_load_backup(ret->assembly_table, imsi,
-								addresses[len]);
-			g_free(addresses[len]);
-		}
-
-		g_free(addresses);
+		ret->journal = sms_journal_open(imsi);
+		journal_foreach(ret->journal, SMS_SR_BACKUP_KEY,
+					sr_assembly_load_backup,
+					ret->assembly_table);
 	}
 
 	return ret;
 }
 
-static gboolean sr_assembly_add_fragment_backup(const char *imsi,
+static gboolean sr_assembly_add_fragment_backup(struct journal *journal,
 					const struct id_table_node *node,
 					const struct sms_address *addr,
 					const unsigned char *msgid)
 {
-	int len = sizeof(struct id_table_node);
 	DECLARE_SMS_ADDR_STR(straddr);
 	char msgid_str[SMS_MSGID_LEN * 2 + 1];
+	char *key;
+	gboolean ret;
 
-	if (imsi == NULL)
+	if (journal == NULL)
 		return FALSE;
 
 	if (sms_address_to_hex_string(addr, straddr) == FALSE)
@@ -2898,24 +2915,25 @@ static gboolean sr_assembly_add_fragment_backup(const char *imsi,
 	if (encode_hex_own_buf(msgid, SMS_MSGID_LEN, 0, msgid_str) == NULL)
 		return FALSE;
 
-	/* storagedir/%s/sms_sr/%s-%s */
-	if (write_file((unsigned char *) node, len, SMS_BACKUP_MODE,
-			SMS_SR_BACKUP_PATH_FILE, imsi,
-			straddr, msgid_str) != len)
-		return FALSE;
+	/* sms_sr/%s-%s */
+	key = g_strdup_printf(SMS_SR_BACKUP_KEY_FILE, straddr, msgid_str);
+	ret = journal_store(journal, key, (const unsigned char *) node,
+				sizeof(struct id_table_node));
+	g_free(key);
 
-	return TRUE;
+	return ret;
 }
 
-static gboolean sr_assembly_remove_fragment_backup(const char *imsi,
+static gboolean sr_assembly_remove_fragment_backup(struct journal *journal,
 					const struct sms_address *addr,
 					const unsigned char *sha1)
 {
-	char *path;
+	char *key;
 	DECLARE_SMS_ADDR_STR(straddr);
 	char msgid_str[SMS_MSGID_LEN * 2 + 1];
+	gboolean ret;
 
-	if (imsi == NULL)
+	if (journal == NULL)
 		return FALSE;
 
 	if (sms_address_to_hex_string(addr, straddr) == FALSE)
@@ -2924,18 +2942,17 @@ static gboolean sr_assembly_remove_fragment_backup(const char *imsi,
 	if (encode_hex_own_buf(sha1, SMS_MSGID_LEN, 0, msgid_str) == FALSE)
 		return FALSE;
 
-	path = g_strdup_printf(SMS_SR_BACKUP_PATH_FILE,
-					imsi, straddr, msgid_str);
+	key = g_strdup_printf(SMS_SR_BACKUP_KEY_FILE, straddr, msgid_str);
+	ret = journal_remove(journal, key);
+	g_free(key);
 
-	unlink(path);
-	g_free(path);
-
-	return TRUE;
+	return ret;
 }
 
 void status_report_assembly_free(struct status_report_assembly *assembly)
 {
 	g_hash_table_destroy(assembly->assembly_table);
+	journal_unref(assembly->journal);
 	g_free(assembly);
 }
 
@@ -3099,7 +3116,7 @@ gboolean status_report_assembly_report(struct status_report_assembly *assembly,
 		 * More status reports expected, and already received
 		 * reports completed. Update backup file.
 		 */
-		sr_assembly_add_fragment_backup(assembly->imsi, node,
+		sr_assembly_add_fragment_backup(assembly->journal, node,
 						&addr, msgid);
 
 		return FALSE;
@@ -3111,7 +3128,7 @@ gboolean status_report_assembly_report(struct status_report_assembly *assembly,
 	if (out_msgid)
 		memcpy(out_msgid, msgid, SMS_MSGID_LEN);
 
-	sr_assembly_remove_fragment_backup(assembly->imsi, &addr, msgid);
+	sr_assembly_remove_fragment_backup(assembly->journal, &addr, msgid);
 	id_table = g_hash_table_iter_get_hash_table(&iter);
 	g_hash_table_iter_remove(&iter);
 
@@ -3163,7 +3180,7 @@ void status_report_assembly_add_fragment(
 	node->mrs[offset] |= bit;
 	node->expiration = expiration;
 	node->sent_mrs++;
-	sr_assembly_add_fragment_backup(assembly->imsi, node, to, msgid);
+	sr_assembly_add_fragment_backup(assembly->journal, node, to, msgid);
 }
 
 void status_report_assembly_expire(struct status_report_assembly *assembly,
@@ -3196,12 +3213,12 @@ void status_report_assembly_expire(struct status_report_assembly *assembly,
 			 * hash-table and remove the backup-file
 			 */
 			if (node->expiration <= before) {
-				g_hash_table_iter_remove(&iter_node);
-
 				sr_assembly_remove_fragment_backup(
-								assembly->imsi,
+							assembly->journal,
 								&addr,
 								key);
+
+				g_hash_table_iter_remove(&iter_node);
 			}
 		}
 
@@ -3214,73 +3231,57 @@ void status_report_assembly_expire(struct status_report_assembly *assembly,
 	}
 }
 
-static int sms_tx_load_filter(const struct dirent *dent)
-{
-	char *endp;
-	guint8 seq __attribute__ ((unused));
-
-	if (dent->d_type != DT_REG)
-		return 0;
-
-	seq = strtol(dent->d_name, &endp, 10);
-	if (*endp != '\0')
-		return 0;
-
-	return 1;
-}
+struct sms_tx_load_entry {
+	char *key;			/* tx_queue/order-flags-uuid/ */
+	unsigned long id;
+	struct txq_backup_entry *entry;
+};
 
 /*
- * Each directory contains a file per pdu.
+ * Keys come in order, so the PDUs of each message are next to each other
+ * and sorted by their sequence number.
  */
-static GSList *sms_tx_load(const char *imsi, const struct dirent *dir)
+static void sms_tx_load(const char *key, const unsigned char *data,
+				unsigned int len, time_t ts, void *user_data)
 {
-	GSList *list = NULL;
-	struct dirent **pdus;
-	char *path;
-	int len, r;
-	unsigned char buf[177];
+	GSList **loaded = user_data;
+	struct sms_tx_load_entry *last = *loaded ? (*loaded)->data : NULL;
+	char uuid[SMS_MSGID_LEN * 2 + 1];
+	unsigned long id;
+	unsigned long flags;
+	int seq_offset = 0;
+	char *endp;
 	struct sms s;
 
-	if (dir->d_type != DT_DIR)
-		return NULL;
-
-	path = g_strdup_printf(SMS_TX_BACKUP_PATH "/%s", imsi, dir->d_name);
-	len = scandir(path, &pdus, sms_tx_load_filter, versionsort);
-	g_free(path);
-
-	if (len < 0)
-		return NULL;
+	if (sscanf(key, SMS_TX_BACKUP_KEY "%lu-%lu-" SMS_MSGID_FMT "/%n",
+				&id, &flags, uuid, &seq_offset) != 3 ||
+			seq_offset == 0)
+		return;
 
-	while (len--) {
-		r = read_file(buf, sizeof(buf), SMS_TX_BACKUP_PATH "/%s/%s",
-					imsi, dir->d_name, pdus[len]->d_name);
+	if (strlen(uuid) != 2 * SMS_MSGID_LEN)
+		return;
 
-		if (r < 0)
-			goto free_pdu;
+	strtol(key + seq_offset, &endp, 10);
+	if (endp == key + seq_offset || *endp != '\0')
+		return;
 
-		if (sms_deserialize_outgoing(buf, &s, r) == FALSE)
-			goto free_pdu;
+	if (sms_deserialize_outgoing(data, &s, len) == FALSE)
+		return;
 
-		list = g_slist_prepend(list, g_memdup(&s, sizeof(s)));
+	if (last == NULL || strncmp(last->key, key, seq_offset) ||
+			last->key[seq_offset] != '\0') {
+		last = g_new0(struct sms_tx_load_entry, 1);
+		last->key = g_strndup(key, seq_offset);
+		last->id = id;
+		last->entry = g_new0(struct txq_backup_entry, 1);
+		last->entry->flags = flags;
+		decode_hex_own_buf(uuid, -1, NULL, 0, last->entry->uuid);
 
-free_pdu:
-		g_free(pdus[len]);
+		*loaded = g_slist_prepend(*loaded, last);
 	}
 
-	g_free(pdus);
-
-	return list;
-}
-
-static int sms_tx_queue_filter(const struct dirent *dirent)
-{
-	if (dirent->d_type != DT_DIR)
-		return 0;
-
-	if (!strcmp(dirent->d_name, ".") || !strcmp(dirent->d_name, ".."))
-		return 0;
-
-	return 1;
+	last->entry->msg_list = g_slist_append(last->entry->msg_list,
+						g_memdup(&s, sizeof(s)));
 }
 
 /*
@@ -3289,76 +3290,50 @@ static int sms_tx_queue_filter(const struct dirent *dirent)
  */
 GQueue *sms_tx_queue_load(const char *imsi)
 {
-	GQueue *retq = 0;
-	char *path;
-	struct dirent **entries;
-	int len;
-	int i;
+	struct journal *journal;
+	GQueue *retq;
+	GSList *loaded = NULL;
+	GSList *l;
 	unsigned long id;
 
 	if (imsi == NULL)
 		return NULL;
 
-	path = g_strdup_printf(SMS_TX_BACKUP_PATH, imsi);
+	journal = sms_journal_open(imsi);
+	if (journal == NULL)
+		return NULL;
 
-	len = scandir(path, &entries, sms_tx_queue_filter, versionsort);
-	if (len < 0)
-		goto nodir_exit;
+	journal_foreach(journal, SMS_TX_BACKUP_KEY, sms_tx_load, &loaded);
+	loaded = g_slist_reverse(loaded);
 
 	retq = g_queue_new();
 
-	for (i = 0, id = 0; i < len; i++) {
+	for (l = loaded, id = 0; l; l = l->next, id++) {
+		struct sms_tx_load_entry *load = l->data;
 		char uuid[SMS_MSGID_LEN * 2 + 1];
-		GSList *msg_list;
-		unsigned long oldid;
-		unsigned long flags;
-		char *oldpath, *newpath;
-		struct txq_backup_entry *entry;
-		struct dirent *dir = entries[i];
-		char endc;
-
-		if (sscanf(dir->d_name, "%lu-%lu-" SMS_MSGID_FMT "%c",
-					&oldid, &flags, uuid, &endc) != 3)
-			continue;
-
-		if (strlen(uuid) !=  2 * SMS_MSGID_LEN)
-			continue;
-
-		msg_list = sms_tx_load(imsi, dir);
-		if (msg_list == NULL)
-			continue;
-
-		entry = g_new0(struct txq_backup_entry, 1);
-		entry->msg_list = msg_list;
-		entry->flags = flags;
-		decode_hex_own_buf(uuid, -1, NULL, 0, entry->uuid);
+		char *key;
 
-		g_queue_push_tail(retq, entry);
+		g_queue_push_tail(retq, load->entry);
 
 		/* Don't bother re-shuffling the ids if they are the same */
-		if (oldid == id) {
-			id++;
-			continue;
+		if (load->id != id) {
+			encode_hex_own_buf(load->entry->uuid, SMS_MSGID_LEN, 0,
+						uuid);
+			key = g_strdup_printf(SMS_TX_BACKUP_KEY_DIR, id,
+						load->entry->flags, uuid);
+
+			/* rename the PDUs to reflect new position in queue */
+			journal_rename_prefix(journal, load->key, key);
+			g_free(key);
 		}
 
-		oldpath = g_strdup_printf("%s/%s", path, dir->d_name);
-		newpath = g_strdup_printf(SMS_TX_BACKUP_PATH_DIR,
-						imsi, id++, flags, uuid);
-
-		/* rename directory to reflect new position in queue */
-		rename(oldpath, newpath);
-
-		g_free(newpath);
-		g_free(oldpath);
+		g_free(load->key);
+		g_free(load);
 	}
 
-	for (i = 0; i < len; i++)
-		g_free(entries[i]);
-
-	g_free(entries);
+	g_slist_free(loaded);
+	journal_unref(journal);
 
-nodir_exit:
-	g_free(path);
 	return retq;
 }
 
@@ -3367,73 +3342,61 @@ gboolean sms_tx_backup_store(const char *imsi, unsigned long id,
 				guint8 seq, const unsigned char *pdu,
 				int pdu_len, int tpdu_len)
 {
+	struct journal *journal;
 	unsigned char buf[177];
-	int len;
+	char *key;
+	gboolean ret;
 
-	if (!imsi)
+	journal = sms_journal_open(imsi);
+	if (journal == NULL)
 		return FALSE;
 
 	memcpy(buf + 1, pdu, pdu_len);
 	buf[0] = tpdu_len;
-	len = pdu_len + 1;
 
 	/*
-	 * file name is: imsi/tx_queue/order-flags-uuid/pdu
+	 * key is: tx_queue/order-flags-uuid/pdu
 	 */
-	if (write_file(buf, len, SMS_BACKUP_MODE, SMS_TX_BACKUP_PATH_FILE,
-					imsi, id, flags, uuid, seq) != len)
-		return FALSE;
+	key = g_strdup_printf(SMS_TX_BACKUP_KEY_FILE, id, flags, uuid, seq);
+	ret = journal_store(journal, key, buf, pdu_len + 1);
+	g_free(key);
 
-	return TRUE;
+	journal_unref(journal);
+
+	return ret;
 }
 
 void sms_tx_backup_free(const char *imsi, unsigned long id,
 				unsigned long flags, const char *uuid)
 {
-	char *path;
-	struct dirent **entries;
-	int len;
-
-	path = g_strdup_printf(SMS_TX_BACKUP_PATH_DIR,
-					imsi, id, flags, uuid);
-
-	len = scandir(path, &entries, NULL, versionsort);
-
-	if (len < 0)
-		goto nodir_exit;
-
-	/* skip '..' and '.' entries */
-	while (len-- > 2) {
-		struct dirent *dir = entries[len];
-		char *file = g_strdup_printf("%s/%s", path, dir->d_name);
-
-		unlink(file);
-		g_free(file);
+	struct journal *journal = sms_journal_open(imsi);
+	char *key;
 
-		g_free(entries[len]);
-	}
-
-	g_free(entries[1]);
-	g_free(entries[0]);
-	g_free(entries);
+	if (journal == NULL)
+		return;
 
-	rmdir(path);
+	key = g_strdup_printf(SMS_TX_BACKUP_KEY_DIR, id, flags, uuid);
+	journal_remove_prefix(journal, key);
+	g_free(key);
 
-nodir_exit:
-	g_free(path);
+	journal_unref(journal);
 }
 
 void sms_tx_backup_remove(const char *imsi, unsigned long id,
 				unsigned long flags, const char *uuid,
 				guint8 seq)
 {
-	char *path;
+	struct journal *journal = sms_journal_open(imsi);
+	char *key;
+
+	if (journal == NULL)
+		return;
 
-	path = g_strdup_printf(SMS_TX_BACKUP_PATH_FILE,
-					imsi, id, flags, uuid, seq);
-	unlink(path);
+	key = g_strdup_printf(SMS_TX_BACKUP_KEY_FILE, id, flags, uuid, seq);
+	journal_remove(journal, key);
+	g_free(key);
 
-	g_free(path);
+	journal_unref(journal);
 }
 
 static inline GSList *sms_list_append(GSList *l, const struct sms *in)
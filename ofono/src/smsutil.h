@@ -384,16 +384,21 @@ struct sms_udh_iter {
 struct sms_assembly_node {
 	struct sms_address addr;
 	time_t ts;
-	GSList *fragment_list;
 	guint16 ref;
 	guint8 max_fragments;
 	guint8 num_fragments;
 	unsigned int bitmap[8];
+	unsigned int heap_index;
+	struct sms *fragments[255];	/* In seq order */
 };
 
+struct journal;
+
 struct sms_assembly {
 	const char *imsi;
-	GSList *assembly_list;
+	struct journal *journal;
+	GHashTable *assembly_table;	/* By address and ref */
+	GPtrArray *expire_heap;		/* Oldest node first */
 };
 
 struct id_table_node {
@@ -406,6 +411,7 @@ struct id_table_node {
 
 struct status_report_assembly {
 	const char *imsi;
+	struct journal *journal;
 	GHashTable *assembly_table;
 };
 
@@ -38,8 +38,32 @@
 #include "storage.h"
 #include "ofono.h"
 
+/*
+ * storage_sync() only takes a snapshot of the key file, the snapshots
+ * are written by a worker thread once STORAGE_SYNC_DELAY_MS has passed
+ * since the first unwritten change.  Until a snapshot has been written,
+ * storage_open() loads it instead of the file.
+ */
+#define STORAGE_SYNC_DELAY_MS 500
+
+struct storage_file {
+	char *path;
+	char *data;		/* Newest snapshot, not yet written */
+	gsize length;
+	char *writing;		/* The snapshot being written */
+	gsize writing_length;
+	gboolean queued;	/* Owned by the worker thread */
+};
+
 static char* config_dir = NULL;
 
+/* Everything except the timer is protected by storage_lock */
+static GMutex storage_lock;
+static GCond storage_cond;
+static GHashTable *storage_files;
+static GThreadPool *storage_pool;
+static guint storage_sync_id;
+
 void __ofono_set_config_dir(const char *dir)
 {
 	g_free(config_dir);
@@ -180,61 +204,250 @@ error_create_dirs:
 	return r;
 }
 
+static char *storage_path(const char *imsi, const char *store)
+{
+	if (imsi)
+		return g_strdup_printf(STORAGEDIR "/%s/%s", imsi, store);
+	else
+		return g_strdup_printf(STORAGEDIR "/%s", store);
+}
+
+static void storage_write(const char *path, const char *data, gsize length)
+{
+	if (create_dirs(path, S_IRUSR | S_IWUSR | S_IXUSR) != 0)
+		return;
+
+	g_file_set_contents(path, data, length, NULL);
+}
+
+static void storage_file_free(gpointer data)
+{
+	struct storage_file *file = data;
+
+	g_free(file->path);
+	g_free(file->data);
+	g_free(file->writing);
+	g_free(file);
+}
+
+/* Runs in the worker thread */
+static void storage_file_write(gpointer data, gpointer user_data)
+{
+	struct storage_file *file = data;
+
+	g_mutex_lock(&storage_lock);
+
+	/* Snapshots taken while writing are written right away */
+	while (file->data) {
+		file->writing = file->data;
+		file->writing_length = file->length;
+		file->data = NULL;
+		file->length = 0;
+
+		g_mutex_unlock(&storage_lock);
+		storage_write(file->path, file->writing, file->writing_length);
+		g_mutex_lock(&storage_lock);
+
+		g_free(file->writing);
+		file->writing = NULL;
+	}
+
+	g_hash_table_remove(storage_files, file->path);
+	g_cond_broadcast(&storage_cond);
+	g_mutex_unlock(&storage_lock);
+}
+
+/* Must be called with storage_lock held */
+static void storage_file_queue(struct storage_file *file)
+{
+	if (file->queued)
+		return;
+
+	if (storage_pool == NULL)
+		storage_pool = g_thread_pool_new(storage_file_write, NULL,
+							1, FALSE, NULL);
+
+	file->queued = TRUE;
+	g_thread_pool_push(storage_pool, file, NULL);
+}
+
+static gboolean storage_sync_cb(gpointer user_data)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	storage_sync_id = 0;
+
+	g_mutex_lock(&storage_lock);
+	g_hash_table_iter_init(&iter, storage_files);
+
+	while (g_hash_table_iter_next(&iter, NULL, &value))
+		storage_file_queue(value);
+
+	g_mutex_unlock(&storage_lock);
+	return G_SOURCE_REMOVE;
+}
+
+/* Must be called with storage_lock held */
+static struct storage_file *storage_file_get(const char *path)
+{
+	struct storage_file *file;
+
+	if (storage_files == NULL)
+		storage_files = g_hash_table_new_full(g_str_hash, g_str_equal,
+						NULL, storage_file_free);
+
+	file = g_hash_table_lookup(storage_files, path);
+
+	if (file == NULL) {
+		file = g_new0(struct storage_file, 1);
+		file->path = g_strdup(path);
+		g_hash_table_insert(storage_files, file->path, file);
+	}
+
+	return file;
+}
+
+/* Must be called with storage_lock held */
+static void storage_file_wait(const char *path)
+{
+	while (g_hash_table_lookup(storage_files, path))
+		g_cond_wait(&storage_cond, &storage_lock);
+}
+
 GKeyFile *storage_open(const char *imsi, const char *store)
 {
 	GKeyFile *keyfile;
+	struct storage_file *file = NULL;
 	char *path;
 
 	if (store == NULL)
 		return NULL;
 
-	if (imsi)
-		path = g_strdup_printf(STORAGEDIR "/%s/%s", imsi, store);
-	else
-		path = g_strdup_printf(STORAGEDIR "/%s", store);
-
+	path = storage_path(imsi, store);
 	keyfile = g_key_file_new();
 
-	if (path) {
+	g_mutex_lock(&storage_lock);
+
+	if (storage_files)
+		file = g_hash_table_lookup(storage_files, path);
+
+	/* The newest snapshot is what the file is about to contain */
+	if (file && file->data)
+		g_key_file_load_from_data(keyfile, file->data, file->length,
+								0, NULL);
+	else if (file && file->writing)
+		g_key_file_load_from_data(keyfile, file->writing,
+						file->writing_length, 0, NULL);
+	else
 		g_key_file_load_from_file(keyfile, path, 0, NULL);
-		g_free(path);
-	}
 
+	g_mutex_unlock(&storage_lock);
+
+	g_free(path);
 	return keyfile;
 }
 
 void storage_sync(const char *imsi, const char *store, GKeyFile *keyfile)
 {
+	struct storage_file *file;
 	char *path;
 	char *data;
 	gsize length = 0;
 
-	if (imsi)
-		path = g_strdup_printf(STORAGEDIR "/%s/%s", imsi, store);
-	else
-		path = g_strdup_printf(STORAGEDIR "/%s", store);
+	path = storage_path(imsi, store);
+	data = g_key_file_to_data(keyfile, &length, NULL);
 
-	if (path == NULL)
-		return;
+	g_mutex_lock(&storage_lock);
 
-	if (create_dirs(path, S_IRUSR | S_IWUSR | S_IXUSR) != 0) {
-		g_free(path);
-		return;
-	}
+	file = storage_file_get(path);
+	g_free(file->data);
+	file->data = data;
+	file->length = length;
 
-	data = g_key_file_to_data(keyfile, &length, NULL);
+	g_mutex_unlock(&storage_lock);
 
-	g_file_set_contents(path, data, length, NULL);
+	if (storage_sync_id == 0)
+		storage_sync_id = g_timeout_add(STORAGE_SYNC_DELAY_MS,
+						storage_sync_cb, NULL);
 
-	g_free(data);
 	g_free(path);
 }
 
+void storage_flush(void)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	if (storage_sync_id) {
+		g_source_remove(storage_sync_id);
+		storage_sync_id = 0;
+	}
+
+	g_mutex_lock(&storage_lock);
+
+	if (storage_files) {
+		g_hash_table_iter_init(&iter, storage_files);
+
+		while (g_hash_table_iter_next(&iter, NULL, &value))
+			storage_file_queue(value);
+
+		while (g_hash_table_size(storage_files))
+			g_cond_wait(&storage_cond, &storage_lock);
+	}
+
+	g_mutex_unlock(&storage_lock);
+}
+
+/* Saving on close is synchronous, the caller may be going away */
 void storage_close(const char *imsi, const char *store, GKeyFile *keyfile,
 			gboolean save)
 {
-	if (save == TRUE)
-		storage_sync(imsi, store, keyfile);
+	struct storage_file *file = NULL;
+	char *path;
+	char *data;
+	gsize length = 0;
+
+	if (save == TRUE) {
+		path = storage_path(imsi, store);
+		data = g_key_file_to_data(keyfile, &length, NULL);
+
+		g_mutex_lock(&storage_lock);
+
+		if (storage_files)
+			file = g_hash_table_lookup(storage_files, path);
+
+		if (file) {
+			/* Let the snapshot supersede the unwritten ones */
+			g_free(file->data);
+			file->data = data;
+			file->length = length;
+			storage_file_queue(file);
+			storage_file_wait(path);
+			g_mutex_unlock(&storage_lock);
+		} else {
+			g_mutex_unlock(&storage_lock);
+			storage_write(path, data, length);
+			g_free(data);
+		}
+
+		g_free(path);
+	}
 
 	g_key_file_free(keyfile);
 }
+
+void __ofono_storage_cleanup(void)
+{
+	storage_flush();
+
+	if (storage_pool) {
+		g_thread_pool_free(storage_pool, FALSE, TRUE);
+		storage_pool = NULL;
+	}
+
+	if (storage_files) {
+		g_hash_table_destroy(storage_files);
+		storage_files = NULL;
+	}
+}
@@ -44,6 +44,8 @@ ssize_t write_file(const unsigned char *buffer, size_t len, mode_t mode,
 	__attribute__((format(printf, 4, 5)));
 
 GKeyFile *storage_open(const char *imsi, const char *store);
+/* Saved in the background, storage_flush() waits for everything to hit disk */
 void storage_sync(const char *imsi, const char *store, GKeyFile *keyfile);
+void storage_flush(void);
 void storage_close(const char *imsi, const char *store, GKeyFile *keyfile,
 			gboolean save);
@@ -27,11 +27,18 @@
 
 #include <stdio.h>
 #include <string.h>
-#include <ctype.h>
 #include <stdlib.h>
 
 #include <glib.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <emmintrin.h>
+#define HEX_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HEX_NEON
+#endif
+
 #include "util.h"
 
 /*
@@ -74,21 +81,23 @@ struct codepoint {
 	unsigned short to;
 };
 
+/* Two-level map from UCS-2 to GSM, by the high byte of the code point */
+struct unicode_map {
+	unsigned short *pages[256];
+};
+
 struct conversion_table {
-	/* To unicode locking shift table */
-	const struct codepoint *locking_u;
-	unsigned int locking_len_u;
+	/* To unicode locking shift table, indexed by GSM code */
+	const unsigned short *locking_g;
 
-	/* To unicode single shift table */
-	const struct codepoint *single_u;
-	unsigned int single_len_u;
+	/* To unicode single shift table, indexed by the code after 0x1B */
+	const unsigned short *single_g;
 
-	/* To GSM locking shift table, fixed size */
-	const unsigned short *locking_g;
+	/* To GSM locking shift table */
+	const struct unicode_map *locking_u;
 
 	/* To GSM single shift table */
-	const struct codepoint *single_g;
-	unsigned int single_len_g;
+	const struct unicode_map *single_u;
 };
 
 /* GSM to Unicode extension table, for GSM sequences starting with 0x1B */
@@ -2644,254 +2653,214 @@ const struct codepoint urd_unicode[] = {
 	{ 0x06CC, 0x59 }, { 0x06D0, 0x5A }, { 0x06D2, 0x5B }, { 0x06D5, 0x55 }
 };
 
-static int compare_codepoints(const void *a, const void *b)
+/* The tables above, by the dialect they belong to */
+struct dialect_source {
+	const unsigned short *locking_gsm;
+	const struct codepoint *locking_unicode;
+	unsigned int locking_unicode_len;
+	const struct codepoint *single_gsm;
+	unsigned int single_gsm_len;
+	const struct codepoint *single_unicode;
+	unsigned int single_unicode_len;
+};
+
+#define LOCKING_SHIFT(gsm, unicode) \
+	.locking_gsm = gsm, .locking_unicode = unicode, \
+	.locking_unicode_len = TABLE_SIZE(unicode)
+
+#define SINGLE_SHIFT(gsm, unicode) \
+	.single_gsm = gsm, .single_gsm_len = TABLE_SIZE(gsm), \
+	.single_unicode = unicode, .single_unicode_len = TABLE_SIZE(unicode)
+
+static const struct dialect_source dialect_sources[] = {
+	[GSM_DIALECT_DEFAULT] = {
+		LOCKING_SHIFT(def_gsm, def_unicode),
+		SINGLE_SHIFT(def_ext_gsm, def_ext_unicode)
+	},
+	[GSM_DIALECT_TURKISH] = {
+		LOCKING_SHIFT(tur_gsm, tur_unicode),
+		SINGLE_SHIFT(tur_ext_gsm, tur_ext_unicode)
+	},
+	/* Spanish dialect uses the default locking shift table */
+	[GSM_DIALECT_SPANISH] = {
+		LOCKING_SHIFT(def_gsm, def_unicode),
+		SINGLE_SHIFT(spa_ext_gsm, spa_ext_unicode)
+	},
+	[GSM_DIALECT_PORTUGUESE] = {
+		LOCKING_SHIFT(por_gsm, por_unicode),
+		SINGLE_SHIFT(por_ext_gsm, por_ext_unicode)
+	},
+	[GSM_DIALECT_BENGALI] = {
+		LOCKING_SHIFT(ben_gsm, ben_unicode),
+		SINGLE_SHIFT(ben_ext_gsm, ben_ext_unicode)
+	},
+	[GSM_DIALECT_GUJARATI] = {
+		LOCKING_SHIFT(guj_gsm, guj_unicode),
+		SINGLE_SHIFT(guj_ext_gsm, guj_ext_unicode)
+	},
+	[GSM_DIALECT_HINDI] = {
+		LOCKING_SHIFT(hin_gsm, hin_unicode),
+		SINGLE_SHIFT(hin_ext_gsm, hin_ext_unicode)
+	},
+	[GSM_DIALECT_KANNADA] = {
+		LOCKING_SHIFT(kan_gsm, kan_unicode),
+		SINGLE_SHIFT(kan_ext_gsm, kan_ext_unicode)
+	},
+	[GSM_DIALECT_MALAYALAM] = {
+		LOCKING_SHIFT(mal_gsm, mal_unicode),
+		SINGLE_SHIFT(mal_ext_gsm, mal_ext_unicode)
+	},
+	[GSM_DIALECT_ORIYA] = {
+		LOCKING_SHIFT(ori_gsm, ori_unicode),
+		SINGLE_SHIFT(ori_ext_gsm, ori_ext_unicode)
+	},
+	[GSM_DIALECT_PUNJABI] = {
+		LOCKING_SHIFT(pun_gsm, pun_unicode),
+		SINGLE_SHIFT(pun_ext_gsm, pun_ext_unicode)
+	},
+	[GSM_DIALECT_TAMIL] = {
+		LOCKING_SHIFT(tam_gsm, tam_unicode),
+		SINGLE_SHIFT(tam_ext_gsm, tam_ext_unicode)
+	},
+	[GSM_DIALECT_TELUGU] = {
+		LOCKING_SHIFT(tel_gsm, tel_unicode),
+		SINGLE_SHIFT(tel_ext_gsm, tel_ext_unicode)
+	},
+	[GSM_DIALECT_URDU] = {
+		LOCKING_SHIFT(urd_gsm, urd_unicode),
+		SINGLE_SHIFT(urd_ext_gsm, urd_ext_unicode)
+	},
+};
+
+/*
+ * Direct-indexed versions of the tables above, built once on first use.
+ * GSM to unicode tables cover all 256 octet values so that a stray 8-bit
+ * value maps to GUND rather than past the end of the table.
+ */
+static struct dialect_tables {
+	unsigned short locking_g[256];
+	unsigned short single_g[256];
+	struct unicode_map locking_u;
+	struct unicode_map single_u;
+} dialect_tables[G_N_ELEMENTS(dialect_sources)];
+
+/* Shared by all the unicode_map pages that have no mappings */
+static unsigned short unmapped_page[256];
+
+static void unicode_map_init(struct unicode_map *map,
+				const struct codepoint *table,
+				unsigned int len)
 {
-	const struct codepoint *ca = (const struct codepoint *) a;
-	const struct codepoint *cb = (const struct codepoint *) b;
+	unsigned int i;
 
-	return (ca->from > cb->from) - (ca->from < cb->from);
+	for (i = 0; i < G_N_ELEMENTS(map->pages); i++)
+		map->pages[i] = unmapped_page;
+
+	for (i = 0; i < len; i++) {
+		unsigned short *page = map->pages[table[i].from >> 8];
+
+		if (page == unmapped_page) {
+			page = g_new(unsigned short, 256);
+			memset(page, 0xff, 256 * sizeof(unsigned short));
+			map->pages[table[i].from >> 8] = page;
+		}
+
+		/* Some characters have two codes, the first one is used */
+		if (page[table[i].from & 0xff] == GUND)
+			page[table[i].from & 0xff] = table[i].to;
+	}
 }
 
-static unsigned short codepoint_lookup(struct codepoint *key,
-					const struct codepoint *table,
-					unsigned int len)
+static void dialect_tables_init(void)
 {
-	struct codepoint *result = NULL;
+	static bool initialized;
+	unsigned int i;
+	unsigned int j;
+
+	if (initialized)
+		return;
+
+	/* All ones is GUND */
+	memset(unmapped_page, 0xff, sizeof(unmapped_page));
 
-	result = bsearch(key, table, len, sizeof(struct codepoint),
-				compare_codepoints);
+	for (i = 0; i < G_N_ELEMENTS(dialect_sources); i++) {
+		const struct dialect_source *src = dialect_sources + i;
+		struct dialect_tables *t = dialect_tables + i;
+
+		memset(t->locking_g, 0xff, sizeof(t->locking_g));
+		memcpy(t->locking_g, src->locking_gsm,
+					128 * sizeof(unsigned short));
+
+		memset(t->single_g, 0xff, sizeof(t->single_g));
+		for (j = 0; j < src->single_gsm_len; j++)
+			t->single_g[src->single_gsm[j].from] =
+						src->single_gsm[j].to;
+
+		unicode_map_init(&t->locking_u, src->locking_unicode,
+					src->locking_unicode_len);
+		unicode_map_init(&t->single_u, src->single_unicode,
+					src->single_unicode_len);
+	}
 
-	return result ? result->to : GUND;
+	initialized = true;
 }
 
-static unsigned short gsm_locking_shift_lookup(struct conversion_table *t,
-						unsigned char k)
+static inline unsigned short gsm_locking_shift_lookup(
+					const struct conversion_table *t,
+					unsigned char k)
 {
 	return t->locking_g[k];
 }
 
-static unsigned short gsm_single_shift_lookup(struct conversion_table *t,
-						unsigned char k)
+static inline unsigned short gsm_single_shift_lookup(
+					const struct conversion_table *t,
+					unsigned char k)
 {
-	struct codepoint key = { k, 0 };
-	return codepoint_lookup(&key, t->single_g, t->single_len_g);
+	return t->single_g[k];
 }
 
-static unsigned short unicode_locking_shift_lookup(struct conversion_table *t,
-							unsigned short k)
+static inline unsigned short unicode_locking_shift_lookup(
+					const struct conversion_table *t,
+					unsigned short k)
 {
-	struct codepoint key = { k, 0 };
-	return codepoint_lookup(&key, t->locking_u, t->locking_len_u);
+	return t->locking_u->pages[k >> 8][k & 0xff];
 }
 
-static unsigned short unicode_single_shift_lookup(struct conversion_table *t,
-							unsigned short k)
+static inline unsigned short unicode_single_shift_lookup(
+					const struct conversion_table *t,
+					unsigned short k)
 {
-	struct codepoint key = { k, 0 };
-	return codepoint_lookup(&key, t->single_u, t->single_len_u);
+	return t->single_u->pages[k >> 8][k & 0xff];
 }
 
-static bool populate_locking_shift(struct conversion_table *t,
-					enum gsm_dialect lang)
+/* Falls back to the single shift table */
+static inline unsigned short unicode_lookup(const struct conversion_table *t,
+						unsigned short k)
 {
-	switch (lang) {
-	case GSM_DIALECT_DEFAULT:
-	case GSM_DIALECT_SPANISH:
-		t->locking_g = def_gsm;
-		t->locking_u = def_unicode;
-		t->locking_len_u = TABLE_SIZE(def_unicode);
-		return true;
-
-	case GSM_DIALECT_TURKISH:
-		t->locking_g = tur_gsm;
-		t->locking_u = tur_unicode;
-		t->locking_len_u = TABLE_SIZE(tur_unicode);
-		return true;
-
-	case GSM_DIALECT_PORTUGUESE:
-		t->locking_g = por_gsm;
-		t->locking_u = por_unicode;
-		t->locking_len_u = TABLE_SIZE(por_unicode);
-		return true;
-
-	case GSM_DIALECT_BENGALI:
-		t->locking_g = ben_gsm;
-		t->locking_u = ben_unicode;
-		t->locking_len_u = TABLE_SIZE(ben_unicode);
-		return true;
-
-	case GSM_DIALECT_GUJARATI:
-                t->locking_g = guj_gsm;
-                t->locking_u = guj_unicode;
-                t->locking_len_u = TABLE_SIZE(guj_unicode);
-                return true;
-
-	case GSM_DIALECT_HINDI:
-		t->locking_g = hin_gsm;
-		t->locking_u = hin_unicode;
-		t->locking_len_u = TABLE_SIZE(hin_unicode);
-		return true;
-
-	case GSM_DIALECT_KANNADA:
-		t->locking_g = kan_gsm;
-		t->locking_u = kan_unicode;
-		t->locking_len_u = TABLE_SIZE(kan_unicode);
-		return true;
-
-	case GSM_DIALECT_MALAYALAM:
-		t->locking_g = mal_gsm;
-		t->locking_u = mal_unicode;
-		t->locking_len_u = TABLE_SIZE(mal_unicode);
-		return true;
-
-	case GSM_DIALECT_ORIYA:
-		t->locking_g = ori_gsm;
-		t->locking_u = ori_unicode;
-		t->locking_len_u = TABLE_SIZE(ori_unicode);
-		return true;
-
-	case GSM_DIALECT_PUNJABI:
-		t->locking_g = pun_gsm;
-		t->locking_u = pun_unicode;
-		t->locking_len_u = TABLE_SIZE(pun_unicode);
-		return true;
-
-	case GSM_DIALECT_TAMIL:
-		t->locking_g = tam_gsm;
-		t->locking_u = tam_unicode;
-		t->locking_len_u = TABLE_SIZE(tam_unicode);
-		return true;
-
-	case GSM_DIALECT_TELUGU:
-		t->locking_g = tel_gsm;
-		t->locking_u = tel_unicode;
-		t->locking_len_u = TABLE_SIZE(tel_unicode);
-		return true;
-
-	case GSM_DIALECT_URDU:
-		t->locking_g = urd_gsm;
-		t->locking_u = urd_unicode;
-		t->locking_len_u = TABLE_SIZE(urd_unicode);
-		return true;
-        }
-
-	return false;
-}
+	unsigned short converted = unicode_locking_shift_lookup(t, k);
 
-static bool populate_single_shift(struct conversion_table *t,
-					enum gsm_dialect lang)
-{
-	switch (lang) {
-	case GSM_DIALECT_DEFAULT:
-		t->single_g = def_ext_gsm;
-		t->single_len_g = TABLE_SIZE(def_ext_gsm);
-		t->single_u = def_ext_unicode;
-		t->single_len_u = TABLE_SIZE(def_ext_unicode);
-		return true;
-
-	case GSM_DIALECT_TURKISH:
-		t->single_g = tur_ext_gsm;
-		t->single_len_g = TABLE_SIZE(tur_ext_gsm);
-		t->single_u = tur_ext_unicode;
-		t->single_len_u = TABLE_SIZE(tur_ext_unicode);
-		return true;
-
-	case GSM_DIALECT_SPANISH:
-		t->single_g = spa_ext_gsm;
-		t->single_len_g = TABLE_SIZE(spa_ext_gsm);
-		t->single_u = spa_ext_unicode;
-		t->single_len_u = TABLE_SIZE(spa_ext_unicode);
-		return true;
-
-	case GSM_DIALECT_PORTUGUESE:
-		t->single_g = por_ext_gsm;
-		t->single_len_g = TABLE_SIZE(por_ext_gsm);
-		t->single_u = por_ext_unicode;
-		t->single_len_u = TABLE_SIZE(por_ext_unicode);
-		return true;
-
-	case GSM_DIALECT_BENGALI:
-		t->single_g = ben_ext_gsm;
-		t->single_len_g = TABLE_SIZE(ben_ext_gsm);
-		t->single_u = ben_ext_unicode;
-		t->single_len_u = TABLE_SIZE(ben_ext_unicode);
-		return true;
-
-	case GSM_DIALECT_GUJARATI:
-                t->single_g = guj_ext_gsm;
-                t->single_len_g = TABLE_SIZE(guj_ext_gsm);
-                t->single_u = guj_ext_unicode;
-                t->single_len_u = TABLE_SIZE(guj_ext_unicode);
-                return true;
-
-	case GSM_DIALECT_HINDI:
-		t->single_g = hin_ext_gsm;
-		t->single_len_g = TABLE_SIZE(hin_ext_gsm);
-		t->single_u = hin_ext_unicode;
-		t->single_len_u = TABLE_SIZE(hin_ext_unicode);
-		return true;
-
-	case GSM_DIALECT_KANNADA:
-		t->single_g = kan_ext_gsm;
-		t->single_len_g = TABLE_SIZE(kan_ext_gsm);
-		t->single_u = kan_ext_unicode;
-		t->single_len_u = TABLE_SIZE(kan_ext_unicode);
-		return true;
-
-	case GSM_DIALECT_MALAYALAM:
-		t->single_g = mal_ext_gsm;
-		t->single_len_g = TABLE_SIZE(mal_ext_gsm);
-		t->single_u = mal_ext_unicode;
-		t->single_len_u = TABLE_SIZE(mal_ext_unicode);
-		return true;
-
-	case GSM_DIALECT_ORIYA:
-		t->single_g = ori_ext_gsm;
-		t->single_len_g = TABLE_SIZE(ori_ext_gsm);
-		t->single_u = ori_ext_unicode;
-		t->single_len_u = TABLE_SIZE(ori_ext_unicode);
-		return true;
-
-	case GSM_DIALECT_PUNJABI:
-		t->single_g = pun_ext_gsm;
-		t->single_len_g = TABLE_SIZE(pun_ext_gsm);
-		t->single_u = pun_ext_unicode;
-		t->single_len_u = TABLE_SIZE(pun_ext_unicode);
-		return true;
-
-	case GSM_DIALECT_TAMIL:
-		t->single_g = tam_ext_gsm;
-		t->single_len_g = TABLE_SIZE(tam_ext_gsm);
-		t->single_u = tam_ext_unicode;
-		t->single_len_u = TABLE_SIZE(tam_ext_unicode);
-		return true;
-
-	case GSM_DIALECT_TELUGU:
-		t->single_g = tel_ext_gsm;
-		t->single_len_g = TABLE_SIZE(tel_ext_gsm);
-		t->single_u = tel_ext_unicode;
-		t->single_len_u = TABLE_SIZE(tel_ext_unicode);
-		return true;
-
-	case GSM_DIALECT_URDU:
-		t->single_g = urd_ext_gsm;
-		t->single_len_g = TABLE_SIZE(urd_ext_gsm);
-		t->single_u = urd_ext_unicode;
-		t->single_len_u = TABLE_SIZE(urd_ext_unicode);
-		return true;
-        }
-
-	return false;
+	if (converted == GUND)
+		converted = unicode_single_shift_lookup(t, k);
+
+	return converted;
 }
 
 static bool conversion_table_init(struct conversion_table *t,
 					enum gsm_dialect locking,
 					enum gsm_dialect single)
 {
-	memset(t, 0, sizeof(struct conversion_table));
+	if ((unsigned int) locking >= G_N_ELEMENTS(dialect_tables) ||
+			(unsigned int) single >= G_N_ELEMENTS(dialect_tables))
+		return false;
+
+	dialect_tables_init();
 
-	return populate_locking_shift(t, locking) &&
-			populate_single_shift(t, single);
+	t->locking_g = dialect_tables[locking].locking_g;
+	t->locking_u = &dialect_tables[locking].locking_u;
+	t->single_g = dialect_tables[single].single_g;
+	t->single_u = &dialect_tables[single].single_u;
+
+	return true;
 }
 
 /*!
@@ -2943,7 +2912,7 @@ char *convert_gsm_to_utf8_with_lang(const unsigned char *text, long len,
 
 		if (text[i] == 0x1b) {
 			++i;
-			if (i >= len)
+			if (i >= len || text[i] > 0x7f)
 				goto error;
 
 			c = gsm_single_shift_lookup(&t, text[i]);
@@ -3014,6 +2983,51 @@ char *convert_gsm_to_utf8(const unsigned char *text, long len,
 						GSM_DIALECT_DEFAULT);
 }
 
+/*
+ * Writes out nchars characters of text already known to convert to
+ * res_len octets with the table.
+ */
+static unsigned char *utf8_to_gsm_output(const struct conversion_table *t,
+						const char *text, long nchars,
+						long res_len,
+						unsigned char terminator,
+						long *items_written)
+{
+	const char *in = text;
+	unsigned char *res;
+	unsigned char *out;
+	long i;
+
+	res = g_try_malloc(res_len + (terminator ? 1 : 0));
+	if (res == NULL)
+		return NULL;
+
+	out = res;
+	for (i = 0; i < nchars; i++) {
+		unsigned short converted;
+
+		converted = unicode_lookup(t, g_utf8_get_char(in));
+
+		if (converted & 0x1b00) {
+			*out = 0x1b;
+			++out;
+		}
+
+		*out = converted;
+		++out;
+
+		in = g_utf8_next_char(in);
+	}
+
+	if (terminator)
+		*out = terminator;
+
+	if (items_written)
+		*items_written = out - res;
+
+	return res;
+}
+
 /*!
  * Converts UTF-8 encoded text to GSM alphabet.  The result is unpacked,
  * with the 7th bit always 0.  If terminator is not 0, a terminator character
@@ -3033,10 +3047,8 @@ unsigned char *convert_utf8_to_gsm_with_lang(const char *text, long len,
 	struct conversion_table t;
 	long nchars = 0;
 	const char *in;
-	unsigned char *out;
 	unsigned char *res = NULL;
 	long res_len;
-	long i;
 
 	if (!conversion_table_init(&t, locking_lang, single_lang))
 		return NULL;
@@ -3072,38 +3084,8 @@ unsigned char *convert_utf8_to_gsm_with_lang(const char *text, long len,
 		nchars += 1;
 	}
 
-	res = g_try_malloc(res_len + (terminator ? 1 : 0));
-	if (res == NULL)
-		goto err_out;
-
-	in = text;
-	out = res;
-	for (i = 0; i < nchars; i++) {
-		unsigned short converted;
-
-		gunichar c = g_utf8_get_char(in);
-
-		converted = unicode_locking_shift_lookup(&t, c);
-
-		if (converted == GUND)
-			converted = unicode_single_shift_lookup(&t, c);
-
-		if (converted & 0x1b00) {
-			*out = 0x1b;
-			++out;
-		}
-
-		*out = converted;
-		++out;
-
-		in = g_utf8_next_char(in);
-	}
-
-	if (terminator)
-		*out = terminator;
-
-	if (items_written)
-		*items_written = out - res;
+	res = utf8_to_gsm_output(&t, text, nchars, res_len, terminator,
+					items_written);
 
 err_out:
 	if (items_read)
@@ -3127,10 +3109,10 @@ unsigned char *convert_utf8_to_gsm(const char *text, long len,
  * Converts UTF-8 encoded text to GSM alphabet. It finds an encoding
  * that uses the minimum set of GSM dialects based on the hint given.
  *
- * It first attempts to use the default dialect's single shift and
- * locking shift tables. It then tries with only the single shift
- * table of the hinted dialect, and finally with both the single shift
- * and locking shift tables of the hinted dialect.
+ * It prefers the default dialect's single shift and locking shift
+ * tables, then only the single shift table of the hinted dialect, and
+ * finally both the single shift and locking shift tables of the hinted
+ * dialect.  All of them are tried in a single pass over the text.
  *
  * Returns the encoded data or NULL if no suitable encoding could be
  * found. The data must be freed by the caller. If items_read is not
@@ -3146,48 +3128,302 @@ unsigned char *convert_utf8_to_gsm_best_lang(const char *utf8, long len,
 					enum gsm_dialect *used_locking,
 					enum gsm_dialect *used_single)
 {
-	enum gsm_dialect locking = GSM_DIALECT_DEFAULT;
-	enum gsm_dialect single = GSM_DIALECT_DEFAULT;
+	struct conversion_table t[3];
+	enum gsm_dialect locking[3];
+	enum gsm_dialect single[3];
+	long res_len[3] = { 0, 0, 0 };
+	long failed_at[3];
+	unsigned int candidates = 0;
+	unsigned int alive;
+	unsigned int i;
+	const char *in = utf8;
+	long nchars = 0;
 	unsigned char *encoded;
 
-	encoded = convert_utf8_to_gsm_with_lang(utf8, len, items_read,
-						items_written, terminator,
-						locking, single);
-	if (encoded != NULL)
-		goto out;
+	/* The combinations to try, in order of preference */
+	locking[candidates] = GSM_DIALECT_DEFAULT;
+	single[candidates++] = GSM_DIALECT_DEFAULT;
 
-	if (hint == GSM_DIALECT_DEFAULT)
-		return NULL;
+	if (hint != GSM_DIALECT_DEFAULT) {
+		locking[candidates] = GSM_DIALECT_DEFAULT;
+		single[candidates++] = hint;
 
-	single = hint;
-	encoded = convert_utf8_to_gsm_with_lang(utf8, len, items_read,
-						items_written, terminator,
-						locking, single);
-	if (encoded != NULL)
-		goto out;
+		/* Spanish dialect uses the default locking shift table */
+		if (hint != GSM_DIALECT_SPANISH) {
+			locking[candidates] = hint;
+			single[candidates++] = hint;
+		}
+	}
+
+	for (i = 0; i < candidates; i++)
+		if (!conversion_table_init(&t[i], locking[i], single[i]))
+			return NULL;
+
+	/* Score all of them in one pass, dropping the ones that fail */
+	alive = (1 << candidates) - 1;
+
+	while (alive && (len < 0 || utf8 + len - in > 0) && *in) {
+		long max = len < 0 ? 6 : utf8 + len - in;
+		gunichar c = g_utf8_get_char_validated(in, max);
+
+		for (i = 0; i < candidates; i++) {
+			unsigned short converted = GUND;
+
+			if (!(alive & (1 << i)))
+				continue;
+
+			if (!(c & 0x80000000) && c <= 0xffff)
+				converted = unicode_lookup(&t[i], c);
+
+			if (converted == GUND) {
+				alive &= ~(1 << i);
+				failed_at[i] = in - utf8;
+			} else if (converted & 0x1b00)
+				res_len[i] += 2;
+			else
+				res_len[i] += 1;
+		}
+
+		if (!alive)
+			break;
+
+		in = g_utf8_next_char(in);
+		nchars += 1;
+	}
+
+	if (!alive) {
+		if (items_read)
+			*items_read = failed_at[candidates - 1];
 
-	/* Spanish dialect uses the default locking shift table */
-	if (hint == GSM_DIALECT_SPANISH)
 		return NULL;
+	}
 
-	locking = hint;
-	encoded = convert_utf8_to_gsm_with_lang(utf8, len, items_read,
-						items_written, terminator,
-						locking, single);
+	i = __builtin_ctz(alive);
 
+	encoded = utf8_to_gsm_output(&t[i], utf8, nchars, res_len[i],
+					terminator, items_written);
 	if (encoded == NULL)
 		return NULL;
 
-out:
+	if (items_read)
+		*items_read = in - utf8;
+
 	if (used_locking != NULL)
-		*used_locking = locking;
+		*used_locking = locking[i];
 
 	if (used_single != NULL)
-		*used_single = single;
+		*used_single = single[i];
 
 	return encoded;
 }
 
+/*
+ * The hex and 7-bit codecs below sit under every PDU that goes through
+ * an AT modem, so they work on whole words rather than bit by bit.  The
+ * hex codecs also have SSE2 and NEON variants, used when the CPU has
+ * them.
+ */
+/* Digit values, with HEX_VALID set for the characters that are digits */
+#define HEX_VALID 0x10
+
+static const unsigned char hex_digits[16] = "0123456789ABCDEF";
+
+static const unsigned char hex_values[256] = {
+	['0'] = 0x10, ['1'] = 0x11, ['2'] = 0x12, ['3'] = 0x13, ['4'] = 0x14,
+	['5'] = 0x15, ['6'] = 0x16, ['7'] = 0x17, ['8'] = 0x18, ['9'] = 0x19,
+	['A'] = 0x1a, ['B'] = 0x1b, ['C'] = 0x1c, ['D'] = 0x1d, ['E'] = 0x1e,
+	['F'] = 0x1f,
+	['a'] = 0x1a, ['b'] = 0x1b, ['c'] = 0x1c, ['d'] = 0x1d, ['e'] = 0x1e,
+	['f'] = 0x1f,
+};
+
+#if defined(HEX_SSE2)
+
+static gboolean hex_simd_supported(void)
+{
+	static int supported = -1;
+
+	if (supported < 0) {
+		__builtin_cpu_init();
+		supported = __builtin_cpu_supports("sse2") ? 1 : 0;
+	}
+
+	return supported;
+}
+
+/* Turns 16 hex digits into their values, all 0xff if any is invalid */
+__attribute__((target("sse2")))
+static inline __m128i hex_decode_sse2(__m128i c, int *valid)
+{
+	__m128i digit = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+	__m128i alpha = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)),
+					_mm_set1_epi8('a'));
+	__m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digit,
+						_mm_set1_epi8(9)), digit);
+	__m128i is_alpha = _mm_cmpeq_epi8(_mm_min_epu8(alpha,
+						_mm_set1_epi8(5)), alpha);
+
+	*valid = _mm_movemask_epi8(_mm_or_si128(is_digit, is_alpha)) ==
+									0xffff;
+
+	alpha = _mm_add_epi8(alpha, _mm_set1_epi8(10));
+
+	return _mm_or_si128(_mm_and_si128(is_digit, digit),
+				_mm_and_si128(is_alpha, alpha));
+}
+
+/* Combines the digit pairs in each 16-bit lane into one byte */
+__attribute__((target("sse2")))
+static inline __m128i hex_combine_sse2(__m128i v)
+{
+	__m128i hi = _mm_and_si128(_mm_slli_epi16(v, 4),
+					_mm_set1_epi16(0x00f0));
+
+	return _mm_or_si128(hi, _mm_srli_epi16(v, 8));
+}
+
+__attribute__((target("sse2")))
+static long decode_hex_simd(const char *in, long len, unsigned char *out)
+{
+	long i;
+
+	for (i = 0; i + 32 <= len; i += 32) {
+		__m128i a = _mm_loadu_si128((const __m128i *) (in + i));
+		__m128i b = _mm_loadu_si128((const __m128i *) (in + i + 16));
+		int valid_a;
+		int valid_b;
+
+		a = hex_decode_sse2(a, &valid_a);
+		b = hex_decode_sse2(b, &valid_b);
+
+		if (!valid_a || !valid_b)
+			break;
+
+		a = _mm_packus_epi16(hex_combine_sse2(a),
+					hex_combine_sse2(b));
+		_mm_storeu_si128((__m128i *) (out + i / 2), a);
+	}
+
+	return i;
+}
+
+__attribute__((target("sse2")))
+static long encode_hex_simd(const unsigned char *in, long len, char *out)
+{
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	const __m128i nine = _mm_set1_epi8(9);
+	const __m128i zero = _mm_set1_epi8('0');
+	const __m128i gap = _mm_set1_epi8('A' - '0' - 10);
+	long i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (in + i));
+		__m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+		__m128i lo = _mm_and_si128(v, mask);
+
+		/* Nibbles are below 16, signed compare is fine */
+		hi = _mm_add_epi8(_mm_add_epi8(hi, zero),
+				_mm_and_si128(_mm_cmpgt_epi8(hi, nine), gap));
+		lo = _mm_add_epi8(_mm_add_epi8(lo, zero),
+				_mm_and_si128(_mm_cmpgt_epi8(lo, nine), gap));
+
+		_mm_storeu_si128((__m128i *) (out + i * 2),
+					_mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((__m128i *) (out + i * 2 + 16),
+					_mm_unpackhi_epi8(hi, lo));
+	}
+
+	return i;
+}
+
+#elif defined(HEX_NEON)
+
+static gboolean hex_simd_supported(void)
+{
+	/* Only built when the compiler may assume NEON anyway */
+	return TRUE;
+}
+
+static inline uint8x16_t hex_decode_neon(uint8x16_t c, uint8x16_t *invalid)
+{
+	uint8x16_t digit = vsubq_u8(c, vdupq_n_u8('0'));
+	uint8x16_t alpha = vsubq_u8(vorrq_u8(c, vdupq_n_u8(0x20)),
+					vdupq_n_u8('a'));
+	uint8x16_t is_digit = vcleq_u8(digit, vdupq_n_u8(9));
+	uint8x16_t is_alpha = vcleq_u8(alpha, vdupq_n_u8(5));
+
+	*invalid = vorrq_u8(*invalid, vmvnq_u8(vorrq_u8(is_digit, is_alpha)));
+
+	alpha = vaddq_u8(alpha, vdupq_n_u8(10));
+
+	return vbslq_u8(is_digit, digit, alpha);
+}
+
+static long decode_hex_simd(const char *in, long len, unsigned char *out)
+{
+	long i;
+
+	for (i = 0; i + 32 <= len; i += 32) {
+		uint8x16x2_t c = vld2q_u8((const uint8_t *) in + i);
+		uint8x16_t invalid = vdupq_n_u8(0);
+		uint8x16_t hi = hex_decode_neon(c.val[0], &invalid);
+		uint8x16_t lo = hex_decode_neon(c.val[1], &invalid);
+		uint8x8_t any = vorr_u8(vget_low_u8(invalid),
+					vget_high_u8(invalid));
+
+		if (vget_lane_u64(vreinterpret_u64_u8(any), 0))
+			break;
+
+		vst1q_u8(out + i / 2, vorrq_u8(vshlq_n_u8(hi, 4), lo));
+	}
+
+	return i;
+}
+
+static long encode_hex_simd(const unsigned char *in, long len, char *out)
+{
+	const uint8x16_t nine = vdupq_n_u8(9);
+	const uint8x16_t zero = vdupq_n_u8('0');
+	const uint8x16_t gap = vdupq_n_u8('A' - '0' - 10);
+	long i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		uint8x16_t v = vld1q_u8(in + i);
+		uint8x16x2_t digits;
+
+		digits.val[0] = vshrq_n_u8(v, 4);
+		digits.val[1] = vandq_u8(v, vdupq_n_u8(0x0f));
+
+		digits.val[0] = vaddq_u8(vaddq_u8(digits.val[0], zero),
+				vandq_u8(vcgtq_u8(digits.val[0], nine), gap));
+		digits.val[1] = vaddq_u8(vaddq_u8(digits.val[1], zero),
+				vandq_u8(vcgtq_u8(digits.val[1], nine), gap));
+
+		vst2q_u8((uint8_t *) out + i * 2, digits);
+	}
+
+	return i;
+}
+
+#else
+
+static gboolean hex_simd_supported(void)
+{
+	return FALSE;
+}
+
+static long decode_hex_simd(const char *in, long len, unsigned char *out)
+{
+	return 0;
+}
+
+static long encode_hex_simd(const unsigned char *in, long len, char *out)
+{
+	return 0;
+}
+
+#endif
+
 /*!
  * Decodes the hex encoded data and converts to a byte array.  If terminator
  * is not 0, the terminator character is appended to the end of the result.
@@ -3202,37 +3438,26 @@ unsigned char *decode_hex_own_buf(const char *in, long len, long *items_written,
 					unsigned char terminator,
 					unsigned char *buf)
 {
-	long i, j;
-	char c;
-	unsigned char b;
+	const unsigned char *p = (const unsigned char *) in;
+	long i = 0;
+	long j;
 
 	if (len < 0)
 		len = strlen(in);
 
 	len &= ~0x1;
 
-	for (i = 0, j = 0; i < len; i++, j++) {
-		c = toupper(in[i]);
+	if (hex_simd_supported())
+		i = decode_hex_simd(in, len, buf);
 
-		if (c >= '0' && c <= '9')
-			b = c - '0';
-		else if (c >= 'A' && c <= 'F')
-			b = 10 + c - 'A';
-		else
-			return NULL;
+	for (j = i / 2; i < len; i += 2, j++) {
+		unsigned char hi = hex_values[p[i]];
+		unsigned char lo = hex_values[p[i + 1]];
 
-		i += 1;
-
-		c = toupper(in[i]);
-
-		if (c >= '0' && c <= '9')
-			b = b * 16 + c - '0';
-		else if (c >= 'A' && c <= 'F')
-			b = b * 16 + 10 + c - 'A';
-		else
+		if (!(hi & lo & HEX_VALID))
 			return NULL;
 
-		buf[j] = b;
+		buf[j] = ((hi & 0x0f) << 4) | (lo & 0x0f);
 	}
 
 	if (terminator)
@@ -3248,7 +3473,6 @@ unsigned char *decode_hex(const char *in, long len, long *items_written,
 				unsigned char terminator)
 {
 	long i;
-	char c;
 	unsigned char *buf;
 
 	if (len < 0)
@@ -3256,14 +3480,9 @@ unsigned char *decode_hex(const char *in, long len, long *items_written,
 
 	len &= ~0x1;
 
-	for (i = 0; i < len; i++) {
-		c = toupper(in[i]);
-
-		if ((c >= '0' && c <= '9') || (c >= 'A' && c <= 'F'))
-			continue;
-
-		return NULL;
-	}
+	for (i = 0; i < len; i++)
+		if (!(hex_values[(unsigned char) in[i]] & HEX_VALID))
+			return NULL;
 
 	buf = g_new(unsigned char, (len >> 1) + (terminator ? 1 : 0));
 
@@ -3279,37 +3498,25 @@ unsigned char *decode_hex(const char *in, long len, long *items_written,
 char *encode_hex_own_buf(const unsigned char *in, long len,
 				unsigned char terminator, char *buf)
 {
-	long i, j;
-	char c;
+	long i = 0;
 
 	if (len < 0) {
-		i = 0;
-
 		while (in[i] != terminator)
 			i++;
 
 		len = i;
+		i = 0;
 	}
 
-	for (i = 0, j = 0; i < len; i++, j++) {
-		c = (in[i] >> 4) & 0xf;
-
-		if (c <= 9)
-			buf[j] = '0' + c;
-		else
-			buf[j] = 'A' + c - 10;
-
-		j += 1;
-
-		c = (in[i]) & 0xf;
+	if (hex_simd_supported())
+		i = encode_hex_simd(in, len, buf);
 
-		if (c <= 9)
-			buf[j] = '0' + c;
-		else
-			buf[j] = 'A' + c - 10;
+	for (; i < len; i++) {
+		buf[i * 2] = hex_digits[in[i] >> 4];
+		buf[i * 2 + 1] = hex_digits[in[i] & 0xf];
 	}
 
-	buf[j] = '\0';
+	buf[len * 2] = '\0';
 
 	return buf;
 }
@@ -3333,15 +3540,40 @@ char *encode_hex(const unsigned char *in, long len, unsigned char terminator)
 	return encode_hex_own_buf(in, len, terminator, buf);
 }
 
+static inline guint64 load_le64(const unsigned char *p)
+{
+	guint64 v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return GUINT64_FROM_LE(v);
+}
+
+/* Stores the low 56 bits of v, i.e. 8 septets, as 7 octets */
+static inline void store_le56(unsigned char *p, guint64 v)
+{
+	v = GUINT64_TO_LE(v);
+	memcpy(p, &v, 7);
+}
+
+/*
+ * Septets follow the fill bits that align them to a septet boundary
+ * after byte_offset octets of header, LSB first.
+ */
+static inline unsigned int septet_fill_bits(int byte_offset)
+{
+	return (7 - byte_offset % 7) % 7;
+}
+
 unsigned char *unpack_7bit_own_buf(const unsigned char *in, long len,
 					int byte_offset, bool ussd,
 					long max_to_unpack, long *items_written,
 					unsigned char terminator,
 					unsigned char *buf)
 {
-	unsigned char rest = 0;
+	unsigned long bit = septet_fill_bits(byte_offset);
 	unsigned char *out = buf;
-	int bits = 7 - (byte_offset % 7);
+	long n;
 	long i;
 
 	if (len <= 0)
@@ -3351,39 +3583,30 @@ unsigned char *unpack_7bit_own_buf(const unsigned char *in, long len,
 	if (ussd == true)
 		max_to_unpack = len * 8 / 7;
 
-	for (i = 0; (i < len) && ((out-buf) < max_to_unpack); i++) {
-		/* Grab what we have in the current octet */
-		*out = (in[i] & ((1 << bits) - 1)) << (7 - bits);
+	/* Only whole septets */
+	n = (len * 8 - (long) bit) / 7;
 
-		/* Append what we have from the previous octet, if any */
-		*out |= rest;
+	if (n > max_to_unpack)
+		n = max_to_unpack;
 
-		/* Figure out the remainder */
-		rest = (in[i] >> bits) & ((1 << (8-bits)) - 1);
+	/* 8 septets out of one 64-bit load, as long as it fits the input */
+	for (i = 0; i + 8 <= n && bit / 8 + 8 <= (unsigned long) len;
+							i += 8, bit += 56) {
+		guint64 w = load_le64(in + bit / 8) >> (bit % 8);
+		int k;
 
-		/*
-		 * We have the entire character, here we don't increate
-		 * out if this is we started at an offset.  Instead
-		 * we effectively populate variable rest
-		 */
-		if (i != 0 || bits == 7)
-			out++;
+		for (k = 0; k < 8; k++, w >>= 7)
+			*out++ = w & 0x7f;
+	}
 
-		if ((out-buf) == max_to_unpack)
-			break;
+	for (; i < n; i++, bit += 7) {
+		unsigned int c = in[bit / 8] >> (bit % 8);
 
-		/*
-		 * We expected only 1 bit from this octet, means there's 7
-		 * left, take care of them here
-		 */
-		if (bits == 1) {
-			*out = rest;
-			out++;
-			bits = 7;
-			rest = 0;
-		} else {
-			bits = bits - 1;
-		}
+		/* Septet straddles two octets */
+		if (bit % 8 > 1)
+			c |= in[bit / 8 + 1] << (8 - bit % 8);
+
+		*out++ = c & 0x7f;
 	}
 
 	/*
@@ -3399,7 +3622,8 @@ unsigned char *unpack_7bit_own_buf(const unsigned char *in, long len,
 	 * the message ends on an octet boundary with <CR> as the last
 	 * character.
 	 */
-	if (ussd && (((out - buf) % 8) == 0) && (*(out - 1) == '\r'))
+	if (ussd && out > buf && (((out - buf) % 8) == 0) &&
+			(*(out - 1) == '\r'))
 		out = out - 1;
 
 	if (terminator)
@@ -3428,8 +3652,9 @@ unsigned char *pack_7bit_own_buf(const unsigned char *in, long len,
 					unsigned char terminator,
 					unsigned char *buf)
 {
-	int bits = 7 - (byte_offset % 7);
+	unsigned int bits = septet_fill_bits(byte_offset);
 	unsigned char *out = buf;
+	guint64 acc = 0;
 	long i;
 	long total_bits;
 
@@ -3445,29 +3670,34 @@ unsigned char *pack_7bit_own_buf(const unsigned char *in, long len,
 		len = i;
 	}
 
-	total_bits = len * 7;
+	total_bits = len * 7 + bits;
 
-	if (bits != 7) {
-		total_bits += bits;
-		bits = bits - 1;
-		*out = 0;
-	}
+	/*
+	 * acc holds the bits (fewer than 8) not yet written out, starting
+	 * with the zero fill bits.  8 septets make exactly 7 octets.
+	 */
+	for (i = 0; i + 8 <= len; i += 8) {
+		guint64 w = 0;
+		int k;
 
-	for (i = 0; i < len; i++) {
-		if (bits != 7) {
-			*out |= (in[i] & ((1 << (7 - bits)) - 1)) <<
-					(bits + 1);
-			out++;
-		}
+		for (k = 7; k >= 0; k--)
+			w = (w << 7) | (in[i + k] & 0x7f);
 
-		/* This is a no op when bits == 0, lets keep valgrind happy */
-		if (bits != 0)
-			*out = in[i] >> (7 - bits);
+		acc |= w << bits;
+		store_le56(out, acc);
+		out += 7;
+		acc >>= 56;
+	}
 
-		if (bits == 0)
-			bits = 7;
-		else
-			bits = bits - 1;
+	for (; i < len; i++) {
+		acc |= (guint64) (in[i] & 0x7f) << bits;
+		bits += 7;
+
+		if (bits >= 8) {
+			*out++ = acc;
+			acc >>= 8;
+			bits -= 8;
+		}
 	}
 
 	/*
@@ -3479,10 +3709,10 @@ unsigned char *pack_7bit_own_buf(const unsigned char *in, long len,
 	 * <CR> in clause 6.1.1 is identical to the definition of <CR><CR>.
 	 */
 	if (ussd && ((total_bits % 8) == 1))
-		*out |= '\r' << 1;
+		acc |= '\r' << 1;
 
-	if (bits != 7)
-		out++;
+	if (bits)
+		*out++ = acc;
 
 	if (ussd && ((total_bits % 8) == 0) && (in[len - 1] == '\r')) {
 		*out = '\r';
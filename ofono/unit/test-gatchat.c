@@ -0,0 +1,335 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "gatchat.h"
+
+struct test_chat {
+	GAtChat *chat;
+	int fd;
+};
+
+static void test_chat_init(struct test_chat *tc)
+{
+	GIOChannel *io;
+	GAtSyntax *syntax;
+	int sv[2];
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	g_assert(fcntl(sv[1], F_SETFL, O_NONBLOCK) == 0);
+
+	io = g_io_channel_unix_new(sv[0]);
+	g_io_channel_set_close_on_unref(io, TRUE);
+	g_io_channel_set_encoding(io, NULL, NULL);
+	g_io_channel_set_buffered(io, FALSE);
+	g_io_channel_set_flags(io, G_IO_FLAG_NONBLOCK, NULL);
+
+	syntax = g_at_syntax_new_gsm_permissive();
+	tc->chat = g_at_chat_new(io, syntax);
+	g_assert(tc->chat);
+	tc->fd = sv[1];
+
+	g_at_syntax_unref(syntax);
+	g_io_channel_unref(io);
+}
+
+static void test_chat_cleanup(struct test_chat *tc)
+{
+	g_at_chat_unref(tc->chat);
+	close(tc->fd);
+}
+
+/* Writes the data while letting the chat drain the other end */
+static void test_chat_feed(struct test_chat *tc, const char *data, gsize len)
+{
+	while (len > 0) {
+		ssize_t n = write(tc->fd, data, len);
+
+		if (n < 0) {
+			g_assert(errno == EAGAIN);
+			n = 0;
+		}
+
+		data += n;
+		len -= n;
+
+		while (g_main_context_iteration(NULL, FALSE));
+	}
+}
+
+static void test_chat_feed_str(struct test_chat *tc, const char *str)
+{
+	test_chat_feed(tc, str, strlen(str));
+}
+
+static void count_notify(GAtResult *result, gpointer user_data)
+{
+	int *count = user_data;
+
+	*count += 1;
+}
+
+static void test_notify(void)
+{
+	struct test_chat tc;
+	int creg = 0, creg_colon = 0, c = 0, cgreg = 0, ring = 0;
+
+	test_chat_init(&tc);
+
+	g_at_chat_register(tc.chat, "+CREG", count_notify, FALSE, &creg, NULL);
+	g_at_chat_register(tc.chat, "+CREG:", count_notify, FALSE,
+							&creg_colon, NULL);
+	g_at_chat_register(tc.chat, "+C", count_notify, FALSE, &c, NULL);
+	g_at_chat_register(tc.chat, "+CGREG:", count_notify, FALSE,
+							&cgreg, NULL);
+	g_at_chat_register(tc.chat, "RING", count_notify, FALSE, &ring, NULL);
+
+	test_chat_feed_str(&tc, "\r\n+CREG: 1\r\n");
+	g_assert_cmpint(creg, == , 1);
+	g_assert_cmpint(creg_colon, == , 1);
+	g_assert_cmpint(c, == , 1);
+	g_assert_cmpint(cgreg, == , 0);
+
+	test_chat_feed_str(&tc, "\r\n+CGREG: 1\r\n\r\n+CREGX\r\n");
+	g_assert_cmpint(creg, == , 2);
+	g_assert_cmpint(creg_colon, == , 1);
+	g_assert_cmpint(c, == , 3);
+	g_assert_cmpint(cgreg, == , 1);
+
+	test_chat_feed_str(&tc, "\r\nRING\r\n\r\n+XREG: 1\r\n\r\nRIN\r\n");
+	g_assert_cmpint(ring, == , 1);
+	g_assert_cmpint(c, == , 3);
+
+	test_chat_cleanup(&tc);
+}
+
+struct self_unregister {
+	GAtChat *chat;
+	guint id;
+	int count;
+};
+
+static void self_unregister_notify(GAtResult *result, gpointer user_data)
+{
+	struct self_unregister *su = user_data;
+
+	su->count++;
+	g_at_chat_unregister(su->chat, su->id);
+}
+
+static void test_notify_unregister(void)
+{
+	struct test_chat tc;
+	struct self_unregister su;
+	int ciev = 0;
+	guint id;
+
+	test_chat_init(&tc);
+
+	memset(&su, 0, sizeof(su));
+	su.chat = tc.chat;
+	su.id = g_at_chat_register(tc.chat, "+CIEV:", self_unregister_notify,
+							FALSE, &su, NULL);
+	id = g_at_chat_register(tc.chat, "+CIEV: 1", count_notify, FALSE,
+							&ciev, NULL);
+
+	test_chat_feed_str(&tc, "\r\n+CIEV: 1,2\r\n\r\n+CIEV: 1,3\r\n");
+	g_assert_cmpint(su.count, == , 1);
+	g_assert_cmpint(ciev, == , 2);
+
+	g_assert(g_at_chat_unregister(tc.chat, id));
+	g_assert(!g_at_chat_unregister(tc.chat, id));
+
+	/* Both prefixes are gone now, and so must be their index nodes */
+	test_chat_feed_str(&tc, "\r\n+CIEV: 1,4\r\n");
+	g_assert_cmpint(su.count, == , 1);
+	g_assert_cmpint(ciev, == , 2);
+
+	/* Re-registering a pruned prefix works */
+	g_at_chat_register(tc.chat, "+CIEV", count_notify, FALSE, &ciev, NULL);
+	test_chat_feed_str(&tc, "\r\n+CIEV: 1,5\r\n");
+	g_assert_cmpint(ciev, == , 3);
+
+	test_chat_cleanup(&tc);
+}
+
+struct cpbr_data {
+	int count;
+	gboolean ok;
+	gboolean called;
+};
+
+static void cpbr_cb(gboolean ok, GAtResult *result, gpointer user_data)
+{
+	struct cpbr_data *cd = user_data;
+	GAtResultIter iter;
+
+	cd->called = TRUE;
+	cd->ok = ok;
+
+	g_at_result_iter_init(&iter, result);
+
+	while (g_at_result_iter_next(&iter, "+CPBR:")) {
+		const char *number;
+		const char *name;
+		char expected[32];
+		int index;
+
+		g_assert(g_at_result_iter_next_number(&iter, &index));
+		g_assert_cmpint(index, == , cd->count + 1);
+
+		g_assert(g_at_result_iter_next_string(&iter, &number));
+		snprintf(expected, sizeof(expected), "+3581234%04d", index);
+		g_assert_cmpstr(number, == , expected);
+
+		g_assert(g_at_result_iter_skip_next(&iter));
+		g_assert(g_at_result_iter_next_string(&iter, &name));
+		snprintf(expected, sizeof(expected), "Contact %d", index);
+		g_assert_cmpstr(name, == , expected);
+
+		cd->count++;
+	}
+}
+
+static void test_response_lines(void)
+{
+	static const char *cpbr_prefix[] = { "+CPBR:", NULL };
+	struct test_chat tc;
+	struct cpbr_data cd;
+	GString *response = g_string_new(NULL);
+	char buf[64];
+	int round;
+	int i;
+
+	test_chat_init(&tc);
+
+	/* Enough data to wrap the read buffer several times */
+	for (i = 1; i <= 500; i++)
+		g_string_append_printf(response, "\r\n+CPBR: %d,"
+					"\"+3581234%04d\",145,\"Contact %d\"",
+					i, i, i);
+
+	g_string_append(response, "\r\n\r\nOK\r\n");
+
+	/* Second round reuses the line storage */
+	for (round = 0; round < 2; round++) {
+		memset(&cd, 0, sizeof(cd));
+
+		g_assert(g_at_chat_send(tc.chat, "AT+CPBR=1,500", cpbr_prefix,
+						cpbr_cb, &cd, NULL));
+
+		while (g_main_context_iteration(NULL, FALSE));
+		while (read(tc.fd, buf, sizeof(buf)) > 0);
+
+		test_chat_feed(&tc, response->str, response->len);
+
+		g_assert(cd.called);
+		g_assert(cd.ok);
+		g_assert_cmpint(cd.count, == , 500);
+	}
+
+	g_string_free(response, TRUE);
+	test_chat_cleanup(&tc);
+}
+
+static const char *urc_prefixes[] = {
+	"+CREG:", "+CGREG:", "+CEREG:", "+CIEV:", "+CMTI:", "+CMT:",
+	"+CBM:", "+CDS:", "+CDSI:", "+CBMI:", "+CUSD:", "+CSSI:", "+CSSU:",
+	"+CCWA:", "+CLIP:", "+CNAP:", "+COLP:", "+CRING:", "+CTZV:",
+	"+CTZE:", "+CGEV:", "+CSQ:", "+CESQ:", "+CPIN:", "+CUSATP:",
+	"+CUSATEND", "+STKPCI:", "^MODE:", "^RSSI:", "^SIMST:", "^BOOT:",
+	"^DSFLOWRPT:", "*EMRDY:", "*ETZV:", "*EPSB:", "%CSQ:", "%CPI:",
+	"+XCIEV:", "+XREG:", "+XNITZINFO:", "NO CARRIER", "RING",
+};
+
+static const char *urc_lines[] = {
+	"\r\n+CREG: 1,\"1A2B\",\"0001F2C3\",7\r\n",
+	"\r\n+CGREG: 1,\"1A2B\",\"0001F2C3\",7\r\n",
+	"\r\n+CIEV: 2,4\r\n",
+	"\r\n^RSSI: 17\r\n",
+	"\r\n+XCIEV: 3,2\r\n",
+	"\r\n+CEREG: 1,\"1A2B\",\"0001F2C3\",7\r\n",
+	"\r\n^DSFLOWRPT: 0000001D,00000000,00000000\r\n",
+	"\r\n+UNKNOWN: 42\r\n",
+};
+
+static void test_notify_perf(void)
+{
+	struct test_chat tc;
+	GString *stream = g_string_new(NULL);
+	int count = 0;
+	int expected = 0;
+	int rounds = g_test_perf() ? 20000 : 200;
+	unsigned int i;
+	int n;
+	double elapsed;
+
+	test_chat_init(&tc);
+
+	for (i = 0; i < G_N_ELEMENTS(urc_prefixes); i++)
+		g_at_chat_register(tc.chat, urc_prefixes[i], count_notify,
+							FALSE, &count, NULL);
+
+	for (i = 0; i < G_N_ELEMENTS(urc_lines); i++) {
+		g_string_append(stream, urc_lines[i]);
+
+		if (!strstr(urc_lines[i], "UNKNOWN"))
+			expected++;
+	}
+
+	g_test_timer_start();
+
+	for (n = 0; n < rounds; n++)
+		test_chat_feed(&tc, stream->str, stream->len);
+
+	elapsed = g_test_timer_elapsed();
+
+	g_assert_cmpint(count, == , expected * rounds);
+
+	g_test_maximized_result(G_N_ELEMENTS(urc_lines) * rounds / elapsed,
+				"%.0f URCs/s with %u registrations",
+				G_N_ELEMENTS(urc_lines) * rounds / elapsed,
+				(unsigned int) G_N_ELEMENTS(urc_prefixes));
+
+	g_string_free(stream, TRUE);
+	test_chat_cleanup(&tc);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testgatchat/notify", test_notify);
+	g_test_add_func("/testgatchat/notify_unregister",
+						test_notify_unregister);
+	g_test_add_func("/testgatchat/notify_perf", test_notify_perf);
+	g_test_add_func("/testgatchat/response_lines", test_response_lines);
+
+	return g_test_run();
+}
@@ -0,0 +1,462 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <glib.h>
+
+#include <ofono/types.h>
+#include <gril.h>
+
+#define TEST_UNSOL	1042
+#define TEST_REQ	61
+
+struct test_ril {
+	GRil *ril;
+	int fd;
+	int count;
+	gsize last_len;
+	gboolean content_ok;
+	gboolean disconnected;
+};
+
+static void test_ril_disconnect(gpointer user_data)
+{
+	struct test_ril *tr = user_data;
+
+	tr->disconnected = TRUE;
+}
+
+static void test_ril_init(struct test_ril *tr)
+{
+	struct sockaddr_un addr;
+	int sk;
+
+	memset(tr, 0, sizeof(*tr));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "/tmp/test-gril-%d",
+							(int) getpid());
+	unlink(addr.sun_path);
+
+	sk = socket(AF_UNIX, SOCK_STREAM, 0);
+	g_assert(sk >= 0);
+	g_assert(bind(sk, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+	g_assert(listen(sk, 1) == 0);
+
+	tr->ril = g_ril_new(addr.sun_path, OFONO_RIL_VENDOR_AOSP);
+	g_assert(tr->ril);
+	g_ril_set_disconnect_function(tr->ril, test_ril_disconnect, tr);
+
+	tr->fd = accept(sk, NULL, NULL);
+	g_assert(tr->fd >= 0);
+	g_assert(fcntl(tr->fd, F_SETFL, O_NONBLOCK) == 0);
+
+	close(sk);
+	unlink(addr.sun_path);
+}
+
+static void test_ril_cleanup(struct test_ril *tr)
+{
+	g_ril_unref(tr->ril);
+	close(tr->fd);
+}
+
+/* Writes the data in chunks, letting gril drain the other end */
+static void test_ril_feed(struct test_ril *tr, const guchar *data, gsize len,
+				gsize chunk)
+{
+	while (len > 0) {
+		ssize_t n = write(tr->fd, data, MIN(len, chunk));
+
+		if (n < 0) {
+			g_assert(errno == EAGAIN);
+			n = 0;
+		}
+
+		data += n;
+		len -= n;
+
+		while (g_main_context_iteration(NULL, FALSE));
+	}
+}
+
+static guchar test_byte(gsize i)
+{
+	return (i * 13) ^ (i >> 8);
+}
+
+static GByteArray *unsol_parcel(int req, gsize data_len)
+{
+	GByteArray *parcel = g_byte_array_new();
+	guint32 plen = htonl(8 + data_len);
+	int32_t header[2] = { 1, req };
+	gsize i;
+
+	g_byte_array_append(parcel, (void *) &plen, 4);
+	g_byte_array_append(parcel, (void *) header, sizeof(header));
+
+	for (i = 0; i < data_len; i++) {
+		guchar c = test_byte(i);
+
+		g_byte_array_append(parcel, &c, 1);
+	}
+
+	return parcel;
+}
+
+static void unsol_notify(struct ril_msg *message, gpointer user_data)
+{
+	struct test_ril *tr = user_data;
+	const guchar *buf = (const guchar *) message->buf;
+	gsize i;
+
+	g_assert(message->unsolicited);
+	g_assert_cmpint(message->req, == , TEST_UNSOL);
+
+	tr->count++;
+	tr->last_len = message->buf_len;
+	tr->content_ok = TRUE;
+
+	for (i = 0; i < message->buf_len; i++)
+		if (buf[i] != test_byte(i))
+			tr->content_ok = FALSE;
+}
+
+static void test_unsol(gsize data_len, gsize chunk)
+{
+	struct test_ril tr;
+	GByteArray *parcel;
+
+	test_ril_init(&tr);
+	g_ril_register(tr.ril, TEST_UNSOL, unsol_notify, &tr);
+
+	parcel = unsol_parcel(TEST_UNSOL, data_len);
+	test_ril_feed(&tr, parcel->data, parcel->len, chunk);
+
+	g_assert_cmpint(tr.count, == , 1);
+	g_assert_cmpint(tr.last_len, == , data_len);
+	g_assert(tr.content_ok);
+	g_assert(!tr.disconnected);
+
+	g_byte_array_free(parcel, TRUE);
+	test_ril_cleanup(&tr);
+}
+
+static void test_small(void)
+{
+	test_unsol(16, 3);
+}
+
+static void test_large(void)
+{
+	/* Way bigger than GRIL_BUFFER_SIZE */
+	test_unsol(40000, 4096);
+	test_unsol(40000, 1);
+}
+
+static void test_stream(void)
+{
+	struct test_ril tr;
+	GByteArray *stream = g_byte_array_new();
+	int i;
+
+	test_ril_init(&tr);
+	g_ril_register(tr.ril, TEST_UNSOL, unsol_notify, &tr);
+
+	/* Odd sizes, so that the records end up crossing the buffer end */
+	for (i = 0; i < 50; i++) {
+		GByteArray *parcel = unsol_parcel(TEST_UNSOL, 1000 + i * 37);
+
+		g_byte_array_append(stream, parcel->data, parcel->len);
+		g_byte_array_free(parcel, TRUE);
+	}
+
+	test_ril_feed(&tr, stream->data, stream->len, 3001);
+
+	g_assert_cmpint(tr.count, == , 50);
+	g_assert_cmpint(tr.last_len, == , 1000 + 49 * 37);
+	g_assert(tr.content_ok);
+
+	g_byte_array_free(stream, TRUE);
+	test_ril_cleanup(&tr);
+}
+
+struct test_response {
+	int count;
+	int order[8];
+};
+
+static void response_cb(struct ril_msg *message, gpointer user_data)
+{
+	struct test_response *tr = user_data;
+
+	g_assert(!message->unsolicited);
+	g_assert_cmpint(message->req, == , TEST_REQ);
+	g_assert_cmpint(message->error, == , 0);
+	g_assert_cmpint(message->buf_len, == , 4);
+
+	tr->order[tr->count++] = message->serial_no;
+}
+
+/* Reads one request, returns its serial */
+static int test_ril_read_request(struct test_ril *tr)
+{
+	guint32 header[3];
+
+	while (read(tr->fd, header, sizeof(header)) != sizeof(header))
+		g_main_context_iteration(NULL, FALSE);
+
+	g_assert_cmpint(ntohl(header[0]), == , 8);
+	g_assert_cmpint(header[1], == , TEST_REQ);
+
+	return header[2];
+}
+
+static void test_ril_respond(struct test_ril *tr, int serial)
+{
+	guint32 plen = htonl(16);
+	int32_t response[4] = { 0, serial, 0, 42 };
+
+	g_assert(write(tr->fd, &plen, 4) == 4);
+	g_assert(write(tr->fd, response, sizeof(response)) ==
+							sizeof(response));
+
+	while (g_main_context_iteration(NULL, FALSE));
+}
+
+static void test_response(void)
+{
+	struct test_ril tr;
+	struct test_response resp;
+	struct ril_request_stats stats;
+	int serial[4];
+	int i;
+
+	test_ril_init(&tr);
+	memset(&resp, 0, sizeof(resp));
+
+	g_assert(!g_ril_get_request_stats(tr.ril, TEST_REQ, &stats));
+
+	/*
+	 * Each request goes out as soon as it is queued, so several of them
+	 * are in flight at once. Answer them out of order.
+	 */
+	for (i = 0; i < 4; i++) {
+		g_assert(g_ril_send(tr.ril, TEST_REQ, NULL, response_cb,
+					&resp, NULL) > 0);
+		serial[i] = test_ril_read_request(&tr);
+	}
+
+	test_ril_respond(&tr, serial[1]);
+	test_ril_respond(&tr, serial[0]);
+	test_ril_respond(&tr, serial[3]);
+	test_ril_respond(&tr, serial[2]);
+
+	/* Unknown serial is ignored */
+	test_ril_respond(&tr, 1000);
+
+	g_assert_cmpint(resp.count, == , 4);
+	g_assert_cmpint(resp.order[0], == , serial[1]);
+	g_assert_cmpint(resp.order[1], == , serial[0]);
+	g_assert_cmpint(resp.order[2], == , serial[3]);
+	g_assert_cmpint(resp.order[3], == , serial[2]);
+
+	g_assert(g_ril_get_request_stats(tr.ril, TEST_REQ, &stats));
+	g_assert_cmpint(stats.count, == , 4);
+	g_assert(stats.min_us <= stats.max_us);
+	g_assert(stats.total_us >= stats.max_us);
+
+	g_ril_reset_request_stats(tr.ril);
+	g_assert(!g_ril_get_request_stats(tr.ril, TEST_REQ, &stats));
+
+	test_ril_cleanup(&tr);
+}
+
+static void test_cancel(void)
+{
+	struct test_ril tr;
+	struct test_response resp;
+	GRil *clone;
+	int serial;
+
+	test_ril_init(&tr);
+	memset(&resp, 0, sizeof(resp));
+	clone = g_ril_clone(tr.ril);
+
+	g_assert(g_ril_send(clone, TEST_REQ, NULL, response_cb, &resp, NULL));
+	g_assert(g_ril_send(clone, TEST_REQ, NULL, response_cb, &resp, NULL));
+	serial = test_ril_read_request(&tr);
+
+	/* One request is out already, the other one is dropped */
+	g_ril_unref(clone);
+
+	test_ril_respond(&tr, serial);
+	g_assert_cmpint(resp.count, == , 0);
+
+	g_assert(g_ril_send(tr.ril, TEST_REQ, NULL, response_cb, &resp,
+								NULL));
+	serial = test_ril_read_request(&tr);
+	test_ril_respond(&tr, serial);
+	g_assert_cmpint(resp.count, == , 1);
+
+	test_ril_cleanup(&tr);
+}
+
+static void test_oversized(void)
+{
+	struct test_ril tr;
+	GByteArray *parcel;
+
+	test_ril_init(&tr);
+	g_ril_register(tr.ril, TEST_UNSOL, unsol_notify, &tr);
+	g_assert(g_ril_set_max_parcel_size(tr.ril, 1024));
+
+	/* Dropped, but the connection survives */
+	parcel = unsol_parcel(TEST_UNSOL, 20000);
+	test_ril_feed(&tr, parcel->data, parcel->len, 4096);
+	g_byte_array_free(parcel, TRUE);
+
+	g_assert_cmpint(tr.count, == , 0);
+	g_assert(!tr.disconnected);
+
+	parcel = unsol_parcel(TEST_UNSOL, 100);
+	test_ril_feed(&tr, parcel->data, parcel->len, 4096);
+	g_byte_array_free(parcel, TRUE);
+
+	g_assert_cmpint(tr.count, == , 1);
+	g_assert_cmpint(tr.last_len, == , 100);
+	g_assert(tr.content_ok);
+
+	test_ril_cleanup(&tr);
+}
+
+static const char *parcel_strings[] = {
+	"", "a", "internet", "\xc3\xa4\x62\x63\xe2\x82\xac",
+	"x\xf0\x9f\x98\x80y", "3G",
+};
+
+static void test_parcel_string(void)
+{
+	struct parcel p;
+	unsigned int i;
+	char *str;
+
+	parcel_init_sized(&p, 8);
+
+	for (i = 0; i < G_N_ELEMENTS(parcel_strings); i++)
+		g_assert(parcel_w_string(&p, parcel_strings[i]) == 0);
+
+	g_assert(parcel_w_string(&p, NULL) == 0);
+
+	/* Invalid UTF-8 is sent as a null string */
+	g_assert(parcel_w_string(&p, "\xc0\x80") < 0);
+	parcel_w_int32(&p, 42);
+
+	g_assert_cmpint(p.size % 4, == , 0);
+	g_assert(p.size <= p.capacity);
+	p.offset = 0;
+
+	for (i = 0; i < G_N_ELEMENTS(parcel_strings); i++) {
+		str = parcel_r_string(&p);
+		g_assert_cmpstr(str, == , parcel_strings[i]);
+		g_free(str);
+	}
+
+	g_assert(parcel_r_string(&p) == NULL);
+	g_assert(parcel_r_string(&p) == NULL);
+	g_assert_cmpint(parcel_r_int32(&p), == , 42);
+	g_assert(!p.malformed);
+
+	parcel_free(&p);
+}
+
+static void test_parcel_view(void)
+{
+	struct parcel p;
+	struct parcel_str_view view;
+	char buf[8];
+
+	parcel_init(&p);
+	parcel_w_string(&p, "current");
+	parcel_w_string(&p, "\xc3\xa4\x62\x63\xe2\x82\xac");
+	parcel_w_string(&p, NULL);
+	p.offset = 0;
+
+	g_assert(parcel_r_string_view(&p, &view) == 0);
+	g_assert_cmpint(view.len, == , 7);
+	g_assert_cmpint(parcel_str_view_cmp(&view, "current"), == , 0);
+	g_assert_cmpint(parcel_str_view_cmp(&view, "forbidden"), < , 0);
+	g_assert_cmpint(parcel_str_view_cmp(&view, "curren"), > , 0);
+	g_assert_cmpint(parcel_str_view_cmp(&view, "current!"), < , 0);
+	g_assert_cmpint(parcel_str_view_cmp(&view, NULL), > , 0);
+
+	/* Truncated to what fits, the full length is returned */
+	g_assert_cmpint(parcel_str_view_to_utf8(&view, buf, 5), == , 7);
+	g_assert_cmpstr(buf, == , "curr");
+
+	g_assert(parcel_r_string_view(&p, &view) == 0);
+	g_assert_cmpint(view.len, == , 4);
+	g_assert_cmpint(parcel_str_view_cmp(&view,
+				"\xc3\xa4\x62\x63\xe2\x82\xac"), == , 0);
+	g_assert_cmpint(parcel_str_view_cmp(&view, "\xc3\xa4\x62\x63"),
+								> , 0);
+
+	/* Only whole characters */
+	g_assert_cmpint(parcel_str_view_to_utf8(&view, buf, 7), == , 7);
+	g_assert_cmpstr(buf, == , "\xc3\xa4\x62\x63");
+
+	g_assert(parcel_r_string_view(&p, &view) == 0);
+	g_assert(view.data == NULL);
+	g_assert_cmpint(parcel_str_view_cmp(&view, NULL), == , 0);
+	g_assert_cmpint(parcel_str_view_cmp(&view, ""), < , 0);
+	g_assert(parcel_str_view_to_utf8(&view, buf, sizeof(buf)) < 0);
+
+	/* Nothing left */
+	g_assert(parcel_r_string_view(&p, &view) < 0);
+	g_assert(p.malformed);
+
+	parcel_free(&p);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testgril/small", test_small);
+	g_test_add_func("/testgril/large", test_large);
+	g_test_add_func("/testgril/stream", test_stream);
+	g_test_add_func("/testgril/oversized", test_oversized);
+	g_test_add_func("/testgril/response", test_response);
+	g_test_add_func("/testgril/cancel", test_cancel);
+	g_test_add_func("/testgril/parcel_string", test_parcel_string);
+	g_test_add_func("/testgril/parcel_view", test_parcel_view);
+
+	return g_test_run();
+}
@@ -0,0 +1,477 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "crc-ccitt.h"
+#include "gathdlc.h"
+
+#define MAX_FRAME 1502
+
+struct test_link {
+	GAtHDLC *tx;
+	GAtHDLC *rx;
+	GQueue *expected;
+	unsigned int received;
+	gsize received_bytes;
+	int fd;			/* Raw end, for replaying streams */
+};
+
+static GAtHDLC *test_hdlc_new(int fd)
+{
+	GIOChannel *io = g_io_channel_unix_new(fd);
+	GAtHDLC *hdlc;
+
+	g_io_channel_set_close_on_unref(io, TRUE);
+	hdlc = g_at_hdlc_new(io);
+	g_assert(hdlc);
+	g_io_channel_unref(io);
+
+	return hdlc;
+}
+
+static void test_link_receive(const unsigned char *data, gsize size,
+							gpointer user_data)
+{
+	struct test_link *link = user_data;
+	GByteArray *frame = g_queue_pop_head(link->expected);
+
+	if (frame) {
+		g_assert_cmpuint(size, == , frame->len);
+		g_assert(!memcmp(data, frame->data, size));
+		g_byte_array_free(frame, TRUE);
+	}
+
+	link->received++;
+	link->received_bytes += size;
+}
+
+/* tx -> rx over a socket pair */
+static void test_link_init(struct test_link *link)
+{
+	int sv[2];
+
+	memset(link, 0, sizeof(*link));
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+	link->tx = test_hdlc_new(sv[0]);
+	link->rx = test_hdlc_new(sv[1]);
+	link->expected = g_queue_new();
+	link->fd = -1;
+
+	g_at_hdlc_set_receive(link->rx, test_link_receive, link);
+}
+
+/* Raw stream -> rx over a socket pair */
+static void test_link_init_raw(struct test_link *link)
+{
+	int sv[2];
+
+	memset(link, 0, sizeof(*link));
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	g_assert(fcntl(sv[0], F_SETFL, O_NONBLOCK) == 0);
+
+	link->rx = test_hdlc_new(sv[1]);
+	link->expected = g_queue_new();
+	link->fd = sv[0];
+
+	g_at_hdlc_set_receive(link->rx, test_link_receive, link);
+}
+
+static void test_link_cleanup(struct test_link *link)
+{
+	GByteArray *frame;
+
+	while ((frame = g_queue_pop_head(link->expected)))
+		g_byte_array_free(frame, TRUE);
+
+	g_queue_free(link->expected);
+	g_at_hdlc_unref(link->tx);
+	g_at_hdlc_unref(link->rx);
+
+	if (link->fd >= 0)
+		close(link->fd);
+}
+
+static void test_link_flush(void)
+{
+	while (g_main_context_iteration(NULL, FALSE));
+}
+
+static void test_link_feed(struct test_link *link, const guint8 *data,
+								gsize len)
+{
+	while (len > 0) {
+		ssize_t n = write(link->fd, data, len);
+
+		if (n < 0) {
+			g_assert(errno == EAGAIN);
+			n = 0;
+		}
+
+		data += n;
+		len -= n;
+
+		test_link_flush();
+	}
+}
+
+static GByteArray *random_frame(guint len, gboolean specials)
+{
+	GByteArray *frame = g_byte_array_sized_new(len);
+	guint i;
+
+	for (i = 0; i < len; i++) {
+		guint8 c = g_random_int_range(0, 256);
+
+		/* Make sure there's plenty of bytes that need escaping */
+		if (specials && g_random_int_range(0, 16) == 0)
+			c = g_random_boolean() ? 0x7e : 0x7d;
+
+		g_byte_array_append(frame, &c, 1);
+	}
+
+	return frame;
+}
+
+static void test_crc(void)
+{
+	guint8 buf[256];
+	guint off, len, i;
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = g_random_int_range(0, 256);
+
+	for (off = 0; off < 8; off++) {
+		for (len = 0; len + off <= sizeof(buf); len++) {
+			guint16 fcs = 0xffff;
+
+			for (i = 0; i < len; i++)
+				fcs = crc_ccitt_byte(fcs, buf[off + i]);
+
+			g_assert_cmpuint(crc_ccitt(0xffff, buf + off, len),
+								== , fcs);
+		}
+	}
+}
+
+static void test_decode_accm(guint32 accm)
+{
+	struct test_link link;
+	unsigned int i;
+
+	test_link_init(&link);
+	g_at_hdlc_set_xmit_accm(link.tx, accm);
+	g_at_hdlc_set_recv_accm(link.rx, accm);
+
+	for (i = 0; i < 200; i++) {
+		GByteArray *frame = random_frame(1 + i * 7 % MAX_FRAME, i & 1);
+
+		g_queue_push_tail(link.expected, frame);
+		g_assert(g_at_hdlc_send(link.tx, frame->data, frame->len));
+
+		test_link_flush();
+	}
+
+	g_assert_cmpuint(link.received, == , 200);
+	g_assert(g_queue_is_empty(link.expected));
+
+	test_link_cleanup(&link);
+}
+
+static void test_decode(void)
+{
+	/* Default ACCM, all control characters escaped */
+	test_decode_accm(~0U);
+
+	/* Negotiated ACCM, control characters in the clear */
+	test_decode_accm(0);
+}
+
+static void test_decode_dropped_ctrl(void)
+{
+	/*
+	 * Unescaped characters in the receive ACCM are dropped, as
+	 * inserted by DCEs for flow control.  The frame is 0x01 0x02 0x03
+	 * with a 0x11 (XON) injected in the middle.
+	 */
+	static const guint8 stream[] = {
+		0x7e, 0x01, 0x11, 0x02, 0x03, 0x3b, 0x9d, 0x7e
+	};
+	static const guint8 payload[] = { 0x01, 0x02, 0x03 };
+	struct test_link link;
+	GByteArray *frame = g_byte_array_new();
+
+	test_link_init_raw(&link);
+	g_byte_array_append(frame, payload, sizeof(payload));
+	g_queue_push_tail(link.expected, frame);
+
+	test_link_feed(&link, stream, sizeof(stream));
+	g_assert_cmpuint(link.received, == , 1);
+
+	test_link_cleanup(&link);
+}
+
+static void test_encode_batch_accm(guint32 accm)
+{
+	struct test_link link;
+	struct iovec frames[32];
+	unsigned int i;
+
+	test_link_init(&link);
+	g_at_hdlc_set_xmit_accm(link.tx, accm);
+	g_at_hdlc_set_recv_accm(link.rx, accm);
+
+	for (i = 0; i < G_N_ELEMENTS(frames); i++) {
+		GByteArray *frame = random_frame(1 + i * 97 % MAX_FRAME,
+							i % 3 == 0);
+
+		g_queue_push_tail(link.expected, frame);
+		frames[i].iov_base = frame->data;
+		frames[i].iov_len = frame->len;
+	}
+
+	g_assert_cmpint(g_at_hdlc_send_batch(link.tx, frames,
+				G_N_ELEMENTS(frames)), == , G_N_ELEMENTS(frames));
+
+	test_link_flush();
+
+	g_assert_cmpuint(link.received, == , G_N_ELEMENTS(frames));
+	g_assert(g_queue_is_empty(link.expected));
+
+	test_link_cleanup(&link);
+}
+
+static void test_encode_batch(void)
+{
+	test_encode_batch_accm(~0U);
+	test_encode_batch_accm(0);
+}
+
+static void writable_cb(gpointer user_data)
+{
+	int *count = user_data;
+
+	*count += 1;
+}
+
+static void test_congestion(void)
+{
+	struct test_link link;
+	GByteArray *frame = random_frame(MAX_FRAME, TRUE);
+	struct iovec iov;
+	unsigned int queued = 0;
+	int writable = 0;
+
+	test_link_init(&link);
+	g_at_hdlc_set_writable_function(link.tx, writable_cb, &writable);
+
+	iov.iov_base = frame->data;
+	iov.iov_len = frame->len;
+
+	/* Without the main loop running nothing gets written out */
+	while (g_at_hdlc_send_batch(link.tx, &iov, 1) == 1)
+		queued++;
+
+	g_assert_cmpuint(queued, > , 0);
+	g_assert(g_at_hdlc_is_congested(link.tx));
+	g_assert_cmpint(writable, == , 0);
+
+	/* Nothing that was accepted gets lost */
+	test_link_flush();
+
+	g_assert_cmpint(writable, == , 1);
+	g_assert(!g_at_hdlc_is_congested(link.tx));
+	g_assert_cmpuint(link.received, == , queued);
+	g_assert_cmpuint(link.received_bytes, == , queued * frame->len);
+
+	g_byte_array_free(frame, TRUE);
+	test_link_cleanup(&link);
+}
+
+static void test_encode_perf(void)
+{
+	struct test_link link;
+	struct iovec frames[16];
+	GByteArray *frame = random_frame(MAX_FRAME, FALSE);
+	int rounds = g_test_perf() ? 20000 : 20;
+	double elapsed;
+	int i;
+
+	test_link_init(&link);
+	g_at_hdlc_set_xmit_accm(link.tx, 0);
+	g_at_hdlc_set_recv_accm(link.rx, 0);
+
+	for (i = 0; i < (int) G_N_ELEMENTS(frames); i++) {
+		frames[i].iov_base = frame->data;
+		frames[i].iov_len = frame->len;
+	}
+
+	g_test_timer_start();
+
+	for (i = 0; i < rounds; i++) {
+		g_assert_cmpint(g_at_hdlc_send_batch(link.tx, frames,
+				G_N_ELEMENTS(frames)), == , G_N_ELEMENTS(frames));
+		test_link_flush();
+	}
+
+	elapsed = g_test_timer_elapsed();
+
+	g_assert_cmpuint(link.received, == , rounds * G_N_ELEMENTS(frames));
+
+	g_test_maximized_result(link.received_bytes / elapsed / 1e6,
+				"%.1f MB/s encoded and decoded",
+				link.received_bytes / elapsed / 1e6);
+
+	g_byte_array_free(frame, TRUE);
+	test_link_cleanup(&link);
+}
+
+/*
+ * Reads a file written by g_at_hdlc_set_recording() and returns the
+ * concatenated data of the records in the given direction
+ * (0x01 - sent, 0x02 - received)
+ */
+static GByteArray *load_recording(const char *filename, guint8 dir)
+{
+	GByteArray *stream = g_byte_array_new();
+	gchar *contents;
+	gsize size;
+	gsize pos = 0;
+
+	g_assert(g_file_get_contents(filename, &contents, &size, NULL));
+
+	while (pos + 8 <= size) {
+		guint16 len;
+
+		g_assert_cmpuint(contents[pos], == , 0x07);
+
+		memcpy(&len, contents + pos + 6, sizeof(len));
+		len = ntohs(len);
+		g_assert(pos + 8 + len <= size);
+
+		if ((guint8) contents[pos + 5] == dir)
+			g_byte_array_append(stream,
+					(guint8 *) contents + pos + 8, len);
+
+		pos += 8 + len;
+	}
+
+	g_free(contents);
+
+	return stream;
+}
+
+static void test_replay_perf(void)
+{
+	const char *recording = getenv("TEST_HDLC_RECORDING");
+	char *tmpfile = NULL;
+	struct test_link link;
+	GByteArray *stream;
+	int rounds = g_test_perf() ? 200 : 2;
+	unsigned int frames = 0;
+	double elapsed;
+	int i;
+
+	if (recording == NULL) {
+		/* Record a bulk transfer of our own */
+		int fd;
+
+		tmpfile = g_strdup("/tmp/test-hdlc-XXXXXX");
+		fd = mkstemp(tmpfile);
+		g_assert(fd >= 0);
+		close(fd);
+
+		test_link_init(&link);
+		g_at_hdlc_set_recording(link.tx, tmpfile);
+		g_at_hdlc_set_xmit_accm(link.tx, 0);
+		g_at_hdlc_set_recv_accm(link.rx, 0);
+
+		for (i = 0; i < 100; i++) {
+			GByteArray *frame = random_frame(MAX_FRAME, FALSE);
+
+			g_assert(g_at_hdlc_send(link.tx, frame->data,
+								frame->len));
+			g_byte_array_free(frame, TRUE);
+			test_link_flush();
+		}
+
+		g_assert_cmpuint(link.received, == , 100);
+		frames = link.received;
+
+		g_at_hdlc_set_recording(link.tx, NULL);
+		test_link_cleanup(&link);
+
+		stream = load_recording(tmpfile, 0x01);
+	} else
+		stream = load_recording(recording, 0x02);
+
+	test_link_init_raw(&link);
+	g_at_hdlc_set_recv_accm(link.rx, 0);
+
+	g_test_timer_start();
+
+	for (i = 0; i < rounds; i++)
+		test_link_feed(&link, stream->data, stream->len);
+
+	elapsed = g_test_timer_elapsed();
+
+	if (frames)
+		g_assert_cmpuint(link.received, == , frames * rounds);
+
+	g_test_maximized_result(stream->len * rounds / elapsed / 1e6,
+				"%.1f MB/s decoded, %u frames",
+				stream->len * rounds / elapsed / 1e6,
+				link.received);
+
+	test_link_cleanup(&link);
+	g_byte_array_free(stream, TRUE);
+
+	if (tmpfile) {
+		unlink(tmpfile);
+		g_free(tmpfile);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testhdlc/crc", test_crc);
+	g_test_add_func("/testhdlc/decode", test_decode);
+	g_test_add_func("/testhdlc/decode_dropped_ctrl",
+						test_decode_dropped_ctrl);
+	g_test_add_func("/testhdlc/encode_batch", test_encode_batch);
+	g_test_add_func("/testhdlc/congestion", test_congestion);
+	g_test_add_func("/testhdlc/encode_perf", test_encode_perf);
+	g_test_add_func("/testhdlc/replay_perf", test_replay_perf);
+
+	return g_test_run();
+}
@@ -0,0 +1,399 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "storage.h"
+#include "journal.h"
+
+#define TEST_DIR_FMT "/tmp/test-journal-%d"
+
+static char *test_dir;
+static char *test_journal;
+
+static int rmdir_r(const char *path)
+{
+	DIR *d = opendir(path);
+
+	if (d) {
+		const struct dirent *p;
+		int r = 0;
+
+		while (!r && (p = readdir(d))) {
+			char *buf;
+			struct stat st;
+
+			if (!strcmp(p->d_name, ".") ||
+						!strcmp(p->d_name, "..")) {
+				continue;
+			}
+
+			buf = g_strdup_printf("%s/%s", path, p->d_name);
+			if (!stat(buf, &st)) {
+				r =  S_ISDIR(st.st_mode) ? rmdir_r(buf) :
+								unlink(buf);
+			}
+			g_free(buf);
+		}
+		closedir(d);
+		return r ? r : rmdir(path);
+	} else {
+		return -1;
+	}
+}
+
+static void test_init(void)
+{
+	test_dir = g_strdup_printf(TEST_DIR_FMT, (int) getpid());
+	test_journal = g_build_filename(test_dir, "test.journal", NULL);
+	rmdir_r(test_dir);
+}
+
+static void test_cleanup(void)
+{
+	rmdir_r(test_dir);
+	g_free(test_journal);
+	g_free(test_dir);
+}
+
+static void fill_value(unsigned char *value, unsigned int len, int seed)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+		value[i] = seed + i * 13;
+}
+
+static void check_value(struct journal *journal, const char *key,
+				unsigned int len, int seed)
+{
+	unsigned char expected[1024];
+	const unsigned char *data;
+	unsigned int data_len = 0;
+
+	g_assert(len <= sizeof(expected));
+	fill_value(expected, len, seed);
+
+	data = journal_lookup(journal, key, &data_len, NULL);
+	g_assert(data);
+	g_assert_cmpuint(data_len, == , len);
+	g_assert(memcmp(data, expected, len) == 0);
+}
+
+static void store_value(struct journal *journal, const char *key,
+				unsigned int len, int seed)
+{
+	unsigned char value[1024];
+
+	g_assert(len <= sizeof(value));
+	fill_value(value, len, seed);
+	g_assert(journal_store(journal, key, value, len));
+}
+
+static off_t file_size(const char *path)
+{
+	struct stat st;
+
+	g_assert(stat(path, &st) == 0);
+
+	return st.st_size;
+}
+
+static void test_basic(void)
+{
+	struct journal *journal;
+	struct journal *other;
+	time_t ts = 0;
+
+	test_init();
+
+	journal = journal_open(test_journal);
+	g_assert(journal);
+	g_assert(!journal_lookup(journal, "a/1", NULL, NULL));
+	g_assert(!journal_store(journal, "a/1", NULL, 0));
+	g_assert(!journal_store(journal, "", (unsigned char *) "x", 1));
+
+	store_value(journal, "a/1", 48, 1);
+	store_value(journal, "a/2", 49, 2);
+	store_value(journal, "b/1", 50, 3);
+	check_value(journal, "a/1", 48, 1);
+	check_value(journal, "a/2", 49, 2);
+
+	g_assert(journal_lookup(journal, "a/1", NULL, &ts));
+	g_assert(ts != 0 && ts <= time(NULL));
+
+	/* The newest record wins */
+	store_value(journal, "a/1", 300, 4);
+	check_value(journal, "a/1", 300, 4);
+
+	g_assert(journal_remove(journal, "a/2"));
+	g_assert(journal_remove(journal, "a/2"));
+	g_assert(!journal_lookup(journal, "a/2", NULL, NULL));
+
+	/* Users of the same path share the journal */
+	other = journal_open(test_journal);
+	g_assert(other == journal);
+	journal_unref(other);
+	journal_unref(journal);
+
+	/* Everything survives a reopen */
+	journal = journal_open(test_journal);
+	g_assert(journal);
+	check_value(journal, "a/1", 300, 4);
+	check_value(journal, "b/1", 50, 3);
+	g_assert(!journal_lookup(journal, "a/2", NULL, NULL));
+
+	g_assert(journal_remove_prefix(journal, "a/"));
+	g_assert(!journal_lookup(journal, "a/1", NULL, NULL));
+	check_value(journal, "b/1", 50, 3);
+	journal_unref(journal);
+
+	journal = journal_open(test_journal);
+	g_assert(!journal_lookup(journal, "a/1", NULL, NULL));
+	check_value(journal, "b/1", 50, 3);
+
+	/* Once nothing is left the file shrinks back to its header */
+	g_assert(journal_remove(journal, "b/1"));
+	g_assert_cmpint(file_size(test_journal), == , 8);
+	journal_unref(journal);
+
+	test_cleanup();
+}
+
+static void collect_key(const char *key, const unsigned char *data,
+			unsigned int len, time_t ts, void *user_data)
+{
+	GString *keys = user_data;
+
+	g_string_append(keys, key);
+	g_string_append(keys, " ");
+}
+
+static void test_foreach(void)
+{
+	struct journal *journal;
+	GString *keys = g_string_new(NULL);
+
+	test_init();
+
+	journal = journal_open(test_journal);
+	store_value(journal, "tx/10-0-A/001", 10, 1);
+	store_value(journal, "tx/2-0-B/000", 10, 1);
+	store_value(journal, "tx/10-0-A/000", 10, 1);
+	store_value(journal, "rx/1", 10, 1);
+	store_value(journal, "tx/9-0-C/000", 10, 1);
+
+	journal_foreach(journal, "tx/", collect_key, keys);
+	g_assert_cmpstr(keys->str, == , "tx/2-0-B/000 tx/9-0-C/000 "
+					"tx/10-0-A/000 tx/10-0-A/001 ");
+
+	g_assert(journal_rename_prefix(journal, "tx/10-0-A/", "tx/0-0-A/"));
+	g_assert(journal_rename_prefix(journal, "tx/9-0-C/", "tx/1-0-C/"));
+	journal_unref(journal);
+
+	journal = journal_open(test_journal);
+	g_string_truncate(keys, 0);
+	journal_foreach(journal, "tx/", collect_key, keys);
+	g_assert_cmpstr(keys->str, == , "tx/0-0-A/000 tx/0-0-A/001 "
+					"tx/1-0-C/000 tx/2-0-B/000 ");
+	check_value(journal, "tx/0-0-A/001", 10, 1);
+	journal_unref(journal);
+
+	g_string_free(keys, TRUE);
+	test_cleanup();
+}
+
+static void test_torn(void)
+{
+	struct journal *journal;
+	off_t size;
+	int fd;
+
+	test_init();
+
+	journal = journal_open(test_journal);
+	store_value(journal, "a/1", 48, 1);
+	store_value(journal, "b/1", 100, 2);
+	journal_unref(journal);
+
+	/* Chop the last record in half, as a crash during append would */
+	g_assert(truncate(test_journal, file_size(test_journal) - 50) == 0);
+
+	journal = journal_open(test_journal);
+	g_assert(journal);
+	check_value(journal, "a/1", 48, 1);
+	g_assert(!journal_lookup(journal, "b/1", NULL, NULL));
+
+	/* Appending after recovery must not resurrect the garbage */
+	store_value(journal, "b/1", 20, 3);
+	journal_unref(journal);
+
+	journal = journal_open(test_journal);
+	check_value(journal, "a/1", 48, 1);
+	check_value(journal, "b/1", 20, 3);
+
+	/* A change spanning several records is replayed whole or not at all */
+	store_value(journal, "c/1", 30, 4);
+	store_value(journal, "c/2", 30, 5);
+	size = file_size(test_journal);
+	g_assert(journal_rename_prefix(journal, "c/", "d/"));
+	journal_unref(journal);
+
+	g_assert(truncate(test_journal, size +
+				(file_size(test_journal) - size) / 2) == 0);
+
+	journal = journal_open(test_journal);
+	check_value(journal, "c/1", 30, 4);
+	check_value(journal, "c/2", 30, 5);
+	g_assert(!journal_lookup(journal, "d/1", NULL, NULL));
+	g_assert(!journal_lookup(journal, "d/2", NULL, NULL));
+	journal_unref(journal);
+
+	/* A corrupted value fails the CRC */
+	fd = open(test_journal, O_WRONLY);
+	g_assert(fd >= 0);
+	g_assert(pwrite(fd, "x", 1, file_size(test_journal) - 1) == 1);
+	close(fd);
+
+	journal = journal_open(test_journal);
+	check_value(journal, "a/1", 48, 1);
+	check_value(journal, "c/1", 30, 4);
+	g_assert(!journal_lookup(journal, "c/2", NULL, NULL));
+	journal_unref(journal);
+
+	/* Garbage in place of the header starts a new journal */
+	g_assert(g_file_set_contents(test_journal, "garbage!garbage!", -1,
+						NULL));
+	journal = journal_open(test_journal);
+	g_assert(journal);
+	g_assert(!journal_lookup(journal, "a/1", NULL, NULL));
+	store_value(journal, "a/1", 48, 5);
+	check_value(journal, "a/1", 48, 5);
+	journal_unref(journal);
+
+	test_cleanup();
+}
+
+static void test_compact(void)
+{
+	struct journal *journal;
+	off_t before;
+	int i;
+
+	test_init();
+
+	journal = journal_open(test_journal);
+	store_value(journal, "keep", 30, 1);
+
+	/* Keep rewriting one key, compaction bounds the file size */
+	for (i = 0; i < 200; i++) {
+		store_value(journal, "hot", 1000, i);
+		g_assert_cmpint(file_size(test_journal), < , 40 * 1024);
+	}
+
+	check_value(journal, "keep", 30, 1);
+	check_value(journal, "hot", 1000, 199);
+
+	store_value(journal, "hot", 1000, 200);
+	before = file_size(test_journal);
+
+	g_assert(journal_compact(journal));
+	g_assert_cmpint(file_size(test_journal), < , before);
+	g_assert_cmpint(file_size(test_journal), == ,
+				8 + 20 + 4 + 30 + 20 + 3 + 1000);
+
+	check_value(journal, "keep", 30, 1);
+	check_value(journal, "hot", 1000, 200);
+	journal_unref(journal);
+
+	journal = journal_open(test_journal);
+	check_value(journal, "keep", 30, 1);
+	check_value(journal, "hot", 1000, 200);
+	journal_unref(journal);
+
+	test_cleanup();
+}
+
+static void write_legacy(const char *name, unsigned int len, int seed)
+{
+	unsigned char value[1024];
+	char *path = g_build_filename(test_dir, "legacy", name, NULL);
+
+	fill_value(value, len, seed);
+	g_assert(create_dirs(path, 0700) == 0);
+	g_assert(g_file_set_contents(path, (char *) value, len, NULL));
+	g_free(path);
+}
+
+static void test_import(void)
+{
+	struct journal *journal;
+	char *legacy;
+
+	test_init();
+
+	legacy = g_build_filename(test_dir, "legacy", NULL);
+
+	write_legacy("1-0-A/000", 48, 1);
+	write_legacy("1-0-A/001", 49, 2);
+	write_legacy("2-0-B/000", 50, 3);
+	write_legacy("2-0-B/001.XXXXXX.tmp", 10, 4);
+
+	journal = journal_open(test_journal);
+	store_value(journal, "tx/2-0-B/000", 60, 5);
+	g_assert_cmpuint(journal_import_dir(journal, legacy, "tx/"), == , 2);
+
+	/* What is already in the journal is newer than the old files */
+	check_value(journal, "tx/1-0-A/000", 48, 1);
+	check_value(journal, "tx/1-0-A/001", 49, 2);
+	check_value(journal, "tx/2-0-B/000", 60, 5);
+	g_assert(!journal_lookup(journal, "tx/2-0-B/001.XXXXXX.tmp",
+							NULL, NULL));
+	g_assert(!g_file_test(legacy, G_FILE_TEST_EXISTS));
+
+	g_assert_cmpuint(journal_import_dir(journal, legacy, "tx/"), == , 0);
+	journal_unref(journal);
+
+	journal = journal_open(test_journal);
+	check_value(journal, "tx/1-0-A/001", 49, 2);
+	journal_unref(journal);
+
+	g_free(legacy);
+	test_cleanup();
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testjournal/basic", test_basic);
+	g_test_add_func("/testjournal/foreach", test_foreach);
+	g_test_add_func("/testjournal/torn", test_torn);
+	g_test_add_func("/testjournal/compact", test_compact);
+	g_test_add_func("/testjournal/import", test_import);
+
+	return g_test_run();
+}
@@ -26,6 +26,8 @@
 #include "plugins/provision.h"
 
 #include <string.h>
+#include <unistd.h>
+#include <utime.h>
 
 #define TEST_SUITE "/provision/"
 
@@ -188,6 +190,165 @@ static void test_no_mcc_mnc()
 	__ofono_builtin_provision.exit();
 }
 
+static const char test_mbpi_index_xml[] =
+"<serviceproviders format=\"2.0\">\n\
+<country code=\"xx\">\n\
+  <provider>\n\
+    <name>Test GSM</name>\n\
+    <gsm>\n\
+      <network-id mcc=\"123\" mnc=\"45\"/>\n\
+      <apn value=\"internet1\">\n\
+        <usage type=\"internet\"/>\n\
+      </apn>\n\
+      <apn value=\"internet2\">\n\
+        <usage type=\"internet\"/>\n\
+        <username>user</username>\n\
+      </apn>\n\
+    </gsm>\n\
+  </provider>\n\
+  <provider>\n\
+    <name>Test CDMA</name>\n\
+    <cdma>\n\
+      <sid value=\"4567\"/>\n\
+    </cdma>\n\
+  </provider>\n\
+</country>\n\
+</serviceproviders>\n";
+
+static void test_mbpi_index_write(const char *path, const char *text,
+							time_t mtime)
+{
+	struct utimbuf times;
+	FILE *f;
+
+	/* Rewrite the file in place, keeping the inode */
+	f = fopen(path, "w");
+	g_assert(f);
+	g_assert(fputs(text, f) >= 0);
+	fclose(f);
+
+	times.actime = times.modtime = mtime;
+	g_assert(utime(path, &times) == 0);
+}
+
+static char *test_mbpi_index_first_apn(void)
+{
+	GSList *apns = mbpi_lookup_apn("123", "45", TRUE, NULL);
+	struct ofono_gprs_provision_data *ap;
+	char *apn;
+
+	g_assert_cmpuint(g_slist_length(apns), ==, 2);
+	ap = apns->data;
+	apn = g_strdup(ap->apn);
+	g_slist_free_full(apns, (GDestroyNotify) mbpi_ap_free);
+	return apn;
+}
+
+static void test_mbpi_index()
+{
+	const char *saved_database = mbpi_database;
+	const char *saved_index = mbpi_index;
+	char *dir = g_dir_make_tmp("provisionXXXXXX", NULL);
+	char *xml = g_build_filename(dir, "serviceproviders.xml", NULL);
+	char *other = g_build_filename(dir, "other.xml", NULL);
+	char *index = g_build_filename(dir, "mbpi.index", NULL);
+	char *changed = g_strdup(test_mbpi_index_xml);
+	char *message;
+	char *name;
+	char *apn;
+	GSList *apns;
+	GError *error = NULL;
+	struct ofono_gprs_provision_data *ap;
+	gsize size;
+
+	*strstr(changed, "internet1") = 'X';
+	test_mbpi_index_write(xml, test_mbpi_index_xml, 1000000);
+	test_mbpi_index_write(other, test_mbpi_index_xml, 1000000);
+	mbpi_database = xml;
+	mbpi_index = index;
+
+	/* The defaults are applied at lookup time */
+	apns = mbpi_lookup_apn("123", "45", TRUE, &error);
+	g_assert(!error);
+	g_assert_cmpuint(g_slist_length(apns), ==, 2);
+	ap = apns->data;
+	g_assert_cmpstr(ap->provider_name, ==, "Test GSM");
+	g_assert_cmpstr(ap->apn, ==, "internet1");
+	g_assert(ap->type == OFONO_GPRS_CONTEXT_TYPE_INTERNET);
+	g_assert(ap->proto == mbpi_default_internet_proto);
+	g_assert(ap->auth_method == OFONO_GPRS_AUTH_METHOD_NONE);
+	ap = apns->next->data;
+	g_assert(ap->auth_method == mbpi_default_auth_method);
+	g_slist_free_full(apns, (GDestroyNotify) mbpi_ap_free);
+	g_assert(g_file_test(index, G_FILE_TEST_EXISTS));
+
+	/* The error is the one the XML parser would report */
+	g_assert(!mbpi_lookup_apn("123", "45", FALSE, &error));
+	message = g_strconcat(xml, ":14 Duplicate context detected", NULL);
+	g_assert_cmpstr(error->message, ==, message);
+	g_clear_error(&error);
+	g_free(message);
+
+	g_assert(!mbpi_lookup_apn("123", "46", TRUE, &error));
+	g_assert(!error);
+
+	name = mbpi_lookup_cdma_provider_name("4567", &error);
+	g_assert(!error);
+	g_assert_cmpstr(name, ==, "Test CDMA");
+	g_free(name);
+
+	/* Switch to another database without touching the index file */
+	mbpi_database = other;
+	mbpi_index = NULL;
+	g_free(test_mbpi_index_first_apn());
+
+	/* Same inode, size and mtime, the saved index is believed */
+	test_mbpi_index_write(xml, changed, 1000000);
+	mbpi_database = xml;
+	mbpi_index = index;
+	apn = test_mbpi_index_first_apn();
+	g_assert_cmpstr(apn, ==, "internet1");
+	g_free(apn);
+
+	/* A new mtime invalidates it */
+	test_mbpi_index_write(xml, changed, 1000010);
+	apn = test_mbpi_index_first_apn();
+	g_assert_cmpstr(apn, ==, "Xnternet1");
+	g_free(apn);
+
+	/* Garbage is rebuilt */
+	mbpi_database = other;
+	mbpi_index = NULL;
+	g_free(test_mbpi_index_first_apn());
+	g_assert(g_file_set_contents(index, "garbage", -1, NULL));
+	mbpi_database = xml;
+	mbpi_index = index;
+	apn = test_mbpi_index_first_apn();
+	g_assert_cmpstr(apn, ==, "Xnternet1");
+	g_free(apn);
+	g_assert(g_file_get_contents(index, &message, &size, NULL));
+	g_assert_cmpuint(size, >, strlen("garbage"));
+	g_free(message);
+
+	/* Broken XML is left to the parser */
+	test_mbpi_index_write(xml, "<serviceproviders", 1000020);
+	g_assert(!mbpi_lookup_apn("123", "45", TRUE, &error));
+	g_assert(error);
+	g_clear_error(&error);
+
+	mbpi_database = saved_database;
+	mbpi_index = saved_index;
+	unlink(xml);
+	unlink(other);
+	unlink(index);
+	rmdir(dir);
+	g_free(changed);
+	g_free(index);
+	g_free(other);
+	g_free(xml);
+	g_free(dir);
+}
+
 static char telia_fi_provider_name [] = "Telia FI";
 static char telia_fi_name_internet [] = "Telia Internet";
 static char telia_fi_name_mms [] = "Telia MMS";
@@ -1378,6 +1539,7 @@ int main(int argc, char **argv)
 	g_test_add_func(TEST_SUITE "no_driver", test_no_driver);
 	g_test_add_func(TEST_SUITE "bad_driver", test_bad_driver);
 	g_test_add_func(TEST_SUITE "no_mcc_mnc", test_no_mcc_mnc);
+	g_test_add_func(TEST_SUITE "mbpi_index", test_mbpi_index);
 	for (i = 0; i < G_N_ELEMENTS(test_cases); i++) {
 		const struct provision_test_case *test = test_cases + i;
 		g_test_add_data_func(test->name, test, test_provision);
@@ -0,0 +1,649 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "ofono.h"
+
+#include "drivers/qmimodem/qmi.h"
+#include "drivers/qmimodem/ctl.h"
+#include "drivers/qmimodem/nas.h"
+
+struct test_qmi {
+	struct qmi_device *device;
+	struct qmi_service *service;
+	int fd;
+	int synced;
+	int discovered;
+	int notified;
+};
+
+static void test_qmi_init(struct test_qmi *tq)
+{
+	int sv[2];
+
+	memset(tq, 0, sizeof(*tq));
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	g_assert(fcntl(sv[1], F_SETFL, O_NONBLOCK) == 0);
+
+	tq->device = qmi_device_new(sv[0]);
+	g_assert(tq->device);
+	qmi_device_set_close_on_unref(tq->device, true);
+	tq->fd = sv[1];
+}
+
+static void test_qmi_cleanup(struct test_qmi *tq)
+{
+	qmi_service_unref(tq->service);
+	qmi_device_unref(tq->device);
+	close(tq->fd);
+}
+
+static void test_qmi_flush(void)
+{
+	while (g_main_context_iteration(NULL, FALSE));
+}
+
+static void sync_cb(void *user_data)
+{
+	struct test_qmi *tq = user_data;
+
+	tq->synced++;
+}
+
+/* Sends a sync request and returns its transaction id */
+static guint8 test_qmi_sync(struct test_qmi *tq)
+{
+	guint8 buf[64];
+	ssize_t len;
+
+	g_assert(qmi_device_sync(tq->device, sync_cb, tq));
+	test_qmi_flush();
+
+	len = read(tq->fd, buf, sizeof(buf));
+	g_assert_cmpint(len, == , 12);
+	g_assert_cmpuint(buf[0], == , 0x01);
+	g_assert_cmpuint(buf[4], == , QMI_SERVICE_CONTROL);
+
+	return buf[7];
+}
+
+static void tlv_append(GByteArray *tlvs, guint8 type, const void *data,
+								guint16 len)
+{
+	guint8 hdr[3] = { type, len & 0xff, len >> 8 };
+
+	g_byte_array_append(tlvs, hdr, sizeof(hdr));
+	g_byte_array_append(tlvs, data, len);
+}
+
+/* Wraps the TLVs into a frame from the modem */
+static GByteArray *qmi_frame(guint8 service, guint8 client, guint8 type,
+				guint16 tid, guint16 message, GByteArray *tlvs)
+{
+	GByteArray *frame = g_byte_array_new();
+	guint16 msg_len = tlvs ? tlvs->len : 0;
+	guint16 mux_len;
+	guint8 hdr[13];
+	guint n = 0;
+
+	mux_len = 5 + (service == QMI_SERVICE_CONTROL ? 2 : 3) + 4 + msg_len;
+
+	hdr[n++] = 0x01;			/* Frame */
+	hdr[n++] = mux_len & 0xff;
+	hdr[n++] = mux_len >> 8;
+	hdr[n++] = 0x80;			/* Flags */
+	hdr[n++] = service;
+	hdr[n++] = client;
+	hdr[n++] = type;
+	hdr[n++] = tid & 0xff;
+
+	if (service != QMI_SERVICE_CONTROL)
+		hdr[n++] = tid >> 8;
+
+	hdr[n++] = message & 0xff;
+	hdr[n++] = message >> 8;
+	hdr[n++] = msg_len & 0xff;
+	hdr[n++] = msg_len >> 8;
+	g_byte_array_append(frame, hdr, n);
+
+	if (tlvs)
+		g_byte_array_append(frame, tlvs->data, tlvs->len);
+
+	return frame;
+}
+
+/* Control response to a sync, padded with a TLV of the given size */
+static GByteArray *sync_response(guint8 tid, guint16 tlv_len)
+{
+	GByteArray *tlvs = NULL;
+	GByteArray *frame;
+	guint8 *pad;
+	guint i;
+
+	if (tlv_len) {
+		tlvs = g_byte_array_new();
+		pad = g_malloc(tlv_len);
+
+		for (i = 0; i < tlv_len; i++)
+			pad[i] = i;
+
+		tlv_append(tlvs, 0x10, pad, tlv_len);
+		g_free(pad);
+	}
+
+	/* Response */
+	frame = qmi_frame(QMI_SERVICE_CONTROL, 0x00, 0x01, tid,
+						QMI_CTL_SYNC, tlvs);
+
+	if (tlvs)
+		g_byte_array_free(tlvs, TRUE);
+
+	return frame;
+}
+
+static void test_qmi_send(struct test_qmi *tq, const guint8 *data, gsize len)
+{
+	g_assert_cmpint(write(tq->fd, data, len), == , len);
+	test_qmi_flush();
+}
+
+static void test_split_frame(void)
+{
+	struct test_qmi tq;
+	GByteArray *frame;
+	guint i;
+
+	test_qmi_init(&tq);
+
+	/* Byte by byte */
+	frame = sync_response(test_qmi_sync(&tq), 20);
+
+	for (i = 0; i < frame->len; i++) {
+		g_assert_cmpint(tq.synced, == , 0);
+		test_qmi_send(&tq, frame->data + i, 1);
+	}
+
+	g_assert_cmpint(tq.synced, == , 1);
+	g_byte_array_free(frame, TRUE);
+
+	/* Split in the middle of the header */
+	frame = sync_response(test_qmi_sync(&tq), 0);
+	test_qmi_send(&tq, frame->data, 3);
+	g_assert_cmpint(tq.synced, == , 1);
+	test_qmi_send(&tq, frame->data + 3, frame->len - 3);
+	g_assert_cmpint(tq.synced, == , 2);
+	g_byte_array_free(frame, TRUE);
+
+	test_qmi_cleanup(&tq);
+}
+
+static void test_large_frame(void)
+{
+	struct test_qmi tq;
+	GByteArray *frame;
+	GByteArray *second;
+	guint8 tid;
+	gsize sent;
+
+	test_qmi_init(&tq);
+
+	/* Larger than a single read chunk, sent in pieces */
+	tid = test_qmi_sync(&tq);
+	frame = sync_response(tid, 20000);
+
+	for (sent = 0; sent < frame->len; sent += 3000)
+		test_qmi_send(&tq, frame->data + sent,
+					MIN(3000, frame->len - sent));
+
+	g_assert_cmpint(tq.synced, == , 1);
+	g_byte_array_free(frame, TRUE);
+
+	/* And in one go, followed by another frame in the same read */
+	frame = sync_response(test_qmi_sync(&tq), 30000);
+	second = sync_response(test_qmi_sync(&tq), 0);
+	g_byte_array_append(frame, second->data, second->len);
+	g_byte_array_free(second, TRUE);
+
+	test_qmi_send(&tq, frame->data, frame->len);
+	g_assert_cmpint(tq.synced, == , 3);
+	g_byte_array_free(frame, TRUE);
+
+	test_qmi_cleanup(&tq);
+}
+
+static void test_resync(void)
+{
+	static const guint8 garbage[] = { 0x7e, 0x00, 0x01, 0x02, 0xff };
+	struct test_qmi tq;
+	GByteArray *frame;
+
+	test_qmi_init(&tq);
+
+	frame = sync_response(test_qmi_sync(&tq), 8);
+	g_byte_array_prepend(frame, garbage, sizeof(garbage));
+	test_qmi_send(&tq, frame->data, frame->len);
+	g_assert_cmpint(tq.synced, == , 1);
+	g_byte_array_free(frame, TRUE);
+
+	test_qmi_cleanup(&tq);
+}
+
+static void test_out_of_order(void)
+{
+	struct test_qmi tq;
+	guint8 tids[100];
+	GByteArray *frame;
+	int i;
+
+	test_qmi_init(&tq);
+
+	for (i = 0; i < (int) G_N_ELEMENTS(tids); i++)
+		tids[i] = test_qmi_sync(&tq);
+
+	/* A response nobody waits for is ignored */
+	frame = sync_response(tids[0] - 1, 0);
+	test_qmi_send(&tq, frame->data, frame->len);
+	g_assert_cmpint(tq.synced, == , 0);
+	g_byte_array_free(frame, TRUE);
+
+	for (i = G_N_ELEMENTS(tids) - 1; i >= 0; i--) {
+		frame = sync_response(tids[i], 0);
+		test_qmi_send(&tq, frame->data, frame->len);
+		g_byte_array_free(frame, TRUE);
+
+		g_assert_cmpint(tq.synced, == , G_N_ELEMENTS(tids) - i);
+	}
+
+	/* Each response completes its request once */
+	frame = sync_response(tids[0], 0);
+	test_qmi_send(&tq, frame->data, frame->len);
+	g_assert_cmpint(tq.synced, == , G_N_ELEMENTS(tids));
+	g_byte_array_free(frame, TRUE);
+
+	test_qmi_cleanup(&tq);
+}
+
+static void test_pipelined(void)
+{
+	struct test_qmi tq;
+	guint8 buf[20 * 12];
+	GByteArray *frame;
+	ssize_t len;
+	int i;
+
+	test_qmi_init(&tq);
+
+	for (i = 0; i < 20; i++)
+		g_assert(qmi_device_sync(tq.device, sync_cb, &tq));
+
+	/* A single wakeup writes out the whole queue */
+	g_assert(g_main_context_iteration(NULL, FALSE));
+
+	len = read(tq.fd, buf, sizeof(buf));
+	g_assert_cmpint(len, == , sizeof(buf));
+
+	frame = g_byte_array_new();
+
+	for (i = 0; i < 20; i++) {
+		GByteArray *response = sync_response(buf[i * 12 + 7], 0);
+
+		g_assert_cmpuint(buf[i * 12], == , 0x01);
+		g_byte_array_append(frame, response->data, response->len);
+		g_byte_array_free(response, TRUE);
+	}
+
+	test_qmi_send(&tq, frame->data, frame->len);
+	g_assert_cmpint(tq.synced, == , 20);
+	g_byte_array_free(frame, TRUE);
+
+	test_qmi_cleanup(&tq);
+}
+
+static void discover_cb(void *user_data)
+{
+	struct test_qmi *tq = user_data;
+
+	tq->discovered++;
+}
+
+static void create_cb(struct qmi_service *service, void *user_data)
+{
+	struct test_qmi *tq = user_data;
+
+	tq->service = qmi_service_ref(service);
+}
+
+/* Reads the next control request and returns its transaction id */
+static guint8 test_qmi_read_ctl(struct test_qmi *tq, guint16 message)
+{
+	guint8 buf[64];
+	ssize_t len;
+
+	test_qmi_flush();
+
+	len = read(tq->fd, buf, sizeof(buf));
+	g_assert_cmpint(len, >= , 12);
+	g_assert_cmpuint(buf[4], == , QMI_SERVICE_CONTROL);
+	g_assert_cmpuint(buf[8] | (buf[9] << 8), == , message);
+
+	return buf[7];
+}
+
+static void test_qmi_send_frame(struct test_qmi *tq, GByteArray *frame)
+{
+	test_qmi_send(tq, frame->data, frame->len);
+	g_byte_array_free(frame, TRUE);
+}
+
+/* Discovers the device and creates a NAS client with the id 1 */
+static void test_qmi_init_nas(struct test_qmi *tq)
+{
+	static const guint8 result_ok[4] = { 0 };
+	static const guint8 services[] = { 0x01, QMI_SERVICE_NAS,
+						0x01, 0x00, 0x02, 0x00 };
+	static const guint8 client_id[] = { QMI_SERVICE_NAS, 0x01 };
+	GByteArray *tlvs;
+	guint8 tid;
+
+	test_qmi_init(tq);
+
+	g_assert(qmi_device_discover(tq->device, discover_cb, tq, NULL));
+	tid = test_qmi_read_ctl(tq, QMI_CTL_GET_VERSION_INFO);
+
+	tlvs = g_byte_array_new();
+	tlv_append(tlvs, 0x02, result_ok, sizeof(result_ok));
+	tlv_append(tlvs, 0x01, services, sizeof(services));
+	test_qmi_send_frame(tq, qmi_frame(QMI_SERVICE_CONTROL, 0x00, 0x01,
+				tid, QMI_CTL_GET_VERSION_INFO, tlvs));
+	g_byte_array_free(tlvs, TRUE);
+	g_assert_cmpint(tq->discovered, == , 1);
+
+	g_assert(qmi_service_create(tq->device, QMI_SERVICE_NAS, create_cb,
+								tq, NULL));
+	tid = test_qmi_read_ctl(tq, QMI_CTL_GET_CLIENT_ID);
+
+	tlvs = g_byte_array_new();
+	tlv_append(tlvs, 0x02, result_ok, sizeof(result_ok));
+	tlv_append(tlvs, 0x01, client_id, sizeof(client_id));
+	test_qmi_send_frame(tq, qmi_frame(QMI_SERVICE_CONTROL, 0x00, 0x01,
+				tid, QMI_CTL_GET_CLIENT_ID, tlvs));
+	g_byte_array_free(tlvs, TRUE);
+	g_assert(tq->service);
+}
+
+/*
+ * Serving system indication the way modems send it: registration
+ * state, attach states, radio interfaces, roaming, data capabilities,
+ * the current PLMN, cell location and time zone
+ */
+static GByteArray *nas_serving_system_ind(void)
+{
+	static const guint8 ss[] = { 0x01, 0x01, 0x01, 0x01, 0x01, 0x08 };
+	static const guint8 roaming[] = { 0x01 };
+	static const guint8 data_caps[] = { 0x02, 0x05, 0x0b };
+	static const guint8 plmn[] = { 0xf4, 0x00, 0x05, 0x00, 0x04,
+					'J', 'o', 'l', 'l' };
+	static const guint8 lac[] = { 0x2b, 0x1a };
+	static const guint8 cell_id[] = { 0xc3, 0xf2, 0x01, 0x00 };
+	static const guint8 tz[] = { 0x08 };
+	static const guint8 dst[] = { 0x00 };
+	static const guint8 mnc_pcs[] = { 0xf4, 0x00, 0x05, 0x00, 0x00 };
+	static const guint8 srv_status[] = { 0x02, 0x02, 0x00, 0x02 };
+	static const guint8 tac[] = { 0x01, 0x30 };
+	GByteArray *tlvs = g_byte_array_new();
+	GByteArray *frame;
+
+	tlv_append(tlvs, 0x01, ss, sizeof(ss));
+	tlv_append(tlvs, 0x10, roaming, sizeof(roaming));
+	tlv_append(tlvs, 0x11, data_caps, sizeof(data_caps));
+	tlv_append(tlvs, 0x12, plmn, sizeof(plmn));
+	tlv_append(tlvs, 0x1a, tz, sizeof(tz));
+	tlv_append(tlvs, 0x1b, dst, sizeof(dst));
+	tlv_append(tlvs, 0x1d, lac, sizeof(lac));
+	tlv_append(tlvs, 0x1e, cell_id, sizeof(cell_id));
+	tlv_append(tlvs, 0x22, srv_status, sizeof(srv_status));
+	tlv_append(tlvs, 0x25, tac, sizeof(tac));
+	tlv_append(tlvs, 0x26, mnc_pcs, sizeof(mnc_pcs));
+
+	/* Radio interface list, repeated as some firmwares do */
+	tlv_append(tlvs, 0x13, "\x01\x08", 2);
+	tlv_append(tlvs, 0x13, "\x02\x05\x04", 3);
+
+	/* Indication */
+	frame = qmi_frame(QMI_SERVICE_NAS, 0x01, 0x04, 0x0000,
+					QMI_NAS_SS_INFO_IND, tlvs);
+	g_byte_array_free(tlvs, TRUE);
+
+	return frame;
+}
+
+static void serving_system_check(struct qmi_result *result, void *user_data)
+{
+	struct test_qmi *tq = user_data;
+	struct qmi_result_iter iter;
+	const char *str;
+	const uint8_t *ss;
+	uint16_t len, mcc, mnc, lac;
+	uint32_t cell_id;
+	uint8_t u8, n;
+
+	tq->notified++;
+
+	ss = qmi_result_get(result, 0x01, &len);
+	g_assert(ss);
+	g_assert_cmpuint(len, == , 6);
+	g_assert_cmpuint(ss[0], == , 0x01);
+
+	g_assert(qmi_result_get_uint8(result, 0x10, &u8));
+	g_assert_cmpuint(u8, == , 0x01);
+	g_assert(qmi_result_get_uint16(result, 0x1d, &lac));
+	g_assert_cmpuint(lac, == , 0x1a2b);
+	g_assert(qmi_result_get_uint32(result, 0x1e, &cell_id));
+	g_assert_cmpuint(cell_id, == , 0x1f2c3);
+	g_assert(!qmi_result_get_uint8(result, 0x42, &u8));
+
+	/* The current PLMN without copying the description */
+	g_assert(qmi_result_iter_init(&iter, result, 0x12));
+	g_assert(qmi_result_iter_next_uint16(&iter, &mcc));
+	g_assert(qmi_result_iter_next_uint16(&iter, &mnc));
+	g_assert(qmi_result_iter_next_string(&iter, &str, &n));
+	g_assert_cmpuint(mcc, == , 244);
+	g_assert_cmpuint(mnc, == , 5);
+	g_assert_cmpuint(n, == , 4);
+	g_assert(!memcmp(str, "Joll", 4));
+	g_assert_cmpuint(qmi_result_iter_remaining(&iter), == , 0);
+	g_assert(!qmi_result_iter_next_uint8(&iter, &u8));
+
+	/* Repeated TLVs, the getters only ever see the first one */
+	g_assert(qmi_result_get(result, 0x13, &len));
+	g_assert_cmpuint(len, == , 2);
+
+	g_assert(qmi_result_iter_init(&iter, result, 0x13));
+	g_assert(qmi_result_iter_next_uint8(&iter, &n));
+	g_assert_cmpuint(n, == , 1);
+	g_assert(qmi_result_iter_next_uint8(&iter, &u8));
+	g_assert_cmpuint(u8, == , 0x08);
+
+	g_assert(qmi_result_iter_next_tlv(&iter));
+	g_assert(qmi_result_iter_next_uint8(&iter, &n));
+	g_assert_cmpuint(n, == , 2);
+	g_assert_cmpuint(qmi_result_iter_remaining(&iter), == , n);
+	g_assert(!qmi_result_iter_next_tlv(&iter));
+}
+
+static void test_result(void)
+{
+	struct test_qmi tq;
+
+	test_qmi_init_nas(&tq);
+
+	g_assert(qmi_service_register(tq.service,
+				QMI_NAS_SS_INFO_IND,
+				serving_system_check, &tq, NULL));
+
+	test_qmi_send_frame(&tq, nas_serving_system_ind());
+	g_assert_cmpint(tq.notified, == , 1);
+
+	test_qmi_cleanup(&tq);
+}
+
+static void truncated_check(struct qmi_result *result, void *user_data)
+{
+	struct test_qmi *tq = user_data;
+	struct qmi_result_iter iter;
+	uint8_t u8;
+
+	tq->notified++;
+
+	g_assert(qmi_result_get_uint8(result, 0x10, &u8));
+	g_assert_cmpuint(u8, == , 0x05);
+
+	/* Never read past the end of the message */
+	g_assert(!qmi_result_get(result, 0x11, NULL));
+	g_assert(!qmi_result_iter_init(&iter, result, 0x11));
+}
+
+static void test_result_truncated(void)
+{
+	static const guint8 tlvs[] = {
+		0x10, 0x01, 0x00, 0x05,
+		0x11, 0x08, 0x00, 0x01, 0x02		/* Truncated */
+	};
+	struct test_qmi tq;
+	GByteArray *frame;
+
+	test_qmi_init_nas(&tq);
+
+	frame = qmi_frame(QMI_SERVICE_NAS, 0x01, 0x04, 0x0000,
+					QMI_NAS_SS_INFO_IND, NULL);
+	g_byte_array_append(frame, tlvs, sizeof(tlvs));
+
+	/* Fix up the lengths of the mux and message headers */
+	frame->data[1] += sizeof(tlvs);
+	frame->data[11] = sizeof(tlvs);
+
+	g_assert(qmi_service_register(tq.service,
+				QMI_NAS_SS_INFO_IND,
+				truncated_check, &tq, NULL));
+
+	test_qmi_send_frame(&tq, frame);
+	g_assert_cmpint(tq.notified, == , 1);
+
+	test_qmi_cleanup(&tq);
+}
+
+static void serving_system_parse(struct qmi_result *result, void *user_data)
+{
+	struct test_qmi *tq = user_data;
+	struct qmi_result_iter iter;
+	const char *str;
+	uint16_t u16;
+	uint32_t u32;
+	uint8_t u8;
+
+	/* What the network registration atom looks at */
+	qmi_result_get(result, 0x01, NULL);
+	qmi_result_get_uint8(result, 0x10, &u8);
+	qmi_result_get(result, 0x11, NULL);
+	qmi_result_get_uint8(result, 0x1a, &u8);
+	qmi_result_get_uint8(result, 0x1b, &u8);
+	qmi_result_get_uint16(result, 0x1d, &u16);
+	qmi_result_get_uint32(result, 0x1e, &u32);
+	qmi_result_get(result, 0x22, NULL);
+	qmi_result_get_uint16(result, 0x25, &u16);
+	qmi_result_get(result, 0x26, NULL);
+	qmi_result_get(result, 0x27, NULL);
+	qmi_result_get(result, 0x28, NULL);
+
+	if (qmi_result_iter_init(&iter, result, 0x12)) {
+		qmi_result_iter_next_uint16(&iter, &u16);
+		qmi_result_iter_next_uint16(&iter, &u16);
+		qmi_result_iter_next_string(&iter, &str, &u8);
+	}
+
+	tq->notified++;
+}
+
+static void test_result_perf(void)
+{
+	struct test_qmi tq;
+	GByteArray *ind = nas_serving_system_ind();
+	GByteArray *stream = g_byte_array_new();
+	int rounds = g_test_perf() ? 2000 : 20;
+	double elapsed;
+	int i;
+
+	test_qmi_init_nas(&tq);
+
+	g_assert(qmi_service_register(tq.service,
+				QMI_NAS_SS_INFO_IND,
+				serving_system_parse, &tq, NULL));
+
+	for (i = 0; i < 100; i++)
+		g_byte_array_append(stream, ind->data, ind->len);
+
+	g_test_timer_start();
+
+	for (i = 0; i < rounds; i++)
+		test_qmi_send(&tq, stream->data, stream->len);
+
+	elapsed = g_test_timer_elapsed();
+
+	g_assert_cmpint(tq.notified, == , rounds * 100);
+
+	g_test_maximized_result(tq.notified / elapsed,
+				"%.0f serving system indications/s",
+				tq.notified / elapsed);
+
+	g_byte_array_free(stream, TRUE);
+	g_byte_array_free(ind, TRUE);
+	test_qmi_cleanup(&tq);
+}
+
+#define TEST_(name) "/qmi/" name
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	__ofono_log_init("test-qmi",
+		g_test_verbose() ? "*" : NULL,
+		FALSE, FALSE);
+
+	g_test_add_func(TEST_("split_frame"), test_split_frame);
+	g_test_add_func(TEST_("large_frame"), test_large_frame);
+	g_test_add_func(TEST_("resync"), test_resync);
+	g_test_add_func(TEST_("out_of_order"), test_out_of_order);
+	g_test_add_func(TEST_("pipelined"), test_pipelined);
+	g_test_add_func(TEST_("result"), test_result);
+	g_test_add_func(TEST_("result_truncated"), test_result_truncated);
+	g_test_add_func(TEST_("result_perf"), test_result_perf);
+
+	return g_test_run();
+}
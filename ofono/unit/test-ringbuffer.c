@@ -0,0 +1,191 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "ringbuffer.h"
+
+#define TEST_SIZE 8192
+
+static void fill_pattern(unsigned char *data, unsigned int len,
+				unsigned int start)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+		data[i] = (start + i) * 7;
+}
+
+static gsize iov_total(const struct iovec *iov, int iovcnt)
+{
+	gsize total = 0;
+	int i;
+
+	for (i = 0; i < iovcnt; i++)
+		total += iov[i].iov_len;
+
+	return total;
+}
+
+/* Moves the read/write counters so that the next write wraps */
+static void make_wrap(struct ring_buffer *rb, unsigned int used)
+{
+	unsigned char junk[TEST_SIZE];
+	unsigned int cap = ring_buffer_capacity(rb);
+
+	memset(junk, 0, sizeof(junk));
+	g_assert_cmpint(ring_buffer_write(rb, junk, cap - 100), == , cap - 100);
+	g_assert_cmpint(ring_buffer_drain(rb, cap - 100 - used), == ,
+							cap - 100 - used);
+}
+
+static void check_iov(struct ring_buffer *rb)
+{
+	unsigned char in[TEST_SIZE];
+	unsigned char out[TEST_SIZE];
+	struct iovec iov[2];
+	unsigned int cap = ring_buffer_capacity(rb);
+	unsigned int off;
+	int iovcnt;
+	int i;
+
+	g_assert_cmpint(ring_buffer_read_iov(rb, iov), == , 0);
+
+	/* 50 bytes left in front of the wrap point, 100 free behind it */
+	make_wrap(rb, 50);
+	g_assert_cmpint(ring_buffer_len(rb), == , 50);
+
+	iovcnt = ring_buffer_write_iov(rb, iov);
+	g_assert_cmpint(iov_total(iov, iovcnt), == , cap - 50);
+	g_assert_cmpint(iov_total(iov, iovcnt), == , ring_buffer_avail(rb));
+
+	if (ring_buffer_is_mirrored(rb))
+		g_assert_cmpint(iovcnt, == , 1);
+	else
+		g_assert_cmpint(iovcnt, == , 2);
+
+	/* Scatter a pattern through the vectors, as readv would */
+	fill_pattern(in, 200, 0);
+
+	for (i = 0, off = 0; i < iovcnt && off < 200; i++) {
+		unsigned int n = MIN(200 - off, iov[i].iov_len);
+
+		memcpy(iov[i].iov_base, in + off, n);
+		off += n;
+	}
+
+	g_assert_cmpint(ring_buffer_write_advance(rb, 200), == , 200);
+	g_assert_cmpint(ring_buffer_drain(rb, 50), == , 50);
+
+	/* The data now wraps, the mirror still makes it contiguous */
+	iovcnt = ring_buffer_read_iov(rb, iov);
+	g_assert_cmpint(iov_total(iov, iovcnt), == , 200);
+	g_assert_cmpint(ring_buffer_len_no_wrap(rb), == , iov[0].iov_len);
+
+	if (ring_buffer_is_mirrored(rb)) {
+		g_assert_cmpint(iovcnt, == , 1);
+		g_assert(memcmp(iov[0].iov_base, in, 200) == 0);
+		g_assert(memcmp(ring_buffer_read_ptr(rb, 0), in, 200) == 0);
+	} else {
+		g_assert_cmpint(iovcnt, == , 2);
+		g_assert_cmpint(iov[0].iov_len, == , 50);
+	}
+
+	g_assert_cmpint(ring_buffer_read(rb, out, sizeof(out)), == , 200);
+	g_assert(memcmp(in, out, 200) == 0);
+	g_assert_cmpint(ring_buffer_len(rb), == , 0);
+}
+
+static void test_iov(void)
+{
+	struct ring_buffer *rb = ring_buffer_new(TEST_SIZE);
+
+	g_assert(rb);
+	g_assert(!ring_buffer_is_mirrored(rb));
+	check_iov(rb);
+	ring_buffer_free(rb);
+}
+
+static void test_iov_mirrored(void)
+{
+	struct ring_buffer *rb = ring_buffer_new_mirrored(TEST_SIZE);
+
+	/* Falls back to a plain buffer if the mapping is not possible */
+	g_assert(rb);
+	g_assert_cmpint(ring_buffer_capacity(rb), == , TEST_SIZE);
+
+	if (!ring_buffer_is_mirrored(rb))
+		g_test_message("mirrored mapping not available");
+
+	check_iov(rb);
+	ring_buffer_free(rb);
+}
+
+static void test_readv_wrap(void)
+{
+	struct ring_buffer *rb = ring_buffer_new(TEST_SIZE);
+	unsigned char in[512];
+	unsigned char out[512];
+	struct iovec iov[2];
+	int iovcnt;
+	int sv[2];
+	ssize_t n;
+
+	g_assert(rb);
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+	make_wrap(rb, 0);
+	fill_pattern(in, sizeof(in), 3);
+	g_assert(write(sv[1], in, sizeof(in)) == sizeof(in));
+
+	/* A single readv fills both sides of the wrap point */
+	iovcnt = ring_buffer_write_iov(rb, iov);
+	g_assert_cmpint(iovcnt, == , 2);
+
+	n = readv(sv[0], iov, iovcnt);
+	g_assert_cmpint(n, == , sizeof(in));
+	ring_buffer_write_advance(rb, n);
+
+	g_assert_cmpint(ring_buffer_len_no_wrap(rb), == , 100);
+	g_assert_cmpint(ring_buffer_read(rb, out, sizeof(out)), == ,
+							sizeof(out));
+	g_assert(memcmp(in, out, sizeof(in)) == 0);
+
+	close(sv[0]);
+	close(sv[1]);
+	ring_buffer_free(rb);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testringbuffer/iov", test_iov);
+	g_test_add_func("/testringbuffer/iov_mirrored", test_iov_mirrored);
+	g_test_add_func("/testringbuffer/readv_wrap", test_readv_wrap);
+
+	return g_test_run();
+}
@@ -0,0 +1,203 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "ofono.h"
+#include "rtnl.h"
+
+/* Unprivileged processes can't change anything, the kernel says so */
+#define TEST_IFNAME "lo"
+#define TEST_BAD_IFNAME "nonexistent-ifname"
+#define TEST_ADDRESS "192.0.2.1"
+#define TEST_TIMEOUT_SEC 10
+
+struct test_result {
+	GMainLoop *loop;
+	gboolean done;
+	int error;
+};
+
+static void test_done(int error, void *user_data)
+{
+	struct test_result *result = user_data;
+
+	g_assert(!result->done);
+	result->done = TRUE;
+	result->error = error;
+	if (result->loop)
+		g_main_loop_quit(result->loop);
+}
+
+static gboolean test_timeout(gpointer user_data)
+{
+	g_assert_not_reached();
+	return G_SOURCE_REMOVE;
+}
+
+static int test_submit(struct rtnl_request *req)
+{
+	struct test_result result;
+	guint timeout;
+
+	memset(&result, 0, sizeof(result));
+	result.loop = g_main_loop_new(NULL, FALSE);
+	timeout = g_timeout_add_seconds(TEST_TIMEOUT_SEC, test_timeout, NULL);
+
+	g_assert(rtnl_request_submit(req, test_done, &result));
+	g_main_loop_run(result.loop);
+	g_assert(result.done);
+
+	g_source_remove(timeout);
+	g_main_loop_unref(result.loop);
+	return result.error;
+}
+
+static void test_no_interface(void)
+{
+	struct rtnl_request *req = rtnl_request_new(TEST_BAD_IFNAME);
+
+	g_assert(!req);
+	g_assert(!rtnl_request_new(NULL));
+
+	/* NULL request is fine */
+	rtnl_request_set_link_up(NULL, TRUE);
+	rtnl_request_set_mtu(NULL, 1500);
+	g_assert(!rtnl_request_add_address(NULL, TEST_ADDRESS, 32));
+	g_assert(!rtnl_request_del_address(NULL, NULL, 0));
+	g_assert(!rtnl_request_add_route(NULL, TEST_ADDRESS, 32));
+	g_assert(!rtnl_request_add_host_route(NULL, TEST_ADDRESS));
+	g_assert(!rtnl_request_submit(NULL, test_done, NULL));
+	rtnl_request_free(NULL);
+	rtnl_cancel(0);
+}
+
+static void test_bad_address(void)
+{
+	struct rtnl_request *req = rtnl_request_new(TEST_IFNAME);
+
+	g_assert(req);
+	g_assert(!rtnl_request_add_address(req, NULL, 32));
+	g_assert(!rtnl_request_add_address(req, "foo", 32));
+	g_assert(!rtnl_request_add_address(req, TEST_ADDRESS, 33));
+	g_assert(!rtnl_request_del_address(req, "::1", 129));
+	g_assert(!rtnl_request_add_route(req, "foo", 0));
+	g_assert(!rtnl_request_add_host_route(req, "example.com"));
+
+	/* Nothing to send */
+	g_assert(!rtnl_request_submit(req, test_done, NULL));
+	__ofono_rtnl_cleanup();
+}
+
+static void test_link(void)
+{
+	struct rtnl_request *req = rtnl_request_new(TEST_IFNAME);
+	int error;
+
+	/* Loopback is up already, nothing changes */
+	rtnl_request_set_link_up(req, TRUE);
+	error = test_submit(req);
+	g_assert(!error || error == -EPERM);
+	__ofono_rtnl_cleanup();
+}
+
+static void test_missing_address(void)
+{
+	struct rtnl_request *req = rtnl_request_new(TEST_IFNAME);
+	int error;
+
+	/* Removing what's not there succeeds */
+	g_assert(rtnl_request_del_address(req, TEST_ADDRESS, 32));
+	g_assert(rtnl_request_del_address(req, "2001:db8::1", 64));
+	error = test_submit(req);
+	g_assert(!error || error == -EPERM);
+	__ofono_rtnl_cleanup();
+}
+
+static void test_error(void)
+{
+	struct rtnl_request *req = rtnl_request_new(TEST_IFNAME);
+	int error;
+
+	/* The first error is reported, the rest is still applied */
+	rtnl_request_set_link_up(req, TRUE);
+	rtnl_request_set_mtu(req, 1);
+	rtnl_request_set_link_up(req, TRUE);
+	error = test_submit(req);
+	g_assert(error == -EINVAL || error == -EPERM);
+	__ofono_rtnl_cleanup();
+}
+
+static void test_cancel(void)
+{
+	struct test_result cancelled;
+	struct rtnl_request *req = rtnl_request_new(TEST_IFNAME);
+	guint id;
+
+	memset(&cancelled, 0, sizeof(cancelled));
+	rtnl_request_set_link_up(req, TRUE);
+	id = rtnl_request_submit(req, test_done, &cancelled);
+	g_assert(id);
+	rtnl_cancel(id);
+
+	/* Acks come in order, once this one is done so is the first one */
+	req = rtnl_request_new(TEST_IFNAME);
+	rtnl_request_set_link_up(req, TRUE);
+	test_submit(req);
+	g_assert(!cancelled.done);
+
+	/* Pending requests are dropped without callbacks */
+	req = rtnl_request_new(TEST_IFNAME);
+	rtnl_request_set_link_up(req, TRUE);
+	g_assert(rtnl_request_submit(req, test_done, &cancelled));
+	__ofono_rtnl_cleanup();
+	g_assert(!cancelled.done);
+}
+
+#define TEST_(name) "/rtnl/" name
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	__ofono_log_init("test-rtnl",
+		g_test_verbose() ? "*" : NULL,
+		FALSE, FALSE);
+
+	g_test_add_func(TEST_("no_interface"), test_no_interface);
+	g_test_add_func(TEST_("bad_address"), test_bad_address);
+	g_test_add_func(TEST_("link"), test_link);
+	g_test_add_func(TEST_("missing_address"), test_missing_address);
+	g_test_add_func(TEST_("error"), test_error);
+	g_test_add_func(TEST_("cancel"), test_cancel);
+	return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
@@ -0,0 +1,330 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "storage.h"
+#include "simpack.h"
+
+#define TEST_DIR_FMT "/tmp/test-simpack-%d"
+
+static char *test_dir;
+static char *test_pack;
+
+static int rmdir_r(const char *path)
+{
+	DIR *d = opendir(path);
+
+	if (d) {
+		const struct dirent *p;
+		int r = 0;
+
+		while (!r && (p = readdir(d))) {
+			char *buf;
+			struct stat st;
+
+			if (!strcmp(p->d_name, ".") ||
+						!strcmp(p->d_name, "..")) {
+				continue;
+			}
+
+			buf = g_strdup_printf("%s/%s", path, p->d_name);
+			if (!stat(buf, &st)) {
+				r =  S_ISDIR(st.st_mode) ? rmdir_r(buf) :
+								unlink(buf);
+			}
+			g_free(buf);
+		}
+		closedir(d);
+		return r ? r : rmdir(path);
+	} else {
+		return -1;
+	}
+}
+
+static void test_init(void)
+{
+	test_dir = g_strdup_printf(TEST_DIR_FMT, (int) getpid());
+	test_pack = g_build_filename(test_dir, "simfs.pack", NULL);
+	rmdir_r(test_dir);
+}
+
+static void test_cleanup(void)
+{
+	rmdir_r(test_dir);
+	g_free(test_pack);
+	g_free(test_dir);
+}
+
+static void fill_body(unsigned char *body, unsigned int len, int seed)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+		body[i] = seed + i * 13;
+}
+
+static void check_body(struct sim_pack *pack, int id, unsigned int len,
+				int seed)
+{
+	unsigned char expected[1024];
+	const unsigned char *data;
+	unsigned int data_len = 0;
+
+	g_assert(len <= sizeof(expected));
+	fill_body(expected, len, seed);
+
+	data = sim_pack_lookup(pack, id, &data_len);
+	g_assert(data);
+	g_assert_cmpuint(data_len, == , len);
+	g_assert(memcmp(data, expected, len) == 0);
+}
+
+static void store_body(struct sim_pack *pack, int id, unsigned int len,
+				int seed)
+{
+	unsigned char body[1024];
+
+	g_assert(len <= sizeof(body));
+	fill_body(body, len, seed);
+	g_assert(sim_pack_store(pack, id, body, len));
+}
+
+static void test_basic(void)
+{
+	struct sim_pack *pack;
+	struct sim_pack *other;
+
+	test_init();
+
+	pack = sim_pack_open(test_dir);
+	g_assert(pack);
+	g_assert(!sim_pack_lookup(pack, 0x6f07, NULL));
+	g_assert(!sim_pack_store(pack, 0x6f07, NULL, 0));
+
+	store_body(pack, 0x6f07, 48, 1);
+	store_body(pack, 0x2fe2, 49, 2);
+	check_body(pack, 0x6f07, 48, 1);
+	check_body(pack, 0x2fe2, 49, 2);
+
+	/* The newest record wins */
+	store_body(pack, 0x6f07, 300, 3);
+	check_body(pack, 0x6f07, 300, 3);
+
+	g_assert(sim_pack_remove(pack, 0x2fe2));
+	g_assert(sim_pack_remove(pack, 0x2fe2));
+	g_assert(!sim_pack_lookup(pack, 0x2fe2, NULL));
+
+	/* Users of the same directory share the pack */
+	other = sim_pack_open(test_dir);
+	g_assert(other == pack);
+	sim_pack_unref(other);
+	sim_pack_unref(pack);
+
+	/* Everything survives a reopen */
+	pack = sim_pack_open(test_dir);
+	g_assert(pack);
+	check_body(pack, 0x6f07, 300, 3);
+	g_assert(!sim_pack_lookup(pack, 0x2fe2, NULL));
+
+	g_assert(sim_pack_clear(pack));
+	g_assert(!sim_pack_lookup(pack, 0x6f07, NULL));
+	store_body(pack, 0x6f46, 17, 4);
+	sim_pack_unref(pack);
+
+	pack = sim_pack_open(test_dir);
+	g_assert(!sim_pack_lookup(pack, 0x6f07, NULL));
+	check_body(pack, 0x6f46, 17, 4);
+	sim_pack_unref(pack);
+
+	test_cleanup();
+}
+
+static void test_torn(void)
+{
+	struct sim_pack *pack;
+	struct stat st;
+	int fd;
+
+	test_init();
+
+	pack = sim_pack_open(test_dir);
+	store_body(pack, 0x6f07, 48, 1);
+	store_body(pack, 0x6fad, 100, 2);
+	sim_pack_unref(pack);
+
+	/* Chop the last record in half, as a crash during append would */
+	g_assert(stat(test_pack, &st) == 0);
+	g_assert(truncate(test_pack, st.st_size - 50) == 0);
+
+	pack = sim_pack_open(test_dir);
+	g_assert(pack);
+	check_body(pack, 0x6f07, 48, 1);
+	g_assert(!sim_pack_lookup(pack, 0x6fad, NULL));
+
+	/* Appending after recovery must not resurrect the garbage */
+	store_body(pack, 0x6fad, 20, 3);
+	sim_pack_unref(pack);
+
+	pack = sim_pack_open(test_dir);
+	check_body(pack, 0x6f07, 48, 1);
+	check_body(pack, 0x6fad, 20, 3);
+	sim_pack_unref(pack);
+
+	/* A corrupted body fails the checksum */
+	g_assert(stat(test_pack, &st) == 0);
+	fd = open(test_pack, O_WRONLY);
+	g_assert(fd >= 0);
+	g_assert(pwrite(fd, "x", 1, st.st_size - 1) == 1);
+	close(fd);
+
+	pack = sim_pack_open(test_dir);
+	check_body(pack, 0x6f07, 48, 1);
+	g_assert(!sim_pack_lookup(pack, 0x6fad, NULL));
+	sim_pack_unref(pack);
+
+	/* Garbage in place of the header starts a new pack */
+	g_assert(g_file_set_contents(test_pack, "garbage!garbage!", -1,
+					NULL));
+	pack = sim_pack_open(test_dir);
+	g_assert(pack);
+	g_assert(!sim_pack_lookup(pack, 0x6f07, NULL));
+	store_body(pack, 0x6f07, 48, 5);
+	check_body(pack, 0x6f07, 48, 5);
+	sim_pack_unref(pack);
+
+	test_cleanup();
+}
+
+static void test_compact(void)
+{
+	struct sim_pack *pack;
+	struct stat st;
+	off_t before;
+	int i;
+
+	test_init();
+
+	pack = sim_pack_open(test_dir);
+	store_body(pack, 0x6f05, 30, 1);
+
+	/* Keep rewriting one file, compaction bounds the file size */
+	for (i = 0; i < 200; i++) {
+		store_body(pack, 0x6f38, 1000, i);
+		g_assert(stat(test_pack, &st) == 0);
+		g_assert_cmpint(st.st_size, < , 40 * 1024);
+	}
+
+	check_body(pack, 0x6f05, 30, 1);
+	check_body(pack, 0x6f38, 1000, 199);
+
+	store_body(pack, 0x6f38, 1000, 200);
+	g_assert(stat(test_pack, &st) == 0);
+	before = st.st_size;
+
+	g_assert(sim_pack_compact(pack));
+	g_assert(stat(test_pack, &st) == 0);
+	g_assert_cmpint(st.st_size, < , before);
+	g_assert_cmpint(st.st_size, == , 8 + 8 + 30 + 8 + 1000);
+
+	check_body(pack, 0x6f05, 30, 1);
+	check_body(pack, 0x6f38, 1000, 200);
+	sim_pack_unref(pack);
+
+	pack = sim_pack_open(test_dir);
+	check_body(pack, 0x6f05, 30, 1);
+	check_body(pack, 0x6f38, 1000, 200);
+	sim_pack_unref(pack);
+
+	test_cleanup();
+}
+
+static void write_legacy(const char *name, unsigned int len, int seed)
+{
+	unsigned char body[1024];
+	char *path = g_build_filename(test_dir, name, NULL);
+
+	fill_body(body, len, seed);
+	g_assert(create_dirs(path, 0700) == 0);
+	g_assert(g_file_set_contents(path, (char *) body, len, NULL));
+	g_free(path);
+}
+
+static gboolean legacy_exists(const char *name)
+{
+	char *path = g_build_filename(test_dir, name, NULL);
+	gboolean exists = g_file_test(path, G_FILE_TEST_EXISTS);
+
+	g_free(path);
+	return exists;
+}
+
+static void test_migrate(void)
+{
+	struct sim_pack *pack;
+
+	test_init();
+
+	write_legacy("6f07", 48, 1);
+	write_legacy("2FE2", 49, 2);
+	write_legacy("version", 1, 3);
+	write_legacy("6f4", 5, 4);
+
+	pack = sim_pack_open(test_dir);
+	store_body(pack, 0x2fe2, 60, 5);
+	g_assert_cmpuint(sim_pack_migrate(pack, TRUE), == , 1);
+
+	/* What is already in the pack is newer than the old files */
+	check_body(pack, 0x6f07, 48, 1);
+	check_body(pack, 0x2fe2, 60, 5);
+
+	g_assert(!legacy_exists("6f07"));
+	g_assert(!legacy_exists("2FE2"));
+	g_assert(legacy_exists("version"));
+	g_assert(legacy_exists("6f4"));
+	g_assert_cmpuint(sim_pack_migrate(pack, TRUE), == , 0);
+
+	/* Files of an outdated format are dropped, not imported */
+	write_legacy("6f46", 17, 6);
+	g_assert_cmpuint(sim_pack_migrate(pack, FALSE), == , 0);
+	g_assert(!legacy_exists("6f46"));
+	g_assert(!sim_pack_lookup(pack, 0x6f46, NULL));
+	sim_pack_unref(pack);
+
+	test_cleanup();
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testsimpack/basic", test_basic);
+	g_test_add_func("/testsimpack/torn", test_torn);
+	g_test_add_func("/testsimpack/compact", test_compact);
+	g_test_add_func("/testsimpack/migrate", test_migrate);
+
+	return g_test_run();
+}
@@ -26,6 +26,7 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <glib.h>
 
@@ -415,6 +416,212 @@ static void test_eons(void)
 	sim_eons_free(eons_info);
 }
 
+/* Random OPL tables, checked against a plain scan of the raw records */
+
+#define EONS_TEST_PNN 200
+
+static const guint8 eons_test_plmns[][3] = {
+	{ 0x42, 0xF6, 0x18 },	/* 246 81 */
+	{ 0x42, 0xF6, 0x28 },	/* 246 82 */
+	{ 0x13, 0x00, 0x14 },	/* 310 410 */
+	{ 0x13, 0x20, 0x14 },	/* 310 412 */
+	{ 0x13, 0xF0, 0x14 },	/* 310 41 */
+	{ 0x62, 0xF2, 0x10 },	/* 262 01 */
+	{ 0x42, 0xF6, 0xD8 },	/* 246 8b */
+	{ 0x1D, 0x00, 0x14 },	/* b10 410 */
+	{ 0x13, 0xD0, 0xDD },	/* 310 bbb */
+};
+
+static const char *eons_test_queries[][2] = {
+	{ "246", "81" }, { "246", "82" }, { "246", "83" },
+	{ "310", "410" }, { "310", "412" }, { "310", "41" },
+	{ "210", "410" }, { "262", "01" }, { "262", "02" },
+	{ "999", "99" },
+	{ "246", "8" },		/* not indexed, keep last */
+};
+
+static void eons_test_add_pnn(struct sim_eons *eons, int record)
+{
+	guint8 tlv[6] = { 0x43, 0x04, 0x83 };
+	char name[4];
+	unsigned char *packed;
+	long written;
+
+	snprintf(name, sizeof(name), "%03d", record);
+	packed = pack_7bit((const unsigned char *) name, 3, 0, FALSE,
+				&written, 0);
+	g_assert(written == 3);
+	memcpy(tlv + 3, packed, 3);
+	g_free(packed);
+
+	sim_eons_add_pnn_record(eons, record, tlv, sizeof(tlv));
+}
+
+static void eons_test_random_opl(guint8 *opl, int plmns, int lacs)
+{
+	guint16 low, high;
+
+	memcpy(opl, eons_test_plmns[g_random_int_range(0, plmns)], 3);
+
+	switch (g_random_int_range(0, 8)) {
+	case 0:
+		low = 0;
+		high = 0xfffe;
+		break;
+	case 1:
+		low = g_random_int_range(0, lacs);
+		high = g_random_int_range(0, low + 1);
+		break;
+	case 2:
+		low = 0;
+		high = 0xffff;
+		break;
+	default:
+		low = g_random_int_range(0, lacs);
+		high = MIN(low + g_random_int_range(0, lacs / 4), 0xffff);
+		break;
+	}
+
+	opl[3] = low >> 8;
+	opl[4] = low;
+	opl[5] = high >> 8;
+	opl[6] = high;
+	opl[7] = g_random_int_range(0, EONS_TEST_PNN + 1);
+}
+
+static int eons_test_scan(const guint8 *opls, int n, const char *mcc,
+				const char *mnc, gboolean have_lac, guint16 lac)
+{
+	int i, j;
+
+	for (i = 0; i < n; i++) {
+		const guint8 *opl = opls + i * 8;
+		char opl_mcc[OFONO_MAX_MCC_LENGTH + 1];
+		char opl_mnc[OFONO_MAX_MNC_LENGTH + 1];
+		guint16 low = (opl[3] << 8) | opl[4];
+		guint16 high = (opl[5] << 8) | opl[6];
+
+		sim_parse_mcc_mnc(opl, opl_mcc, opl_mnc);
+
+		for (j = 0; j < OFONO_MAX_MCC_LENGTH; j++)
+			if (mcc[j] != opl_mcc[j] &&
+					!(opl_mcc[j] == 'b' && mcc[j]))
+				break;
+		if (j < OFONO_MAX_MCC_LENGTH)
+			continue;
+
+		for (j = 0; j < OFONO_MAX_MNC_LENGTH; j++)
+			if (mnc[j] != opl_mnc[j] &&
+					!(opl_mnc[j] == 'b' && mnc[j]))
+				break;
+		if (j < OFONO_MAX_MNC_LENGTH)
+			continue;
+
+		if (low == 0 && high == 0xfffe)
+			return opl[7];
+
+		if (have_lac && lac >= low && lac <= high)
+			return opl[7];
+	}
+
+	return 0;
+}
+
+static struct sim_eons *eons_test_new(guint8 *opls, int n, int plmns,
+					int lacs)
+{
+	struct sim_eons *eons = sim_eons_new(EONS_TEST_PNN);
+	int i;
+
+	for (i = 1; i <= EONS_TEST_PNN; i++)
+		eons_test_add_pnn(eons, i);
+
+	for (i = 0; i < n; i++) {
+		eons_test_random_opl(opls + i * 8, plmns, lacs);
+		sim_eons_add_opl_record(eons, opls + i * 8, 8);
+	}
+
+	sim_eons_optimize(eons);
+
+	return eons;
+}
+
+static void test_eons_index(void)
+{
+	static const int sizes[] = { 1, 5, 40, 300, 2000 };
+	unsigned int s;
+	int i;
+
+	for (s = 0; s < G_N_ELEMENTS(sizes); s++) {
+		int n = sizes[s];
+		int lacs = g_random_int_range(4, 400);
+		guint8 *opls = g_new(guint8, n * 8);
+		struct sim_eons *eons;
+
+		eons = eons_test_new(opls, n, G_N_ELEMENTS(eons_test_plmns),
+					lacs);
+
+		for (i = 0; i < 2000; i++) {
+			const char **q = eons_test_queries[g_random_int_range(0,
+					G_N_ELEMENTS(eons_test_queries))];
+			gboolean have_lac = g_random_int_range(0, 4) != 0;
+			guint16 lac = g_random_int_range(0, lacs + 10);
+			const struct sim_eons_operator_info *info;
+			int id = eons_test_scan(opls, n, q[0], q[1],
+						have_lac, lac);
+
+			if (have_lac)
+				info = sim_eons_lookup_with_lac(eons, q[0],
+								q[1], lac);
+			else
+				info = sim_eons_lookup(eons, q[0], q[1]);
+
+			if (id == 0) {
+				g_assert(info == NULL);
+			} else {
+				g_assert(info);
+				g_assert_cmpint(atoi(info->longname), == , id);
+			}
+		}
+
+		sim_eons_free(eons);
+		g_free(opls);
+	}
+}
+
+static void test_eons_perf(void)
+{
+	int rounds = g_test_perf() ? 1000000 : 1000;
+	int n = 2000;
+	guint8 *opls = g_new(guint8, n * 8);
+	struct sim_eons *eons;
+	double elapsed;
+	int found = 0;
+	int i;
+
+	/* Plain PLMNs only, a roaming SIM with many LAC ranges */
+	eons = eons_test_new(opls, n, 6, 0xfff0);
+
+	g_test_timer_start();
+
+	for (i = 0; i < rounds; i++) {
+		const char **q = eons_test_queries[i %
+					(G_N_ELEMENTS(eons_test_queries) - 1)];
+
+		if (sim_eons_lookup_with_lac(eons, q[0], q[1], i & 0xffff))
+			found++;
+	}
+
+	elapsed = g_test_timer_elapsed();
+
+	g_test_minimized_result(elapsed * 1e9 / rounds,
+				"%.1f ns per lookup in %d records (%d found)",
+				elapsed * 1e9 / rounds, n, found);
+
+	sim_eons_free(eons);
+	g_free(opls);
+}
+
 static void test_ef_db(void)
 {
 	struct sim_ef_info *info;
@@ -715,6 +922,8 @@ int main(int argc, char **argv)
 	g_test_add_func("/testsimutil/ber tlv encode 3G Status response",
 			test_ber_tlv_builder_3g_status);
 	g_test_add_func("/testsimutil/EONS Handling", test_eons);
+	g_test_add_func("/testsimutil/EONS index", test_eons_index);
+	g_test_add_func("/testsimutil/EONS lookup perf", test_eons_perf);
 	g_test_add_func("/testsimutil/Elementary File DB", test_ef_db);
 	g_test_add_func("/testsimutil/3G Status response", test_3g_status_data);
 	g_test_add_func("/testsimutil/Application entries decoding",
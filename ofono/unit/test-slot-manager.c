@@ -19,6 +19,7 @@
 
 #include "sim-info.h"
 #include "slot-manager-dbus.h"
+#include "storage.h"
 #include "fake_cell_info.h"
 #include "fake_watch.h"
 
@@ -293,6 +294,7 @@ static void test_quit_loop_when_unblocked(struct slot_manager_dbus *d)
 
 static void test_common_init()
 {
+	storage_flush();
 	rmdir_r(STORAGEDIR);
 	g_assert(!test_loop);
 	g_assert(!test_drivers);
@@ -1698,6 +1700,7 @@ static gboolean test_config_storage_run(gpointer user_data)
 	g_assert(!m->slots[1]->enabled);
 
 	/* Check the config file */
+	storage_flush();
 	g_assert(g_key_file_load_from_file(storage, storage_file, 0, NULL));
 	val = g_key_file_get_string(storage, SM_STORE_GROUP,
 		SM_STORE_ENABLED_SLOTS, NULL);
@@ -1713,6 +1716,7 @@ static gboolean test_config_storage_run(gpointer user_data)
 	g_strfreev(slots);
 
 	/* There's no [EnabledSlots] there because it's the default config */
+	storage_flush();
 	storage = g_key_file_new();
 	g_assert(g_key_file_load_from_file(storage, storage_file, 0, NULL));
 	g_assert(!g_key_file_get_string(storage, SM_STORE_GROUP,
@@ -1100,17 +1100,17 @@ static void test_assembly(void)
 				sms_address_to_string(&sms.deliver.oaddr));
 	}
 
-	g_assert(g_slist_length(assembly->assembly_list) == 1);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
 	g_assert(l == NULL);
 
 	sms_assembly_expire(assembly, time(NULL) + 40);
 
-	g_assert(g_slist_length(assembly->assembly_list) == 0);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 0);
 
 	sms_extract_concatenation(&sms, &ref, &max, &seq);
 	l = sms_assembly_add_fragment(assembly, &sms, time(NULL),
 					&sms.deliver.oaddr, ref, max, seq);
-	g_assert(g_slist_length(assembly->assembly_list) == 1);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
 	g_assert(l == NULL);
 
 	decode_hex_own_buf(assembly_pdu2, -1, &pdu_len, 0, pdu);
@@ -1156,6 +1156,101 @@ static void test_assembly(void)
 	g_free(reencoded);
 }
 
+static void test_assembly_interleaved(void)
+{
+	struct sms_assembly *assembly = sms_assembly_new(NULL);
+	struct sms_address addr;
+	struct sms fragment;
+	time_t now = time(NULL);
+	GSList *l;
+	GSList *i;
+	guint8 expected;
+	int n;
+
+	memset(&fragment, 0, sizeof(fragment));
+	memset(&addr, 0, sizeof(addr));
+	addr.number_type = SMS_NUMBER_TYPE_INTERNATIONAL;
+	addr.numbering_plan = SMS_NUMBERING_PLAN_ISDN;
+
+	/*
+	 * 200 messages of 5 fragments arriving backwards and interleaved,
+	 * one second apart, every message is received a while after the
+	 * previous one.  The first fragment of each is left out for now.
+	 */
+	for (n = 0; n < 1000; n++) {
+		int msg = n % 200;
+		guint8 seq = 5 - n / 200;
+
+		if (seq == 1)
+			continue;
+
+		sprintf(addr.address, "3584%05d", msg % 50);
+		fragment.type = seq;
+		l = sms_assembly_add_fragment(assembly, &fragment,
+						now + msg, &addr, msg, 5, seq);
+		g_assert(l == NULL);
+	}
+
+	g_assert_cmpuint(g_hash_table_size(assembly->assembly_table),
+								== , 200);
+
+	/* Duplicates and mismatching max are ignored */
+	sprintf(addr.address, "3584%05d", 7);
+	g_assert(!sms_assembly_add_fragment(assembly, &fragment, now, &addr,
+						7, 5, 3));
+	g_assert(!sms_assembly_add_fragment(assembly, &fragment, now, &addr,
+						7, 4, 1));
+	g_assert_cmpuint(g_hash_table_size(assembly->assembly_table),
+								== , 200);
+
+	/* The ref tells apart messages from the same address */
+	for (n = 199; n >= 0; n -= 2) {
+		sprintf(addr.address, "3584%05d", n % 50);
+		fragment.type = 1;
+		l = sms_assembly_add_fragment(assembly, &fragment, now + 1000,
+						&addr, n, 5, 1);
+		g_assert(l);
+		g_assert_cmpuint(g_slist_length(l), == , 5);
+
+		for (i = l, expected = 1; i; i = i->next, expected++) {
+			struct sms *s = i->data;
+
+			g_assert_cmpuint(s->type, == , expected);
+		}
+
+		g_slist_free_full(l, g_free);
+	}
+
+	g_assert_cmpuint(g_hash_table_size(assembly->assembly_table),
+								== , 100);
+
+	/* Messages expire oldest first */
+	sms_assembly_expire(assembly, now + 99);
+	g_assert_cmpuint(g_hash_table_size(assembly->assembly_table),
+								== , 50);
+	sms_assembly_expire(assembly, now + 99);
+	g_assert_cmpuint(g_hash_table_size(assembly->assembly_table),
+								== , 50);
+
+	sprintf(addr.address, "3584%05d", 150 % 50);
+	l = sms_assembly_add_fragment(assembly, &fragment, now, &addr,
+						150, 5, 1);
+	g_assert(l);
+	g_slist_free_full(l, g_free);
+
+	sprintf(addr.address, "3584%05d", 20 % 50);
+	g_assert(!sms_assembly_add_fragment(assembly, &fragment, now, &addr,
+						20, 5, 1));
+	g_assert_cmpuint(g_hash_table_size(assembly->assembly_table),
+								== , 50);
+
+	sms_assembly_expire(assembly, now + 150);
+	g_assert_cmpuint(g_hash_table_size(assembly->assembly_table),
+								== , 24);
+
+	sms_assembly_free(assembly);
+}
+
 static const char *test_no_fragmentation_7bit = "This is testing !";
 static const char *expected_no_fragmentation_7bit = "079153485002020911000C915"
 			"348870420140000A71154747A0E4ACF41F4F29C9E769F4121";
@@ -1914,6 +2009,8 @@ int main(int argc, char **argv)
 			&ems_udh_test_2, test_ems_udh);
 
 	g_test_add_func("/testsms/Test Assembly", test_assembly);
+	g_test_add_func("/testsms/Test Assembly Interleaved",
+					test_assembly_interleaved);
 	g_test_add_func("/testsms/Test Prepare 7Bit", test_prepare_7bit);
 
 	g_test_add_data_func("/testsms/Test Prepare Concat",
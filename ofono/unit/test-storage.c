@@ -0,0 +1,216 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2026 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "ofono.h"
+#include "storage.h"
+
+#define TEST_IMSI "244120000000000"
+#define TEST_STORE "settings"
+#define TEST_GROUP "Settings"
+#define TEST_KEY "Value"
+#define TEST_FILE STORAGEDIR "/" TEST_IMSI "/" TEST_STORE
+#define TEST_TIMEOUT_SEC 10
+
+static int rmdir_r(const char *path)
+{
+	DIR *d = opendir(path);
+
+	if (d) {
+		const struct dirent *p;
+		int r = 0;
+
+		while (!r && (p = readdir(d))) {
+			char *buf;
+			struct stat st;
+
+			if (!strcmp(p->d_name, ".") ||
+						!strcmp(p->d_name, "..")) {
+				continue;
+			}
+
+			buf = g_strdup_printf("%s/%s", path, p->d_name);
+			if (!stat(buf, &st)) {
+				r =  S_ISDIR(st.st_mode) ? rmdir_r(buf) :
+								unlink(buf);
+			}
+			g_free(buf);
+		}
+		closedir(d);
+		return r ? r : rmdir(path);
+	} else {
+		return -1;
+	}
+}
+
+static void test_init(void)
+{
+	storage_flush();
+	rmdir_r(STORAGEDIR);
+}
+
+static void test_sync_value(GKeyFile *keyfile, const char *value)
+{
+	g_key_file_set_string(keyfile, TEST_GROUP, TEST_KEY, value);
+	storage_sync(TEST_IMSI, TEST_STORE, keyfile);
+}
+
+static void test_check_open(const char *value)
+{
+	GKeyFile *keyfile = storage_open(TEST_IMSI, TEST_STORE);
+	char *str = g_key_file_get_string(keyfile, TEST_GROUP, TEST_KEY, NULL);
+
+	g_assert_cmpstr(str, == ,value);
+	g_free(str);
+	storage_close(TEST_IMSI, TEST_STORE, keyfile, FALSE);
+}
+
+static void test_check_file(const char *value)
+{
+	GKeyFile *keyfile = g_key_file_new();
+	char *str = NULL;
+
+	if (g_key_file_load_from_file(keyfile, TEST_FILE, 0, NULL))
+		str = g_key_file_get_string(keyfile, TEST_GROUP, TEST_KEY,
+									NULL);
+
+	g_assert_cmpstr(str, == ,value);
+	g_free(str);
+	g_key_file_free(keyfile);
+}
+
+static void test_sync(void)
+{
+	GKeyFile *keyfile;
+
+	test_init();
+
+	keyfile = storage_open(TEST_IMSI, TEST_STORE);
+	test_sync_value(keyfile, "1");
+	test_sync_value(keyfile, "2");
+	test_sync_value(keyfile, "3");
+
+	/* Unwritten changes are visible to storage_open() */
+	test_check_open("3");
+	storage_close(TEST_IMSI, TEST_STORE, keyfile, FALSE);
+
+	storage_flush();
+	test_check_file("3");
+	test_check_open("3");
+
+	test_init();
+}
+
+static void test_timer(void)
+{
+	GKeyFile *keyfile;
+	gint64 deadline;
+
+	test_init();
+
+	keyfile = storage_open(TEST_IMSI, TEST_STORE);
+	test_sync_value(keyfile, "1");
+	storage_close(TEST_IMSI, TEST_STORE, keyfile, FALSE);
+
+	/* The file gets written without anyone asking */
+	deadline = g_get_monotonic_time() + TEST_TIMEOUT_SEC * G_USEC_PER_SEC;
+	while (!g_file_test(TEST_FILE, G_FILE_TEST_EXISTS)) {
+		g_assert_cmpint(g_get_monotonic_time(), < ,deadline);
+		if (!g_main_context_iteration(NULL, FALSE))
+			g_usleep(10000);
+	}
+
+	storage_flush();
+	test_check_file("1");
+
+	test_init();
+}
+
+static void test_close(void)
+{
+	GKeyFile *keyfile;
+
+	test_init();
+
+	/* Saving on close is synchronous */
+	keyfile = storage_open(TEST_IMSI, TEST_STORE);
+	g_key_file_set_string(keyfile, TEST_GROUP, TEST_KEY, "1");
+	storage_close(TEST_IMSI, TEST_STORE, keyfile, TRUE);
+	test_check_file("1");
+
+	/* And supersedes the unwritten changes */
+	keyfile = storage_open(TEST_IMSI, TEST_STORE);
+	test_sync_value(keyfile, "2");
+	g_key_file_set_string(keyfile, TEST_GROUP, TEST_KEY, "3");
+	storage_close(TEST_IMSI, TEST_STORE, keyfile, TRUE);
+	test_check_file("3");
+
+	storage_flush();
+	test_check_file("3");
+	test_check_open("3");
+
+	test_init();
+}
+
+static void test_cleanup(void)
+{
+	GKeyFile *keyfile;
+
+	test_init();
+
+	keyfile = storage_open(TEST_IMSI, TEST_STORE);
+	test_sync_value(keyfile, "1");
+	storage_close(TEST_IMSI, TEST_STORE, keyfile, FALSE);
+	test_check_file(NULL);
+
+	/* Nothing gets lost on exit */
+	__ofono_storage_cleanup();
+	test_check_file("1");
+	test_check_open("1");
+
+	test_init();
+}
+
+#define TEST_(name) "/storage/" name
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+	g_test_add_func(TEST_("sync"), test_sync);
+	g_test_add_func(TEST_("timer"), test_timer);
+	g_test_add_func(TEST_("close"), test_close);
+	g_test_add_func(TEST_("cleanup"), test_cleanup);
+	return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
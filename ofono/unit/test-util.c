@@ -25,6 +25,7 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <ctype.h>
 #include <assert.h>
 #include <glib.h>
 
@@ -1012,6 +1013,563 @@ static void test_unicode_to_gsm(void)
 	}
 }
 
+
+static void test_dialect_round_trip(void)
+{
+	unsigned char buf[2];
+	enum gsm_dialect locking;
+	enum gsm_dialect single;
+	long nwritten;
+	long nread;
+	int c;
+
+	/*
+	 * Every code of every table pair decodes to a character which
+	 * encodes back to a code that decodes to the same character.
+	 */
+	for (locking = GSM_DIALECT_DEFAULT; locking <= GSM_DIALECT_URDU;
+								locking++) {
+		for (single = GSM_DIALECT_DEFAULT; single <= GSM_DIALECT_URDU;
+								single++) {
+			for (c = 0; c < 0x100; c++) {
+				char *utf8;
+				char *again;
+				unsigned char *back;
+
+				buf[0] = 0x1b;
+				buf[1] = c;
+
+				utf8 = convert_gsm_to_utf8_with_lang(buf, 2,
+							&nread, &nwritten, 0,
+							locking, single);
+
+				/* Not GSM, even after an escape */
+				if (c > 0x7f) {
+					g_assert(!utf8);
+					continue;
+				}
+
+				g_assert(utf8);
+
+				back = convert_utf8_to_gsm_with_lang(utf8, -1,
+							&nread, &nwritten, 0,
+							locking, single);
+				g_assert(back);
+
+				again = convert_gsm_to_utf8_with_lang(back,
+							nwritten, NULL, NULL,
+							0, locking, single);
+				g_assert_cmpstr(utf8, == , again);
+
+				g_free(again);
+				g_free(back);
+				g_free(utf8);
+			}
+		}
+	}
+}
+
+static void test_best_lang(void)
+{
+	/* Needs the Turkish single shift table */
+	static const char *single_only = "Price 5\xe2\x82\xac \xc4\x9e";
+	/* Needs the Hindi locking shift table */
+	static const char *locking_too = "\xe0\xa4\xa8\xe0\xa4\xae\xe0\xa4\xb8"
+					"\xe0\xa5\x8d\xe0\xa4\xa4\xe0\xa5\x87";
+	enum gsm_dialect locking;
+	enum gsm_dialect single;
+	unsigned char *res;
+	long nread;
+	long nwritten;
+
+	res = convert_utf8_to_gsm_best_lang("Hello", -1, &nread, &nwritten,
+						0, GSM_DIALECT_TURKISH,
+						&locking, &single);
+	g_assert(res);
+	g_assert_cmpint(nread, == , 5);
+	g_assert_cmpint(nwritten, == , 5);
+	g_assert_cmpint(locking, == , GSM_DIALECT_DEFAULT);
+	g_assert_cmpint(single, == , GSM_DIALECT_DEFAULT);
+	g_free(res);
+
+	res = convert_utf8_to_gsm_best_lang(single_only, -1, &nread,
+						&nwritten, 0,
+						GSM_DIALECT_TURKISH,
+						&locking, &single);
+	g_assert(res);
+	g_assert_cmpint(nread, == , strlen(single_only));
+	g_assert_cmpint(locking, == , GSM_DIALECT_DEFAULT);
+	g_assert_cmpint(single, == , GSM_DIALECT_TURKISH);
+	g_free(res);
+
+	res = convert_utf8_to_gsm_best_lang(locking_too, -1, &nread,
+						&nwritten, 0,
+						GSM_DIALECT_HINDI,
+						&locking, &single);
+	g_assert(res);
+	g_assert_cmpint(nwritten, == , 6);
+	g_assert_cmpint(locking, == , GSM_DIALECT_HINDI);
+	g_assert_cmpint(single, == , GSM_DIALECT_HINDI);
+	g_free(res);
+
+	/* Spanish has no locking shift table of its own */
+	g_assert(!convert_utf8_to_gsm_best_lang(locking_too, -1, &nread,
+						NULL, 0, GSM_DIALECT_SPANISH,
+						NULL, NULL));
+	g_assert_cmpint(nread, == , 0);
+
+	/* Where the last combination tried gave up */
+	g_assert(!convert_utf8_to_gsm_best_lang("ab\xe4\xb8\xad", -1, &nread,
+						NULL, 0, GSM_DIALECT_TURKISH,
+						NULL, NULL));
+	g_assert_cmpint(nread, == , 2);
+}
+
+static void test_conversion_perf(void)
+{
+	int rounds = g_test_perf() ? 20000 : 10;
+	GString *text = g_string_new(NULL);
+	double elapsed;
+	unsigned char *gsm;
+	long nwritten;
+	char *utf8;
+	int i;
+
+	/* A long Hindi message, found by the last combination tried */
+	for (i = 0; i < 40; i++)
+		g_string_append(text, "\xe0\xa4\xa8\xe0\xa4\xae"
+					"\xe0\xa4\xb8\xe0\xa5\x8d"
+					"\xe0\xa4\xa4\xe0\xa5\x87 ");
+
+	g_test_timer_start();
+
+	for (i = 0; i < rounds; i++) {
+		gsm = convert_utf8_to_gsm_best_lang(text->str, -1, NULL,
+							&nwritten, 0,
+							GSM_DIALECT_HINDI,
+							NULL, NULL);
+		g_assert(gsm);
+		g_free(gsm);
+	}
+
+	elapsed = g_test_timer_elapsed();
+	g_test_minimized_result(elapsed * 1e6 / rounds,
+				"best language encoding: %.1f us per %ld chars",
+				elapsed * 1e6 / rounds,
+				g_utf8_strlen(text->str, -1));
+
+	gsm = convert_utf8_to_gsm_best_lang(text->str, -1, NULL, &nwritten,
+						0, GSM_DIALECT_HINDI,
+						NULL, NULL);
+
+	g_test_timer_start();
+
+	for (i = 0; i < rounds; i++) {
+		utf8 = convert_gsm_to_utf8_with_lang(gsm, nwritten, NULL,
+							NULL, 0,
+							GSM_DIALECT_HINDI,
+							GSM_DIALECT_HINDI);
+		g_assert(utf8);
+		g_free(utf8);
+	}
+
+	elapsed = g_test_timer_elapsed();
+	g_test_minimized_result(elapsed * 1e6 / rounds,
+				"decoding: %.1f us per %ld octets",
+				elapsed * 1e6 / rounds, nwritten);
+
+	g_free(gsm);
+	g_string_free(text, TRUE);
+}
+
+/*
+ * The bit by bit codecs the word at a time ones in util.c replaced,
+ * their output must match byte for byte.
+ */
+static unsigned char *ref_decode_hex(const char *in, long len,
+					long *items_written,
+					unsigned char terminator,
+					unsigned char *buf)
+{
+	long i, j;
+	char c;
+	unsigned char b;
+
+	if (len < 0)
+		len = strlen(in);
+
+	len &= ~0x1;
+
+	for (i = 0, j = 0; i < len; i++, j++) {
+		c = toupper(in[i]);
+
+		if (c >= '0' && c <= '9')
+			b = c - '0';
+		else if (c >= 'A' && c <= 'F')
+			b = 10 + c - 'A';
+		else
+			return NULL;
+
+		i += 1;
+
+		c = toupper(in[i]);
+
+		if (c >= '0' && c <= '9')
+			b = b * 16 + c - '0';
+		else if (c >= 'A' && c <= 'F')
+			b = b * 16 + 10 + c - 'A';
+		else
+			return NULL;
+
+		buf[j] = b;
+	}
+
+	if (terminator)
+		buf[j] = terminator;
+
+	if (items_written)
+		*items_written = j;
+
+	return buf;
+}
+
+static char *ref_encode_hex(const unsigned char *in, long len,
+				unsigned char terminator, char *buf)
+{
+	long i, j;
+	char c;
+
+	if (len < 0) {
+		i = 0;
+
+		while (in[i] != terminator)
+			i++;
+
+		len = i;
+	}
+
+	for (i = 0, j = 0; i < len; i++, j++) {
+		c = (in[i] >> 4) & 0xf;
+
+		if (c <= 9)
+			buf[j] = '0' + c;
+		else
+			buf[j] = 'A' + c - 10;
+
+		j += 1;
+
+		c = (in[i]) & 0xf;
+
+		if (c <= 9)
+			buf[j] = '0' + c;
+		else
+			buf[j] = 'A' + c - 10;
+	}
+
+	buf[j] = '\0';
+
+	return buf;
+}
+
+static unsigned char *ref_unpack_7bit(const unsigned char *in, long len,
+					int byte_offset, bool ussd,
+					long max_to_unpack, long *items_written,
+					unsigned char terminator,
+					unsigned char *buf)
+{
+	unsigned char rest = 0;
+	unsigned char *out = buf;
+	int bits = 7 - (byte_offset % 7);
+	long i;
+
+	if (len <= 0)
+		return NULL;
+
+	/* In the case of CB, unpack as much as possible */
+	if (ussd == true)
+		max_to_unpack = len * 8 / 7;
+
+	for (i = 0; (i < len) && ((out-buf) < max_to_unpack); i++) {
+		/* Grab what we have in the current octet */
+		*out = (in[i] & ((1 << bits) - 1)) << (7 - bits);
+
+		/* Append what we have from the previous octet, if any */
+		*out |= rest;
+
+		/* Figure out the remainder */
+		rest = (in[i] >> bits) & ((1 << (8-bits)) - 1);
+
+		/*
+		 * We have the entire character, here we don't increate
+		 * out if this is we started at an offset.  Instead
+		 * we effectively populate variable rest
+		 */
+		if (i != 0 || bits == 7)
+			out++;
+
+		if ((out-buf) == max_to_unpack)
+			break;
+
+		/*
+		 * We expected only 1 bit from this octet, means there's 7
+		 * left, take care of them here
+		 */
+		if (bits == 1) {
+			*out = rest;
+			out++;
+			bits = 7;
+			rest = 0;
+		} else {
+			bits = bits - 1;
+		}
+	}
+
+	/*
+	 * According to 23.038 6.1.2.3.1, last paragraph:
+	 * "If the total number of characters to be sent equals (8n-1)
+	 * where n=1,2,3 etc. then there are 7 spare bits at the end
+	 * of the message. To avoid the situation where the receiving
+	 * entity confuses 7 binary zero pad bits as the @ character,
+	 * the carriage return or <CR> character shall be used for
+	 * padding in this situation, just as for Cell Broadcast."
+	 *
+	 * "The receiving entity shall remove the final <CR> character where
+	 * the message ends on an octet boundary with <CR> as the last
+	 * character.
+	 */
+	if (ussd && out > buf && (((out - buf) % 8) == 0) &&
+			(*(out - 1) == '\r'))
+		out = out - 1;
+
+	if (terminator)
+		*out = terminator;
+
+	if (items_written)
+		*items_written = out - buf;
+
+	return buf;
+}
+
+static unsigned char *ref_pack_7bit(const unsigned char *in, long len,
+					int byte_offset, bool ussd,
+					long *items_written,
+					unsigned char terminator,
+					unsigned char *buf)
+{
+	int bits = 7 - (byte_offset % 7);
+	unsigned char *out = buf;
+	long i;
+	long total_bits;
+
+	if (len == 0)
+		return NULL;
+
+	if (len < 0) {
+		i = 0;
+
+		while (in[i] != terminator)
+			i++;
+
+		len = i;
+	}
+
+	total_bits = len * 7;
+
+	if (bits != 7) {
+		total_bits += bits;
+		bits = bits - 1;
+		*out = 0;
+	}
+
+	for (i = 0; i < len; i++) {
+		if (bits != 7) {
+			*out |= (in[i] & ((1 << (7 - bits)) - 1)) <<
+					(bits + 1);
+			out++;
+		}
+
+		/* This is a no op when bits == 0, lets keep valgrind happy */
+		if (bits != 0)
+			*out = in[i] >> (7 - bits);
+
+		if (bits == 0)
+			bits = 7;
+		else
+			bits = bits - 1;
+	}
+
+	/*
+	 * If <CR> is intended to be the last character and the message
+	 * (including the wanted <CR>) ends on an octet boundary, then
+	 * another <CR> must be added together with a padding bit 0. The
+	 * receiving entity will perform the carriage return function twice,
+	 * but this will not result in misoperation as the definition of
+	 * <CR> in clause 6.1.1 is identical to the definition of <CR><CR>.
+	 */
+	if (ussd && ((total_bits % 8) == 1))
+		*out |= '\r' << 1;
+
+	if (bits != 7)
+		out++;
+
+	if (ussd && ((total_bits % 8) == 0) && (in[len - 1] == '\r')) {
+		*out = '\r';
+		out++;
+	}
+
+	if (items_written)
+		*items_written = out - buf;
+
+	return buf;
+}
+
+static void random_septets(unsigned char *buf, long len)
+{
+	long i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = g_test_rand_int_range(0, 0x80);
+
+	/* Exercise the <CR> padding rules */
+	if (g_test_rand_bit())
+		buf[len - 1] = '\r';
+}
+
+static void test_hex_equivalence(void)
+{
+	unsigned char in[300];
+	char hex[sizeof(in) * 2 + 1];
+	char ref_hex[sizeof(in) * 2 + 1];
+	unsigned char out[sizeof(in) + 1];
+	unsigned char ref_out[sizeof(in) + 1];
+	long written;
+	long ref_written;
+	long len;
+	long i;
+	int round;
+
+	for (round = 0; round < 2000; round++) {
+		len = g_test_rand_int_range(0, sizeof(in));
+
+		for (i = 0; i < len; i++)
+			in[i] = g_test_rand_int_range(0, 256);
+
+		g_assert(encode_hex_own_buf(in, len, 0, hex) == hex);
+		ref_encode_hex(in, len, 0, ref_hex);
+		g_assert_cmpstr(hex, == , ref_hex);
+
+		/* Mixed case, odd lengths and the length taken from the NUL */
+		for (i = 0; i < len * 2; i++)
+			if (g_test_rand_bit())
+				hex[i] = g_ascii_tolower(hex[i]);
+
+		i = g_test_rand_bit() ? -1 : len * 2 - g_test_rand_bit();
+		g_assert(decode_hex_own_buf(hex, i, &written, 'X', out));
+		g_assert(ref_decode_hex(hex, i, &ref_written, 'X', ref_out));
+		g_assert_cmpint(written, == , ref_written);
+		g_assert(!memcmp(out, ref_out, written + 1));
+
+		if (len == 0)
+			continue;
+
+		/* A single bad digit anywhere fails the whole string */
+		i = g_test_rand_int_range(0, len * 2);
+		hex[i] = "g:/@G`\x80 "[g_test_rand_int_range(0, 8)];
+		g_assert(!decode_hex_own_buf(hex, -1, NULL, 0, out));
+		g_assert(!ref_decode_hex(hex, -1, NULL, 0, ref_out));
+	}
+}
+
+static void test_7bit_equivalence(void)
+{
+	unsigned char in[200];
+	unsigned char out[sizeof(in) * 8 / 7 + 2];
+	unsigned char ref_out[sizeof(in) * 8 / 7 + 2];
+	long written;
+	long ref_written;
+	long len;
+	long max;
+	long i;
+	int offset;
+	int ussd;
+
+	for (offset = 0; offset < 14; offset++) {
+		for (len = 1; len < (long) sizeof(in); len++) {
+			ussd = g_test_rand_bit();
+
+			random_septets(in, len);
+			g_assert(pack_7bit_own_buf(in, len, offset, ussd,
+							&written, 0, out));
+			ref_pack_7bit(in, len, offset, ussd, &ref_written, 0,
+					ref_out);
+			g_assert_cmpint(written, == , ref_written);
+			g_assert(!memcmp(out, ref_out, written));
+
+			/* And back, from arbitrary octets */
+			for (i = 0; i < len; i++)
+				in[i] = g_test_rand_int_range(0, 256);
+
+			if (g_test_rand_bit())
+				max = len * 8 / 7;
+			else
+				max = g_test_rand_int_range(0, len * 8 / 7 + 1);
+
+			g_assert(unpack_7bit_own_buf(in, len, offset, ussd, max,
+							&written, 0xff, out));
+			ref_unpack_7bit(in, len, offset, ussd, max,
+					&ref_written, 0xff, ref_out);
+			g_assert_cmpint(written, == , ref_written);
+			g_assert(!memcmp(out, ref_out, written + 1));
+		}
+	}
+}
+
+static void test_codec_perf(void)
+{
+	int rounds = g_test_perf() ? 200000 : 100;
+	unsigned char pdu[176];
+	char hex[sizeof(pdu) * 2 + 1];
+	unsigned char septets[160];
+	unsigned char packed[140];
+	unsigned char unpacked[160];
+	double elapsed;
+	long written;
+	int i;
+
+	for (i = 0; i < (int) sizeof(pdu); i++)
+		pdu[i] = g_test_rand_int_range(0, 256);
+
+	random_septets(septets, sizeof(septets));
+
+	g_test_timer_start();
+
+	for (i = 0; i < rounds; i++) {
+		encode_hex_own_buf(pdu, sizeof(pdu), 0, hex);
+		decode_hex_own_buf(hex, -1, &written, 0, pdu);
+	}
+
+	elapsed = g_test_timer_elapsed();
+	g_test_maximized_result(rounds * sizeof(pdu) / elapsed / 1e6,
+				"hex encode + decode: %.1f MB/s",
+				rounds * sizeof(pdu) / elapsed / 1e6);
+
+	g_test_timer_start();
+
+	for (i = 0; i < rounds; i++) {
+		pack_7bit_own_buf(septets, sizeof(septets), 0, false,
+					&written, 0, packed);
+		unpack_7bit_own_buf(packed, written, 0, false,
+					sizeof(unpacked), &written, 0,
+					unpacked);
+	}
+
+	elapsed = g_test_timer_elapsed();
+	g_assert(!memcmp(septets, unpacked, sizeof(septets)));
+	g_test_maximized_result(rounds * sizeof(septets) / elapsed / 1e6,
+				"7-bit pack + unpack: %.1f M septets/s",
+				rounds * sizeof(septets) / elapsed / 1e6);
+}
+
 int main(int argc, char **argv)
 {
 	g_test_init(&argc, &argv, NULL);
@@ -1028,6 +1586,14 @@ int main(int argc, char **argv)
 	g_test_add_func("/testutil/SIM conversions", test_sim);
 	g_test_add_func("/testutil/Valid Unicode to GSM Conversion",
 			test_unicode_to_gsm);
+	g_test_add_func("/testutil/Dialect Round Trip",
+			test_dialect_round_trip);
+	g_test_add_func("/testutil/Best Language", test_best_lang);
+	g_test_add_func("/testutil/Conversion Performance",
+			test_conversion_perf);
+	g_test_add_func("/testutil/Hex Equivalence", test_hex_equivalence);
+	g_test_add_func("/testutil/7Bit Equivalence", test_7bit_equivalence);
+	g_test_add_func("/testutil/Codec Performance", test_codec_perf);
 
 	return g_test_run();
 }